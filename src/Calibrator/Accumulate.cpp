@@ -5,53 +5,58 @@ CalibratorAccumulate::CalibratorAccumulate(Variable::Type iVariable) :
       Calibrator(),
       mVariable(iVariable) {
 }
-bool CalibratorAccumulate::calibrateCore(File& iFile) const {
+bool CalibratorAccumulate::calibrateCore(File& iFile, int iTime) const {
    int nLat = iFile.getNumLat();
    int nLon = iFile.getNumLon();
    int nEns = iFile.getNumEns();
-   int nTime = iFile.getNumTime();
 
-   // Get all fields
-   std::vector<FieldPtr> fields(nTime);
-   std::vector<FieldPtr> fieldsAcc(nTime);
-   for(int t = 0; t < nTime; t++) {
-      fields[t]    = iFile.getField(mVariable, t);
-      fieldsAcc[t] = iFile.getEmptyField();
+   Variable::Type variableAcc;
+   if(mVariable == Variable::Precip) {
+      variableAcc = Variable::PrecipAcc;
+   }
+   else {
+      Util::error("Cannot accumulate " + Variable::getTypeName(mVariable));
+   }
+
+   if(iTime == 0) {
+      iFile.addField(iFile.getEmptyField(0), variableAcc, iTime);
+      return true;
    }
 
-   for(int t = 0; t < nTime; t++) {
-      #pragma omp parallel for
-      for(int i = 0; i < nLat; i++) {
-         for(int j = 0; j < nLon; j++) {
-            for(int e = 0; e < nEns; e++) {
-               if(t == 0) {
-                  (*fieldsAcc[t])(i,j,e) = 0;
-               }
-               else {
-                  float previous = (*fieldsAcc[t-1])(i,j,e);
-                  float current  = (*fields[t])(i,j,e);
-                  if(Util::isValid(current) && Util::isValid(previous)) {
-                     (*fieldsAcc[t])(i,j,e) = current + previous;
-                  }
-                  else {
-                     (*fieldsAcc[t])(i,j,e) = Util::MV;
-                  }
-               }
+   // Add the current value to the accumulation up to the previous time
+   const FieldPtr previousAcc = iFile.getField(variableAcc, iTime-1);
+   const FieldPtr field = iFile.getField(mVariable, iTime);
+   FieldPtr fieldAcc = iFile.getEmptyField();
+   #pragma omp parallel for
+   for(int i = 0; i < nLat; i++) {
+      for(int j = 0; j < nLon; j++) {
+         for(int e = 0; e < nEns; e++) {
+            float previous = (*previousAcc)(i,j,e);
+            float current  = (*field)(i,j,e);
+            if(Util::isValid(current) && Util::isValid(previous)) {
+               (*fieldAcc)(i,j,e) = current + previous;
+            }
+            else {
+               (*fieldAcc)(i,j,e) = Util::MV;
             }
          }
       }
-
-      Variable::Type variableAcc;
-      if(mVariable == Variable::Precip) {
-         variableAcc = Variable::PrecipAcc;
-      }
-      else {
-         Util::error("Cannot accumulate " + Variable::getTypeName(mVariable));
-      }
-      iFile.addField(fieldsAcc[t], variableAcc, t);
    }
+   iFile.addField(fieldAcc, variableAcc, iTime);
+   return true;
+}
+bool CalibratorAccumulate::dependsOnPreviousTime() const {
    return true;
 }
+std::vector<Variable::Type> CalibratorAccumulate::getInputVariables() const {
+   std::vector<Variable::Type> variables;
+   variables.push_back(mVariable);
+   variables.push_back(Variable::PrecipAcc);
+   return variables;
+}
+std::vector<Variable::Type> CalibratorAccumulate::getOutputVariables() const {
+   return std::vector<Variable::Type>(1, Variable::PrecipAcc);
+}
 std::string CalibratorAccumulate::description() {
    std::stringstream ss;
    ss << Util::formatDescription("-c accumulate","") << std::endl;
@@ -9,8 +9,11 @@ class CalibratorAccumulate : public Calibrator {
       CalibratorAccumulate(Variable::Type iVariable);
       static std::string description();
       std::string name() const {return "accumulate";};
+      bool dependsOnPreviousTime() const;
+      std::vector<Variable::Type> getInputVariables() const;
+      std::vector<Variable::Type> getOutputVariables() const;
    private:
-      bool calibrateCore(File& iFile) const;
+      bool calibrateCore(File& iFile, int iTime) const;
       Variable::Type mVariable;
 };
 #endif
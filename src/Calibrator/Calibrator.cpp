@@ -1,10 +1,56 @@
 #include "Calibrator.h"
 #include <algorithm>
+#include <functional>
+#include <set>
 #include <math.h>
 #include <boost/math/distributions/gamma.hpp>
 #include "../Util.h"
 #include "../Options.h"
 #include "../ParameterFile.h"
+#include "../File/File.h"
+
+namespace {
+   //! Ensembles up to this size are sorted with a sorting network instead of std::sort
+   const int maxNetworkSize = 16;
+
+   //! \brief Comparators (pairs of indices) of Batcher's odd-even merge sort for each ensemble size
+   //! up to maxNetworkSize. Sizes that are not a power of two use the network for the next power of
+   //! two, without the comparators involving the extra values (which can be thought of as infinite).
+   std::vector<std::vector<std::pair<int,int> > > getNetworks() {
+      std::vector<std::vector<std::pair<int,int> > > networks(maxNetworkSize + 1);
+      for(int n = 2; n <= maxNetworkSize; n++) {
+         int N = 1;
+         while(N < n)
+            N *= 2;
+         for(int p = 1; p < N; p *= 2) {
+            for(int k = p; k >= 1; k /= 2) {
+               for(int j = k % p; j + k < N; j += 2*k) {
+                  for(int i = 0; i < k && i + j + k < N; i++) {
+                     int a = i + j;
+                     int b = i + j + k;
+                     if(b < n && a / (2*p) == b / (2*p))
+                        networks[n].push_back(std::pair<int,int>(a, b));
+                  }
+               }
+            }
+         }
+      }
+      return networks;
+   }
+   const std::vector<std::vector<std::pair<int,int> > > networks = getNetworks();
+
+   //! \brief Sort iN <= maxNetworkSize values with a sorting network. Like std::sort, this is not
+   //! stable, so tied values can end up in any order.
+   template<class T, class Compare> void networkSort(T* iValues, int iN, Compare iCompare) {
+      const std::vector<std::pair<int,int> >& network = networks[iN];
+      for(int c = 0; c < network.size(); c++) {
+         T& first = iValues[network[c].first];
+         T& second = iValues[network[c].second];
+         if(iCompare(second, first))
+            std::swap(first, second);
+      }
+   }
+}
 
 Calibrator::Calibrator() {
 
@@ -29,6 +75,10 @@ Calibrator* Calibrator::getScheme(std::string iName, const Options& iOptions) {
       if(iOptions.getValue("fracThreshold", fracThreshold)) {
          c->setFracThreshold(fracThreshold);
       }
+      float accuracy;
+      if(iOptions.getValue("accuracy", accuracy)) {
+         c->setAccuracy(accuracy);
+      }
       return c;
    }
    else if(iName == "cloud") {
@@ -123,7 +173,135 @@ Calibrator* Calibrator::getScheme(std::string iName, const Options& iOptions) {
    }
 }
 bool Calibrator::calibrate(File& iFile) const {
-   return calibrateCore(iFile);
+   // For files with few latitudes, parallelize over time instead. Timesteps that depend on the
+   // previous timestep must be calibrated in order.
+   if(!dependsOnPreviousTime() && Util::parallelizeOverTime(iFile.getNumTime(), iFile.getNumLat())) {
+      int numFailed = 0;
+      #pragma omp parallel for schedule(dynamic) reduction(+:numFailed)
+      for(int t = 0; t < iFile.getNumTime(); t++) {
+         if(!calibrateCore(iFile, t))
+            numFailed++;
+      }
+      return numFailed == 0;
+   }
+   for(int t = 0; t < iFile.getNumTime(); t++) {
+      if(!calibrateCore(iFile, t))
+         return false;
+   }
+   return true;
+}
+bool Calibrator::calibrate(File& iFile, int iTime) const {
+   return calibrateCore(iFile, iTime);
+}
+bool Calibrator::dependsOnPreviousTime() const {
+   return false;
+}
+std::vector<Variable::Type> Calibrator::getInputVariables() const {
+   return Variable::getAllVariables();
+}
+std::vector<Variable::Type> Calibrator::getOutputVariables() const {
+   return Variable::getAllVariables();
+}
+bool Calibrator::isPointwise() const {
+   return false;
+}
+CalibratorKernelPtr Calibrator::getKernel(File& iFile, int iTime) const {
+   return CalibratorKernelPtr();
+}
+bool Calibrator::calibrateCore(File& iFile, int iTime) const {
+   CalibratorKernelPtr kernel = getKernel(iFile, iTime);
+   if(!kernel) {
+      Util::error("Calibrator '" + name() + "' does not implement calibrateCore");
+   }
+   applyKernels(std::vector<CalibratorKernelPtr>(1, kernel), iFile.getNumLat());
+   return true;
+}
+
+std::vector<std::vector<Calibrator*> > Calibrator::getGroups(const std::vector<Calibrator*>& iCalibrators, const File& iFile) {
+   std::vector<std::vector<Calibrator*> > groups;
+   for(int c = 0; c < iCalibrators.size(); c++) {
+      // Add to the previous group if both it and this calibrator are pointwise
+      bool fuse = iCalibrators[c]->isPointwise() && groups.size() > 0 && groups.back().back()->isPointwise()
+                  && !readsDerivedOutput(groups.back(), *iCalibrators[c], iFile);
+      if(!fuse)
+         groups.push_back(std::vector<Calibrator*>());
+      groups.back().push_back(iCalibrators[c]);
+   }
+   return groups;
+}
+bool Calibrator::readsDerivedOutput(const std::vector<Calibrator*>& iGroup, const Calibrator& iCalibrator, const File& iFile) {
+   std::set<Variable::Type> outputs;
+   for(int c = 0; c < iGroup.size(); c++) {
+      std::vector<Variable::Type> curr = iGroup[c]->getOutputVariables();
+      outputs.insert(curr.begin(), curr.end());
+   }
+   std::vector<Variable::Type> inputs = iCalibrator.getInputVariables();
+   for(int k = 0; k < inputs.size(); k++) {
+      std::vector<Variable::Type> derivedFrom = iFile.getDerivedFrom(inputs[k]);
+      for(int m = 0; m < derivedFrom.size(); m++) {
+         if(outputs.find(derivedFrom[m]) != outputs.end())
+            return true;
+      }
+   }
+   return false;
+}
+bool Calibrator::calibrate(const std::vector<Calibrator*>& iCalibrators, File& iFile) {
+   std::vector<std::vector<Calibrator*> > groups = getGroups(iCalibrators, iFile);
+   for(int g = 0; g < groups.size(); g++) {
+      const std::vector<Calibrator*>& group = groups[g];
+      if(group.size() == 1) {
+         if(!group[0]->calibrate(iFile))
+            return false;
+         continue;
+      }
+      // Pointwise calibrators do not depend on the previous timestep
+      if(Util::parallelizeOverTime(iFile.getNumTime(), iFile.getNumLat())) {
+         int numFailed = 0;
+         #pragma omp parallel for schedule(dynamic) reduction(+:numFailed)
+         for(int t = 0; t < iFile.getNumTime(); t++) {
+            if(!calibrate(group, iFile, t))
+               numFailed++;
+         }
+         if(numFailed > 0)
+            return false;
+      }
+      else {
+         for(int t = 0; t < iFile.getNumTime(); t++) {
+            if(!calibrate(group, iFile, t))
+               return false;
+         }
+      }
+   }
+   return true;
+}
+bool Calibrator::calibrate(const std::vector<Calibrator*>& iCalibrators, File& iFile, int iTime) {
+   std::vector<std::vector<Calibrator*> > groups = getGroups(iCalibrators, iFile);
+   for(int g = 0; g < groups.size(); g++) {
+      const std::vector<Calibrator*>& group = groups[g];
+      if(group.size() == 1) {
+         if(!group[0]->calibrate(iFile, iTime))
+            return false;
+         continue;
+      }
+      std::vector<CalibratorKernelPtr> kernels(group.size());
+      for(int c = 0; c < group.size(); c++) {
+         kernels[c] = group[c]->getKernel(iFile, iTime);
+         if(!kernels[c]) {
+            Util::error("Calibrator '" + group[c]->name() + "' is pointwise but has no kernel");
+         }
+      }
+      applyKernels(kernels, iFile.getNumLat());
+   }
+   return true;
+}
+void Calibrator::applyKernels(const std::vector<CalibratorKernelPtr>& iKernels, int iNumLat) {
+   int nKernels = iKernels.size();
+   #pragma omp parallel for
+   for(int i = 0; i < iNumLat; i++) {
+      for(int k = 0; k < nKernels; k++) {
+         iKernels[k]->calibrate(i);
+      }
+   }
 }
 
 void Calibrator::shuffle(const std::vector<float>& iBefore, std::vector<float>& iAfter) {
@@ -133,22 +311,40 @@ void Calibrator::shuffle(const std::vector<float>& iBefore, std::vector<float>&
    if(iBefore.size() == 0)
       return;
 
-   int N = iBefore.size();
-   std::vector<std::pair<float,int> > pairs(N);
-   for(int e = 0; e < N; e++) {
+   std::vector<std::pair<float,int> > pairs;
+   std::vector<float> values;
+   shuffle(&iBefore[0], &iAfter[0], iBefore.size(), pairs, values);
+}
+void Calibrator::shuffle(const float* iBefore, float* iAfter, int iN, std::vector<std::pair<float,int> >& iPairs, std::vector<float>& iValues) {
+   if(iN <= 0)
+      return;
+   for(int e = 0; e < iN; e++) {
       if(!Util::isValid(iBefore[e]) || !Util::isValid(iAfter[e])) {
          return;
       }
+   }
+   if(iPairs.size() < iN)
+      iPairs.resize(iN);
+   if(iValues.size() < iN)
+      iValues.resize(iN);
+
+   std::pair<float,int>* pairs = &iPairs[0];
+   float* values = &iValues[0];
+   for(int e = 0; e < iN; e++) {
       pairs[e].first = iBefore[e];
       pairs[e].second = e;
+      values[e] = iAfter[e];
    }
-   std::vector<float> afterCopy = iAfter;
    // Sort values so that the rank of a member is the same before and after calibration
-   std::sort(pairs.begin(), pairs.end(), Util::sort_pair_first<float,int>());
-   std::sort(afterCopy.begin(), afterCopy.end());
-   for(int e = 0; e < N; e++) {
-      int ei = pairs[e].second;
-      float valueCal = afterCopy[e];
-      iAfter[ei] = valueCal;
+   if(iN <= maxNetworkSize) {
+      networkSort(pairs, iN, Util::sort_pair_first<float,int>());
+      networkSort(values, iN, std::less<float>());
+   }
+   else {
+      std::sort(pairs, pairs + iN, Util::sort_pair_first<float,int>());
+      std::sort(values, values + iN);
+   }
+   for(int e = 0; e < iN; e++) {
+      iAfter[pairs[e].second] = values[e];
    }
 }
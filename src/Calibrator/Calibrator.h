@@ -1,10 +1,25 @@
 #ifndef CALIBRATOR_H
 #define CALIBRATOR_H
 #include <string>
+#include <utility>
 #include <vector>
+#include <boost/shared_ptr.hpp>
+#include "../Variable.h"
 class File;
 class Options;
 
+//! \brief Calibrates one timestep one latitude row at a time. Provided by calibrators where each
+//! value only depends on values at the same gridpoint and timestep, such that consecutive
+//! calibrators of this kind can be applied in a single pass over the data.
+class CalibratorKernel {
+   public:
+      virtual ~CalibratorKernel() {};
+      //! \brief Calibrate all longitudes and ensemble members of latitude row iI. The values of a
+      //! row are contiguous (see Field::getRow), so implementations should loop over them directly.
+      virtual void calibrate(int iI) const = 0;
+};
+typedef boost::shared_ptr<CalibratorKernel> CalibratorKernelPtr;
+
 //! Abstract calibration class
 class Calibrator {
    public:
@@ -14,6 +29,39 @@ class Calibrator {
       //! @return true if calibration was successful, false otherwise
       bool calibrate(File& iFile) const;
 
+      //! \brief Calibrate one or more fields in iFile for one timestep only
+      //! @return true if calibration was successful, false otherwise
+      bool calibrate(File& iFile, int iTime) const;
+
+      //! \brief Does calibrating timestep t use the calibrated values of timestep t-1? If so, the
+      //! timesteps must be calibrated in order.
+      virtual bool dependsOnPreviousTime() const;
+
+      //! \brief Calibrate iFile with a chain of calibrators, in order. Consecutive pointwise
+      //! calibrators (see isPointwise) are fused, such that each latitude row is visited once per
+      //! timestep for the whole group, while it is still in the cache. Other calibrators are run on
+      //! their own. The result is the same as running the calibrators one after another.
+      //! @return true if all calibrations were successful, false otherwise
+      static bool calibrate(const std::vector<Calibrator*>& iCalibrators, File& iFile);
+      //! Same as above, but for one timestep only
+      static bool calibrate(const std::vector<Calibrator*>& iCalibrators, File& iFile, int iTime);
+      //! \brief Split a chain of calibrators into the groups that are run together. A pointwise
+      //! calibrator is not fused with the previous ones if it reads a variable that iFile derives
+      //! from their outputs (e.g. wind direction derived from U and V), since the kernel would
+      //! then be built from values that the previous ones have not yet calibrated.
+      static std::vector<std::vector<Calibrator*> > getGroups(const std::vector<Calibrator*>& iCalibrators, const File& iFile);
+
+      //! \brief Does each calibrated value only depend on values at the same gridpoint and
+      //! timestep? Such calibrators must implement getKernel.
+      virtual bool isPointwise() const;
+
+      //! \brief Variables that the calibrator reads from the file. Used to find variables that can
+      //! be post-processed concurrently. The default is all variables.
+      virtual std::vector<Variable::Type> getInputVariables() const;
+      //! \brief Variables that the calibrator changes or adds in the file. The default is all
+      //! variables.
+      virtual std::vector<Variable::Type> getOutputVariables() const;
+
       //! Instantiates a calibrator with name iName
       static Calibrator* getScheme(std::string iName, const Options& iOptions);
 
@@ -22,11 +70,30 @@ class Calibrator {
       //! If the sizes are different, then iAfter is left unchanged.
       static void  shuffle(const std::vector<float>& iBefore, std::vector<float>& iAfter);
 
+      //! \brief Same as above, but for arrays with iN values. The work space is only resized when
+      //! it is too small, so reusing it across gridpoints (e.g. one per thread) avoids allocations.
+      //! @param iPairs work space
+      //! @param iValues work space
+      static void  shuffle(const float* iBefore, float* iAfter, int iN, std::vector<std::pair<float,int> >& iPairs, std::vector<float>& iValues);
+
       //! Returns the name of this calibrator
       virtual std::string name() const = 0;
    protected:
-      virtual bool calibrateCore(File& iFile) const = 0;
+      //! \brief Calibrate one timestep. Can be called for several timesteps in parallel, unless
+      //! dependsOnPreviousTime() is true. The default applies the kernel to all gridpoints.
+      virtual bool calibrateCore(File& iFile, int iTime) const;
+
+      //! \brief Get a kernel that calibrates timestep iTime of iFile one latitude row at a time.
+      //! Retrieves the fields and parameters needed, so that the kernel can be applied to rows
+      //! in parallel. The kernel must hold on to the fields (FieldPtr), such that they are not
+      //! removed from the file's cache while it is used.
+      //! @return Null pointer if the calibrator is not pointwise (the default)
+      virtual CalibratorKernelPtr getKernel(File& iFile, int iTime) const;
    private:
+      //! Apply the kernels, in order, to each latitude row
+      static void applyKernels(const std::vector<CalibratorKernelPtr>& iKernels, int iNumLat);
+      //! Does iCalibrator read a variable that iFile derives from the outputs of iGroup?
+      static bool readsDerivedOutput(const std::vector<Calibrator*>& iGroup, const Calibrator& iCalibrator, const File& iFile);
 };
 #include "Zaga.h"
 #include "Cloud.h"
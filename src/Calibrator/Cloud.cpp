@@ -1,47 +1,58 @@
 #include "Cloud.h"
 #include "../Util.h"
 #include "../File/File.h"
-CalibratorCloud::CalibratorCloud(Variable::Type iPrecip, Variable::Type iCloud) :
-      Calibrator(),
-      mCloudType(iCloud),
-      mPrecipType(iPrecip) {
-
-}
-bool CalibratorCloud::calibrateCore(File& iFile) const {
-   int nLat = iFile.getNumLat();
-   int nLon = iFile.getNumLon();
-   int nEns = iFile.getNumEns();
-   int nTime = iFile.getNumTime();
-
-   // Loop over offsets
-   for(int t = 0; t < nTime; t++) {
-      const Field& precip = *iFile.getField(mPrecipType, t);
-      Field& cloud        = *iFile.getField(mCloudType, t);
-
-      // TODO: Figure out which cloudless members to use. Ideally, if more members
-      // need precip, we should pick members that already have clouds, so that we minimize
-      // our effect on the cloud cover field.
 
-      #pragma omp parallel for
-      for(int i = 0; i < nLat; i++) {
-         for(int j = 0; j < nLon; j++) {
+namespace {
+   //! Turns on clouds for members with precip in one latitude row
+   class CloudKernel : public CalibratorKernel {
+      public:
+         CloudKernel(FieldPtr iPrecip, FieldPtr iCloud) : mPrecip(iPrecip), mCloud(iCloud) {};
+         void calibrate(int iI) const {
+            const float* precip = mPrecip->getRow(iI);
+            float* cloud = mCloud->getRow(iI);
+            int n = mCloud->getNumLon() * mCloud->getNumEns();
+            const float MV = Util::MV;
             // Turn on clouds if needed, i.e don't allow a member to
             // have precip without cloud cover.
-            for(int e = 0; e < nEns; e++) {
-               float currPrecip = precip(i,j,e);
-               float currCloud  = cloud(i,j,e);
-               if(Util::isValid(currPrecip) && Util::isValid(currCloud)) {
-                  cloud(i,j,e)  = currCloud;
-                  // std::cout << "currPrecip = " << currPrecip << std::endl;
+            for(int k = 0; k < n; k++) {
+               float currPrecip = precip[k];
+               float currCloud  = cloud[k];
+               if(Util::isValidInline(currPrecip, MV) && Util::isValidInline(currCloud, MV)) {
                   if(currPrecip > 0 && currCloud < 1) {
-                     cloud(i,j,e) = 1;
+                     cloud[k] = 1;
                   }
                }
             }
-         }
-      }
-   }
-   return true;
+         };
+      private:
+         FieldPtr mPrecip;
+         FieldPtr mCloud;
+   };
+}
+
+CalibratorCloud::CalibratorCloud(Variable::Type iPrecip, Variable::Type iCloud) :
+      Calibrator(),
+      mCloudType(iCloud),
+      mPrecipType(iPrecip) {
+
+}
+CalibratorKernelPtr CalibratorCloud::getKernel(File& iFile, int iTime) const {
+   FieldPtr precip = iFile.getField(mPrecipType, iTime);
+   FieldPtr cloud  = iFile.getField(mCloudType, iTime);
+
+   // TODO: Figure out which cloudless members to use. Ideally, if more members
+   // need precip, we should pick members that already have clouds, so that we minimize
+   // our effect on the cloud cover field.
+   return CalibratorKernelPtr(new CloudKernel(precip, cloud));
+}
+std::vector<Variable::Type> CalibratorCloud::getInputVariables() const {
+   std::vector<Variable::Type> variables;
+   variables.push_back(mPrecipType);
+   variables.push_back(mCloudType);
+   return variables;
+}
+std::vector<Variable::Type> CalibratorCloud::getOutputVariables() const {
+   return std::vector<Variable::Type>(1, mCloudType);
 }
 std::string CalibratorCloud::description() {
    std::stringstream ss;
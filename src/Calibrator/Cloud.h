@@ -9,8 +9,11 @@ class CalibratorCloud : public Calibrator {
       CalibratorCloud(Variable::Type iPrecip=Variable::Precip, Variable::Type iCloud=Variable::Cloud);
       static std::string description();
       std::string name() const {return "cloud";};
+      bool isPointwise() const {return true;};
+      std::vector<Variable::Type> getInputVariables() const;
+      std::vector<Variable::Type> getOutputVariables() const;
    private:
-      bool calibrateCore(File& iFile) const;
+      CalibratorKernelPtr getKernel(File& iFile, int iTime) const;
       Variable::Type mPrecipType;
       Variable::Type mCloudType;
 };
@@ -4,6 +4,56 @@
 #include <boost/math/distributions/gamma.hpp>
 #include "../Util.h"
 #include "../File/File.h"
+
+namespace {
+   //! \brief Interpolate the quantile iQuantile of N sorted values
+   //! @param iLowerValue the value with index iLowerIndex = floor(iQuantile * (N-1))
+   //! @param iUpperValue the value with index iUpperIndex = ceil(iQuantile * (N-1))
+   float interpolateQuantile(float iQuantile, int N, int iLowerIndex, int iUpperIndex, float iLowerValue, float iUpperValue) {
+      if(iLowerIndex == iUpperIndex)
+         return iLowerValue;
+      float lowerQuantile = (float) iLowerIndex / (N-1);
+      float upperQuantile = (float) iUpperIndex / (N-1);
+      assert(upperQuantile > lowerQuantile);
+      assert(iQuantile >= lowerQuantile);
+      float f = (iQuantile - lowerQuantile)/(upperQuantile - lowerQuantile);
+      assert(f >= 0);
+      assert(f <= 1);
+      return iLowerValue + (iUpperValue - iLowerValue) * f;
+   }
+
+   //! Binary indexed tree counting how many values of each rank are in the neighbourhood
+   class RankTree {
+      public:
+         RankTree(int iSize) : mCounts(iSize+1, 0), mTotal(0) {
+            mTopBit = 1;
+            while(mTopBit * 2 <= iSize)
+               mTopBit *= 2;
+         };
+         void add(int iRank, int iCount) {
+            mTotal += iCount;
+            for(int k = iRank + 1; k < mCounts.size(); k += k & (-k))
+               mCounts[k] += iCount;
+         };
+         //! Rank of the value with index iIndex (0 is the smallest) among the values in the tree
+         int find(int iIndex) const {
+            int pos = 0;
+            for(int step = mTopBit; step > 0; step /= 2) {
+               if(pos + step < mCounts.size() && mCounts[pos + step] <= iIndex) {
+                  pos += step;
+                  iIndex -= mCounts[pos];
+               }
+            }
+            return pos;
+         };
+         int size() const {return mTotal;};
+      private:
+         std::vector<int> mCounts;
+         int mTotal;
+         int mTopBit;
+   };
+}
+
 CalibratorNeighbourhood::CalibratorNeighbourhood(Variable::Type iVariable, const Options& iOptions):
       Calibrator(),
       mRadius(3),
@@ -52,51 +102,212 @@ CalibratorNeighbourhood::CalibratorNeighbourhood(Variable::Type iVariable, const
    }
 }
 
-bool CalibratorNeighbourhood::calibrateCore(File& iFile) const {
-   int nLat = iFile.getNumLat();
-   int nLon = iFile.getNumLon();
-   int nEns = iFile.getNumEns();
-   int nTime = iFile.getNumTime();
+bool CalibratorNeighbourhood::calibrateCore(File& iFile, int iTime) const {
+   Field& precip = *iFile.getField(mVariable, iTime);
+   Field precipRaw = precip;
+
+   if(mOperator == OperatorMean || mOperator == OperatorStd) {
+      calibrateMoments(precipRaw, precip);
+   }
+   else if(mQuantile == 0 || mQuantile == 1) {
+      calibrateExtreme(precipRaw, precip, mQuantile == 1);
+   }
+   else {
+      calibrateQuantile(precipRaw, precip);
+   }
+   return true;
+}
+
+void CalibratorNeighbourhood::calibrateMoments(const Field& iInput, Field& iOutput) const {
+   int nLat = iInput.getNumLat();
+   int nLon = iInput.getNumLon();
+   int nEns = iInput.getNumEns();
+   if(nLat == 0 || nLon == 0)
+      return;
+
+   // Summed-area tables with one extra row and column of zeros, such that entry (i,j) holds the
+   // sum over all gridpoints with latitude index < i and longitude index < j. Missing values
+   // are left out of the sums and the count.
+   int nCol = nLon + 1;
+   std::vector<double> total((nLat+1)*nCol, 0);
+   std::vector<double> total2((nLat+1)*nCol, 0);
+   std::vector<int> count((nLat+1)*nCol, 0);
 
-   // Loop over offsets
-   for(int t = 0; t < nTime; t++) {
-      Field& precip = *iFile.getField(mVariable, t);
-      Field precipRaw = precip;
+   for(int e = 0; e < nEns; e++) {
+      // VAR(X) = VAR(X-K). Subtract a value K in the field so that the squares stay small and
+      // E[X^2] - E[X]^2 remains stable when the variance is small and the mean is large.
+      float K = Util::MV;
+      for(int i = 0; i < nLat && !Util::isValid(K); i++) {
+         for(int j = 0; j < nLon; j++) {
+            if(Util::isValid(iInput(i,j,e))) {
+               K = iInput(i,j,e);
+               break;
+            }
+         }
+      }
 
+      // Cumulative sums along each row, then down each column
       #pragma omp parallel for
+      for(int i = 0; i < nLat; i++) {
+         int row = (i+1)*nCol;
+         for(int j = 0; j < nLon; j++) {
+            float value = iInput(i,j,e);
+            bool isValid = Util::isValid(value);
+            double diff = isValid ? value - K : 0;
+            total[row + j+1]  = total[row + j] + diff;
+            total2[row + j+1] = total2[row + j] + diff*diff;
+            count[row + j+1]  = count[row + j] + isValid;
+         }
+      }
+      for(int i = 1; i <= nLat; i++) {
+         int row = i*nCol;
+         int prev = (i-1)*nCol;
+         for(int j = 1; j <= nLon; j++) {
+            total[row + j]  += total[prev + j];
+            total2[row + j] += total2[prev + j];
+            count[row + j]  += count[prev + j];
+         }
+      }
+
+      #pragma omp parallel for
+      for(int i = 0; i < nLat; i++) {
+         // Corners of the neighbourhood in the tables
+         int top    = std::max(0, i-mRadius) * nCol;
+         int bottom = (std::min(nLat-1, i+mRadius) + 1) * nCol;
+         for(int j = 0; j < nLon; j++) {
+            int left  = std::max(0, j-mRadius);
+            int right = std::min(nLon-1, j+mRadius) + 1;
+            int n = count[bottom+right] - count[bottom+left] - count[top+right] + count[top+left];
+            float value = Util::MV;
+            if(n > 0) {
+               double sum  = total[bottom+right] - total[bottom+left] - total[top+right] + total[top+left];
+               double mean = sum / n;
+               if(mOperator == OperatorMean) {
+                  value = mean + K;
+               }
+               else {
+                  double sum2 = total2[bottom+right] - total2[bottom+left] - total2[top+right] + total2[top+left];
+                  double var  = sum2 / n - mean*mean;
+                  // Rounding can give slightly negative variances when all values are equal
+                  value = var > 0 ? sqrt(var) : 0;
+               }
+            }
+            iOutput(i,j,e) = value;
+         }
+      }
+   }
+}
+
+void CalibratorNeighbourhood::calibrateExtreme(const Field& iInput, Field& iOutput, bool iMax) const {
+   int nLat = iInput.getNumLat();
+   int nLon = iInput.getNumLon();
+   int nEns = iInput.getNumEns();
+   if(nLat == 0 || nLon == 0)
+      return;
+
+   // The extreme over a box is the extreme (over latitudes) of the extremes along each row
+   std::vector<float> rowExtremes(nLat*nLon);
+   for(int e = 0; e < nEns; e++) {
+      #pragma omp parallel
+      {
+         std::vector<int> queue(std::max(nLat, nLon));
+         #pragma omp for
+         for(int i = 0; i < nLat; i++) {
+            Util::slidingExtreme(iInput.getRow(i) + e, nLon, nEns, mRadius, iMax, &rowExtremes[i*nLon], 1, queue);
+         }
+         #pragma omp for
+         for(int j = 0; j < nLon; j++) {
+            Util::slidingExtreme(&rowExtremes[j], nLat, nLon, mRadius, iMax, iOutput.getData() + j*nEns + e, nLon*nEns, queue);
+         }
+      }
+   }
+}
+
+void CalibratorNeighbourhood::calibrateQuantile(const Field& iInput, Field& iOutput) const {
+   int nLat = iInput.getNumLat();
+   int nLon = iInput.getNumLon();
+   int nEns = iInput.getNumEns();
+
+   for(int e = 0; e < nEns; e++) {
+      // Rank all valid values in the field. Ties get different ranks, so that every gridpoint
+      // has its own rank. Missing values get rank -1.
+      std::vector<std::pair<float,int> > sorted;
+      sorted.reserve(nLat*nLon);
       for(int i = 0; i < nLat; i++) {
          for(int j = 0; j < nLon; j++) {
+            float value = iInput(i,j,e);
+            if(Util::isValid(value))
+               sorted.push_back(std::pair<float,int>(value, i*nLon + j));
+         }
+      }
+      std::sort(sorted.begin(), sorted.end());
+      int numValid = sorted.size();
+      std::vector<float> values(numValid);
+      std::vector<int> ranks(nLat*nLon, -1);
+      for(int r = 0; r < numValid; r++) {
+         values[r] = sorted[r].first;
+         ranks[sorted[r].second] = r;
+      }
 
-            for(int e = 0; e < nEns; e++) {
-               // Put neighbourhood into vector
-               std::vector<float> neighbourhood;
-               int Ni = std::min(nLat-1, i+mRadius) - std::max(0, i-mRadius) + 1;
-               int Nj = std::min(nLon-1, j+mRadius) - std::max(0, j-mRadius) + 1;
-               assert(Ni > 0);
-               assert(Nj > 0);
-               neighbourhood.resize(Ni*Nj, Util::MV);
-               int index = 0;
-               for(int ii = std::max(0, i-mRadius); ii <= std::min(nLat-1, i+mRadius); ii++) {
-                  for(int jj = std::max(0, j-mRadius); jj <= std::min(nLon-1, j+mRadius); jj++) {
-                     float value = precipRaw(ii,jj,e);
-                     assert(index < Ni*Nj);
-                     neighbourhood[index] = value;
-                     index++;
+      #pragma omp parallel
+      {
+         RankTree tree(numValid);
+         #pragma omp for
+         for(int i = 0; i < nLat; i++) {
+            int iStart = std::max(0, i-mRadius);
+            int iEnd = std::min(nLat-1, i+mRadius);
+            // Neighbourhood of the first gridpoint in the row. Then add and remove one column
+            // at a time, while moving along the row.
+            for(int jj = 0; jj <= std::min(nLon-1, mRadius); jj++) {
+               for(int ii = iStart; ii <= iEnd; ii++) {
+                  if(ranks[ii*nLon + jj] >= 0)
+                     tree.add(ranks[ii*nLon + jj], 1);
+               }
+            }
+            for(int j = 0; j < nLon; j++) {
+               if(j > 0) {
+                  int jAdd = j + mRadius;
+                  int jRemove = j - mRadius - 1;
+                  for(int ii = iStart; ii <= iEnd; ii++) {
+                     if(jAdd < nLon && ranks[ii*nLon + jAdd] >= 0)
+                        tree.add(ranks[ii*nLon + jAdd], 1);
+                     if(jRemove >= 0 && ranks[ii*nLon + jRemove] >= 0)
+                        tree.add(ranks[ii*nLon + jRemove], -1);
                   }
                }
-               assert(index == Ni*Nj);
-               precip(i,j,e) = compute(neighbourhood, mOperator, mQuantile);
+               int N = tree.size();
+               float value = Util::MV;
+               if(N > 0) {
+                  int lowerIndex = floor(mQuantile * (N-1));
+                  int upperIndex = ceil(mQuantile * (N-1));
+                  float lowerValue = values[tree.find(lowerIndex)];
+                  float upperValue = values[tree.find(upperIndex)];
+                  value = interpolateQuantile(mQuantile, N, lowerIndex, upperIndex, lowerValue, upperValue);
+               }
+               iOutput(i,j,e) = value;
+            }
+            // Empty the tree for the next row
+            for(int jj = std::max(0, nLon-1-mRadius); jj < nLon; jj++) {
+               for(int ii = iStart; ii <= iEnd; ii++) {
+                  if(ranks[ii*nLon + jj] >= 0)
+                     tree.add(ranks[ii*nLon + jj], -1);
+               }
             }
          }
       }
    }
-   return true;
 }
 
 int CalibratorNeighbourhood::getRadius() const {
    return mRadius;
 }
 
+std::vector<Variable::Type> CalibratorNeighbourhood::getInputVariables() const {
+   return std::vector<Variable::Type>(1, mVariable);
+}
+std::vector<Variable::Type> CalibratorNeighbourhood::getOutputVariables() const {
+   return std::vector<Variable::Type>(1, mVariable);
+}
 std::string CalibratorNeighbourhood::description() {
    std::stringstream ss;
    ss << Util::formatDescription("-c neighbourhood", "Applies an operator on a neighbourhood (example by averaging across a neighbourhood thereby smoothing the field).") << std::endl;
@@ -167,21 +378,7 @@ float CalibratorNeighbourhood::compute(const std::vector<float>& neighbourhood,
          std::sort(cleanHood.begin(), cleanHood.end());
          int lowerIndex = floor(iQuantile * (N-1));
          int upperIndex = ceil(iQuantile * (N-1));
-         float lowerQuantile = (float) lowerIndex / (N-1);
-         float upperQuantile = (float) upperIndex / (N-1);
-         float lowerValue = cleanHood[lowerIndex];
-         float upperValue = cleanHood[upperIndex];
-         if(lowerIndex == upperIndex) {
-            value = lowerValue;
-         }
-         else {
-            assert(upperQuantile > lowerQuantile);
-            assert(iQuantile >= lowerQuantile);
-            float f = (iQuantile - lowerQuantile)/(upperQuantile - lowerQuantile);
-            assert(f >= 0);
-            assert(f <= 1);
-            value   = lowerValue + (upperValue - lowerValue) * f;
-         }
+         value = interpolateQuantile(iQuantile, N, lowerIndex, upperIndex, cleanHood[lowerIndex], cleanHood[upperIndex]);
       }
    }
    return value;
@@ -3,6 +3,7 @@
 #include "Calibrator.h"
 #include "../Variable.h"
 #include "../Util.h"
+#include "../Field.h"
 
 class ParameterFile;
 class Parameters;
@@ -13,6 +14,8 @@ class CalibratorNeighbourhood : public Calibrator {
       CalibratorNeighbourhood(Variable::Type iVariable, const Options& iOptions);
       static std::string description();
       std::string name() const {return "neighbourhood";};
+      std::vector<Variable::Type> getInputVariables() const;
+      std::vector<Variable::Type> getOutputVariables() const;
       int  getRadius() const;
       enum OperatorType {
          OperatorMean      = 0,
@@ -22,7 +25,16 @@ class CalibratorNeighbourhood : public Calibrator {
       // Compute the statistic over the neighbourhood. Removes missing values.
       static float compute(const std::vector<float>& neighbourhood, OperatorType iOperator, float iQuantile=Util::MV);
    private:
-      bool calibrateCore(File& iFile) const;
+      bool calibrateCore(File& iFile, int iTime) const;
+      //! \brief Compute the mean or standard deviation of all neighbourhoods using summed-area
+      //! tables, such that the cost per gridpoint does not depend on the radius
+      void calibrateMoments(const Field& iInput, Field& iOutput) const;
+      //! \brief Compute the minimum or maximum of all neighbourhoods with a sliding window,
+      //! first along each row and then along each column
+      void calibrateExtreme(const Field& iInput, Field& iOutput, bool iMax) const;
+      //! \brief Compute a quantile of all neighbourhoods. The neighbourhood is updated column by
+      //! column when moving along a row, and quantiles are found by rank in a binary indexed tree.
+      void calibrateQuantile(const Field& iInput, Field& iOutput) const;
       Variable::Type mVariable;
       int mRadius;
       OperatorType mOperator;
@@ -15,76 +15,108 @@ CalibratorPhase::CalibratorPhase(const ParameterFile* iParameterFile) :
    }
 
 }
-bool CalibratorPhase::calibrateCore(File& iFile) const {
+bool CalibratorPhase::calibrateCore(File& iFile, int iTime) const {
    int nLat = iFile.getNumLat();
    int nLon = iFile.getNumLon();
    int nEns = iFile.getNumEns();
-   int nTime = iFile.getNumTime();
-   iFile.initNewVariable(Variable::Phase);
-   vec2 elevs = iFile.getElevs();
+   iFile.initNewVariable(Variable::Phase, iTime);
+   const vec2& elevs = iFile.getElevs();
 
 
-   // Loop over offsets
-   for(int t = 0; t < nTime; t++) {
-      const Parameters& par = mParameterFile->getParameters(t);
-      float snowSleetThreshold = par[0];
-      float sleetRainThreshold = par[1];
-      const FieldPtr temp = iFile.getField(Variable::T, t);
-      const FieldPtr precip = iFile.getField(Variable::Precip, t);
-      FieldPtr phase = iFile.getField(Variable::Phase, t);
-      FieldPtr pressure;
-      FieldPtr rh;
-      if(mUseWetbulb) {
-         // Only load these fields if they are to be used, to save memory
-         rh = iFile.getField(Variable::RH, t);
-         if(!mEstimatePressure)
-            pressure = iFile.getField(Variable::P, t);
-      }
+   const Parameters& par = mParameterFile->getParameters(iTime);
+   float snowSleetThreshold = par[0];
+   float sleetRainThreshold = par[1];
+   bool validThresholds = Util::isValid(snowSleetThreshold) && Util::isValid(sleetRainThreshold);
+   const FieldPtr temp = iFile.getField(Variable::T, iTime);
+   const FieldPtr precip = iFile.getField(Variable::Precip, iTime);
+   FieldPtr phase = iFile.getField(Variable::Phase, iTime);
+   FieldPtr pressure;
+   FieldPtr rh;
+   if(mUseWetbulb) {
+      // Only load these fields if they are to be used, to save memory
+      rh = iFile.getField(Variable::RH, iTime);
+      if(!mEstimatePressure)
+         pressure = iFile.getField(Variable::P, iTime);
+   }
 
-      #pragma omp parallel for
+   int N = nLon * nEns;
+   #pragma omp parallel
+   {
+      // Work space for the members in a row that need the wet-bulb temperature
+      std::vector<int> indices(N);
+      std::vector<float> wetTemp(N), wetPressure(N), wetRh(N), wetbulb(N);
+      std::vector<float> elevPressure(nLon);
+      #pragma omp for
       for(int i = 0; i < nLat; i++) {
-         for(int j = 0; j < nLon; j++) {
-            float currElev = elevs[i][j];
-            for(int e = 0; e < nEns; e++) {
-               float currDryTemp  = (*temp)(i,j,e);
-               float currTemp     = currDryTemp;
-               float currPrecip   = (*precip)(i,j,e);
-               if(mUseWetbulb) {
-                  float currPressure;
-                  if(mEstimatePressure)
-                     currPressure = DownscalerPressure::calcPressure(0, 101325, currElev);
-                  else
-                     currPressure = (*pressure)(i,j,e);
-                  float currRh       = (*rh)(i,j,e);
-                  float currWetbulb  = getWetbulb(currDryTemp, currPressure, currRh);
-                  if(Util::isValid(snowSleetThreshold) && Util::isValid(sleetRainThreshold)
-                        && Util::isValid(currPrecip)   && Util::isValid(currDryTemp)
-                        && Util::isValid(currPressure) && Util::isValid(currRh)) {
-                     currTemp = currWetbulb;
-                  }
-               }
-               if(Util::isValid(snowSleetThreshold) && Util::isValid(sleetRainThreshold) && Util::isValid(currTemp)) {
-                  if(currPrecip <= mMinPrecip)
-                     (*phase)(i,j,e)  = Variable::PhaseNone;
-                  else if(!Util::isValid(currTemp))
-                     (*phase)(i,j,e)  = Util::MV;
-                  else if(currTemp <= snowSleetThreshold)
-                     (*phase)(i,j,e)  = Variable::PhaseSnow;
-                  else if(currTemp <= sleetRainThreshold)
-                     (*phase)(i,j,e)  = Variable::PhaseSleet;
-                  else
-                     (*phase)(i,j,e)  = Variable::PhaseRain;
-               }
-               else {
-                  (*phase)(i,j,e) = Util::MV;
+         const float* tempRow = temp->getRow(i);
+         const float* precipRow = precip->getRow(i);
+         float* phaseRow = phase->getRow(i);
+         if(!validThresholds) {
+            for(int k = 0; k < N; k++)
+               phaseRow[k] = Util::MV;
+            continue;
+         }
+         const float* rhRow = mUseWetbulb ? rh->getRow(i) : NULL;
+         const float* pressureRow = NULL;
+         if(mUseWetbulb) {
+            if(mEstimatePressure) {
+               // The pressure only depends on the elevation, so compute it once per gridpoint
+               for(int j = 0; j < nLon; j++)
+                  elevPressure[j] = DownscalerPressure::calcPressure(0, 101325, elevs[i][j]);
+            }
+            else {
+               pressureRow = pressure->getRow(i);
+            }
+         }
+
+         // Classify members without precip and members that use the dry temperature, and collect
+         // the rest so that the wet-bulb temperature is only computed where it is needed
+         int numWet = 0;
+         for(int k = 0; k < N; k++) {
+            float currDryTemp = tempRow[k];
+            float currPrecip  = precipRow[k];
+            if(currPrecip <= mMinPrecip) {
+               phaseRow[k] = Util::isValid(currDryTemp) ? Variable::PhaseNone : Util::MV;
+               continue;
+            }
+            if(mUseWetbulb) {
+               float currPressure = mEstimatePressure ? elevPressure[k / nEns] : pressureRow[k];
+               float currRh = rhRow[k];
+               if(Util::isValid(currPrecip) && Util::isValid(currDryTemp)
+                     && Util::isValid(currPressure) && Util::isValid(currRh)) {
+                  indices[numWet] = k;
+                  wetTemp[numWet] = currDryTemp;
+                  wetPressure[numWet] = currPressure;
+                  wetRh[numWet] = currRh;
+                  numWet++;
+                  continue;
                }
             }
+            phaseRow[k] = getPhase(currDryTemp, snowSleetThreshold, sleetRainThreshold);
+         }
+
+         if(numWet > 0) {
+            getWetbulb(&wetTemp[0], &wetPressure[0], &wetRh[0], numWet, &wetbulb[0]);
+            for(int w = 0; w < numWet; w++) {
+               phaseRow[indices[w]] = getPhase(wetbulb[w], snowSleetThreshold, sleetRainThreshold);
+            }
          }
       }
    }
    return true;
 }
 
+float CalibratorPhase::getPhase(float iTemperature, float iSnowSleetThreshold, float iSleetRainThreshold) {
+   if(!Util::isValid(iTemperature))
+      return Util::MV;
+   else if(iTemperature <= iSnowSleetThreshold)
+      return Variable::PhaseSnow;
+   else if(iTemperature <= iSleetRainThreshold)
+      return Variable::PhaseSleet;
+   else
+      return Variable::PhaseRain;
+}
+
 float CalibratorPhase::getMinPrecip() const {
    return mMinPrecip;
 }
@@ -98,6 +130,20 @@ bool CalibratorPhase::getUseWetbulb() {
    return mUseWetbulb;
 }
 
+std::vector<Variable::Type> CalibratorPhase::getInputVariables() const {
+   std::vector<Variable::Type> variables;
+   variables.push_back(Variable::T);
+   variables.push_back(Variable::Precip);
+   if(mUseWetbulb) {
+      variables.push_back(Variable::RH);
+      if(!mEstimatePressure)
+         variables.push_back(Variable::P);
+   }
+   return variables;
+}
+std::vector<Variable::Type> CalibratorPhase::getOutputVariables() const {
+   return std::vector<Variable::Type>(1, Variable::Phase);
+}
 std::string CalibratorPhase::description() {
    std::stringstream ss;
    ss << Util::formatDescription("-c phase", "Compute precipitation phase based on temperature, with values encoded by:") << std::endl;
@@ -116,21 +162,31 @@ std::string CalibratorPhase::description() {
    return ss.str();
 }
 float CalibratorPhase::getWetbulb(float iTemperature, float iPressure, float iRelativeHumidity) {
-   float temperatureC = iTemperature - 273.15;
-   if(temperatureC <= -243.04 || iRelativeHumidity <= 0)
-      return Util::MV;
-   if(Util::isValid(temperatureC) && Util::isValid(iPressure) && Util::isValid(iRelativeHumidity)) {
-      float e  = (iRelativeHumidity)*0.611*exp((17.63*temperatureC)/(temperatureC+243.04));
-      float Td = (116.9 + 243.04*log(e))/(16.78-log(e));
-      float gamma = 0.00066 * iPressure/1000;
-      float delta = (4098*e)/pow(Td+243.04,2);
-      if(gamma + delta == 0)
-         return Util::MV;
+   float wetbulb;
+   getWetbulb(&iTemperature, &iPressure, &iRelativeHumidity, 1, &wetbulb);
+   return wetbulb;
+}
+void CalibratorPhase::getWetbulb(const float* iTemperature, const float* iPressure, const float* iRelativeHumidity, int iN, float* oWetbulb) {
+   for(int n = 0; n < iN; n++) {
+      float temperatureC = iTemperature[n] - 273.15;
+      float relativeHumidity = iRelativeHumidity[n];
+      float pressure = iPressure[n];
+      if(temperatureC <= -243.04 || relativeHumidity <= 0
+            || !Util::isValid(temperatureC) || !Util::isValid(pressure) || !Util::isValid(relativeHumidity)) {
+         oWetbulb[n] = Util::MV;
+         continue;
+      }
+      float e  = (relativeHumidity)*0.611*exp((17.63*temperatureC)/(temperatureC+243.04));
+      float logE = log(e);
+      float Td = (116.9 + 243.04*logE)/(16.78-logE);
+      float gamma = 0.00066 * pressure/1000;
+      double TdShifted = Td+243.04;
+      float delta = (4098*e)/(TdShifted*TdShifted);
+      if(gamma + delta == 0) {
+         oWetbulb[n] = Util::MV;
+         continue;
+      }
       float wetbulbTemperature   = (gamma * temperatureC + delta * Td)/(gamma + delta);
-      float wetbulbTemperatureK  = wetbulbTemperature + 273.15;
-      return wetbulbTemperatureK;
-   }
-   else {
-      return Util::MV;
+      oWetbulb[n] = wetbulbTemperature + 273.15;
    }
 }
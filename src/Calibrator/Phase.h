@@ -9,19 +9,27 @@ class CalibratorPhase : public Calibrator {
       CalibratorPhase(const ParameterFile* iParameterFile);
       static std::string description();
       std::string name() const {return "phase";};
+      std::vector<Variable::Type> getInputVariables() const;
+      std::vector<Variable::Type> getOutputVariables() const;
       //! Compute wetbulb temperature
       //! @param iTemperature Temperature in K
       //! @param iPressure Pressure in pa
       //! @param iRelativeHumidity Relative humidity (out of 1)
       //! @return Wetbulb temperature in K
       static float getWetbulb(float iTemperature, float iPressure, float iRelativeHumidity);
+      //! \brief Compute the wet-bulb temperature of iN values at once
+      //! @param oWetbulb array with iN values, Util::MV where the inputs are invalid
+      static void getWetbulb(const float* iTemperature, const float* iPressure, const float* iRelativeHumidity, int iN, float* oWetbulb);
+      //! \brief Precipitation phase for a given (wet-bulb) temperature, assuming there is precipitation
+      //! @return Util::MV if the temperature is missing
+      static float getPhase(float iTemperature, float iSnowSleetThreshold, float iSleetRainThreshold);
 
       float getMinPrecip() const;
       void  setMinPrecip(float iMinPrecip);
       void  setUseWetbulb(bool iUseWetbulb);
       bool  getUseWetbulb();
    private:
-      bool calibrateCore(File& iFile) const;
+      bool calibrateCore(File& iFile, int iTime) const;
       const ParameterFile* mParameterFile;
       float mMinPrecip;
       bool mUseWetbulb;
@@ -4,6 +4,36 @@
 #include <boost/math/distributions/gamma.hpp>
 #include "../Util.h"
 #include "../File/File.h"
+
+namespace {
+   //! Truncates values in one latitude row to [min, max]
+   class QcKernel : public CalibratorKernel {
+      public:
+         QcKernel(FieldPtr iField, float iMin, float iMax) : mField(iField), mMin(iMin), mMax(iMax) {};
+         void calibrate(int iI) const {
+            float* values = mField->getRow(iI);
+            int n = mField->getNumLon() * mField->getNumEns();
+            const float MV = Util::MV;
+            bool hasMin = Util::isValid(mMin);
+            bool hasMax = Util::isValid(mMax);
+            for(int k = 0; k < n; k++) {
+               float value = values[k];
+               if(Util::isValidInline(value, MV)) {
+                  if(hasMin && value < mMin)
+                     value = mMin;
+                  else if(hasMax && value > mMax)
+                     value = mMax;
+                  values[k] = value;
+               }
+            }
+         };
+      private:
+         FieldPtr mField;
+         float mMin;
+         float mMax;
+   };
+}
+
 CalibratorQc::CalibratorQc(Variable::Type iVariable, const Options& iOptions):
       Calibrator(),
       mVariable(iVariable),
@@ -14,36 +44,17 @@ CalibratorQc::CalibratorQc(Variable::Type iVariable, const Options& iOptions):
    Util::warning("CalibratorQc: both 'min' and 'max' are missing, therefore no correction is applied.");
 }
 
-bool CalibratorQc::calibrateCore(File& iFile) const {
-   int nLat = iFile.getNumLat();
-   int nLon = iFile.getNumLon();
-   int nEns = iFile.getNumEns();
-   int nTime = iFile.getNumTime();
-
-   // Loop over offsets
-   for(int t = 0; t < nTime; t++) {
-      Field& field = *iFile.getField(mVariable, t);
-
-      #pragma omp parallel for
-      for(int i = 0; i < nLat; i++) {
-         for(int j = 0; j < nLon; j++) {
-
-            for(int e = 0; e < nEns; e++) {
-               float value = field(i,j,e);
-               if(Util::isValid(value)) {
-                  if(Util::isValid(mMin) && value < mMin)
-                     value = mMin;
-                  else if(Util::isValid(mMax) && value > mMax)
-                     value = mMax;
-                  field(i,j,e) = value;
-               }
-            }
-         }
-      }
-   }
-   return true;
+CalibratorKernelPtr CalibratorQc::getKernel(File& iFile, int iTime) const {
+   FieldPtr field = iFile.getField(mVariable, iTime);
+   return CalibratorKernelPtr(new QcKernel(field, mMin, mMax));
 }
 
+std::vector<Variable::Type> CalibratorQc::getInputVariables() const {
+   return std::vector<Variable::Type>(1, mVariable);
+}
+std::vector<Variable::Type> CalibratorQc::getOutputVariables() const {
+   return std::vector<Variable::Type>(1, mVariable);
+}
 std::string CalibratorQc::description() {
    std::stringstream ss;
    ss << Util::formatDescription("-c qc", "Apply quality control, ensuring the values are within the bounds of the variable. If the original value is missing, no correction is applied.") << std::endl;
@@ -14,8 +14,11 @@ class CalibratorQc : public Calibrator {
       CalibratorQc(Variable::Type iVariable, const Options& iOptions);
       static std::string description();
       std::string name() const {return "qc";};
+      bool isPointwise() const {return true;};
+      std::vector<Variable::Type> getInputVariables() const;
+      std::vector<Variable::Type> getOutputVariables() const;
    private:
-      bool calibrateCore(File& iFile) const;
+      CalibratorKernelPtr getKernel(File& iFile, int iTime) const;
       Variable::Type mVariable;
       float mMin;
       float mMax;
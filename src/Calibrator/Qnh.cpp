@@ -2,39 +2,56 @@
 #include "../Util.h"
 #include "../File/File.h"
 #include <math.h>
-CalibratorQnh::CalibratorQnh() :
-      Calibrator() {
 
+namespace {
+   //! \brief Computes QNH from the pressure in one latitude row. The kernel holds on to the grid,
+   //! such that the elevations stay valid even if the file's elevations are changed later.
+   class QnhKernel : public CalibratorKernel {
+      public:
+         QnhKernel(FieldPtr iPressure, FieldPtr iQnh, GridPtr iGrid) : mPressure(iPressure), mQnh(iQnh), mGrid(iGrid) {};
+         void calibrate(int iI) const {
+            const float* pressure = mPressure->getRow(iI);
+            float* qnh = mQnh->getRow(iI);
+            int nLon = mQnh->getNumLon();
+            if(nLon == 0)
+               return;
+            const float* elevs = &mGrid->getElevs()[mGrid->getIndex(iI, 0)];
+            int nEns = mQnh->getNumEns();
+            const float MV = Util::MV;
+            for(int j = 0; j < nLon; j++) {
+               float currElev = elevs[j];
+               if(!Util::isValidInline(currElev, MV))
+                  continue;
+               int index = j * nEns;
+               for(int e = 0; e < nEns; e++) {
+                  float currPressure = pressure[index + e];
+                  if(Util::isValidInline(currPressure, MV)) {
+                     qnh[index + e] = CalibratorQnh::calcQnh(currElev, currPressure);
+                  }
+               }
+            }
+         };
+      private:
+         FieldPtr mPressure;
+         FieldPtr mQnh;
+         GridPtr mGrid;
+   };
 }
-bool CalibratorQnh::calibrateCore(File& iFile) const {
-   int nLat = iFile.getNumLat();
-   int nLon = iFile.getNumLon();
-   int nEns = iFile.getNumEns();
-   int nTime = iFile.getNumTime();
 
-   vec2 lats  = iFile.getLats();
-   vec2 lons  = iFile.getLons();
-   vec2 elevs = iFile.getElevs();
-
-   // Loop over offsets
-   for(int t = 0; t < nTime; t++) {
-      const Field& input = *iFile.getField(Variable::P, t);
-      Field& output      = *iFile.getField(Variable::QNH, t);
+CalibratorQnh::CalibratorQnh() :
+      Calibrator() {
 
-      #pragma omp parallel for
-      for(int i = 0; i < nLat; i++) {
-         for(int j = 0; j < nLon; j++) {
-            float currElev = elevs[i][j];
-            for(int e = 0; e < nEns; e++) {
-               float currPressure = input(i,j,e);
-               if(Util::isValid(currPressure) && Util::isValid(currElev)) {
-                  output(i,j,e)  = calcQnh(currElev, currPressure);
-               }
-            }
-         }
-      }
-   }
-   return true;
+}
+CalibratorKernelPtr CalibratorQnh::getKernel(File& iFile, int iTime) const {
+   FieldPtr input  = iFile.getField(Variable::P, iTime);
+   FieldPtr output = iFile.getField(Variable::QNH, iTime);
+   return CalibratorKernelPtr(new QnhKernel(input, output, iFile.getGrid()));
+}
+std::vector<Variable::Type> CalibratorQnh::getInputVariables() const {
+   return std::vector<Variable::Type>(1, Variable::P);
+}
+std::vector<Variable::Type> CalibratorQnh::getOutputVariables() const {
+   return std::vector<Variable::Type>(1, Variable::QNH);
 }
 std::string CalibratorQnh::description() {
    std::stringstream ss;
@@ -42,27 +59,5 @@ std::string CalibratorQnh::description() {
    return ss.str();
 }
 float CalibratorQnh::calcQnh(float iElev, float iPressure) {
-   if(iPressure == 0)
-         return 0;
-   else if(Util::isValid(iElev) && Util::isValid(iPressure)) {
-      float g  = 9.80665;   // m/s2
-      float T0 = 288.15;    // K
-      float L  = 0.0065;    // K/m
-      // Method 1:
-      // float dElev = 0 - iElev;
-      // float M  = 0.0289644; // kg/mol
-      // float R  = 8.31447;   // J/(mol•K)
-      // float cp = 1007;      // J/(kg•K)
-      // float constant = -g*M/R/T0;
-      // float qnh = iPressure * pow(1 - L*dElev/T0, g*M/R/L);
-
-      // Method 2: http://www.hochwarth.com/misc/AviationCalculator.html
-      float CRGas = 287.053; // [m^2/(s^2*K)] = [J/(kg*K)]
-      float p0    = 101325;  // pa
-      float qnh   = p0*pow(pow((iPressure/p0), (CRGas*L)/g) + (iElev*L)/T0, g/(CRGas*L));
-      return qnh;
-   }
-   else {
-      return Util::MV;
-   }
+   return Util::calcQnh(iElev, iPressure);
 }
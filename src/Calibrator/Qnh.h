@@ -9,8 +9,11 @@ class CalibratorQnh : public Calibrator {
       CalibratorQnh();
       static std::string description();
       std::string name() const {return "qnh";};
+      bool isPointwise() const {return true;};
+      std::vector<Variable::Type> getInputVariables() const;
+      std::vector<Variable::Type> getOutputVariables() const;
       static float calcQnh(float iElev, float iPressure);
    private:
-      bool calibrateCore(File& iFile) const;
+      CalibratorKernelPtr getKernel(File& iFile, int iTime) const;
 };
 #endif
@@ -1,9 +1,60 @@
 #include "Regression.h"
-#include <cmath>
+#include <algorithm>
 #include "../Util.h"
 #include "../File/File.h"
 #include "../ParameterFile.h"
 #include "../Downscaler/Pressure.h"
+
+namespace {
+   //! Number of values that the regression polynomial is evaluated for together
+   const int blockSize = 256;
+
+   //! Applies the regression polynomial to the values in one latitude row
+   class RegressionKernel : public CalibratorKernel {
+      public:
+         RegressionKernel(FieldPtr iField, const Parameters& iParameters) : mField(iField), mValid(iParameters.isValid()) {
+            // The coefficients are the same for all gridpoints, so check them once here. A
+            // polynomial without coefficients is 0.
+            mCoefficients = iParameters.getValues();
+            if(mCoefficients.size() == 0)
+               mCoefficients.push_back(0);
+         };
+         void calibrate(int iI) const {
+            float* values = mField->getRow(iI);
+            int n = mField->getNumLon() * mField->getNumEns();
+            if(!mValid) {
+               for(int k = 0; k < n; k++)
+                  values[k] = Util::MV;
+               return;
+            }
+            const float* coeffs = &mCoefficients[0];
+            int last = mCoefficients.size() - 1;
+            const float MV = Util::MV;
+            // Evaluate a + b * fcst + c * fcst^2 ... with Horner's method, one block of the row at a
+            // time. Each Horner step is applied to the whole block, such that the inner loops have
+            // no branches or function calls and can be vectorized.
+            float total[blockSize];
+            for(int start = 0; start < n; start += blockSize) {
+               float* block = values + start;
+               int size = std::min(blockSize, n - start);
+               for(int k = 0; k < size; k++)
+                  total[k] = coeffs[last];
+               for(int p = last-1; p >= 0; p--) {
+                  float coeff = coeffs[p];
+                  for(int k = 0; k < size; k++)
+                     total[k] = total[k] * block[k] + coeff;
+               }
+               for(int k = 0; k < size; k++)
+                  block[k] = Util::isValidInline(block[k], MV) ? total[k] : MV;
+            }
+         };
+      private:
+         FieldPtr mField;
+         std::vector<float> mCoefficients;
+         bool mValid;
+   };
+}
+
 CalibratorRegression::CalibratorRegression(const ParameterFile* iParameterFile, Variable::Type iVariable) :
       Calibrator(),
       mVariable(iVariable),
@@ -12,45 +63,18 @@ CalibratorRegression::CalibratorRegression(const ParameterFile* iParameterFile,
       Util::error("Parameter file '" + iParameterFile->getFilename() + "' must have at least one datacolumns");
    }
 }
-bool CalibratorRegression::calibrateCore(File& iFile) const {
-   int nLat = iFile.getNumLat();
-   int nLon = iFile.getNumLon();
-   int nEns = iFile.getNumEns();
-   int nTime = iFile.getNumTime();
-   vec2 elevs = iFile.getElevs();
-
-   // Loop over offsets
-   for(int t = 0; t < nTime; t++) {
-      const Parameters& par = mParameterFile->getParameters(t);
-      const FieldPtr field = iFile.getField(mVariable, t);
-
-      #pragma omp parallel for
-      for(int i = 0; i < nLat; i++) {
-         for(int j = 0; j < nLon; j++) {
-            for(int e = 0; e < nEns; e++) {
-               if(Util::isValid((*field)(i,j,e))) {
-                  float total = 0;
-                  // Accumulate a + b * fcst + c * fcst^2 ...
-                  for(int p = 0; p < par.size(); p++) {
-                     float coeff = par[p];
-                     if(!Util::isValid(coeff)) {
-                        total = Util::MV;
-                        break;
-                     }
-                     total += coeff*pow((*field)(i,j,e), p);
-                  }
-                  (*field)(i,j,e)  = total;
-               }
-               else {
-                  (*field)(i,j,e)  = Util::MV;
-               }
-            }
-         }
-      }
-   }
-   return true;
+CalibratorKernelPtr CalibratorRegression::getKernel(File& iFile, int iTime) const {
+   const Parameters& par = mParameterFile->getParameters(iTime);
+   FieldPtr field = iFile.getField(mVariable, iTime);
+   return CalibratorKernelPtr(new RegressionKernel(field, par));
 }
 
+std::vector<Variable::Type> CalibratorRegression::getInputVariables() const {
+   return std::vector<Variable::Type>(1, mVariable);
+}
+std::vector<Variable::Type> CalibratorRegression::getOutputVariables() const {
+   return std::vector<Variable::Type>(1, mVariable);
+}
 std::string CalibratorRegression::description() {
    std::stringstream ss;
    ss << Util::formatDescription("-c regression", "Applies polynomial regression equation to forecasts: newForecast = a + b * forecast + c * forecast^2 ... ") << std::endl;
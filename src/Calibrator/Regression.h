@@ -9,8 +9,11 @@ class CalibratorRegression : public Calibrator {
       CalibratorRegression(const ParameterFile* iParameterFile, Variable::Type iVariable);
       static std::string description();
       std::string name() const {return "regression";};
+      bool isPointwise() const {return true;};
+      std::vector<Variable::Type> getInputVariables() const;
+      std::vector<Variable::Type> getOutputVariables() const;
    private:
-      bool calibrateCore(File& iFile) const;
+      CalibratorKernelPtr getKernel(File& iFile, int iTime) const;
       const ParameterFile* mParameterFile;
       Variable::Type mVariable;
 };
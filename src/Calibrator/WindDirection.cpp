@@ -6,6 +6,43 @@
 #include "../File/File.h"
 #include "../ParameterFile.h"
 #include "../Parameters.h"
+
+namespace {
+   //! Scales the wind in one latitude row by a factor depending on the wind direction
+   class WindDirectionKernel : public CalibratorKernel {
+      public:
+         WindDirectionKernel(FieldPtr iWind, FieldPtr iDirection, const Parameters& iParameters) :
+               mWind(iWind), mDirection(iDirection), mValid(iParameters.isValid()), mCoefficients(iParameters.getValues()) {
+         };
+         void calibrate(int iI) const {
+            float* wind = mWind->getRow(iI);
+            const float* direction = mDirection->getRow(iI);
+            int n = mWind->getNumLon() * mWind->getNumEns();
+            if(!mValid) {
+               for(int k = 0; k < n; k++)
+                  wind[k] = Util::MV;
+               return;
+            }
+            const float* coeffs = &mCoefficients[0];
+            const float MV = Util::MV;
+            // Each member has its own direction. Check it before computing the factor, such that
+            // no sine and cosine are computed for missing values.
+            for(int k = 0; k < n; k++) {
+               float currDirection = direction[k];
+               float currWind = wind[k];
+               bool isValid = Util::isValidInline(currDirection, MV) && Util::isValidInline(currWind, MV);
+               wind[k] = isValid ? CalibratorWindDirection::getFactor(currDirection, coeffs) * currWind : MV;
+            }
+         };
+      private:
+         FieldPtr mWind;
+         FieldPtr mDirection;
+         //! The parameters are the same for all gridpoints, so check them once
+         bool mValid;
+         std::vector<float> mCoefficients;
+   };
+}
+
 CalibratorWindDirection::CalibratorWindDirection(const ParameterFile* iParameterFile, Variable::Type iVariable):
       Calibrator(),
       mVariable(iVariable),
@@ -16,33 +53,23 @@ CalibratorWindDirection::CalibratorWindDirection(const ParameterFile* iParameter
    }
 }
 
-bool CalibratorWindDirection::calibrateCore(File& iFile) const {
-   int nLat = iFile.getNumLat();
-   int nLon = iFile.getNumLon();
-   int nEns = iFile.getNumEns();
-   int nTime = iFile.getNumTime();
-
-   // Loop over offsets
-   for(int t = 0; t < nTime; t++) {
-      Field& wind      = *iFile.getField(mVariable, t);
-      Field& direction = *iFile.getField(Variable::WD, t);
-
-      Parameters parameters = mParameterFile->getParameters(t);
+CalibratorKernelPtr CalibratorWindDirection::getKernel(File& iFile, int iTime) const {
+   FieldPtr wind      = iFile.getField(mVariable, iTime);
+   FieldPtr direction = iFile.getField(Variable::WD, iTime);
 
-      #pragma omp parallel for
-      for(int i = 0; i < nLat; i++) {
-         for(int j = 0; j < nLon; j++) {
-            for(int e = 0; e < nEns; e++) {
-               float currDirection = direction(i,j,e);
-               float factor = getFactor(currDirection, parameters);
-               wind(i,j,e) = factor*wind(i,j,e);
-            }
-         }
-      }
-   }
-   return true;
+   Parameters parameters = mParameterFile->getParameters(iTime);
+   return CalibratorKernelPtr(new WindDirectionKernel(wind, direction, parameters));
 }
 
+std::vector<Variable::Type> CalibratorWindDirection::getInputVariables() const {
+   std::vector<Variable::Type> variables;
+   variables.push_back(mVariable);
+   variables.push_back(Variable::WD);
+   return variables;
+}
+std::vector<Variable::Type> CalibratorWindDirection::getOutputVariables() const {
+   return std::vector<Variable::Type>(1, mVariable);
+}
 std::string CalibratorWindDirection::description() {
    std::stringstream ss;
    ss << Util::formatDescription("-c windDirection", "Multiply a variable by a factor based on the wind-direction:") << std::endl;
@@ -59,17 +86,33 @@ std::string CalibratorWindDirection::description() {
 float CalibratorWindDirection::getFactor(float iWindDirection, const Parameters& iPar) {
    if(!Util::isValid(iWindDirection) || !iPar.isValid())
       return Util::MV;
-   float dir = Util::deg2rad(iWindDirection);
-   float factor = 1;
-   factor = iPar[0] +
-            iPar[1] * sin(dir) +
-            iPar[2] * cos(dir) +
-            iPar[3] * sin(2*dir) +
-            iPar[4] * cos(2*dir) +
-            iPar[5] * sin(3*dir) +
-            iPar[6] * cos(3*dir) +
-            iPar[7] * sin(4*dir) +
-            iPar[8] * cos(4*dir);
+   std::vector<float> coefficients = iPar.getValues();
+   return getFactor(iWindDirection, &coefficients[0]);
+}
+
+float CalibratorWindDirection::getFactor(float iWindDirection, const float* iCoefficients) {
+   double dir = Util::deg2rad(iWindDirection);
+   // Compute the multiple angles with the Chebyshev recurrences
+   //    cos((n+1)x) = 2 cos(x) cos(nx) - cos((n-1)x)
+   //    sin((n+1)x) = 2 cos(x) sin(nx) - sin((n-1)x)
+   // such that only one sine and cosine are needed
+   double s1 = sin(dir);
+   double c1 = cos(dir);
+   double s2 = 2 * c1 * s1;
+   double c2 = 2 * c1 * c1 - 1;
+   double s3 = 2 * c1 * s2 - s1;
+   double c3 = 2 * c1 * c2 - c1;
+   double s4 = 2 * c1 * s3 - s2;
+   double c4 = 2 * c1 * c3 - c2;
+   float factor = iCoefficients[0] +
+                  iCoefficients[1] * s1 +
+                  iCoefficients[2] * c1 +
+                  iCoefficients[3] * s2 +
+                  iCoefficients[4] * c2 +
+                  iCoefficients[5] * s3 +
+                  iCoefficients[6] * c3 +
+                  iCoefficients[7] * s4 +
+                  iCoefficients[8] * c4;
    if(factor < 0)
       factor = 0;
    return factor;
@@ -14,11 +14,18 @@ class CalibratorWindDirection : public Calibrator {
       CalibratorWindDirection(const ParameterFile* iParameterFile, Variable::Type iVariable);
       static std::string description();
       std::string name() const {return "windDirection";};
+      bool isPointwise() const {return true;};
+      std::vector<Variable::Type> getInputVariables() const;
+      std::vector<Variable::Type> getOutputVariables() const;
       //! Get multiplication factor for given wind direction
       //! @param iWindDirection in degrees, meteorological wind direction (0 degrees is from North)
       static float getFactor(float iWindDirection, const Parameters& iPar);
+      //! \brief Same as above, but without checking the inputs
+      //! @param iWindDirection must be valid
+      //! @param iCoefficients the 9 parameters, which must be valid
+      static float getFactor(float iWindDirection, const float* iCoefficients);
    private:
-      bool calibrateCore(File& iFile) const;
+      CalibratorKernelPtr getKernel(File& iFile, int iTime) const;
       Variable::Type mVariable;
       const ParameterFile* mParameterFile;
 };
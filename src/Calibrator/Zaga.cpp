@@ -1,37 +1,52 @@
 #include "Zaga.h"
 #include <algorithm>
+#include <limits>
 #include <math.h>
 #include <boost/math/distributions/gamma.hpp>
+#include <boost/math/special_functions/erf.hpp>
+#include <boost/math/special_functions/gamma.hpp>
 #include "../Util.h"
 #include "../File/File.h"
 #include "../ParameterFile.h"
 #include "../Parameters.h"
+
+namespace {
+   // The default policy evaluates double precision functions in long double, which is several
+   // times slower and not needed when iterating to a given accuracy
+   typedef boost::math::policies::policy<boost::math::policies::promote_double<false> > FastPolicy;
+}
 const float CalibratorZaga::mMaxEnsMean = 100;
 CalibratorZaga::CalibratorZaga(const ParameterFile* iParameterFile, Variable::Type iMainPredictor):
       Calibrator(),
       mParameterFile(iParameterFile),
       mMainPredictor(iMainPredictor),
-      mFracThreshold(0.5) {
+      mFracThreshold(0.5),
+      mAccuracy(0) {
 }
 
-bool CalibratorZaga::calibrateCore(File& iFile) const {
+bool CalibratorZaga::calibrateCore(File& iFile, int iTime) const {
    int nLat = iFile.getNumLat();
    int nLon = iFile.getNumLon();
    int nEns = iFile.getNumEns();
-   int nTime = iFile.getNumTime();
+   if(nEns == 0)
+      return true;
 
    int numInvalidRaw = 0;
    int numInvalidCal = 0;
 
-   // Loop over offsets
-   for(int t = 0; t < nTime; t++) {
-      Parameters parameters = mParameterFile->getParameters(t);
-      Field& precip = *iFile.getField(Variable::Precip, t);
+   Parameters parameters = mParameterFile->getParameters(iTime);
+   Field& precip = *iFile.getField(Variable::Precip, iTime);
 
-      #pragma omp parallel for
+   #pragma omp parallel reduction(+:numInvalidRaw, numInvalidCal)
+   {
+      // Work space for each thread, reused for all gridpoints such that the loop does not allocate
+      std::vector<float> precipCal(nEns);
+      std::vector<std::pair<float,int> > pairs(nEns);
+      std::vector<float> values(nEns);
+      #pragma omp for
       for(int i = 0; i < nLat; i++) {
          for(int j = 0; j < nLon; j++) {
-            std::vector<float> precipRaw = precip(i,j);
+            float* ens = precip.getEnsemble(i,j);
 
             // Compute model variables
             float ensMean = 0;
@@ -41,7 +56,7 @@ bool CalibratorZaga::calibrateCore(File& iFile) const {
             // Check if current ensemble for this gridpoint/time has any missing
             // values. If so, don't calibrate the ensemble.
             for(int e = 0; e < nEns; e++) {
-               float value = precipRaw[e];
+               float value = ens[e];
                if(!Util::isValid(value)) {
                   isValid = false;
                   break;
@@ -60,37 +75,30 @@ bool CalibratorZaga::calibrateCore(File& iFile) const {
                   ensMean = mMaxEnsMean;
                }
 
-               // Calibrate
-               std::vector<std::pair<float,int> > pairs(nEns);
-               std::vector<float> valuesCal(nEns);
+               // Calibrate. The distribution is the same for all members.
+               float P0, shape, scale;
+               getDistribution(ensMean, ensFrac, parameters, P0, shape, scale);
                for(int e = 0; e < nEns; e++) {
                   float quantile = ((float) e+0.5)/nEns;
-                  float valueCal   = getInvCdf(quantile, ensMean, ensFrac, parameters);
-                  precip(i,j,e) = valueCal;
+                  float valueCal   = getQuantile(quantile, P0, shape, scale, mAccuracy);
+                  precipCal[e] = valueCal;
                   if(!Util::isValid(valueCal))
                      isValid = false;
                }
                if(isValid) {
-                  std::vector<float> precipCal = precip(i,j);
-                  Calibrator::shuffle(precipRaw, precipCal);
+                  Calibrator::shuffle(ens, &precipCal[0], nEns, pairs, values);
                   for(int e = 0; e < nEns; e++) {
-                     precip(i,j,e) = precipCal[e];
+                     ens[e] = precipCal[e];
                   }
                }
                else {
                   numInvalidCal++;
-                  // Calibrator produced some invalid members. Revert to the raw values.
-                  for(int e = 0; e < nEns; e++) {
-                     precip(i,j,e) = precipRaw[e];
-                  }
+                  // Calibrator produced some invalid members. Keep the raw values.
                }
             }
             else {
                numInvalidRaw++;
                // One or more members are missing, don't calibrate
-               for(int e = 0; e < nEns; e++) {
-                  precip(i,j,e) = precipRaw[e];
-               }
             }
          }
       }
@@ -98,19 +106,22 @@ bool CalibratorZaga::calibrateCore(File& iFile) const {
    if(numInvalidRaw > 0) {
       std::stringstream ss;
       ss << "File '" << iFile.getFilename() << "' has " << numInvalidRaw
-         << " missing ensembles, out of " << nTime * nLat * nLon << ".";
+         << " missing ensembles, out of " << nLat * nLon << " for time " << iTime << ".";
       Util::warning(ss.str());
    }
    if(numInvalidCal > 0) {
       std::stringstream ss;
       ss << "Calibrator produced " << numInvalidCal
-         << " invalid ensembles, out of " << nTime * nLat * nLon << ".";
+         << " invalid ensembles, out of " << nLat * nLon << " for time " << iTime << ".";
       Util::warning(ss.str());
    }
    return true;
 }
 
 float CalibratorZaga::getInvCdf(float iQuantile, float iEnsMean, float iEnsFrac, Parameters& iParameters) {
+   return getInvCdf(iQuantile, iEnsMean, iEnsFrac, iParameters, 0);
+}
+float CalibratorZaga::getInvCdf(float iQuantile, float iEnsMean, float iEnsFrac, Parameters& iParameters, float iAccuracy) {
    if(iQuantile < 0 || iQuantile >= 1) {
       Util::warning("Quantile must be in the interval [0,1)");
       return Util::MV;
@@ -130,41 +141,114 @@ float CalibratorZaga::getInvCdf(float iQuantile, float iEnsMean, float iEnsFrac,
    if(iQuantile == 0)
       return 0;
 
-   // Check if we are in the discrete mass
-   float P0 = getP0(iEnsMean, iEnsFrac, iParameters);
-   if(!Util::isValid(P0))
-      return Util::MV;
-   if(iQuantile < P0)
-      return 0;
+   float P0, shape, scale;
+   getDistribution(iEnsMean, iEnsFrac, iParameters, P0, shape, scale);
+   return getQuantile(iQuantile, P0, shape, scale, iAccuracy);
+}
+
+void CalibratorZaga::getDistribution(float iEnsMean, float iEnsFrac, Parameters& iParameters, float& iP0, float& iShape, float& iScale) {
+   iShape = Util::MV;
+   iScale = Util::MV;
+   iP0 = getP0(iEnsMean, iEnsFrac, iParameters);
+   if(!Util::isValid(iP0))
+      return;
 
    float mua = iParameters[0];
    float mub = iParameters[1];
    float sa  = iParameters[2];
    float sb  = iParameters[3];
 
-   float quantileCont = (iQuantile-P0)/(1-P0);
    // Compute parameters of distribution (in same way as done in gamlss in R)
    float mu    = exp(mua + mub * pow(iEnsMean, 1.0/3));
    float sigma = exp(sa + sb * iEnsMean);
 
    if(mu <= 0 || sigma <= 0)
-      return Util::MV;
+      return;
    if(!Util::isValid(mu) || !Util::isValid(sigma))
-      return Util::MV;
+      return;
 
    // Parameters in boost and wikipedia
    float shape = 1/(sigma*sigma); // k
    float scale = sigma*sigma*mu;  // theta
    if(!Util::isValid(scale) || !Util::isValid(shape))
+      return;
+   iShape = shape;
+   iScale = scale;
+}
+
+float CalibratorZaga::getQuantile(float iQuantile, float iP0, float iShape, float iScale, float iAccuracy) {
+   // Check if we are in the discrete mass
+   if(!Util::isValid(iP0))
+      return Util::MV;
+   if(iQuantile < iP0)
+      return 0;
+   if(!Util::isValid(iShape) || !Util::isValid(iScale))
       return Util::MV;
 
-   // std::cout << mu << " " << sigma << " " << P0 << " " << shape << " " << scale << std::endl;
-   boost::math::gamma_distribution<> dist(shape, scale);
-   float value = boost::math::quantile(dist, quantileCont);
+   float quantileCont = (iQuantile-iP0)/(1-iP0);
+   float value = getGammaQuantile(quantileCont, iShape, iScale, iAccuracy);
    if(!Util::isValid(value))
       return Util::MV;
    return value;
 }
+
+float CalibratorZaga::getGammaQuantile(float iQuantile, float iShape, float iScale, float iAccuracy) {
+   if(iAccuracy <= 0 || iQuantile <= 0 || iQuantile >= 1) {
+      boost::math::gamma_distribution<> dist(iShape, iScale);
+      return boost::math::quantile(dist, iQuantile);
+   }
+
+   // Work with the standardized distribution (scale 1) in y = log(x), where the CDF is smooth and
+   // monotonic and Newton steps give relative changes in x.
+   double k = iShape;
+   double q = iQuantile;
+   double lgammaK = boost::math::lgamma(k, FastPolicy());
+
+   // Initial guess from the Wilson-Hilferty approximation. In the lower tail and for small shapes,
+   // use CDF(x) ~ x^k / Gamma(k+1) instead.
+   double z = -sqrt(2.0) * boost::math::erfc_inv(2*q, FastPolicy());
+   double c = 1 / (9*k);
+   double cube = 1 - c + z * sqrt(c);
+   double x = k * cube * cube * cube;
+   if(x <= 0 || k < 1) {
+      double xSmall = exp((log(q) + boost::math::lgamma(k+1, FastPolicy())) / k);
+      if(x <= 0 || xSmall < x)
+         x = xSmall;
+   }
+   if(!(x > 0) || !Util::isValid(x)) {
+      return getGammaQuantile(iQuantile, iShape, iScale, 0);
+   }
+
+   // Safeguarded Newton: keep track of an interval [lower, upper] containing the solution and
+   // bisect whenever a step leaves it.
+   double y = log(x);
+   double lower = -std::numeric_limits<double>::infinity();
+   double upper = std::numeric_limits<double>::infinity();
+   const int maxIterations = 50;
+   for(int it = 0; it < maxIterations; it++) {
+      double xCurr = exp(y);
+      double diff = boost::math::gamma_p(k, xCurr, FastPolicy()) - q;
+      if(diff < 0)
+         lower = y;
+      else
+         upper = y;
+      // dCDF/dy = pdf(x) * x
+      double deriv = exp(k*y - xCurr - lgammaK);
+      double yNew = y - diff / deriv;
+      if(!(yNew > lower && yNew < upper)) {
+         if(lower > -std::numeric_limits<double>::infinity() && upper < std::numeric_limits<double>::infinity())
+            yNew = (lower + upper) / 2;
+         else
+            yNew = diff < 0 ? y + 1 : y - 1;
+      }
+      if(fabs(yNew - y) < iAccuracy)
+         return exp(yNew) * iScale;
+      y = yNew;
+   }
+
+   // Did not converge
+   return getGammaQuantile(iQuantile, iShape, iScale, 0);
+}
 float CalibratorZaga::getP0(float iEnsMean, float iEnsFrac, Parameters& iParameters) {
    if(!Util::isValid(iEnsMean) || !Util::isValid(iEnsFrac) || iEnsMean < 0 || iEnsFrac < 0 || iEnsFrac > 1)
       return Util::MV;
@@ -189,7 +273,21 @@ void CalibratorZaga::setFracThreshold(float iFraction) {
    }
    mFracThreshold = iFraction;
 }
+void CalibratorZaga::setAccuracy(float iAccuracy) {
+   if(!Util::isValid(iAccuracy) || iAccuracy < 0 || iAccuracy >= 1) {
+      std::stringstream ss;
+      ss << "CalibratorZaga: accuracy (" << iAccuracy << ") must be in the interval [0,1).";
+      Util::error(ss.str());
+   }
+   mAccuracy = iAccuracy;
+}
 
+std::vector<Variable::Type> CalibratorZaga::getInputVariables() const {
+   return std::vector<Variable::Type>(1, Variable::Precip);
+}
+std::vector<Variable::Type> CalibratorZaga::getOutputVariables() const {
+   return std::vector<Variable::Type>(1, Variable::Precip);
+}
 std::string CalibratorZaga::description() {
    std::stringstream ss;
    ss << Util::formatDescription("-c zaga", "Calibrates an ensemble using a zero-adjusted gamma distribution, suitable for parameters like precip and precip. The distribution has three parameters:") << std::endl;
@@ -203,5 +301,6 @@ std::string CalibratorZaga::description() {
    ss << Util::formatDescription("", "offsetN a b c d e f g h") << std::endl;
    ss << Util::formatDescription("", "If the file only has a single line, then the same set of parameters are used for all offsets.") << std::endl;
    ss << Util::formatDescription("   fracThreshold=0.5", "Threshold defining precip/no-precip boundary when computing fraction of members with precip.") << std::endl;
+   ss << Util::formatDescription("   accuracy=0", "Relative accuracy of the calibrated amounts. Use 0 for full precision, or e.g. 0.001 for faster calibration.") << std::endl;
    return ss.str();
 }
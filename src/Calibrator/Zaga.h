@@ -19,20 +19,40 @@ class CalibratorZaga : public Calibrator {
       //! Get Precipitation amount corresponding to quantile
       //! If any input has missing values, the end result is missing
       static float getInvCdf(float iQuantile, float iEnsMean, float iEnsFrac, Parameters& iParameters);
+      //! Same as above, but computes the gamma quantile with the given relative accuracy (see
+      //! getGammaQuantile)
+      static float getInvCdf(float iQuantile, float iEnsMean, float iEnsFrac, Parameters& iParameters, float iAccuracy);
+      //! \brief Get the quantile of a gamma distribution
+      //! @param iAccuracy If 0, use boost's quantile function. Otherwise solve CDF(x) = iQuantile
+      //! with Newton iterations in log(x), starting from the Wilson-Hilferty approximation, and stop
+      //! when the relative change in x is less than iAccuracy.
+      static float getGammaQuantile(float iQuantile, float iShape, float iScale, float iAccuracy=0);
       //! Set threshold between precip/no-precip used when computing what fraction of
       //! members have precip.
       //! @param must be valid and >= 0
       void setFracThreshold(float iFraction);
       float getFracThreshold() {return mFracThreshold;};
+      //! \brief Set the relative accuracy of the calibrated amounts
+      //! @param iAccuracy 0 gives full precision. Must be valid and in [0,1).
+      void setAccuracy(float iAccuracy);
+      float getAccuracy() const {return mAccuracy;};
 
       static std::string description();
       std::string name() const {return "zaga";};
+      std::vector<Variable::Type> getInputVariables() const;
+      std::vector<Variable::Type> getOutputVariables() const;
    private:
       const ParameterFile* mParameterFile;
-      bool calibrateCore(File& iFile) const;
+      bool calibrateCore(File& iFile, int iTime) const;
+      //! \brief Compute the parameters of the distribution for one gridpoint. P0 is missing if the
+      //! inputs are invalid. Shape and scale are missing if the continuous part is invalid.
+      static void getDistribution(float iEnsMean, float iEnsFrac, Parameters& iParameters, float& iP0, float& iShape, float& iScale);
+      //! Get the quantile of the distribution with the parameters from getDistribution
+      static float getQuantile(float iQuantile, float iP0, float iShape, float iScale, float iAccuracy);
       static const float mMaxEnsMean;
       //! What precip threshold should be used to count members with no precip?
       float mFracThreshold;
+      float mAccuracy;
       Variable::Type mMainPredictor;
 };
 #endif
@@ -0,0 +1,159 @@
+#include "Bilinear.h"
+#include "../File/File.h"
+#include "../Util.h"
+#include <math.h>
+
+DownscalerBilinear::DownscalerBilinear(Variable::Type iVariable) :
+      Downscaler(iVariable) {
+}
+
+std::string DownscalerBilinear::getOperatorType(const File& iInput, const File& iOutput) const {
+   // Only depends on the latitudes and longitudes of the grids
+   return name();
+}
+
+DownscalingOperatorPtr DownscalerBilinear::buildOperator(const File& iInput, const File& iOutput) const {
+   int nLat = iOutput.getNumLat();
+   int nLon = iOutput.getNumLon();
+   int nInLat = iInput.getNumLat();
+   int nInLon = iInput.getNumLon();
+
+   const vec2& ilats = iInput.getLats();
+   const vec2& ilons = iInput.getLons();
+   const vec2& olats = iOutput.getLats();
+   const vec2& olons = iOutput.getLons();
+
+   NeighbourTablePtr nearest = getNearestNeighbourTable(iInput, iOutput);
+   const vec2Int& nearestI = nearest->first;
+   const vec2Int& nearestJ = nearest->second;
+
+   // Compute the rows in parallel, and add them to the operator in order afterwards
+   int N = nLat * nLon;
+   std::vector<std::vector<int> > indices(N);
+   std::vector<std::vector<float> > weights(N);
+   #pragma omp parallel for
+   for(int i = 0; i < nLat; i++) {
+      for(int j = 0; j < nLon; j++) {
+         int p = i*nLon + j;
+         int I = nearestI[i][j];
+         int J = nearestJ[i][j];
+         if(!Util::isValid(I) || !Util::isValid(J))
+            continue;
+
+         float lat = olats[i][j];
+         float lon = olons[i][j];
+         float cosLat = cos(Util::deg2rad(lat));
+         // Check the four cells that have the nearest neighbour as a corner
+         bool found = false;
+         for(int di = -1; di <= 1 && !found; di += 2) {
+            for(int dj = -1; dj <= 1 && !found; dj += 2) {
+               int cornersI[4] = {I, I, I+di, I+di};
+               int cornersJ[4] = {J, J+dj, J, J+dj};
+               if(I+di < 0 || I+di >= nInLat || J+dj < 0 || J+dj >= nInLon)
+                  continue;
+
+               // Local planar coordinates centered on the lookup point
+               float cornersX[4];
+               float cornersY[4];
+               bool isValid = true;
+               for(int k = 0; k < 4; k++) {
+                  float clat = ilats[cornersI[k]][cornersJ[k]];
+                  float clon = ilons[cornersI[k]][cornersJ[k]];
+                  if(!Util::isValid(clat) || !Util::isValid(clon)) {
+                     isValid = false;
+                     break;
+                  }
+                  float dlon = clon - lon;
+                  if(dlon > 180)
+                     dlon -= 360;
+                  else if(dlon < -180)
+                     dlon += 360;
+                  cornersX[k] = dlon * cosLat;
+                  cornersY[k] = clat - lat;
+               }
+               float s, t;
+               if(isValid && calcParameters(0, 0, cornersX, cornersY, s, t)) {
+                  float cornerWeights[4] = {(1-s)*(1-t), s*(1-t), (1-s)*t, s*t};
+                  for(int k = 0; k < 4; k++) {
+                     if(cornerWeights[k] != 0) {
+                        indices[p].push_back(cornersI[k]*nInLon + cornersJ[k]);
+                        weights[p].push_back(cornerWeights[k]);
+                     }
+                  }
+                  found = true;
+               }
+            }
+         }
+         if(!found) {
+            // Outside the grid, use the nearest neighbour
+            indices[p].push_back(I*nInLon + J);
+            weights[p].push_back(1);
+         }
+      }
+   }
+
+   boost::shared_ptr<DownscalingOperator> op(new DownscalingOperator(nInLat*nInLon));
+   for(int p = 0; p < N; p++) {
+      op->addRow(indices[p], weights[p]);
+   }
+   return op;
+}
+
+bool DownscalerBilinear::calcParameters(float iX, float iY, const float iCornersX[4], const float iCornersY[4], float& iS, float& iT) {
+   // Solve P = P0 + e*s + f*t + g*s*t for s and t
+   double ex = iCornersX[1] - iCornersX[0];
+   double ey = iCornersY[1] - iCornersY[0];
+   double fx = iCornersX[2] - iCornersX[0];
+   double fy = iCornersY[2] - iCornersY[0];
+   double gx = iCornersX[0] - iCornersX[1] - iCornersX[2] + iCornersX[3];
+   double gy = iCornersY[0] - iCornersY[1] - iCornersY[2] + iCornersY[3];
+   double hx = iX - iCornersX[0];
+   double hy = iY - iCornersY[0];
+
+   // Eliminating s gives a quadratic equation in t
+   double k2 = gx*fy - gy*fx;
+   double k1 = ex*fy - ey*fx + hx*gy - hy*gx;
+   double k0 = hx*ey - hy*ex;
+
+   // Points within this distance (relative to the cell size) of the cell are accepted
+   const double tolerance = 1e-5;
+   double area = fabs(ex*fy - ey*fx);
+   if(area == 0)
+      return false;
+
+   double t = Util::MV;
+   if(fabs(k2) <= 1e-9 * area) {
+      // Parallelogram, or trapezoid with parallel sides along s
+      if(k1 == 0)
+         return false;
+      t = -k0 / k1;
+   }
+   else {
+      double discriminant = k1*k1 - 4*k0*k2;
+      if(discriminant < 0)
+         return false;
+      double root = sqrt(discriminant);
+      double t1 = (-k1 - root) / (2*k2);
+      double t2 = (-k1 + root) / (2*k2);
+      t = (t1 >= -tolerance && t1 <= 1+tolerance) ? t1 : t2;
+   }
+   if(t < -tolerance || t > 1+tolerance)
+      return false;
+
+   // Use the component where the denominator is largest
+   double denomX = ex + gx*t;
+   double denomY = ey + gy*t;
+   double s = fabs(denomX) > fabs(denomY) ? (hx - fx*t) / denomX : (hy - fy*t) / denomY;
+   if(!(s >= -tolerance && s <= 1+tolerance))
+      return false;
+
+   iS = std::max(0.0, std::min(1.0, s));
+   iT = std::max(0.0, std::min(1.0, t));
+   return true;
+}
+
+std::string DownscalerBilinear::description() {
+   std::stringstream ss;
+   ss << Util::formatDescription("-d bilinear", "Bilinear interpolation between the four input gridpoints surrounding the lookup point. Uses the nearest neighbour when the lookup point is outside the input grid.") << std::endl;
+   return ss.str();
+}
@@ -0,0 +1,27 @@
+#ifndef DOWNSCALER_BILINEAR_H
+#define DOWNSCALER_BILINEAR_H
+#include "Downscaler.h"
+#include "../Variable.h"
+#include "../Util.h"
+typedef std::vector<std::vector<int> > vec2Int;
+
+//! Bilinear interpolation between the four input gridpoints surrounding the lookup point. Works on
+//! curvilinear grids, by searching the four grid cells around the nearest neighbour for the cell
+//! containing the lookup point. Uses the nearest neighbour when the lookup point is outside the grid.
+class DownscalerBilinear : public Downscaler {
+   public:
+      DownscalerBilinear(Variable::Type iVariable);
+      static std::string description();
+      std::string name() const {return "bilinear";};
+
+      //! \brief Compute the position of a point inside a quadrilateral, such that
+      //! P = (1-s)(1-t)*P0 + s(1-t)*P1 + (1-s)t*P2 + st*P3
+      //! Corners are in planar coordinates (x, y), ordered so that P1 is next to P0 along s, P2 is
+      //! next to P0 along t, and P3 is opposite to P0.
+      //! @return false if the point is not inside the quadrilateral
+      static bool calcParameters(float iX, float iY, const float iCornersX[4], const float iCornersY[4], float& iS, float& iT);
+   private:
+      std::string getOperatorType(const File& iInput, const File& iOutput) const;
+      DownscalingOperatorPtr buildOperator(const File& iInput, const File& iOutput) const;
+};
+#endif
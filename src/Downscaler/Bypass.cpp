@@ -7,7 +7,7 @@ DownscalerBypass::DownscalerBypass(Variable::Type iVariable) :
       Downscaler(iVariable) {
 }
 
-void DownscalerBypass::downscaleCore(const File& iInput, File& iOutput) const {
+void DownscalerBypass::downscaleCore(const File& iInput, File& iOutput, int iTime) const {
 }
 
 std::string DownscalerBypass::description() {
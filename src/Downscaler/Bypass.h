@@ -12,6 +12,6 @@ class DownscalerBypass : public Downscaler {
       static std::string description();
       std::string name() const {return "bypass";};
    private:
-      void downscaleCore(const File& iInput, File& iOutput) const;
+      void downscaleCore(const File& iInput, File& iOutput, int iTime) const;
 };
 #endif
@@ -1,8 +1,25 @@
 #include "Downscaler.h"
 #include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <unistd.h>
+#include <boost/cstdint.hpp>
 #include "../File/File.h"
+#include "../KDTree.h"
 
-std::map<boost::uuids::uuid, std::map<boost::uuids::uuid, std::pair<vec2Int, vec2Int> > > Downscaler::mNeighbourCache;
+namespace {
+   // Header of neighbour cache files: magic, version, nLat, nLon
+   const boost::int32_t cacheMagic = 0x4e505047; // "GPPN"
+   const boost::int32_t cacheVersion = 2;
+}
+
+std::map<boost::uint64_t, std::map<boost::uint64_t, NeighbourTablePtr> > Downscaler::mNeighbourCache;
+std::map<boost::uint64_t, boost::shared_ptr<KDTree> > Downscaler::mTreeCache;
+std::map<std::string, DownscalingOperatorPtr> Downscaler::mOperatorCache;
+std::string Downscaler::mCacheDirectory = "";
+std::set<Downscaler::CacheClearer> Downscaler::mCacheClearers;
 
 Downscaler::Downscaler(Variable::Type iVariable) :
       mVariable(iVariable) {
@@ -12,10 +29,111 @@ bool Downscaler::downscale(const File& iInput, File& iOutput) const {
    if(iInput.getNumTime() != iOutput.getNumTime())
       return false;
 
-   downscaleCore(iInput, iOutput);
+   // Apply the operator to several timesteps at once. Fields in use cannot be removed from the
+   // cache, so only fetch as many input timesteps as fit in the input's cache.
+   DownscalingOperatorPtr op = getOperator(iInput, iOutput);
+   if(op) {
+      int nTime = iInput.getNumTime();
+      int batchSize = nTime;
+      long maxCacheSize = iInput.getMaxCacheSize();
+      if(Util::isValid(maxCacheSize)) {
+         long fieldSize = (long) iInput.getNumLat() * iInput.getNumLon() * iInput.getNumEns() * sizeof(float);
+         if(fieldSize > 0)
+            batchSize = std::max(1L, std::min((long) nTime, maxCacheSize / fieldSize));
+      }
+      for(int start = 0; start < nTime; start += batchSize) {
+         int end = std::min(nTime, start + batchSize);
+         std::vector<FieldPtr> inputs(end - start);
+         std::vector<FieldPtr> outputs(end - start);
+         std::vector<const Field*> inputFields(end - start);
+         std::vector<Field*> outputFields(end - start);
+         for(int t = start; t < end; t++) {
+            inputs[t - start] = iInput.getField(mVariable, t);
+            outputs[t - start] = iOutput.getField(mVariable, t);
+            inputFields[t - start] = inputs[t - start].get();
+            outputFields[t - start] = outputs[t - start].get();
+         }
+         op->apply(inputFields, outputFields);
+      }
+      return true;
+   }
+
+   // For outputs with few latitudes, parallelize over time instead. The loops over latitude
+   // inside downscaleCore then run serially within each thread.
+   bool parallelTime = Util::parallelizeOverTime(iOutput.getNumTime(), iOutput.getNumLat());
+   #pragma omp parallel for schedule(dynamic) if(parallelTime)
+   for(int t = 0; t < iInput.getNumTime(); t++) {
+      downscaleCore(iInput, iOutput, t);
+   }
+   return true;
+}
+
+bool Downscaler::downscale(const File& iInput, File& iOutput, int iTime) const {
+   if(iInput.getNumTime() != iOutput.getNumTime())
+      return false;
+
+   downscaleCore(iInput, iOutput, iTime);
    return true;
 }
 
+void Downscaler::downscaleCore(const File& iInput, File& iOutput, int iTime) const {
+   DownscalingOperatorPtr op = getOperator(iInput, iOutput);
+   if(!op) {
+      Util::error("Downscaler '" + name() + "' does not have an operator");
+   }
+   op->apply(*iInput.getField(mVariable, iTime), *iOutput.getField(mVariable, iTime));
+}
+
+DownscalingOperatorPtr Downscaler::getOperator(const File& iInput, const File& iOutput) const {
+   std::string type = getOperatorType(iInput, iOutput);
+   if(type == "")
+      return DownscalingOperatorPtr();
+
+   std::stringstream ss;
+   ss << type << "_" << toHex(iInput.getUniqueTag()) << "_" << toHex(iOutput.getUniqueTag());
+   std::string key = ss.str();
+   DownscalingOperatorPtr op;
+   // Timesteps and variables can be downscaled in parallel, but the operator should only be built once
+   #pragma omp critical(DownscalerOperatorCache)
+   {
+      std::map<std::string, DownscalingOperatorPtr>::const_iterator it = mOperatorCache.find(key);
+      if(it != mOperatorCache.end()) {
+         op = it->second;
+      }
+      else {
+         std::string filename = getCacheFilename("operator_" + type, iInput, iOutput);
+         boost::shared_ptr<DownscalingOperator> fromDisk(new DownscalingOperator(0));
+         if(filename != "" && fromDisk->read(filename) &&
+               fromDisk->getNumInput() == iInput.getNumLat()*iInput.getNumLon() &&
+               fromDisk->getNumOutput() == iOutput.getNumLat()*iOutput.getNumLon()) {
+            op = fromDisk;
+         }
+         else {
+            op = buildOperator(iInput, iOutput);
+            if(filename != "")
+               op->write(filename);
+         }
+         mOperatorCache[key] = op;
+      }
+   }
+   return op;
+}
+
+std::string Downscaler::getOperatorType(const File& iInput, const File& iOutput) const {
+   return "";
+}
+
+DownscalingOperatorPtr Downscaler::buildOperator(const File& iInput, const File& iOutput) const {
+   Util::error("Downscaler '" + name() + "' cannot be written as an operator");
+   return DownscalingOperatorPtr();
+}
+
+std::string Downscaler::toHex(boost::uint64_t iHash) {
+   std::stringstream ss;
+   ss << std::hex << std::setfill('0') << std::setw(16) << iHash;
+   return ss.str();
+}
+
 Downscaler* Downscaler::getScheme(std::string iName, Variable::Type iVariable, const Options& iOptions) {
    if(iName == "nearestNeighbour") {
       return new DownscalerNearestNeighbour(iVariable);
@@ -40,6 +158,9 @@ Downscaler* Downscaler::getScheme(std::string iName, Variable::Type iVariable, c
       }
       return d;
    }
+   else if(iName == "bilinear") {
+      return new DownscalerBilinear(iVariable);
+   }
    else if(iName == "bypass") {
       DownscalerBypass* d = new DownscalerBypass(iVariable);
       return d;
@@ -55,18 +176,29 @@ Downscaler* Downscaler::getScheme(std::string iName, Variable::Type iVariable, c
 }
 
 void Downscaler::getNearestNeighbour(const File& iFrom, const File& iTo, vec2Int& iI, vec2Int& iJ) {
-   if(isCached(iFrom, iTo)) {
-       getFromCache(iFrom, iTo, iI, iJ);
-       return;
-   }
+   NeighbourTablePtr table;
+   // Timesteps can be downscaled in parallel, but the neighbours should only be computed once
+   #pragma omp critical(DownscalerNeighbourCache)
+   table = computeNearestNeighbour(iFrom, iTo);
+   iI = table->first;
+   iJ = table->second;
+}
 
-   vec2 ilats = iFrom.getLats();
-   vec2 ilons = iFrom.getLons();
-   vec2 olats = iTo.getLats();
-   vec2 olons = iTo.getLons();
+NeighbourTablePtr Downscaler::computeNearestNeighbour(const File& iFrom, const File& iTo) {
+   NeighbourTablePtr cached = getFromCache(iFrom, iTo);
+   if(cached)
+      return cached;
+
+   const vec2& ilats = iFrom.getLats();
+   const vec2& ilons = iFrom.getLons();
+   const vec2& olats = iTo.getLats();
+   const vec2& olons = iTo.getLons();
    int nLon = iTo.getNumLon();
    int nLat = iTo.getNumLat();
 
+   boost::shared_ptr<NeighbourTable> table(new NeighbourTable());
+   vec2Int& iI = table->first;
+   vec2Int& iJ = table->second;
    iI.resize(nLat);
    iJ.resize(nLat);
 
@@ -82,224 +214,189 @@ void Downscaler::getNearestNeighbour(const File& iFrom, const File& iTo, vec2Int
             }
          }
          Util::status("Grids are identical, short cut in finding nearest neighbours");
-         addToCache(iFrom, iTo, iI, iJ);
-         return;
+         addToCache(iFrom, iTo, table);
+         return table;
       }
    }
 
+   std::string filename = getCacheFilename("nearest", iFrom, iTo);
+   if(filename != "" && readFromDisk(filename, iFrom.getNumLat(), iFrom.getNumLon(), nLat, nLon, iI, iJ)) {
+      addToCache(iFrom, iTo, table);
+      return table;
+   }
+
+   const KDTree& tree = getTree(iFrom);
+
    #pragma omp parallel for
    for(int i = 0; i < nLat; i++) {
       iI[i].resize(nLon, Util::MV);
       iJ[i].resize(nLon, Util::MV);
       for(int j = 0; j < nLon; j++) {
-         if(Util::isValid(olats[i][j]) && Util::isValid(olons[i][j])) {
-            float minDist = Util::MV;
-            int I = Util::MV;
-            int J = Util::MV;
-            for(int ii = 0; ii < iFrom.getNumLat(); ii++) {
-               for(int jj = 0; jj < iFrom.getNumLon(); jj++) {
-                  if(Util::isValid(ilats[ii][jj]) && Util::isValid(ilons[ii][jj])) {
-                     float currDist = Util::getDistance(olats[i][j], olons[i][j], ilats[ii][jj], ilons[ii][jj]);
-                     if(!Util::isValid(minDist) || currDist < minDist) {
-                        I = ii;
-                        J = jj;
-                        minDist = currDist;
-                     }
-                  }
-               }
-            }
-            iI[i][j] = I;
-            iJ[i][j] = J;
-         }
+         tree.getNearestNeighbour(olats[i][j], olons[i][j], iI[i][j], iJ[i][j]);
       }
    }
-   addToCache(iFrom, iTo, iI, iJ);
+   addToCache(iFrom, iTo, table);
+   if(filename != "")
+      writeToDisk(filename, iFrom.getNumLat(), iFrom.getNumLon(), iI, iJ);
+   return table;
 }
 
 void Downscaler::getNearestNeighbourFast(const File& iFrom, const File& iTo, vec2Int& iI, vec2Int& iJ) {
    if(iTo.getNumLat() == 0 || iTo.getNumLon() == 0) {
       return;
    }
+   getNearestNeighbour(iFrom, iTo, iI, iJ);
+}
 
-   if(isCached(iFrom, iTo)) {
-      getFromCache(iFrom, iTo, iI, iJ);
-      return;
+NeighbourTablePtr Downscaler::getNearestNeighbourTable(const File& iFrom, const File& iTo) {
+   if(iTo.getNumLat() == 0 || iTo.getNumLon() == 0) {
+      return NeighbourTablePtr(new NeighbourTable());
    }
+   NeighbourTablePtr table;
+   #pragma omp critical(DownscalerNeighbourCache)
+   table = computeNearestNeighbour(iFrom, iTo);
+   return table;
+}
 
-   if(iFrom.getNumLat() == 0 || iFrom.getNumLon() == 0) {
-      iI.resize(iTo.getNumLat());
-      iJ.resize(iTo.getNumLat());
-      for(int i = 0; i < iTo.getNumLat(); i++) {
-         iI[i].resize(iTo.getNumLon(), Util::MV);
-         iJ[i].resize(iTo.getNumLon(), Util::MV);
+void Downscaler::setCacheDirectory(std::string iDirectory) {
+   mCacheDirectory = iDirectory;
+}
+
+void Downscaler::clearCache() {
+   #pragma omp critical(DownscalerNeighbourCache)
+   {
+      mNeighbourCache.clear();
+      mTreeCache.clear();
+   }
+   #pragma omp critical(DownscalerOperatorCache)
+   mOperatorCache.clear();
+   #pragma omp critical(DownscalerCacheClearers)
+   {
+      std::set<CacheClearer>::const_iterator it;
+      for(it = mCacheClearers.begin(); it != mCacheClearers.end(); it++) {
+         (*it)();
       }
-      return;
    }
+}
 
-   vec2 ilats = iFrom.getLats();
-   vec2 ilons = iFrom.getLons();
-   vec2 olats = iTo.getLats();
-   vec2 olons = iTo.getLons();
-   int nLon = iTo.getNumLon();
-   int nLat = iTo.getNumLat();
+void Downscaler::addCacheClearer(CacheClearer iClearer) {
+   #pragma omp critical(DownscalerCacheClearers)
+   mCacheClearers.insert(iClearer);
+}
 
-   iI.resize(nLat);
-   iJ.resize(nLat);
+std::string Downscaler::getCacheDirectory() {
+   return mCacheDirectory;
+}
 
-   // Check if the grid is the same
-   if(iFrom.getNumLat() == iTo.getNumLat() && iFrom.getNumLon() == iTo.getNumLon()) {
-      if(ilats == olats && ilons == olons) {
-         for(int i = 0; i < nLat; i++) {
-            iI[i].resize(nLon, 0);
-            iJ[i].resize(nLon, 0);
-            for(int j = 0; j < nLon; j++) {
-               iI[i][j] = i;
-               iJ[i][j] = j;
-            }
-         }
-      }
-      Util::status("Grids are identical, short cut in finding nearest neighbours");
-      return;
-   }
+std::string Downscaler::getCacheFilename(std::string iType, const File& iFrom, const File& iTo) {
+   if(mCacheDirectory == "")
+      return "";
+   boost::uint64_t fromHash = iFrom.getUniqueTag();
+   boost::uint64_t toHash = iTo.getUniqueTag();
 
-   // Check if grid has missing points
-   bool hasMissing = false;
-   for(int ii = 0; ii < iFrom.getNumLat(); ii++) {
-      for(int jj = 0; jj < iFrom.getNumLon(); jj++) {
-         if(!Util::isValid(ilats[ii][jj]) || !Util::isValid(ilons[ii][jj])) {
-            hasMissing = true;
-         }
-      }
+   std::stringstream ss;
+   ss << mCacheDirectory;
+   if(mCacheDirectory[mCacheDirectory.size()-1] != '/')
+      ss << "/";
+   ss << iType << "_" << std::hex << std::setfill('0') << std::setw(16) << fromHash << "_" << std::setw(16) << toHash << ".bin";
+   return ss.str();
+}
+
+bool Downscaler::readFromDisk(std::string iFilename, int iNumInputLat, int iNumInputLon, int iNLat, int iNLon, vec2Int& iI, vec2Int& iJ) {
+   std::ifstream ifs(iFilename.c_str(), std::ios::binary);
+   if(!ifs.good())
+      return false;
+
+   boost::int32_t header[6];
+   ifs.read(reinterpret_cast<char*>(header), sizeof(header));
+   if(!ifs.good() || header[0] != cacheMagic || header[1] != cacheVersion || header[2] != iNumInputLat || header[3] != iNumInputLon
+         || header[4] != iNLat || header[5] != iNLon) {
+      Util::warning("Neighbour cache file '" + iFilename + "' is invalid. Recomputing neighbours.");
+      return false;
    }
-   if(hasMissing) {
-      std::stringstream ss;
-      ss << "Lats/lons has missing gridpoints, using a slower method to find nearest neighbours";
-      Util::warning(ss.str());
-      return getNearestNeighbour(iFrom, iTo, iI, iJ);
+
+   // Read both tables in one go
+   int N = iNLat * iNLon;
+   std::vector<boost::int32_t> values(2*N);
+   if(N > 0)
+      ifs.read(reinterpret_cast<char*>(&values[0]), 2*N*sizeof(boost::int32_t));
+   if(!ifs.good()) {
+      Util::warning("Neighbour cache file '" + iFilename + "' is truncated. Recomputing neighbours.");
+      return false;
    }
-   // Check if grid is sorted
-   bool isSorted = true;
-   for(int ii = 1; ii < iFrom.getNumLat(); ii++) {
-      for(int jj = 1; jj < iFrom.getNumLon(); jj++) {
-         if(!Util::isValid(ilats[ii][jj]) || !Util::isValid(ilons[ii][jj]) || ilats[ii][jj] < ilats[ii-1][jj] || ilons[ii][jj] < ilons[ii][jj-1]) {
-            isSorted = false;
-         }
-      }
+   // Check that each neighbour is either missing or inside the input grid
+   bool valid = true;
+   for(int k = 0; k < N && valid; k++) {
+      int I = values[k];
+      int J = values[N + k];
+      if(I == Util::MV || J == Util::MV)
+         valid = I == J;
+      else
+         valid = I >= 0 && I < iNumInputLat && J >= 0 && J < iNumInputLon;
    }
-   if(!isSorted) {
-      std::stringstream ss;
-      ss << "Lats/lons are not sorted, using a slower method to find nearest neighbours";
-      Util::warning(ss.str());
-      return getNearestNeighbour(iFrom, iTo, iI, iJ);
+   if(!valid) {
+      Util::warning("Neighbour cache file '" + iFilename + "' is invalid. Recomputing neighbours.");
+      return false;
    }
 
-   float tol = 0.2;
-
-   #pragma omp parallel for
-   for(int i = 0; i < nLat; i++) {
-      int I = 0;
-      int J = 0;
-      iI[i].resize(nLon, 0);
-      iJ[i].resize(nLon, 0);
-      for(int j = 0; j < nLon; j++) {
-         // if(j % 10 == 0)
-         //    std::cout << i << " " << j << std::endl;
-         int counter = 0;
-         float currLat = olats[i][j];
-         float currLon = olons[i][j];
-         while(true) {
-            // std::cout << "   " << ilats[I][J] << " " << ilons[I][J] << std::endl;
-            if(fabs(ilons[I][J] - currLon) < tol && fabs(ilats[I][J] - currLat) < tol) {
-               int startI = std::max(0, I-10);
-               int startJ = std::max(0, J-10);
-               int endI   = std::min(iFrom.getNumLat()-1, I+10);
-               int endJ   = std::min(iFrom.getNumLon()-1, J+10);
-               // std::cout << i << " " << j << " " << olats[i][j] << " " << ilats[I][J] << " " << olons[i][j] << " " << ilons[I][J] << std::endl;
-               // std::cout << i << " " << j << " " << abs(ilons[I][J] - olons[i][j]) << " " << abs(ilats[I][J] - olats[i][j]) << std::endl;
-               // std::cout << i << " " << j << " Searching in [" << startI << " " << startJ << " " << endI << " " << endJ << "]" << std::endl;
-               float minDist = Util::MV;
-               for(int ii = startI; ii <= endI; ii++) {
-                  for(int jj = startJ; jj <= endJ; jj++) {
-                     float currDist = Util::getDistance(olats[i][j], olons[i][j], ilats[ii][jj], ilons[ii][jj]);
-                     if(!Util::isValid(minDist) || currDist < minDist) {
-                        // std::cout << ilats[ii][jj] << " " << ilons[ii][jj] << "    " << currDist << std::endl;
-                        I = ii;
-                        J = jj;
-                        minDist = currDist;
-                     }
-                  }
-               }
-               // std::cout << "Found: " << i << " " << j << " " << olats[i][j] << " " << olons[i][j] << " " << ilats[I][J] << " " << ilons[I][J] << " " << minDist << std::endl;
-               break;
-            }
-            else {
-               assert(I >= 0);
-               assert(J >= 0);
-               assert(ilons.size() > I);
-               assert(ilons[I].size() > J);
-               assert(olons.size() > i);
-               assert(olons[i].size() > j);
-               assert(ilats.size() > I);
-               assert(ilats[I].size() > J);
-               assert(olats.size() > i);
-               assert(olats[i].size() > j);
-               if(ilons[I][J] < currLon-tol)
-                  J++;
-               else if(ilons[I][J] > currLon+tol)
-                  J--;
-               if(ilats[I][J] < currLat-tol)
-                  I++;
-               else if(ilats[I][J] < currLat+tol)
-                  I--;
-               I = std::min(iFrom.getNumLat()-1, std::max(0, I));
-               J = std::min(iFrom.getNumLon()-1, std::max(0, J));
-            }
-            counter++;
-            if(counter > 1000) {
-               // std::cout << "Couldn't find for " << i << " " << j << std::endl;
-               float minDist = Util::MV;
-               for(int ii = 0; ii < iFrom.getNumLat(); ii++) {
-                  for(int jj = 0; jj < iFrom.getNumLon(); jj++) {
-                     float currDist = Util::getDistance(olats[i][j], olons[i][j], ilats[ii][jj], ilons[ii][jj]);
-                     // std::cout << ii << " " << jj << " " << currDist << " " << minDist << std::endl;
-                     if(Util::isValid(currDist) && (!Util::isValid(minDist) || currDist < minDist)) {
-                        I = ii;
-                        J = jj;
-                        minDist = currDist;
-                     }
-                  }
-               }
-               break;
-            }
-         }
-         iI[i][j] = I;
-         iJ[i][j] = J;
-         // std::cout << "Found: " << i << " " << j << " " << olats[i][j] << " " << olons[i][j] << " " << ilats[I][J] << " " << ilons[i][J] << std::endl;
-      }
+   iI.resize(iNLat);
+   iJ.resize(iNLat);
+   for(int i = 0; i < iNLat; i++) {
+      iI[i].assign(values.begin() + i*iNLon, values.begin() + (i+1)*iNLon);
+      iJ[i].assign(values.begin() + N + i*iNLon, values.begin() + N + (i+1)*iNLon);
    }
-   addToCache(iFrom, iTo, iI, iJ);
+   Util::status("Read neighbours from cache file '" + iFilename + "'");
+   return true;
 }
 
-bool Downscaler::isCached(const File& iFrom, const File& iTo) {
-   std::map<boost::uuids::uuid, std::map<boost::uuids::uuid, std::pair<vec2Int, vec2Int> > >::const_iterator it = mNeighbourCache.find(iFrom.getUniqueTag());
-   if(it == mNeighbourCache.end()) {
-      return false;
+bool Downscaler::writeToDisk(std::string iFilename, int iNumInputLat, int iNumInputLon, const vec2Int& iI, const vec2Int& iJ) {
+   int nLat = iI.size();
+   int nLon = nLat > 0 ? iI[0].size() : 0;
+   int N = nLat * nLon;
+   std::vector<boost::int32_t> values(2*N);
+   for(int i = 0; i < nLat; i++) {
+      std::copy(iI[i].begin(), iI[i].end(), values.begin() + i*nLon);
+      std::copy(iJ[i].begin(), iJ[i].end(), values.begin() + N + i*nLon);
    }
-   std::map<boost::uuids::uuid, std::pair<vec2Int, vec2Int> >::const_iterator it2 = it->second.find(iTo.getUniqueTag());
-   if(it2 == it->second.end()) {
+   boost::int32_t header[6] = {cacheMagic, cacheVersion, iNumInputLat, iNumInputLon, nLat, nLon};
+
+   std::stringstream ss;
+   ss << iFilename << ".tmp" << getpid();
+   std::string tempFilename = ss.str();
+   std::ofstream ofs(tempFilename.c_str(), std::ios::binary);
+   ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+   if(N > 0)
+      ofs.write(reinterpret_cast<const char*>(&values[0]), 2*N*sizeof(boost::int32_t));
+   ofs.close();
+   if(!ofs.good() || rename(tempFilename.c_str(), iFilename.c_str()) != 0) {
+      Util::warning("Could not write neighbour cache file '" + iFilename + "'");
+      remove(tempFilename.c_str());
       return false;
    }
    return true;
 }
 
-void Downscaler::addToCache(const File& iFrom, const File& iTo, vec2Int iI, vec2Int iJ) {
-   std::pair<vec2Int, vec2Int> pair(iI, iJ);
-   mNeighbourCache[iFrom.getUniqueTag()][iTo.getUniqueTag()] = pair;
+const KDTree& Downscaler::getTree(const File& iFrom) {
+   std::map<boost::uint64_t, boost::shared_ptr<KDTree> >::const_iterator it = mTreeCache.find(iFrom.getUniqueTag());
+   if(it != mTreeCache.end()) {
+      return *it->second;
+   }
+   boost::shared_ptr<KDTree> tree(new KDTree(*iFrom.getGrid()));
+   mTreeCache[iFrom.getUniqueTag()] = tree;
+   return *tree;
 }
-bool Downscaler::getFromCache(const File& iFrom, const File& iTo, vec2Int& iI, vec2Int& iJ) {
-   if(!isCached(iFrom, iTo))
-      return false;
-   iI = mNeighbourCache[iFrom.getUniqueTag()][iTo.getUniqueTag()].first;
-   iJ = mNeighbourCache[iFrom.getUniqueTag()][iTo.getUniqueTag()].second;
-   return true;
+
+void Downscaler::addToCache(const File& iFrom, const File& iTo, NeighbourTablePtr iTable) {
+   mNeighbourCache[iFrom.getUniqueTag()][iTo.getUniqueTag()] = iTable;
+}
+NeighbourTablePtr Downscaler::getFromCache(const File& iFrom, const File& iTo) {
+   std::map<boost::uint64_t, std::map<boost::uint64_t, NeighbourTablePtr> >::const_iterator it = mNeighbourCache.find(iFrom.getUniqueTag());
+   if(it == mNeighbourCache.end()) {
+      return NeighbourTablePtr();
+   }
+   std::map<boost::uint64_t, NeighbourTablePtr>::const_iterator it2 = it->second.find(iTo.getUniqueTag());
+   if(it2 == it->second.end()) {
+      return NeighbourTablePtr();
+   }
+   return it2->second;
 }
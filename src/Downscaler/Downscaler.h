@@ -2,11 +2,18 @@
 #define DOWNSCALER_H
 #include <string>
 #include <map>
-#include <boost/uuid/uuid.hpp>
+#include <set>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
 #include "../Options.h"
 #include "../Variable.h"
+#include "Operator.h"
 class File;
+class KDTree;
 typedef std::vector<std::vector<int> > vec2Int;
+//! Indices (I, J) of the nearest gridpoint in the input grid for each gridpoint in the output grid
+typedef std::pair<vec2Int, vec2Int> NeighbourTable;
+typedef boost::shared_ptr<const NeighbourTable> NeighbourTablePtr;
 
 //! Converts fields from one grid to another
 class Downscaler {
@@ -14,28 +21,94 @@ class Downscaler {
       Downscaler(Variable::Type iVariable);
       virtual ~Downscaler() {};
       bool downscale(const File& iInput, File& iOutput) const;
+      //! Downscale one timestep only
+      bool downscale(const File& iInput, File& iOutput, int iTime) const;
       static Downscaler* getScheme(std::string iName, Variable::Type iVariable, const Options& iOptions);
       virtual std::string name() const = 0;
 
-      // Slow method: Check every combination
-      // Return Util::MV when it cannot find a neighbour
+      //! Find the nearest neighbour in @param iFrom for each point in @param iTo, using a KD-tree
+      //! on the input grid. Does not require the grid to be sorted.
+      //! Return Util::MV when it cannot find a neighbour
       static void getNearestNeighbour(const File& iFrom, const File& iTo, vec2Int& iI, vec2Int& iJ);
-      // Faster method: Assume lats/lons are sorted
+      //! Same as getNearestNeighbour, but does nothing if @param iTo has no gridpoints
       static void getNearestNeighbourFast(const File& iFrom, const File& iTo, vec2Int& iI, vec2Int& iJ);
+      //! \brief Same as getNearestNeighbourFast, but returns the cached tables instead of copying
+      //! them. Cheap enough to call for every timestep.
+      //! @return empty tables if @param iTo has no gridpoints
+      static NeighbourTablePtr getNearestNeighbourTable(const File& iFrom, const File& iTo);
+
+      //! \brief Store neighbour tables in this directory, such that later runs with the same grids
+      //! can reuse them. Use "" (default) to disable the disk cache. Applies to all downscalers, and
+      //! is set once for the run by the driver (--cacheDir).
+      static void setCacheDirectory(std::string iDirectory);
+      static std::string getCacheDirectory();
+      //! \brief Filename of the disk cache for neighbour tables of type @param iType
+      //! (e.g. "nearest"). The name contains a hash of the lat/lon arrays of both grids.
+      //! @return "" if the disk cache is disabled
+      static std::string getCacheFilename(std::string iType, const File& iFrom, const File& iTo);
+      //! \brief Remove all neighbour tables, operators and spatial indices held in memory (not
+      //! those on disk), including the tables registered by subclasses with addCacheClearer
+      static void clearCache();
+
+      //! \brief Get the linear operator that performs this downscaling between the two grids. It is
+      //! built once for each pair of grids and settings, and stored in the disk cache if enabled.
+      //! @return empty pointer if the downscaling cannot be written as an operator
+      DownscalingOperatorPtr getOperator(const File& iInput, const File& iOutput) const;
    protected:
-      virtual void downscaleCore(const File& iInput, File& iOutput) const = 0;
+      //! \brief Downscale one timestep. Can be called for several timesteps in parallel. The default
+      //! implementation applies the operator.
+      virtual void downscaleCore(const File& iInput, File& iOutput, int iTime) const;
       Variable::Type mVariable;
+
+      //! \brief Identifies the operator for these grids, apart from the lat/lon of the grids. Must
+      //! include the name of the downscaler and anything else the operator depends on (e.g.
+      //! settings, and File::getElevTag for elevations). Called for every downscaled timestep, so
+      //! must not loop over the grids.
+      //! @return "" (default) if the downscaling cannot be written as an operator
+      virtual std::string getOperatorType(const File& iInput, const File& iOutput) const;
+      //! Build the operator. Only called when getOperatorType is not "".
+      virtual DownscalingOperatorPtr buildOperator(const File& iInput, const File& iOutput) const;
+      //! Hexadecimal representation of a hash, for use in operator types and filenames
+      static std::string toHex(boost::uint64_t iHash);
+
+      //! \brief Read neighbour tables from the disk cache
+      //! @param iNumInputLat number of latitudes in the grid the tables index into
+      //! @param iNumInputLon number of longitudes in the grid the tables index into
+      //! @param iNLat expected number of latitudes in the tables
+      //! @param iNLon expected number of longitudes in the tables
+      //! @return false if the file does not exist, or is invalid (including any index that is
+      //! neither missing nor inside the input grid)
+      static bool readFromDisk(std::string iFilename, int iNumInputLat, int iNumInputLon, int iNLat, int iNLon, vec2Int& iI, vec2Int& iJ);
+      //! \brief Write neighbour tables to the disk cache. The file is first written to a temporary
+      //! file and then renamed, such that concurrent runs never see partially written files.
+      static bool writeToDisk(std::string iFilename, int iNumInputLat, int iNumInputLon, const vec2Int& iI, const vec2Int& iJ);
+
+      //! Function that removes tables that a subclass holds in memory
+      typedef void (*CacheClearer)();
+      //! \brief Have clearCache also call this function. Registering the same function several
+      //! times has no effect.
+      static void addCacheClearer(CacheClearer iClearer);
    private:
+      static NeighbourTablePtr computeNearestNeighbour(const File& iFrom, const File& iTo);
       // Cache calls to nearest neighbour
-      //! Is the nearest neighbours in @param iFrom for each point in @param iTo already computed?
-      static bool isCached(const File& iFrom, const File& iTo);
-      static void addToCache(const File& iFrom, const File& iTo, vec2Int iI, vec2Int iJ);
-      static bool getFromCache(const File& iFrom, const File& iTo, vec2Int& iI, vec2Int& iJ);
-      static std::map<boost::uuids::uuid, std::map<boost::uuids::uuid, std::pair<vec2Int, vec2Int> > > mNeighbourCache;
+      static void addToCache(const File& iFrom, const File& iTo, NeighbourTablePtr iTable);
+      //! @return the nearest neighbours in @param iFrom for each point in @param iTo, or an empty
+      //! pointer if they have not been computed yet
+      static NeighbourTablePtr getFromCache(const File& iFrom, const File& iTo);
+      static std::map<boost::uint64_t, std::map<boost::uint64_t, NeighbourTablePtr> > mNeighbourCache;
+
+      //! Get the spatial index of the grid in @param iFrom. The index is built once per grid.
+      static const KDTree& getTree(const File& iFrom);
+      static std::map<boost::uint64_t, boost::shared_ptr<KDTree> > mTreeCache;
+      //! Operators, keyed by the operator type and the lat/lon tags of the grids
+      static std::map<std::string, DownscalingOperatorPtr> mOperatorCache;
+      static std::string mCacheDirectory;
+      static std::set<CacheClearer> mCacheClearers;
 };
 #include "NearestNeighbour.h"
 #include "Gradient.h"
 #include "Smart.h"
 #include "Bypass.h"
 #include "Pressure.h"
+#include "Bilinear.h"
 #endif
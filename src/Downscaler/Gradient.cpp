@@ -2,6 +2,17 @@
 #include "../File/File.h"
 #include "../Util.h"
 #include <math.h>
+#include <algorithm>
+
+namespace {
+   //! \brief Sum of the values in the box [iStartLat,iEndLat] x [iStartLon,iEndLon] (inclusive)
+   //! @param iTable summed-area table with a leading row and column of zeros
+   //! @param iNumCols number of columns in the table
+   template<class T> T boxSum(const std::vector<T>& iTable, int iNumCols, int iStartLat, int iEndLat, int iStartLon, int iEndLon) {
+      return iTable[(iEndLat+1)*iNumCols + iEndLon+1] - iTable[iStartLat*iNumCols + iEndLon+1]
+           - iTable[(iEndLat+1)*iNumCols + iStartLon] + iTable[iStartLat*iNumCols + iStartLon];
+   }
+}
 
 DownscalerGradient::DownscalerGradient(Variable::Type iVariable, const Options& iOptions) :
       Downscaler(iVariable),
@@ -11,7 +22,8 @@ DownscalerGradient::DownscalerGradient(Variable::Type iVariable, const Options&
       mLogTransform(false),
       mConstantGradient(Util::MV),
       mDefaultGradient(0),
-      mMinElevDiff(30) {
+      mMinElevDiff(30),
+      mPrecompute(false) {
 
    iOptions.getValue("minGradient", mMinGradient);
    iOptions.getValue("maxGradient", mMaxGradient);
@@ -20,147 +32,326 @@ DownscalerGradient::DownscalerGradient(Variable::Type iVariable, const Options&
    iOptions.getValue("logTransform", mLogTransform);
    iOptions.getValue("constantGradient", mConstantGradient);
    iOptions.getValue("minElevDiff", mMinElevDiff);
+   iOptions.getValue("precompute", mPrecompute);
 }
 
-void DownscalerGradient::downscaleCore(const File& iInput, File& iOutput) const {
+void DownscalerGradient::downscaleCore(const File& iInput, File& iOutput, int iTime) const {
+   // A constant gradient does not depend on the values
+   if(Util::isValid(mConstantGradient)) {
+      Downscaler::downscaleCore(iInput, iOutput, iTime);
+      return;
+   }
+
    int nLat = iOutput.getNumLat();
    int nLon = iOutput.getNumLon();
    int nEns = iOutput.getNumEns();
-   int nTime = iInput.getNumTime();
 
-   vec2 ilats  = iInput.getLats();
-   vec2 ilons  = iInput.getLons();
-   vec2 ielevs = iInput.getElevs();
-   vec2 olats  = iOutput.getLats();
-   vec2 olons  = iOutput.getLons();
-   vec2 oelevs = iOutput.getElevs();
+   const vec2& ielevs = iInput.getElevs();
+   const vec2& oelevs = iOutput.getElevs();
 
    float minAllowed = Variable::getMin(mVariable);
    float maxAllowed = Variable::getMax(mVariable);
 
    // Get nearest neighbour
-   vec2Int nearestI, nearestJ;
-   getNearestNeighbourFast(iInput, iOutput, nearestI, nearestJ);
+   NeighbourTablePtr nearest = getNearestNeighbourTable(iInput, iOutput);
+   const vec2Int& nearestI = nearest->first;
+   const vec2Int& nearestJ = nearest->second;
 
-   for(int t = 0; t < nTime; t++) {
-      Field& ifield = *iInput.getField(mVariable, t);
-      Field& ofield = *iOutput.getField(mVariable, t);
+   Field& ifield = *iInput.getField(mVariable, iTime);
+   Field& ofield = *iOutput.getField(mVariable, iTime);
 
-      #pragma omp parallel for
-      for(int i = 0; i < nLat; i++) {
-         for(int j = 0; j < nLon; j++) {
-            int Icenter = nearestI[i][j];
-            int Jcenter = nearestJ[i][j];
-            assert(Icenter < ielevs.size());
-            assert(Jcenter < ielevs[Icenter].size());
-            for(int e = 0; e < nEns; e++) {
-               float currElev = oelevs[i][j];
-               float nearestElev = ielevs[Icenter][Jcenter];
-               if(!Util::isValid(currElev) || !Util::isValid(nearestElev)) {
-                  // Can't adjust if we don't have an elevation, use nearest neighbour
-                  ofield(i,j,e) = ifield(Icenter,Jcenter,e);
+   // Compute the gradients on the input grid, once for each member
+   std::vector<std::vector<float> > gradients;
+   if(mPrecompute) {
+      gradients.resize(nEns);
+      int numDefault = 0;
+      for(int e = 0; e < nEns; e++) {
+         numDefault += computeGradients(ielevs, ifield, e, gradients[e]);
+      }
+      if(numDefault > 0) {
+         std::stringstream ss;
+         ss << "DownscalerGradient cannot compute gradient for " << numDefault << " gridpoints. Unstable regression. Reverting to default gradient.";
+         Util::warning(ss.str());
+      }
+   }
+
+   #pragma omp parallel for
+   for(int i = 0; i < nLat; i++) {
+      for(int j = 0; j < nLon; j++) {
+         int Icenter = nearestI[i][j];
+         int Jcenter = nearestJ[i][j];
+         assert(Icenter < ielevs.size());
+         assert(Jcenter < ielevs[Icenter].size());
+         for(int e = 0; e < nEns; e++) {
+            float currElev = oelevs[i][j];
+            float nearestElev = ielevs[Icenter][Jcenter];
+            if(!Util::isValid(currElev) || !Util::isValid(nearestElev)) {
+               // Can't adjust if we don't have an elevation, use nearest neighbour
+               ofield(i,j,e) = ifield(Icenter,Jcenter,e);
+            }
+            else {
+               float dElev = currElev - nearestElev;
+               float gradient = mDefaultGradient;
+               if(mPrecompute) {
+                  gradient = gradients[e][Icenter*iInput.getNumLon() + Jcenter];
                }
                else {
-                  float dElev = currElev - nearestElev;
-                  float gradient = mDefaultGradient;
-                  if(Util::isValid(mConstantGradient)) {
-                     gradient = mConstantGradient;
-                  }
-                  else {
-                     /* Compute the model's gradient:
-                        The gradient is computed by using linear regression on forecast ~ elevation
-                        using all forecasts within a neighbourhood. To produce stable results, there
-                        is a requirement that the elevation within the neighbourhood has a large
-                        range (see mMinElevDiff).
-
-                        For bounded variables (e.g. wind speed), the gradient approach could cause
-                        forecasts to go outside its domain (e.g. negative winds). If this occurs,
-                        the nearest neighbour is used.
-                     */
-                     float meanXY  = 0; // elev*T
-                     float meanX   = 0; // elev
-                     float meanY   = 0; // T
-                     float meanXX  = 0; // elev*elev
-                     int   counter = 0;
-                     float min = Util::MV;
-                     float max = Util::MV;
-                     for(int ii = std::max(0, Icenter-mSearchRadius); ii <= std::min(iInput.getNumLat()-1, Icenter+mSearchRadius); ii++) {
-                        for(int jj = std::max(0, Jcenter-mSearchRadius); jj <= std::min(iInput.getNumLon()-1, Jcenter+mSearchRadius); jj++) {
-                           assert(ii < ielevs.size());
-                           assert(jj < ielevs[ii].size());
-                           float x = ielevs[ii][jj];
-                           float y = ifield(ii,jj,e);
-                           if(mLogTransform) {
-                              y = log(y);
-                           }
-                           if(Util::isValid(x) && Util::isValid(y)) {
-                              meanXY += x*y;
-                              meanX  += x;
-                              meanY  += y;
-                              meanXX += x*x;
-                              counter++;
-                              // Found a new min
-                              if(!Util::isValid(min) || x < min)
-                                 min = x;
-                              // Found a new max
-                              if(!Util::isValid(max) || x > max)
-                                 max = x;
-                           }
-                        }
-                     }
-                     // Compute elevation difference within neighbourhood
-                     float elevDiff = Util::MV;
-                     if(Util::isValid(min) && Util::isValid(max)) {
-                        assert(max >= min);
-                        elevDiff = max - min;
-                     }
+                  /* Compute the model's gradient:
+                     The gradient is computed by using linear regression on forecast ~ elevation
+                     using all forecasts within a neighbourhood. To produce stable results, there
+                     is a requirement that the elevation within the neighbourhood has a large
+                     range (see mMinElevDiff).
 
-                     // Use model gradient if:
-                     // 1) sufficient elevation difference in neighbourhood
-                     // 2) regression parameters are stable enough
-                     if(counter > 0 && Util::isValid(elevDiff) && elevDiff >= mMinElevDiff && meanXX != meanX*meanX) {
-                        // Estimate lapse rate
-                        meanXY /= counter;
-                        meanX  /= counter;
-                        meanY  /= counter;
-                        meanXX /= counter;
-                        gradient = (meanXY - meanX*meanY)/(meanXX - meanX*meanX);
-                     }
-                     else {
-                        std::stringstream ss;
-                        ss << "DownscalerGradient cannot compute gradient. Unstable regression. Reverting to default gradient.";
-                        Util::warning(ss.str());
+                     For bounded variables (e.g. wind speed), the gradient approach could cause
+                     forecasts to go outside its domain (e.g. negative winds). If this occurs,
+                     the nearest neighbour is used.
+                  */
+                  float meanXY  = 0; // elev*T
+                  float meanX   = 0; // elev
+                  float meanY   = 0; // T
+                  float meanXX  = 0; // elev*elev
+                  int   counter = 0;
+                  float min = Util::MV;
+                  float max = Util::MV;
+                  for(int ii = std::max(0, Icenter-mSearchRadius); ii <= std::min(iInput.getNumLat()-1, Icenter+mSearchRadius); ii++) {
+                     for(int jj = std::max(0, Jcenter-mSearchRadius); jj <= std::min(iInput.getNumLon()-1, Jcenter+mSearchRadius); jj++) {
+                        assert(ii < ielevs.size());
+                        assert(jj < ielevs[ii].size());
+                        float x = ielevs[ii][jj];
+                        float y = ifield(ii,jj,e);
+                        if(mLogTransform) {
+                           y = log(y);
+                        }
+                        if(Util::isValid(x) && Util::isValid(y)) {
+                           meanXY += x*y;
+                           meanX  += x;
+                           meanY  += y;
+                           meanXX += x*x;
+                           counter++;
+                           // Found a new min
+                           if(!Util::isValid(min) || x < min)
+                              min = x;
+                           // Found a new max
+                           if(!Util::isValid(max) || x > max)
+                              max = x;
+                        }
                      }
-                     // Safety check
-                     if(!Util::isValid(gradient))
-                        gradient = 0;
-                     // Check against minimum and maximum gradients
-                     if(Util::isValid(mMinGradient) && gradient < mMinGradient)
-                        gradient = mMinGradient;
-                     if(Util::isValid(mMaxGradient) && gradient > mMaxGradient)
-                        gradient = mMaxGradient;
-
                   }
-                  float value = Util::MV;
-                  if(mLogTransform) {
-                     value = ifield(Icenter,Jcenter,e) * exp(gradient * dElev);
-                  }
-                  else {
-                     value = ifield(Icenter,Jcenter,e) + dElev * gradient;
+                  // Compute elevation difference within neighbourhood
+                  float elevDiff = Util::MV;
+                  if(Util::isValid(min) && Util::isValid(max)) {
+                     assert(max >= min);
+                     elevDiff = max - min;
                   }
-                  if((Util::isValid(minAllowed) && value < minAllowed) || (Util::isValid(maxAllowed) && value > maxAllowed)) {
-                     // Use nearest neighbour if the gradient put us outside the bounds of the variable
-                     ofield(i,j,e) = (ifield)(Icenter, Jcenter, e);
+
+                  // Use model gradient if:
+                  // 1) sufficient elevation difference in neighbourhood
+                  // 2) regression parameters are stable enough
+                  if(counter > 0 && Util::isValid(elevDiff) && elevDiff >= mMinElevDiff && meanXX != meanX*meanX) {
+                     // Estimate lapse rate
+                     meanXY /= counter;
+                     meanX  /= counter;
+                     meanY  /= counter;
+                     meanXX /= counter;
+                     gradient = (meanXY - meanX*meanY)/(meanXX - meanX*meanX);
                   }
                   else {
-                     ofield(i,j,e)  = value;
+                     std::stringstream ss;
+                     ss << "DownscalerGradient cannot compute gradient. Unstable regression. Reverting to default gradient.";
+                     Util::warning(ss.str());
                   }
+                  gradient = limitGradient(gradient);
+               }
+               float value = Util::MV;
+               if(mLogTransform) {
+                  value = ifield(Icenter,Jcenter,e) * exp(gradient * dElev);
+               }
+               else {
+                  value = ifield(Icenter,Jcenter,e) + dElev * gradient;
+               }
+               if((Util::isValid(minAllowed) && value < minAllowed) || (Util::isValid(maxAllowed) && value > maxAllowed)) {
+                  // Use nearest neighbour if the gradient put us outside the bounds of the variable
+                  ofield(i,j,e) = (ifield)(Icenter, Jcenter, e);
+               }
+               else {
+                  ofield(i,j,e)  = value;
                }
             }
          }
       }
    }
 }
+std::string DownscalerGradient::getOperatorType(const File& iInput, const File& iOutput) const {
+   if(!Util::isValid(mConstantGradient))
+      return "";
+   vec2 settings(1);
+   settings[0].push_back(mConstantGradient);
+   settings[0].push_back(mLogTransform);
+   settings[0].push_back(Variable::getMin(mVariable));
+   settings[0].push_back(Variable::getMax(mVariable));
+   boost::uint64_t key = Util::hash(iInput.getElevTag());
+   key = Util::hash(iOutput.getElevTag(), key);
+   key = Util::hash(settings, key);
+   return name() + "_" + toHex(key);
+}
+
+DownscalingOperatorPtr DownscalerGradient::buildOperator(const File& iInput, const File& iOutput) const {
+   int nLat = iOutput.getNumLat();
+   int nLon = iOutput.getNumLon();
+   int nInLon = iInput.getNumLon();
+
+   const vec2& ielevs = iInput.getElevs();
+   const vec2& oelevs = iOutput.getElevs();
+
+   NeighbourTablePtr nearest = getNearestNeighbourTable(iInput, iOutput);
+   const vec2Int& nearestI = nearest->first;
+   const vec2Int& nearestJ = nearest->second;
+
+   boost::shared_ptr<DownscalingOperator> op(new DownscalingOperator(iInput.getNumLat()*nInLon));
+   for(int i = 0; i < nLat; i++) {
+      for(int j = 0; j < nLon; j++) {
+         int Icenter = nearestI[i][j];
+         int Jcenter = nearestJ[i][j];
+         if(!Util::isValid(Icenter) || !Util::isValid(Jcenter)) {
+            op->addRow(Util::MV);
+            continue;
+         }
+         int index = Icenter*nInLon + Jcenter;
+         float currElev = oelevs[i][j];
+         float nearestElev = ielevs[Icenter][Jcenter];
+         if(!Util::isValid(currElev) || !Util::isValid(nearestElev)) {
+            // Can't adjust if we don't have an elevation, use nearest neighbour
+            op->addRow(index);
+         }
+         else {
+            float dElev = currElev - nearestElev;
+            if(mLogTransform)
+               op->addRow(index, exp(mConstantGradient * dElev));
+            else
+               op->addRow(index, 1, dElev * mConstantGradient);
+         }
+      }
+   }
+   // Use nearest neighbour if the gradient puts us outside the bounds of the variable
+   op->setBounds(Variable::getMin(mVariable), Variable::getMax(mVariable));
+   return op;
+}
+
+int DownscalerGradient::computeGradients(const vec2& iElevs, const Field& iField, int iEns, std::vector<float>& oGradients) const {
+   int nLat = iField.getNumLat();
+   int nLon = iField.getNumLon();
+   oGradients.resize(nLat*nLon);
+
+   // Elevations and values used in the regression. Both are missing when either is missing.
+   std::vector<float> x(nLat*nLon, Util::MV);
+   std::vector<float> y(nLat*nLon, Util::MV);
+   // Shift the values by the first valid point, to reduce round-off in the sums
+   float shiftX = Util::MV;
+   float shiftY = Util::MV;
+   for(int i = 0; i < nLat; i++) {
+      for(int j = 0; j < nLon; j++) {
+         float currX = iElevs[i][j];
+         float currY = iField(i,j,iEns);
+         if(mLogTransform) {
+            currY = log(currY);
+         }
+         if(Util::isValid(currX) && Util::isValid(currY)) {
+            x[i*nLon + j] = currX;
+            y[i*nLon + j] = currY;
+            if(!Util::isValid(shiftX)) {
+               shiftX = currX;
+               shiftY = currY;
+            }
+         }
+      }
+   }
+
+   // Summed-area tables, with an extra leading row and column of zeros
+   int nCols = nLon + 1;
+   int size = (nLat+1)*nCols;
+   std::vector<double> sumX(size, 0);
+   std::vector<double> sumY(size, 0);
+   std::vector<double> sumXY(size, 0);
+   std::vector<double> sumXX(size, 0);
+   std::vector<int>    count(size, 0);
+   for(int i = 0; i < nLat; i++) {
+      for(int j = 0; j < nLon; j++) {
+         int index = (i+1)*nCols + j+1;
+         double dx = 0;
+         double dy = 0;
+         int valid = 0;
+         if(Util::isValid(x[i*nLon + j])) {
+            dx = x[i*nLon + j] - shiftX;
+            dy = y[i*nLon + j] - shiftY;
+            valid = 1;
+         }
+         sumX[index]  = dx    + sumX[index-1]  + sumX[index-nCols]  - sumX[index-nCols-1];
+         sumY[index]  = dy    + sumY[index-1]  + sumY[index-nCols]  - sumY[index-nCols-1];
+         sumXY[index] = dx*dy + sumXY[index-1] + sumXY[index-nCols] - sumXY[index-nCols-1];
+         sumXX[index] = dx*dx + sumXX[index-1] + sumXX[index-nCols] - sumXX[index-nCols-1];
+         count[index] = valid + count[index-1] + count[index-nCols] - count[index-nCols-1];
+      }
+   }
+
+   // Elevation range within each neighbourhood
+   std::vector<float> minX(nLat*nLon);
+   std::vector<float> maxX(nLat*nLon);
+   std::vector<float> rowExtreme(nLat*nLon);
+   std::vector<int> queue(std::max(nLat, nLon));
+   for(int k = 0; k < 2; k++) {
+      bool isMax = k == 1;
+      std::vector<float>& extreme = isMax ? maxX : minX;
+      for(int i = 0; i < nLat; i++) {
+         Util::slidingExtreme(&x[i*nLon], nLon, 1, mSearchRadius, isMax, &rowExtreme[i*nLon], 1, queue);
+      }
+      for(int j = 0; j < nLon; j++) {
+         Util::slidingExtreme(&rowExtreme[j], nLat, nLon, mSearchRadius, isMax, &extreme[j], nLon, queue);
+      }
+   }
+
+   int numDefault = 0;
+   #pragma omp parallel for reduction(+:numDefault)
+   for(int i = 0; i < nLat; i++) {
+      int startLat = std::max(0, i-mSearchRadius);
+      int endLat   = std::min(nLat-1, i+mSearchRadius);
+      for(int j = 0; j < nLon; j++) {
+         int startLon = std::max(0, j-mSearchRadius);
+         int endLon   = std::min(nLon-1, j+mSearchRadius);
+         int counter = boxSum(count, nCols, startLat, endLat, startLon, endLon);
+         float elevDiff = Util::MV;
+         if(Util::isValid(minX[i*nLon + j]) && Util::isValid(maxX[i*nLon + j]))
+            elevDiff = maxX[i*nLon + j] - minX[i*nLon + j];
+
+         // Same conditions as when computing the gradient for each lookup point. A zero elevation
+         // range means that the regression is singular.
+         float gradient = mDefaultGradient;
+         if(counter > 0 && Util::isValid(elevDiff) && elevDiff >= mMinElevDiff && elevDiff > 0) {
+            double meanX  = boxSum(sumX,  nCols, startLat, endLat, startLon, endLon) / counter;
+            double meanY  = boxSum(sumY,  nCols, startLat, endLat, startLon, endLon) / counter;
+            double meanXY = boxSum(sumXY, nCols, startLat, endLat, startLon, endLon) / counter;
+            double meanXX = boxSum(sumXX, nCols, startLat, endLat, startLon, endLon) / counter;
+            gradient = (meanXY - meanX*meanY)/(meanXX - meanX*meanX);
+         }
+         else {
+            numDefault++;
+         }
+         oGradients[i*nLon + j] = limitGradient(gradient);
+      }
+   }
+   return numDefault;
+}
+float DownscalerGradient::limitGradient(float iGradient) const {
+   float gradient = iGradient;
+   // Safety check
+   if(!Util::isValid(gradient))
+      gradient = 0;
+   // Check against minimum and maximum gradients
+   if(Util::isValid(mMinGradient) && gradient < mMinGradient)
+      gradient = mMinGradient;
+   if(Util::isValid(mMaxGradient) && gradient > mMaxGradient)
+      gradient = mMaxGradient;
+   return gradient;
+}
 float DownscalerGradient::getConstantGradient() const {
    return mConstantGradient;
 }
@@ -182,6 +373,9 @@ float DownscalerGradient::getMaxGradient() const {
 float DownscalerGradient::getDefaultGradient() const {
    return mDefaultGradient;
 }
+bool DownscalerGradient::getPrecompute() const {
+   return mPrecompute;
+}
 std::string DownscalerGradient::description() {
    std::stringstream ss;
    ss << Util::formatDescription("-d gradient", "Adjusts the nearest neighbour based on the elevation difference to the output gridpoint and the gradient in the surrounding neighbourhood: T = T(nn) + gradient * dElev. If the gradient puts the forecast outside the domain of the variable (e.g. negative precipitation) then the nearest neighbour is used.") << std::endl;
@@ -192,6 +386,7 @@ std::string DownscalerGradient::description() {
    ss << Util::formatDescription("   defaultGradient=0", "If the gradient is not computable (too unstable), use this default gradient.") << std::endl;
    ss << Util::formatDescription("   minGradient=undef", "Do not allow gradient to be smaller than this value. If undefined, do not alter gradient.") << std::endl;
    ss << Util::formatDescription("   maxGradient=undef", "Do not allow gradient to be larger than this value. If undefined, do not alter gradient.") << std::endl;
+   ss << Util::formatDescription("   precompute=0", "Compute the gradient once for each gridpoint in the input grid, instead of for each output gridpoint. Faster when the output grid is denser than the input grid.") << std::endl;
    return ss.str();
 }
 
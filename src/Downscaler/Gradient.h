@@ -3,6 +3,7 @@
 #include "Downscaler.h"
 #include "../Variable.h"
 #include "../Util.h"
+#include "../Field.h"
 typedef std::vector<std::vector<int> > vec2Int;
 //! Adjust the value of the nearest neighbour (nn), based on the gradient in a neighbourhood
 //! surrounding the nearest neighbour, and the elevation difference to the lookup point (p):
@@ -10,6 +11,9 @@ typedef std::vector<std::vector<int> > vec2Int;
 //! If the variable is log transformed, then use:
 //! T(p) = T(nn) * exp(gradient*(elev(p) - elev(nn)))
 //! Uses nearest neighbour when the lookup location does not have an elevation
+//! The gradient can either be computed separately for each lookup point, or once for each gridpoint
+//! in the input grid (precompute=1). The latter is faster when the output grid is denser than the
+//! input grid.
 class DownscalerGradient : public Downscaler {
    public:
       //! Downscale the specified variable
@@ -21,10 +25,21 @@ class DownscalerGradient : public Downscaler {
       float getMinGradient() const;
       float getMaxGradient() const;
       float getDefaultGradient() const;
+      bool  getPrecompute() const;
       static std::string description();
       std::string name() const {return "gradient";};
    private:
-      void downscaleCore(const File& iInput, File& iOutput) const;
+      void downscaleCore(const File& iInput, File& iOutput, int iTime) const;
+      //! Only a constant gradient can be written as an operator
+      std::string getOperatorType(const File& iInput, const File& iOutput) const;
+      DownscalingOperatorPtr buildOperator(const File& iInput, const File& iOutput) const;
+      //! \brief Compute the gradient at every gridpoint in the input grid by regression over its
+      //! neighbourhood. Uses summed-area tables so that the cost does not depend on the search radius.
+      //! @param oGradients gradients for each gridpoint (longitude varying fastest)
+      //! @return Number of gridpoints where the regression was unstable and the default gradient was used
+      int computeGradients(const vec2& iElevs, const Field& iField, int iEns, std::vector<float>& oGradients) const;
+      //! Apply the safety checks and the min/max gradient limits
+      float limitGradient(float iGradient) const;
       int   mSearchRadius;
       float mConstantGradient;
       float mMinElevDiff; // Minimum elevation difference within neighbourhood to use gradient
@@ -32,5 +47,6 @@ class DownscalerGradient : public Downscaler {
       float mMinGradient;
       float mMaxGradient;
       float mDefaultGradient;
+      bool  mPrecompute;
 };
 #endif
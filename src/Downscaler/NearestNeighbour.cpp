@@ -3,40 +3,35 @@
 #include "../Util.h"
 #include <math.h>
 
-// std::map<const File*, std::map<const File*, std::pair<vec2Int, vec2Int> > > DownscalerNearestNeighbour::mNeighbourCache;
-
 DownscalerNearestNeighbour::DownscalerNearestNeighbour(Variable::Type iVariable) :
       Downscaler(iVariable) {
 }
 
-void DownscalerNearestNeighbour::downscaleCore(const File& iInput, File& iOutput) const {
+std::string DownscalerNearestNeighbour::getOperatorType(const File& iInput, const File& iOutput) const {
+   return name();
+}
+
+DownscalingOperatorPtr DownscalerNearestNeighbour::buildOperator(const File& iInput, const File& iOutput) const {
    int nLat = iOutput.getNumLat();
    int nLon = iOutput.getNumLon();
-   int nEns = iOutput.getNumEns();
-   int nTime = iInput.getNumTime();
-
-   // Get nearest neighbour
-   vec2Int nearestI, nearestJ;
-   getNearestNeighbourFast(iInput, iOutput, nearestI, nearestJ);
+   int nInLon = iInput.getNumLon();
 
-   for(int t = 0; t < nTime; t++) {
-      Field& ifield = *iInput.getField(mVariable, t);
-      Field& ofield = *iOutput.getField(mVariable, t);
+   NeighbourTablePtr nearest = getNearestNeighbourTable(iInput, iOutput);
+   const vec2Int& nearestI = nearest->first;
+   const vec2Int& nearestJ = nearest->second;
 
-      #pragma omp parallel for
-      for(int i = 0; i < nLat; i++) {
-         for(int j = 0; j < nLon; j++) {
-            int I = nearestI[i][j];
-            int J = nearestJ[i][j];
-            for(int e = 0; e < nEns; e++) {
-               if(Util::isValid(I) && Util::isValid(J))
-                  ofield(i,j,e) = ifield(I,J,e);
-               else
-                  ofield(i,j,e) = Util::MV;
-            }
-         }
+   boost::shared_ptr<DownscalingOperator> op(new DownscalingOperator(iInput.getNumLat()*nInLon));
+   for(int i = 0; i < nLat; i++) {
+      for(int j = 0; j < nLon; j++) {
+         int I = nearestI[i][j];
+         int J = nearestJ[i][j];
+         if(Util::isValid(I) && Util::isValid(J))
+            op->addRow(I*nInLon + J);
+         else
+            op->addRow(Util::MV);
       }
    }
+   return op;
 }
 
 std::string DownscalerNearestNeighbour::description() {
@@ -5,12 +5,14 @@
 #include "../Variable.h"
 #include "../Util.h"
 class File;
+//! Uses the value of the nearest neighbour
 class DownscalerNearestNeighbour : public Downscaler {
    public:
       DownscalerNearestNeighbour(Variable::Type iVariable);
       static std::string description();
       std::string name() const {return "nearestNeighbour";};
    private:
-      void downscaleCore(const File& iInput, File& iOutput) const;
+      std::string getOperatorType(const File& iInput, const File& iOutput) const;
+      DownscalingOperatorPtr buildOperator(const File& iInput, const File& iOutput) const;
 };
 #endif
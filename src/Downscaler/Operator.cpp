@@ -0,0 +1,240 @@
+#include "Operator.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <boost/cstdint.hpp>
+#include "../Util.h"
+
+namespace {
+   // Header of operator files: magic, version, numInput, numOutput, number of weights
+   const boost::int32_t operatorMagic = 0x4f505047; // "GPPO"
+   const boost::int32_t operatorVersion = 1;
+
+   template<class T> void writeArray(std::ofstream& iStream, const std::vector<T>& iValues) {
+      if(iValues.size() > 0)
+         iStream.write(reinterpret_cast<const char*>(&iValues[0]), iValues.size()*sizeof(T));
+   }
+   template<class T> void readArray(std::ifstream& iStream, int iSize, std::vector<T>& iValues) {
+      iValues.resize(iSize);
+      if(iSize > 0)
+         iStream.read(reinterpret_cast<char*>(&iValues[0]), iSize*sizeof(T));
+   }
+}
+
+DownscalingOperator::DownscalingOperator(int iNumInput) :
+      mNumInput(iNumInput),
+      mRowStart(1, 0),
+      mMin(Util::MV),
+      mMax(Util::MV) {
+}
+
+void DownscalingOperator::addRow(const std::vector<int>& iIndices, const std::vector<float>& iWeights, float iScale, float iOffset) {
+   if(iIndices.size() != iWeights.size()) {
+      Util::error("DownscalingOperator: indices and weights must have the same size");
+   }
+   for(int k = 0; k < iIndices.size(); k++) {
+      if(iIndices[k] < 0 || iIndices[k] >= mNumInput) {
+         std::stringstream ss;
+         ss << "DownscalingOperator: input index " << iIndices[k] << " is outside the input grid";
+         Util::error(ss.str());
+      }
+      mIndices.push_back(iIndices[k]);
+      mWeights.push_back(iWeights[k]);
+   }
+   mRowStart.push_back(mIndices.size());
+   mScales.push_back(iScale);
+   mOffsets.push_back(iOffset);
+}
+
+void DownscalingOperator::addRow(int iIndex, float iScale, float iOffset) {
+   std::vector<int> indices;
+   std::vector<float> weights;
+   if(Util::isValid(iIndex)) {
+      indices.push_back(iIndex);
+      weights.push_back(1);
+   }
+   addRow(indices, weights, iScale, iOffset);
+}
+
+void DownscalingOperator::setBounds(float iMin, float iMax) {
+   mMin = iMin;
+   mMax = iMax;
+}
+
+int DownscalingOperator::getNumInput() const {
+   return mNumInput;
+}
+
+int DownscalingOperator::getNumOutput() const {
+   return mRowStart.size() - 1;
+}
+
+int DownscalingOperator::size() const {
+   return mIndices.size();
+}
+
+void DownscalingOperator::apply(const Field& iInput, Field& iOutput) const {
+   std::vector<const Field*> inputs(1, &iInput);
+   std::vector<Field*> outputs(1, &iOutput);
+   apply(inputs, outputs);
+}
+
+void DownscalingOperator::apply(const std::vector<const Field*>& iInputs, const std::vector<Field*>& iOutputs) const {
+   if(iInputs.size() != iOutputs.size()) {
+      Util::error("DownscalingOperator: different number of input and output fields");
+   }
+   int nField = iInputs.size();
+   int numOutput = getNumOutput();
+   if(nField == 0)
+      return;
+   int nEns = iInputs[0]->getNumEns();
+   for(int f = 0; f < nField; f++) {
+      const Field& input = *iInputs[f];
+      const Field& output = *iOutputs[f];
+      if(input.getNumLat()*input.getNumLon() != mNumInput || output.getNumLat()*output.getNumLon() != numOutput
+            || input.getNumEns() != nEns || output.getNumEns() != nEns) {
+         std::stringstream ss;
+         ss << "DownscalingOperator: cannot map " << mNumInput << " to " << numOutput << " gridpoints with fields of size "
+            << input.getNumLat() << "x" << input.getNumLon() << "x" << input.getNumEns() << " and "
+            << output.getNumLat() << "x" << output.getNumLon() << "x" << output.getNumEns();
+         Util::error(ss.str());
+      }
+   }
+   if(numOutput == 0 || nEns == 0)
+      return;
+
+   // Accumulate all fields and members of one output gridpoint at a time, such that each weight is
+   // only read once
+   int N = nField * nEns;
+   #pragma omp parallel
+   {
+      std::vector<double> total(N);
+      std::vector<double> totalWeight(N);
+      std::vector<int> count(N);
+      #pragma omp for
+      for(int p = 0; p < numOutput; p++) {
+         std::fill(total.begin(), total.end(), 0);
+         std::fill(totalWeight.begin(), totalWeight.end(), 0);
+         std::fill(count.begin(), count.end(), 0);
+         double rowWeight = 0;
+         for(int k = mRowStart[p]; k < mRowStart[p+1]; k++) {
+            double weight = mWeights[k];
+            int start = mIndices[k]*nEns;
+            rowWeight += weight;
+            for(int f = 0; f < nField; f++) {
+               const float* values = iInputs[f]->getData() + start;
+               int n = f*nEns;
+               for(int e = 0; e < nEns; e++) {
+                  if(Util::isValid(values[e])) {
+                     total[n+e] += weight * values[e];
+                     totalWeight[n+e] += weight;
+                     count[n+e]++;
+                  }
+               }
+            }
+         }
+         for(int f = 0; f < nField; f++) {
+            float* values = iOutputs[f]->getData() + p*nEns;
+            int n = f*nEns;
+            for(int e = 0; e < nEns; e++) {
+               if(count[n+e] == 0) {
+                  values[e] = Util::MV;
+                  continue;
+               }
+               float raw = total[n+e];
+               // Rescale the weights when some inputs are missing
+               if(totalWeight[n+e] != rowWeight && totalWeight[n+e] != 0)
+                  raw = total[n+e] / totalWeight[n+e] * rowWeight;
+               float value = mScales[p] * raw + mOffsets[p];
+               if((Util::isValid(mMin) && value < mMin) || (Util::isValid(mMax) && value > mMax))
+                  value = raw;
+               values[e] = value;
+            }
+         }
+      }
+   }
+}
+
+bool DownscalingOperator::write(std::string iFilename) const {
+   boost::int32_t header[5] = {operatorMagic, operatorVersion, mNumInput, getNumOutput(), size()};
+   float bounds[2] = {mMin, mMax};
+   std::vector<boost::int32_t> rowStart(mRowStart.begin(), mRowStart.end());
+   std::vector<boost::int32_t> indices(mIndices.begin(), mIndices.end());
+
+   std::stringstream ss;
+   ss << iFilename << ".tmp" << getpid();
+   std::string tempFilename = ss.str();
+   std::ofstream ofs(tempFilename.c_str(), std::ios::binary);
+   ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+   ofs.write(reinterpret_cast<const char*>(bounds), sizeof(bounds));
+   writeArray(ofs, rowStart);
+   writeArray(ofs, indices);
+   writeArray(ofs, mWeights);
+   writeArray(ofs, mScales);
+   writeArray(ofs, mOffsets);
+   ofs.close();
+   if(!ofs.good() || rename(tempFilename.c_str(), iFilename.c_str()) != 0) {
+      Util::warning("Could not write downscaling operator file '" + iFilename + "'");
+      remove(tempFilename.c_str());
+      return false;
+   }
+   return true;
+}
+
+bool DownscalingOperator::read(std::string iFilename) {
+   std::ifstream ifs(iFilename.c_str(), std::ios::binary);
+   if(!ifs.good())
+      return false;
+
+   boost::int32_t header[5];
+   float bounds[2];
+   ifs.read(reinterpret_cast<char*>(header), sizeof(header));
+   ifs.read(reinterpret_cast<char*>(bounds), sizeof(bounds));
+   if(!ifs.good() || header[0] != operatorMagic || header[1] != operatorVersion || header[2] < 0 || header[3] < 0 || header[4] < 0) {
+      Util::warning("Downscaling operator file '" + iFilename + "' is invalid. Recomputing operator.");
+      return false;
+   }
+   int numOutput = header[3];
+   int numWeights = header[4];
+   std::vector<boost::int32_t> rowStart;
+   std::vector<boost::int32_t> indices;
+   std::vector<float> weights, scales, offsets;
+   readArray(ifs, numOutput+1, rowStart);
+   readArray(ifs, numWeights, indices);
+   readArray(ifs, numWeights, weights);
+   readArray(ifs, numOutput, scales);
+   readArray(ifs, numOutput, offsets);
+   if(!ifs.good()) {
+      Util::warning("Downscaling operator file '" + iFilename + "' is truncated. Recomputing operator.");
+      return false;
+   }
+   // Check that the indices are consistent
+   bool valid = rowStart[0] == 0 && rowStart[numOutput] == numWeights;
+   for(int p = 0; p < numOutput && valid; p++)
+      valid = rowStart[p] <= rowStart[p+1];
+   for(int k = 0; k < numWeights && valid; k++)
+      valid = indices[k] >= 0 && indices[k] < header[2];
+   if(!valid) {
+      Util::warning("Downscaling operator file '" + iFilename + "' is invalid. Recomputing operator.");
+      return false;
+   }
+
+   mNumInput = header[2];
+   mMin = bounds[0];
+   mMax = bounds[1];
+   mRowStart.assign(rowStart.begin(), rowStart.end());
+   mIndices.assign(indices.begin(), indices.end());
+   mWeights = weights;
+   mScales = scales;
+   mOffsets = offsets;
+   Util::status("Read downscaling operator from cache file '" + iFilename + "'");
+   return true;
+}
+
+bool DownscalingOperator::operator==(const DownscalingOperator& iOther) const {
+   return mNumInput == iOther.mNumInput && mRowStart == iOther.mRowStart && mIndices == iOther.mIndices
+      && mWeights == iOther.mWeights && mScales == iOther.mScales && mOffsets == iOther.mOffsets
+      && mMin == iOther.mMin && mMax == iOther.mMax;
+}
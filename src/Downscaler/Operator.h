@@ -0,0 +1,64 @@
+#ifndef DOWNSCALING_OPERATOR_H
+#define DOWNSCALING_OPERATOR_H
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "../Field.h"
+
+//! \brief Linear map from the gridpoints of an input grid to those of an output grid. The weights
+//! are stored as a sparse matrix in compressed row format, with one row per output gridpoint
+//! (longitude varying fastest). Each row can have an elevation correction:
+//! output = scale * sum(weight * input) + offset
+//! Missing input values are left out, and the weights of the remaining inputs are rescaled so that
+//! they sum to the same total. If the corrected value is outside the bounds, the uncorrected value
+//! is used.
+class DownscalingOperator {
+   public:
+      //! @param iNumInput number of gridpoints in the input grid
+      DownscalingOperator(int iNumInput);
+
+      //! \brief Add the next output gridpoint
+      //! @param iIndices indices of the input gridpoints used (into the flattened input grid)
+      //! @param iWeights weight of each input gridpoint
+      //! @param iScale multiply the weighted sum by this factor
+      //! @param iOffset then add this offset
+      void addRow(const std::vector<int>& iIndices, const std::vector<float>& iWeights, float iScale=1, float iOffset=0);
+      //! Add an output gridpoint that uses a single input gridpoint. Util::MV gives missing output.
+      void addRow(int iIndex, float iScale=1, float iOffset=0);
+
+      //! \brief Use the uncorrected value when the corrected value is outside [iMin, iMax]
+      //! Util::MV means no bound.
+      void setBounds(float iMin, float iMax);
+
+      int getNumInput() const;
+      int getNumOutput() const;
+      //! Number of non-zero weights
+      int size() const;
+
+      //! Apply to one field. The output field must have getNumOutput() gridpoints.
+      void apply(const Field& iInput, Field& iOutput) const;
+      //! \brief Apply to several fields (e.g. all timesteps) at once, such that the weights are
+      //! only traversed once. All fields must have the same number of ensemble members.
+      void apply(const std::vector<const Field*>& iInputs, const std::vector<Field*>& iOutputs) const;
+
+      //! \brief Write to file. The file is first written to a temporary file and then renamed, such
+      //! that concurrent runs never see partially written files.
+      bool write(std::string iFilename) const;
+      //! \brief Read from file
+      //! @return false if the file does not exist or is invalid
+      bool read(std::string iFilename);
+
+      bool operator==(const DownscalingOperator& iOther) const;
+   private:
+      int mNumInput;
+      //! Start of each row in mIndices and mWeights. Has one more element than the number of rows.
+      std::vector<int> mRowStart;
+      std::vector<int> mIndices;
+      std::vector<float> mWeights;
+      std::vector<float> mScales;
+      std::vector<float> mOffsets;
+      float mMin;
+      float mMax;
+};
+typedef boost::shared_ptr<const DownscalingOperator> DownscalingOperatorPtr;
+#endif
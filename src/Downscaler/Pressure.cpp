@@ -8,50 +8,47 @@ DownscalerPressure::DownscalerPressure(Variable::Type iVariable) :
       Downscaler(iVariable) {
 }
 
-void DownscalerPressure::downscaleCore(const File& iInput, File& iOutput) const {
+std::string DownscalerPressure::getOperatorType(const File& iInput, const File& iOutput) const {
+   boost::uint64_t key = Util::hash(iInput.getElevTag());
+   key = Util::hash(iOutput.getElevTag(), key);
+   return name() + "_" + toHex(key);
+}
+
+DownscalingOperatorPtr DownscalerPressure::buildOperator(const File& iInput, const File& iOutput) const {
    int nLat = iOutput.getNumLat();
    int nLon = iOutput.getNumLon();
-   int nEns = iOutput.getNumEns();
-   int nTime = iInput.getNumTime();
+   int nInLon = iInput.getNumLon();
 
-   vec2 ilats  = iInput.getLats();
-   vec2 ilons  = iInput.getLons();
-   vec2 ielevs = iInput.getElevs();
-   vec2 olats  = iOutput.getLats();
-   vec2 olons  = iOutput.getLons();
-   vec2 oelevs = iOutput.getElevs();
+   const vec2& ielevs = iInput.getElevs();
+   const vec2& oelevs = iOutput.getElevs();
 
    // Get nearest neighbour
-   vec2Int nearestI, nearestJ;
-   getNearestNeighbourFast(iInput, iOutput, nearestI, nearestJ);
-
-   for(int t = 0; t < nTime; t++) {
-      Field& ifield = *iInput.getField(mVariable, t);
-      Field& ofield = *iOutput.getField(mVariable, t);
+   NeighbourTablePtr nearest = getNearestNeighbourTable(iInput, iOutput);
+   const vec2Int& nearestI = nearest->first;
+   const vec2Int& nearestJ = nearest->second;
 
-      #pragma omp parallel for
-      for(int i = 0; i < nLat; i++) {
-         for(int j = 0; j < nLon; j++) {
-            int Icenter = nearestI[i][j];
-            int Jcenter = nearestJ[i][j];
-            assert(Icenter < ielevs.size());
-            assert(Jcenter < ielevs[Icenter].size());
-            for(int e = 0; e < nEns; e++) {
-               float currElev = oelevs[i][j];
-               float nearestElev = ielevs[Icenter][Jcenter];
-               if(!Util::isValid(currElev) || !Util::isValid(nearestElev)) {
-                  // Can't adjust if we don't have an elevation, use nearest neighbour
-                  ofield(i,j,e) = ifield(Icenter,Jcenter,e);
-               }
-               else {
-                  float nearestPressure = ifield(Icenter,Jcenter,e);
-                  float currPressure = calcPressure(nearestElev, nearestPressure, currElev);
-                  ofield(i,j,e) = currPressure;
-               }
-            }
+   boost::shared_ptr<DownscalingOperator> op(new DownscalingOperator(iInput.getNumLat()*nInLon));
+   for(int i = 0; i < nLat; i++) {
+      for(int j = 0; j < nLon; j++) {
+         int Icenter = nearestI[i][j];
+         int Jcenter = nearestJ[i][j];
+         if(!Util::isValid(Icenter) || !Util::isValid(Jcenter)) {
+            op->addRow(Util::MV);
+            continue;
+         }
+         float currElev = oelevs[i][j];
+         float nearestElev = ielevs[Icenter][Jcenter];
+         if(!Util::isValid(currElev) || !Util::isValid(nearestElev)) {
+            // Can't adjust if we don't have an elevation, use nearest neighbour
+            op->addRow(Icenter*nInLon + Jcenter);
+         }
+         else {
+            // Same as calcPressure, but independent of the pressure
+            op->addRow(Icenter*nInLon + Jcenter, exp(mConstant * (currElev - nearestElev)));
          }
       }
    }
+   return op;
 }
 std::string DownscalerPressure::description() {
    std::stringstream ss;
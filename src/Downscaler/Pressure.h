@@ -15,7 +15,8 @@ class DownscalerPressure : public Downscaler {
       std::string name() const {return "pressure";};
       static float calcPressure(float iElev0, float iPressure0, float iElev1);
    private:
-      void downscaleCore(const File& iInput, File& iOutput) const;
+      std::string getOperatorType(const File& iInput, const File& iOutput) const;
+      DownscalingOperatorPtr buildOperator(const File& iInput, const File& iOutput) const;
       static const float mConstant;
 };
 #endif
@@ -2,64 +2,59 @@
 #include "../File/File.h"
 #include "../Util.h"
 #include <math.h>
+#include <algorithm>
+
+namespace {
+   //! Orders stencil points by elevation difference, and then by position in the stencil
+   struct CompareElevDiff {
+      bool operator()(const std::pair<int, float>& iLeft, const std::pair<int, float>& iRight) const {
+         if(iLeft.second != iRight.second)
+            return iLeft.second < iRight.second;
+         return iLeft.first < iRight.first;
+      }
+   };
+}
+
+std::map<DownscalerSmart::CacheKey, DownscalerSmart::SmartTablePtr> DownscalerSmart::mSmartCache;
 
 DownscalerSmart::DownscalerSmart(Variable::Type iVariable) :
       Downscaler(iVariable),
       mSearchRadius(3),
       mNumSmart(5),
       mMinElevDiff(Util::MV) {
+   addCacheClearer(&DownscalerSmart::clearSmartCache);
+}
+
+std::string DownscalerSmart::getOperatorType(const File& iInput, const File& iOutput) const {
+   return name() + "_" + toHex(getSettingsKey(iInput, iOutput));
 }
 
-void DownscalerSmart::downscaleCore(const File& iInput, File& iOutput) const {
+DownscalingOperatorPtr DownscalerSmart::buildOperator(const File& iInput, const File& iOutput) const {
    int nLat = iOutput.getNumLat();
    int nLon = iOutput.getNumLon();
-   int nEns = iOutput.getNumEns();
-   int nTime = iInput.getNumTime();
-
-   vec2 ilats  = iInput.getLats();
-   vec2 ilons  = iInput.getLons();
-   vec2 ielevs = iInput.getElevs();
-   vec2 olats  = iOutput.getLats();
-   vec2 olons  = iOutput.getLons();
-   vec2 oelevs = iOutput.getElevs();
-
-   // Get nearest neighbour
-   vec3Int nearestI, nearestJ;
-   getSmartNeighbours(iInput, iOutput, nearestI, nearestJ);
-
-   for(int t = 0; t < nTime; t++) {
-      Field& ifield = *iInput.getField(mVariable, t);
-      Field& ofield = *iOutput.getField(mVariable, t);
-
-      #pragma omp parallel for
-      for(int i = 0; i < nLat; i++) {
-         for(int j = 0; j < nLon; j++) {
-            for(int e = 0; e < nEns; e++) {
-               float total = 0;
-               int   count = 0;
-               int N = nearestI[i][j].size();
-               assert(nearestI[i][j].size() == nearestJ[i][j].size());
-               for(int n = 0; n < N; n++) {
-                  int ii = nearestI[i][j][n];
-                  int jj = nearestJ[i][j][n];
-
-                  if(Util::isValid(ii) && Util::isValid(jj)) {
-                     float value = ifield(ii,jj,e);
-                     if(Util::isValid(value)) {
-                        total += value;
-                        count++;
-                     }
-                  }
-               }
-               if(count > 0)
-                  ofield(i,j,e) = total/count;
-               else
-                  ofield(i,j,e) = Util::MV;
-               // ofield[i][j][e] = nearestI[i][j][0];
-            }
+   int nInLon = iInput.getNumLon();
+
+   // Average the smart neighbours
+   SmartTablePtr neighbours = getCachedNeighbours(iInput, iOutput);
+   const vec3Int& nearestI = neighbours->first;
+   const vec3Int& nearestJ = neighbours->second;
+
+   boost::shared_ptr<DownscalingOperator> op(new DownscalingOperator(iInput.getNumLat()*nInLon));
+   for(int i = 0; i < nLat; i++) {
+      for(int j = 0; j < nLon; j++) {
+         assert(nearestI[i][j].size() == nearestJ[i][j].size());
+         std::vector<int> indices;
+         for(int n = 0; n < nearestI[i][j].size(); n++) {
+            int ii = nearestI[i][j][n];
+            int jj = nearestJ[i][j][n];
+            if(Util::isValid(ii) && Util::isValid(jj))
+               indices.push_back(ii*nInLon + jj);
          }
+         std::vector<float> weights(indices.size(), 1.0 / indices.size());
+         op->addRow(indices, weights);
       }
    }
+   return op;
 }
 void DownscalerSmart::setNumSmart(int iNumSmart) {
    if(!Util::isValid(iNumSmart) || iNumSmart <= 0) {
@@ -78,18 +73,111 @@ void DownscalerSmart::setSearchRadius(int iNumPoints) {
    mSearchRadius = iNumPoints;
 }
 void DownscalerSmart::getSmartNeighbours(const File& iFrom, const File& iTo, vec3Int& iI, vec3Int& iJ) const {
-   vec2 ilats  = iFrom.getLats();
-   vec2 ilons  = iFrom.getLons();
-   vec2 ielevs = iFrom.getElevs();
-   vec2 olats  = iTo.getLats();
-   vec2 olons  = iTo.getLons();
-   vec2 oelevs = iTo.getElevs();
+   SmartTablePtr neighbours = getCachedNeighbours(iFrom, iTo);
+   iI = neighbours->first;
+   iJ = neighbours->second;
+}
+
+DownscalerSmart::SmartTablePtr DownscalerSmart::getCachedNeighbours(const File& iFrom, const File& iTo) const {
+   boost::uint64_t settingsKey = getSettingsKey(iFrom, iTo);
+   CacheKey key(std::make_pair(iFrom.getUniqueTag(), iTo.getUniqueTag()), settingsKey);
+   SmartTablePtr neighbours;
+   // Timesteps and variables can be downscaled in parallel, but the neighbours should only be
+   // computed once
+   #pragma omp critical(DownscalerSmartCache)
+   {
+      std::map<CacheKey, SmartTablePtr>::const_iterator it = mSmartCache.find(key);
+      if(it != mSmartCache.end()) {
+         neighbours = it->second;
+      }
+      else {
+         boost::shared_ptr<SmartTable> table(new SmartTable());
+         std::string filename = getSmartCacheFilename(iFrom, iTo);
+         if(filename == "" || !readFromDisk(filename, iFrom, iTo, table->first, table->second)) {
+            computeSmartNeighbours(iFrom, iTo, table->first, table->second);
+            if(filename != "")
+               writeToDisk(filename, iFrom, table->first, table->second);
+         }
+         mSmartCache[key] = table;
+         neighbours = table;
+      }
+   }
+   return neighbours;
+}
+
+boost::uint64_t DownscalerSmart::getSettingsKey(const File& iFrom, const File& iTo) const {
+   vec2 settings(1);
+   settings[0].push_back(mSearchRadius);
+   settings[0].push_back(mNumSmart);
+   settings[0].push_back(mMinElevDiff);
+   // The elevation tags are only computed once per grid
+   boost::uint64_t key = Util::hash(iFrom.getElevTag());
+   key = Util::hash(iTo.getElevTag(), key);
+   return Util::hash(settings, key);
+}
+
+std::string DownscalerSmart::getSmartCacheFilename(const File& iFrom, const File& iTo) const {
+   // The settings key is part of the type, since the lat/lon tags do not cover elevations
+   return getCacheFilename("smart_" + toHex(getSettingsKey(iFrom, iTo)), iFrom, iTo);
+}
+
+void DownscalerSmart::clearSmartCache() {
+   #pragma omp critical(DownscalerSmartCache)
+   mSmartCache.clear();
+}
+
+bool DownscalerSmart::readFromDisk(std::string iFilename, const File& iFrom, const File& iTo, vec3Int& iI, vec3Int& iJ) const {
+   int nLat = iTo.getNumLat();
+   int nLon = iTo.getNumLon();
+   vec2Int I, J;
+   if(!Downscaler::readFromDisk(iFilename, iFrom.getNumLat(), iFrom.getNumLon(), nLat, nLon*mNumSmart, I, J))
+      return false;
+   iI.resize(nLat);
+   iJ.resize(nLat);
+   for(int i = 0; i < nLat; i++) {
+      iI[i].resize(nLon);
+      iJ[i].resize(nLon);
+      for(int j = 0; j < nLon; j++) {
+         iI[i][j].clear();
+         iJ[i][j].clear();
+         for(int n = 0; n < mNumSmart; n++) {
+            int ii = I[i][j*mNumSmart + n];
+            int jj = J[i][j*mNumSmart + n];
+            if(Util::isValid(ii) && Util::isValid(jj)) {
+               iI[i][j].push_back(ii);
+               iJ[i][j].push_back(jj);
+            }
+         }
+      }
+   }
+   return true;
+}
+
+bool DownscalerSmart::writeToDisk(std::string iFilename, const File& iFrom, const vec3Int& iI, const vec3Int& iJ) const {
+   int nLat = iI.size();
+   int nLon = nLat > 0 ? iI[0].size() : 0;
+   vec2Int I(nLat, std::vector<int>(nLon*mNumSmart, Util::MV));
+   vec2Int J(nLat, std::vector<int>(nLon*mNumSmart, Util::MV));
+   for(int i = 0; i < nLat; i++) {
+      for(int j = 0; j < nLon; j++) {
+         assert(iI[i][j].size() <= mNumSmart);
+         std::copy(iI[i][j].begin(), iI[i][j].end(), I[i].begin() + j*mNumSmart);
+         std::copy(iJ[i][j].begin(), iJ[i][j].end(), J[i].begin() + j*mNumSmart);
+      }
+   }
+   return Downscaler::writeToDisk(iFilename, iFrom.getNumLat(), iFrom.getNumLon(), I, J);
+}
+
+void DownscalerSmart::computeSmartNeighbours(const File& iFrom, const File& iTo, vec3Int& iI, vec3Int& iJ) const {
+   const vec2& ielevs = iFrom.getElevs();
+   const vec2& oelevs = iTo.getElevs();
    int nLon    = iTo.getNumLon();
    int nLat    = iTo.getNumLat();
    int numSearch = getNumSearchPoints(mSearchRadius);
 
-   vec2Int Icenter, Jcenter;
-   getNearestNeighbourFast(iFrom, iTo, Icenter, Jcenter);
+   NeighbourTablePtr nearest = getNearestNeighbourTable(iFrom, iTo);
+   const vec2Int& Icenter = nearest->first;
+   const vec2Int& Jcenter = nearest->second;
 
    iI.resize(nLat);
    iJ.resize(nLat);
@@ -135,11 +223,10 @@ void DownscalerSmart::getSmartNeighbours(const File& iFrom, const File& iTo, vec
                }
             }
 
-            std::sort(elevDiff.begin(), elevDiff.end(), Util::sort_pair_second<int,float>());
-
-            std::stringstream ss;
-            ss << "Smart neighbours for " << i << " " << j << " " << oelev;
-            Util::status(ss.str());
+            // Only the closest mNumSmart points are needed, so avoid sorting the whole stencil
+            int N = std::min((int) elevDiff.size(), mNumSmart);
+            std::nth_element(elevDiff.begin(), elevDiff.begin() + N, elevDiff.end(), CompareElevDiff());
+            std::sort(elevDiff.begin(), elevDiff.begin() + N, CompareElevDiff());
 
             // Use nearest neighbour if all fails
             if(elevDiff.size() == 0) {
@@ -147,7 +234,6 @@ void DownscalerSmart::getSmartNeighbours(const File& iFrom, const File& iTo, vec
                iJ[i][j].push_back(Jc);
             }
             else {
-               int N = std::min((int) elevDiff.size(), mNumSmart);
                iI[i][j].resize(N, Util::MV);
                iJ[i][j].resize(N, Util::MV);
 
@@ -155,9 +241,6 @@ void DownscalerSmart::getSmartNeighbours(const File& iFrom, const File& iTo, vec
                   int index = elevDiff[n].first;
                   iI[i][j][n] = Ilookup[index];
                   iJ[i][j][n] = Jlookup[index];
-                  std::stringstream ss;
-                  ss << "   " << iI[i][j][n] << " " << iJ[i][j][n] << " " << elevDiff[n].second;
-                  Util::status(ss.str());
                }
             }
          }
@@ -23,14 +23,36 @@ class DownscalerSmart : public Downscaler {
       static std::string description();
       std::string name() const {return "smart";};
 
-      //! Method may return fewer than num smart neighbours
+      //! \brief Method may return fewer than num smart neighbours. The neighbours are computed once
+      //! for each pair of grids and settings, and are shared by all smart downscalers.
       void getSmartNeighbours(const File& iFrom, const File& iTo, vec3Int& iI, vec3Int& iJ) const;
       static int getNumSearchPoints(int iSearchRadius) ;
              int getNumSearchPoints() const;
+      //! Filename of the disk cache for the smart neighbours. Returns "" if the disk cache is disabled.
+      std::string getSmartCacheFilename(const File& iFrom, const File& iTo) const;
+      //! Remove all smart neighbour tables held in memory (not those on disk)
+      static void clearSmartCache();
    private:
-      void downscaleCore(const File& iInput, File& iOutput) const;
+      std::string getOperatorType(const File& iInput, const File& iOutput) const;
+      DownscalingOperatorPtr buildOperator(const File& iInput, const File& iOutput) const;
+      //! Smart neighbour I and J tables, shared between the cache and its users
+      typedef std::pair<vec3Int, vec3Int> SmartTable;
+      typedef boost::shared_ptr<const SmartTable> SmartTablePtr;
+      //! \brief Get the smart neighbours from the memory cache, the disk cache, or by computing them.
+      //! The returned tables remain valid after the cache is cleared.
+      SmartTablePtr getCachedNeighbours(const File& iFrom, const File& iTo) const;
+      void computeSmartNeighbours(const File& iFrom, const File& iTo, vec3Int& iI, vec3Int& iJ) const;
+      //! Hash of the elevation tags of both grids and the settings that the smart neighbours depend on
+      boost::uint64_t getSettingsKey(const File& iFrom, const File& iTo) const;
+      //! \brief Read/write the tables using a fixed number of neighbours (mNumSmart) per point.
+      //! Missing entries are padded with Util::MV.
+      bool readFromDisk(std::string iFilename, const File& iFrom, const File& iTo, vec3Int& iI, vec3Int& iJ) const;
+      bool writeToDisk(std::string iFilename, const File& iFrom, const vec3Int& iI, const vec3Int& iJ) const;
       int mSearchRadius;
       int mNumSmart;
       float mMinElevDiff;
+      //! Smart neighbours, keyed by the lat/lon tags of the input and output grids and the settings key
+      typedef std::pair<std::pair<boost::uint64_t, boost::uint64_t>, boost::uint64_t> CacheKey;
+      static std::map<CacheKey, SmartTablePtr> mSmartCache;
 };
 #endif
@@ -12,7 +12,7 @@
 void writeUsage() {
    std::cout << "Post-processes gridded forecasts" << std::endl;
    std::cout << std::endl;
-   std::cout << "usage:  gridpp input output [-v var [options]* [-d downscaler [options]*]] [-c calibrator [options]*]]*]+" << std::endl;
+   std::cout << "usage:  gridpp input output [-v var [options]* [-d downscaler [options]*]] [-c calibrator [options]*]]*]+ [--stream] [--concurrent] [--cacheDir=dir]" << std::endl;
    std::cout << "        gridpp [--version]" << std::endl;
    std::cout << "        gridpp [--help]" << std::endl;
    std::cout << std::endl;
@@ -24,6 +24,14 @@ void writeUsage() {
    std::cout << "   -d downscaler One of the downscalers below." << std::endl;
    std::cout << "   -c calibrator One of the calibrators below." << std::endl;
    std::cout << "   options       Options of the form key=value" << std::endl;
+   std::cout << "   --stream      Process, write, and free one timestep at a time, instead of" << std::endl;
+   std::cout << "                 processing all timesteps before writing. Reduces memory usage." << std::endl;
+   std::cout << "                 Only available for NetCDF output files." << std::endl;
+   std::cout << "   --concurrent  Process variables that do not depend on each other at the same" << std::endl;
+   std::cout << "                 time, sharing the threads between them." << std::endl;
+   std::cout << "   --cacheDir=dir Store neighbour tables and downscaling operators in this" << std::endl;
+   std::cout << "                 directory and reuse them in later runs with the same input and" << std::endl;
+   std::cout << "                 output grids. Used by all downscalers. Disabled if not set." << std::endl;
    std::cout << "   --version     Print the program's version" << std::endl;
    std::cout << "   --help        Print usage information" << std::endl;
    std::cout << std::endl;
@@ -39,6 +47,8 @@ void writeUsage() {
    std::cout << FileEc::description();
    std::cout << FilePoint::description();
    std::cout << FileNorcomQnh::description();
+   std::cout << "   Options for all types:" << std::endl;
+   std::cout << File::description();
    std::cout << std::endl;
    std::cout << "Variables:" << std::endl;
    std::cout << Variable::description();
@@ -48,6 +58,7 @@ void writeUsage() {
    std::cout << std::endl;
    std::cout << "Downscalers with options (and default values):" << std::endl;
    std::cout << DownscalerNearestNeighbour::description();
+   std::cout << DownscalerBilinear::description();
    std::cout << DownscalerGradient::description();
    std::cout << DownscalerSmart::description();
    std::cout << DownscalerPressure::description();
@@ -69,8 +80,19 @@ int main(int argc, const char *argv[]) {
    double start = Util::clock();
 
    // Parse command line attributes
+   bool stream = false;
+   bool concurrent = false;
    for(int i = 1; i < argc; i++) {
-      if(strcmp(argv[i], "--version") == 0) {
+      if(strcmp(argv[i], "--stream") == 0) {
+         stream = true;
+      }
+      else if(strcmp(argv[i], "--concurrent") == 0) {
+         concurrent = true;
+      }
+      else if(strncmp(argv[i], "--cacheDir=", 11) == 0) {
+         Downscaler::setCacheDirectory(std::string(argv[i] + 11));
+      }
+      else if(strcmp(argv[i], "--version") == 0) {
          std::cout << "gridpp version " << Util::gridppVersion() << std::endl;
          return 0;
       }
@@ -91,7 +113,8 @@ int main(int argc, const char *argv[]) {
    // Retrieve setup
    std::vector<std::string> args;
    for(int i = 1; i < argc; i++) {
-      args.push_back(std::string(argv[i]));
+      if(strcmp(argv[i], "--stream") != 0 && strcmp(argv[i], "--concurrent") != 0 && strncmp(argv[i], "--cacheDir=", 11) != 0)
+         args.push_back(std::string(argv[i]));
    }
    Setup setup(args);
    std::cout << "Input type:  " << setup.inputFile->name() << std::endl;
@@ -99,42 +122,69 @@ int main(int argc, const char *argv[]) {
    setup.outputFile->setTimes(setup.inputFile->getTimes());
    setup.outputFile->setReferenceTime(setup.inputFile->getReferenceTime());
 
-   // Post-process file
    std::vector<Variable::Type> writeVariables;
    for(int v = 0; v < setup.variableConfigurations.size(); v++) {
-      double s = Util::clock();
       VariableConfiguration varconf = setup.variableConfigurations[v];
-      Variable::Type variable = varconf.variable;
-
       bool write = 1;
       varconf.variableOptions.getValue("write", write);
       if(write) {
-         writeVariables.push_back(variable);
+         writeVariables.push_back(varconf.variable);
       }
-      setup.outputFile->initNewVariable(variable);
+   }
+   if(stream && !setup.outputFile->canWriteTimestep()) {
+      Util::warning("Output file type '" + setup.outputFile->name() + "' cannot be written one timestep at a time. Disabling streaming.");
+      stream = false;
+   }
 
-      std::cout << "Processing " << Variable::getTypeName(variable) << std::endl;
+   if(stream) {
+      // Keep the previous timestep in memory if a calibrator needs it
+      bool keepPrevious = false;
+      for(int v = 0; v < setup.variableConfigurations.size(); v++) {
+         VariableConfiguration varconf = setup.variableConfigurations[v];
+         for(int c = 0; c < varconf.calibrators.size(); c++) {
+            keepPrevious = keepPrevious || varconf.calibrators[c]->dependsOnPreviousTime();
+         }
+      }
+
+      // Post-process and write one timestep at a time
+      for(int t = 0; t < setup.outputFile->getNumTime(); t++) {
+         double s = Util::clock();
+         // Read the next timestep in the background while this one is processed
+         for(int v = 0; v < setup.variableConfigurations.size(); v++) {
+            setup.inputFile->prefetch(setup.variableConfigurations[v].variable, t+1);
+         }
+         setup.process(t, concurrent, std::cout);
+         setup.outputFile->writeTimestep(writeVariables, t);
 
-      // Downscale
-      std::cout << "   Downscaler " << varconf.downscaler->name() << std::endl;
-      varconf.downscaler->downscale(*setup.inputFile, *setup.outputFile);
-      for(int c = 0; c < varconf.calibrators.size(); c++) {
-         // Calibrate
-         std::cout << "   Calibrator " << varconf.calibrators[c]->name() << std::endl;
-         varconf.calibrators[c]->calibrate(*setup.outputFile);
+         // Free the memory used by this timestep. The input is kept until the next timestep,
+         // since derived variables (e.g. precipitation) can also use the previous timestep.
+         if(keepPrevious) {
+            if(t > 0)
+               setup.outputFile->clear(t-1);
+         }
+         else {
+            setup.outputFile->clear(t);
+         }
+         if(t > 0)
+            setup.inputFile->clear(t-1);
+         double e = Util::clock();
+         std::cout << "Processing timestep " << t << ": " << e-s << " seconds" << std::endl;
       }
-      double e = Util::clock();
-      std::cout << "   " << e-s << " seconds" << std::endl;
-      std::cout << "Current mem usage input: " << setup.inputFile->getCacheSize() / 1e6<< std::endl;
-      std::cout << "Current mem usage output: " << setup.outputFile->getCacheSize() / 1e6<< std::endl;
-      // setup.inputFile->clear();
    }
+   else {
+      // Post-process file
+      setup.process(Util::MV, concurrent, std::cout);
 
-   // Write to output
-   double s = Util::clock();
-   setup.outputFile->write(writeVariables);
+      // Write to output
+      double s = Util::clock();
+      setup.outputFile->write(writeVariables);
+      double e = Util::clock();
+      std::cout << "Writing file: " << e-s << " seconds" << std::endl;
+   }
    double e = Util::clock();
-   std::cout << "Writing file: " << e-s << " seconds" << std::endl;
+   std::cout << "Input cache:  " << setup.inputFile->getCacheHits() << " hits, "
+             << setup.inputFile->getCacheMisses() << " misses, "
+             << setup.inputFile->getCacheEvictions() << " evictions" << std::endl;
    std::cout << "Total time:   " << e-start << " seconds" << std::endl;
 
    return 0;
@@ -17,20 +17,34 @@ class Field {
       //! @param iFillValue initialize all values in field with this
       Field(int nLat, int nLon, int nEns, float iFillValue=Util::MV);
 
-      //! Access to data
+      //! Access to data. Indices are only checked in debug builds (compiled with -DDEBUG).
       //! @param i latitude index
       //! @param j longitude index
       //! @param k ensemble index
       //! @return data at specified coordinate
-      float      & operator()(unsigned int i, unsigned int j, unsigned int k);
-      float const& operator()(unsigned int i, unsigned int j, unsigned int k) const;
+      float      & operator()(unsigned int i, unsigned int j, unsigned int k) {return mValues[getIndex(i,j,k)];};
+      float const& operator()(unsigned int i, unsigned int j, unsigned int k) const {return mValues[getIndex(i,j,k)];};
 
-      //! Access to an ensemble for a specific grid point
+      //! Access to an ensemble for a specific grid point. Allocates a new vector; use
+      //! getEnsemble in loops over many gridpoints.
       //! @param i latitude index
       //! @param j longitude index
       //! @return ensemble of values
       std::vector<float> operator()(unsigned int i, unsigned int j) const;
 
+      //! \brief Pointer to the getNumEns() contiguous values of the ensemble at a grid point. The
+      //! pointer is valid for the lifetime of the field.
+      float*       getEnsemble(unsigned int i, unsigned int j) {return &mValues[0] + getIndex(i,j);};
+      const float* getEnsemble(unsigned int i, unsigned int j) const {return &mValues[0] + getIndex(i,j);};
+
+      //! Pointer to the getNumLon()*getNumEns() contiguous values of latitude row i
+      float*       getRow(unsigned int i) {return &mValues[0] + getIndex(i,0);};
+      const float* getRow(unsigned int i) const {return &mValues[0] + getIndex(i,0);};
+
+      //! Pointer to all values. The ensemble index changes fastest, then longitude, then latitude.
+      float*       getData() {return &mValues[0];};
+      const float* getData() const {return &mValues[0];};
+
       //! Are all values (for all lat/lon/ens) in fields identical?
       bool operator==(const Field& iField) const;
       bool operator!=(const Field& iField) const;
@@ -51,7 +65,21 @@ class Field {
       int mNLon;
       int mNEns;
       //! Index into flat array that corresponds to coordinate
-      int getIndex(unsigned int i, unsigned int j, unsigned int k) const;
+      int getIndex(unsigned int i, unsigned int j, unsigned int k) const {
+#ifdef DEBUG
+         if(i >= mNLat || j >= mNLon || k >= mNEns)
+            Util::error("Cannot access element");
+#endif
+         return k + j*mNEns + i*mNLon*mNEns;
+      };
+      //! Index of the first ensemble member at a gridpoint
+      int getIndex(unsigned int i, unsigned int j) const {
+#ifdef DEBUG
+         if(i >= mNLat || j >= mNLon)
+            Util::error("Cannot access element");
+#endif
+         return (j + i*mNLon)*mNEns;
+      };
 };
 typedef boost::shared_ptr<Field> FieldPtr;
 #endif
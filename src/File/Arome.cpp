@@ -120,81 +120,74 @@ FieldPtr FileArome::getFieldCore(std::string iVariable, int iTime) const {
 }
 
 FileArome::~FileArome() {
+   stopPrefetch();
 }
 
-void FileArome::writeCore(std::vector<Variable::Type> iVariables) {
-   writeTimes();
-   writeReferenceTime();
-   writeGlobalAttributes();
-   for(int v = 0; v < iVariables.size(); v++) {
-      Variable::Type varType = iVariables[v];
-      std::string variable = getVariableName(varType);
-      NcVar* var;
-      if(hasVariableCore(varType)) {
-         var = getVar(variable);
+void FileArome::writeField(Variable::Type iVariable, int iTime, FieldPtr iField) {
+   std::string variable = getVariableName(iVariable);
+   NcVar* var;
+   if(hasVariableCore(iVariable)) {
+      var = getVar(variable);
+   }
+   else {
+      // Create variable
+      if(0) {
+         NcDim* dTime    = getDim("time");
+         NcDim* dSurface = getDim("height0");
+         NcDim* dLon     = getDim("x");
+         NcDim* dLat     = getDim("y");
+         var = mFile.add_var(variable.c_str(), ncFloat, dTime, dSurface, dLat, dLon);
       }
       else {
-         // Create variable
-         if(0) {
-            NcDim* dTime    = getDim("time");
-            NcDim* dSurface = getDim("height0");
-            NcDim* dLon     = getDim("x");
-            NcDim* dLat     = getDim("y");
-            var = mFile.add_var(variable.c_str(), ncFloat, dTime, dSurface, dLat, dLon);
-         }
-         else {
-            NcDim* dTime    = getDim("time");
-            NcDim* dLon     = getDim("x");
-            NcDim* dLat     = getDim("y");
-            var = mFile.add_var(variable.c_str(), ncFloat, dTime, dLat, dLon);
-         }
+         NcDim* dTime    = getDim("time");
+         NcDim* dLon     = getDim("x");
+         NcDim* dLat     = getDim("y");
+         var = mFile.add_var(variable.c_str(), ncFloat, dTime, dLat, dLon);
       }
-      float MV = getMissingValue(var); // The output file's missing value indicator
-      for(int t = 0; t < mNTime; t++) {
-         float offset = getOffset(var);
-         float scale = getScale(var);
-         FieldPtr field = getField(varType, t);
-         if(field != NULL) { // TODO: Can't be null if coming from reference
-            float* values = new float[mNLat*mNLon];
+   }
+   float MV = getMissingValue(var); // The output file's missing value indicator
+   float offset = getOffset(var);
+   float scale = getScale(var);
+   FieldPtr field = iField;
+   if(field != NULL) { // TODO: Can't be null if coming from reference
+      float* values = new float[mNLat*mNLon];
 
-            int index = 0;
-            for(int lat = 0; lat < mNLat; lat++) {
-               for(int lon = 0; lon < mNLon; lon++) {
-                  float value = (*field)(lat,lon,0);
-                  if(!Util::isValid(value)) {
-                     // Field has missing value indicator and the value is missing
-                     // Save values using the file's missing indicator value
-                     value = MV;
-                  }
-                  else {
-                     value = ((*field)(lat,lon,0) - offset)/scale;
-                  }
-                  values[index] = value;
-                  index++;
-               }
-            }
-            int numDims = var->num_dims();
-            if(numDims == 4) {
-               var->set_cur(t, 0, 0, 0);
-               var->put(values, 1, 1, mNLat, mNLon);
-            }
-            else if(numDims == 3) {
-               var->set_cur(t, 0, 0);
-               var->put(values, 1, mNLat, mNLon);
+      int index = 0;
+      for(int lat = 0; lat < mNLat; lat++) {
+         for(int lon = 0; lon < mNLon; lon++) {
+            float value = (*field)(lat,lon,0);
+            if(!Util::isValid(value)) {
+               // Field has missing value indicator and the value is missing
+               // Save values using the file's missing indicator value
+               value = MV;
             }
             else {
-               std::stringstream ss;
-               ss << "Cannot write variable '" << variable << "' from '" << getFilename() << "'";
-               Util::error(ss.str());
+               value = ((*field)(lat,lon,0) - offset)/scale;
             }
-            setAttribute(var, "coordinates", "longitude latitude");
-            setAttribute(var, "units", Variable::getUnits(varType));
-            setAttribute(var, "standard_name", Variable::getStandardName(varType));
-            delete[] values;
+            values[index] = value;
+            index++;
          }
       }
-      setMissingValue(var, MV);
+      int numDims = var->num_dims();
+      if(numDims == 4) {
+         var->set_cur(iTime, 0, 0, 0);
+         var->put(values, 1, 1, mNLat, mNLon);
+      }
+      else if(numDims == 3) {
+         var->set_cur(iTime, 0, 0);
+         var->put(values, 1, mNLat, mNLon);
+      }
+      else {
+         std::stringstream ss;
+         ss << "Cannot write variable '" << variable << "' from '" << getFilename() << "'";
+         Util::error(ss.str());
+      }
+      setAttribute(var, "coordinates", "longitude latitude");
+      setAttribute(var, "units", Variable::getUnits(iVariable));
+      setAttribute(var, "standard_name", Variable::getStandardName(iVariable));
+      delete[] values;
    }
+   setMissingValue(var, MV);
 }
 
 
@@ -228,6 +221,9 @@ std::string FileArome::getVariableName(Variable::Type iVariable) const {
    else if(iVariable == Variable::RH) {
       return "relative_humidity_2m";
    }
+   else if(iVariable == Variable::TD) {
+      return "dew_point_temperature_2m";
+   }
    else if(iVariable == Variable::Phase) {
       // TODO: Correct name?
       return "phase";
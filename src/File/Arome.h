@@ -20,7 +20,7 @@ class FileArome : public FileNetcdf {
       static std::string description();
       std::string name() const {return "arome";};
    protected:
-      void writeCore(std::vector<Variable::Type> iVariables);
+      void writeField(Variable::Type iVariable, int iTime, FieldPtr iField);
       FieldPtr getFieldCore(Variable::Type iVariable, int iTime) const;
       FieldPtr getFieldCore(std::string iVariable, int iTime) const;
       vec2 getLatLonVariable(std::string iVariable) const;
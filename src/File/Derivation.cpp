@@ -0,0 +1,245 @@
+#include "Derivation.h"
+#include "File.h"
+#include "../Util.h"
+#include <math.h>
+#include <cmath>
+#include <algorithm>
+
+// All values of a field are contiguous, so the kernels below loop over them as one array
+namespace {
+   //! Deaccumulates precipitation
+   class DerivationPrecip : public Derivation {
+      public:
+         DerivationPrecip() : Derivation(std::vector<Variable::Type>(1, Variable::Precip)) {
+            addInput(Variable::PrecipAcc, -1);
+            addInput(Variable::PrecipAcc, 0);
+         };
+         void compute(const File& iFile, const std::vector<FieldPtr>& iInputs, const std::vector<Field*>& iOutputs) const {
+            if(iInputs.size() == 0)
+               return; // First offset is missing
+            const float MV = Util::MV;
+            const float* a0 = iInputs[0]->getData();
+            const float* a1 = iInputs[1]->getData();
+            float* values = iOutputs[0]->getData();
+            int N = iFile.getNumLat() * iFile.getNumLon() * iFile.getNumEns();
+            #pragma omp parallel for
+            for(int n = 0; n < N; n++) {
+               float value = a1[n] - a0[n];
+               if(value < 0)
+                  value = 0;
+               bool isValid = Util::isValidInline(a1[n], MV) && Util::isValidInline(a0[n], MV);
+               values[n] = isValid ? value : MV;
+            }
+         };
+   };
+
+   //! Accumulates precipitation
+   class DerivationPrecipAcc : public Derivation {
+      public:
+         DerivationPrecipAcc() : Derivation(std::vector<Variable::Type>(1, Variable::PrecipAcc)) {
+            addInput(Variable::PrecipAcc, -1);
+            addInput(Variable::Precip, 0);
+         };
+         void compute(const File& iFile, const std::vector<FieldPtr>& iInputs, const std::vector<Field*>& iOutputs) const {
+            const float MV = Util::MV;
+            float* values = iOutputs[0]->getData();
+            int N = iFile.getNumLat() * iFile.getNumLon() * iFile.getNumEns();
+            if(iInputs.size() == 0) {
+               // First offset is 0
+               std::fill(values, values + N, 0);
+               return;
+            }
+            const float* a = iInputs[0]->getData();
+            const float* p = iInputs[1]->getData();
+            #pragma omp parallel for
+            for(int n = 0; n < N; n++) {
+               float value = a[n] + p[n];
+               if(value < 0)
+                  value = 0;
+               bool isValid = Util::isValidInline(a[n], MV) && Util::isValidInline(p[n], MV);
+               values[n] = isValid ? value : MV;
+            }
+         };
+   };
+
+   //! Computes wind speed and direction from the wind components
+   class DerivationWind : public Derivation {
+      public:
+         DerivationWind() : Derivation(getWindOutputs()) {
+            addInput(Variable::U);
+            addInput(Variable::V);
+         };
+         void compute(const File& iFile, const std::vector<FieldPtr>& iInputs, const std::vector<Field*>& iOutputs) const {
+            const float* uValues = iInputs[0]->getData();
+            const float* vValues = iInputs[1]->getData();
+            float* speedValues = iOutputs[0] != NULL ? iOutputs[0]->getData() : NULL;
+            float* directionValues = iOutputs[1] != NULL ? iOutputs[1]->getData() : NULL;
+            int N = iFile.getNumLat() * iFile.getNumLon() * iFile.getNumEns();
+            #pragma omp parallel for
+            for(int n = 0; n < N; n++) {
+               float currU = uValues[n];
+               float currV = vValues[n];
+               if(speedValues != NULL)
+                  speedValues[n] = sqrt(currU*currU + currV*currV);
+               if(directionValues != NULL) {
+                  float dir = std::atan2(-currU,-currV) * 180 / Util::pi;
+                  if(dir < 0)
+                     dir += 360;
+                  directionValues[n] = dir;
+               }
+            }
+         };
+      private:
+         static std::vector<Variable::Type> getWindOutputs() {
+            std::vector<Variable::Type> outputs;
+            outputs.push_back(Variable::W);
+            outputs.push_back(Variable::WD);
+            return outputs;
+         };
+   };
+
+   //! Computes the wind components from wind speed and direction
+   class DerivationWindComponents : public Derivation {
+      public:
+         DerivationWindComponents() : Derivation(getComponentOutputs()) {
+            addInput(Variable::W);
+            addInput(Variable::WD);
+         };
+         void compute(const File& iFile, const std::vector<FieldPtr>& iInputs, const std::vector<Field*>& iOutputs) const {
+            const float MV = Util::MV;
+            const float* speedValues = iInputs[0]->getData();
+            const float* directionValues = iInputs[1]->getData();
+            float* uValues = iOutputs[0] != NULL ? iOutputs[0]->getData() : NULL;
+            float* vValues = iOutputs[1] != NULL ? iOutputs[1]->getData() : NULL;
+            int N = iFile.getNumLat() * iFile.getNumLon() * iFile.getNumEns();
+            #pragma omp parallel for
+            for(int n = 0; n < N; n++) {
+               float speed = speedValues[n];
+               float dir = Util::deg2rad(directionValues[n]);
+               bool isValid = Util::isValidInline(speedValues[n], MV) && Util::isValidInline(directionValues[n], MV);
+               // The direction is where the wind blows from
+               if(uValues != NULL)
+                  uValues[n] = isValid ? -speed * sin(dir) : MV;
+               if(vValues != NULL)
+                  vValues[n] = isValid ? -speed * cos(dir) : MV;
+            }
+         };
+      private:
+         static std::vector<Variable::Type> getComponentOutputs() {
+            std::vector<Variable::Type> outputs;
+            outputs.push_back(Variable::U);
+            outputs.push_back(Variable::V);
+            return outputs;
+         };
+   };
+
+   //! Reduces the surface pressure to sea-level using a standard atmosphere
+   class DerivationQnh : public Derivation {
+      public:
+         DerivationQnh() : Derivation(std::vector<Variable::Type>(1, Variable::QNH)) {
+            addInput(Variable::P);
+         };
+         void compute(const File& iFile, const std::vector<FieldPtr>& iInputs, const std::vector<Field*>& iOutputs) const {
+            const vec2& elevs = iFile.getElevs();
+            const Field& pressure = *iInputs[0];
+            Field& qnh = *iOutputs[0];
+            int nLat = iFile.getNumLat();
+            int nLon = iFile.getNumLon();
+            int nEns = iFile.getNumEns();
+            #pragma omp parallel for
+            for(int i = 0; i < nLat; i++) {
+               for(int j = 0; j < nLon; j++) {
+                  float currElev = elevs[i][j];
+                  const float* currPressure = pressure.getEnsemble(i, j);
+                  float* currQnh = qnh.getEnsemble(i, j);
+                  for(int e = 0; e < nEns; e++) {
+                     currQnh[e] = Util::calcQnh(currElev, currPressure[e]);
+                  }
+               }
+            }
+         };
+   };
+
+   //! Computes relative humidity (fraction) from temperature and dewpoint temperature, using the
+   //! same saturation vapour pressure formula as the wetbulb temperature in CalibratorPhase
+   class DerivationRh : public Derivation {
+      public:
+         DerivationRh() : Derivation(std::vector<Variable::Type>(1, Variable::RH)) {
+            addInput(Variable::T);
+            addInput(Variable::TD);
+         };
+         void compute(const File& iFile, const std::vector<FieldPtr>& iInputs, const std::vector<Field*>& iOutputs) const {
+            const float MV = Util::MV;
+            const float* tValues = iInputs[0]->getData();
+            const float* tdValues = iInputs[1]->getData();
+            float* values = iOutputs[0]->getData();
+            int N = iFile.getNumLat() * iFile.getNumLon() * iFile.getNumEns();
+            #pragma omp parallel for
+            for(int n = 0; n < N; n++) {
+               float t  = tValues[n] - 273.15;
+               float td = tdValues[n] - 273.15;
+               bool isValid = Util::isValidInline(tValues[n], MV) && Util::isValidInline(tdValues[n], MV)
+                              && t > -243.04 && td > -243.04;
+               if(isValid)
+                  values[n] = exp(17.63*td/(td+243.04) - 17.63*t/(t+243.04));
+               else
+                  values[n] = MV;
+            }
+         };
+   };
+}
+
+Derivation::Derivation(const std::vector<Variable::Type>& iOutputs) :
+      mOutputs(iOutputs) {
+   if(iOutputs.size() == 0) {
+      Util::error("Derivation: must have at least one output");
+   }
+}
+
+void Derivation::addInput(Variable::Type iVariable, int iOffset) {
+   if(iOffset > 0 || (iOffset == 0 && hasOutput(iVariable))) {
+      Util::error("Derivation: " + Variable::getTypeName(iVariable) + " cannot be used as input");
+   }
+   mInputs.push_back(iVariable);
+   mOffsets.push_back(iOffset);
+}
+
+const std::vector<Variable::Type>& Derivation::getOutputs() const {
+   return mOutputs;
+}
+
+bool Derivation::hasOutput(Variable::Type iVariable) const {
+   return std::find(mOutputs.begin(), mOutputs.end(), iVariable) != mOutputs.end();
+}
+
+const std::vector<Variable::Type>& Derivation::getInputs() const {
+   return mInputs;
+}
+
+const std::vector<int>& Derivation::getOffsets() const {
+   return mOffsets;
+}
+
+std::vector<DerivationPtr> Derivation::getDefaults() {
+   std::vector<DerivationPtr> derivations;
+   derivations.push_back(DerivationPtr(new DerivationPrecip()));
+   derivations.push_back(DerivationPtr(new DerivationPrecipAcc()));
+   derivations.push_back(DerivationPtr(new DerivationWind()));
+   return derivations;
+}
+
+DerivationPtr Derivation::getScheme(std::string iName) {
+   if(iName == "windComponents") {
+      return DerivationPtr(new DerivationWindComponents());
+   }
+   else if(iName == "qnh") {
+      return DerivationPtr(new DerivationQnh());
+   }
+   else if(iName == "rh") {
+      return DerivationPtr(new DerivationRh());
+   }
+   else {
+      Util::error("Could not understand derivation " + iName);
+   }
+   return DerivationPtr();
+}
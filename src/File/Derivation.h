@@ -0,0 +1,57 @@
+#ifndef DERIVATION_H
+#define DERIVATION_H
+#include <vector>
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include "../Variable.h"
+#include "../Field.h"
+
+class File;
+class Derivation;
+typedef boost::shared_ptr<const Derivation> DerivationPtr;
+
+//! \brief Rule for computing variables that are not in a file from other variables in the file.
+//! Inputs can come from earlier timesteps (e.g. to accumulate precipitation). For the first
+//! timesteps, where these are not available, the rule is given no inputs and must provide initial
+//! values instead.
+class Derivation {
+   public:
+      //! @param iOutputs variables computed by this rule. All outputs are computed from the same
+      //! inputs, such that several of them can be computed in one pass.
+      Derivation(const std::vector<Variable::Type>& iOutputs);
+      virtual ~Derivation() {};
+
+      //! \brief Compute the outputs for one timestep
+      //! @param iFile the file that the fields belong to
+      //! @param iInputs one field for each input, or no fields if some of the inputs are before the
+      //! first timestep
+      //! @param iOutputs one field for each output, initialized with missing values. Outputs that
+      //! are not needed are NULL.
+      virtual void compute(const File& iFile, const std::vector<FieldPtr>& iInputs, const std::vector<Field*>& iOutputs) const = 0;
+
+      const std::vector<Variable::Type>& getOutputs() const;
+      bool hasOutput(Variable::Type iVariable) const;
+      const std::vector<Variable::Type>& getInputs() const;
+      //! Timestep of each input relative to the derived timestep (0 or negative)
+      const std::vector<int>& getOffsets() const;
+
+      //! \brief Rules available in all files, the preferred ones first:
+      //! Precip from PrecipAcc, PrecipAcc from Precip, and W and WD from U and V.
+      static std::vector<DerivationPtr> getDefaults();
+
+      //! \brief Rules that are only used when added to a file (see File::addDerivation), since they
+      //! make more variables available in output files
+      //! @param iName one of: windComponents (U and V from W and WD), qnh (QNH from P), or rh (RH
+      //! from T and TD)
+      static DerivationPtr getScheme(std::string iName);
+   protected:
+      //! Use this variable as the next input
+      //! @param iOffset timestep relative to the derived timestep. Must be negative if the
+      //! variable is also an output.
+      void addInput(Variable::Type iVariable, int iOffset=0);
+   private:
+      std::vector<Variable::Type> mOutputs;
+      std::vector<Variable::Type> mInputs;
+      std::vector<int> mOffsets;
+};
+#endif
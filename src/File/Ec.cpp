@@ -46,6 +46,10 @@ FileEc::FileEc(std::string iFilename, bool iReadOnly) : FileNetcdf(iFilename, iR
    Util::status( "File '" + iFilename + " 'has dimensions " + getDimenionString());
 }
 
+FileEc::~FileEc() {
+   stopPrefetch();
+}
+
 FieldPtr FileEc::getFieldCore(Variable::Type iVariable, int iTime) const {
    std::string variable = getVariableName(iVariable);
    // Not cached, retrieve data
@@ -86,65 +90,58 @@ FieldPtr FileEc::getFieldCore(Variable::Type iVariable, int iTime) const {
    return field;
 }
 
-void FileEc::writeCore(std::vector<Variable::Type> iVariables) {
-   writeTimes();
-   writeReferenceTime();
-   writeGlobalAttributes();
-   for(int v = 0; v < iVariables.size(); v++) {
-      Variable::Type varType = iVariables[v];
-      std::string variable = getVariableName(varType);
-      NcVar* var;
-      if(hasVariableCore(varType)) {
-         var = getVar(variable);
-      }
-      else {
-         // Create variable
-         NcDim* dTime    = getDim("time");
-         NcDim* dSurface = getDim("surface");
-         NcDim* dEns     = getDim("ensemble_member");
-         NcDim* dLon     = getLonDim();
-         NcDim* dLat     = getLatDim();
-         var = mFile.add_var(variable.c_str(), ncFloat, dTime, dSurface, dEns, dLat, dLon);
-      }
-      float MV = getMissingValue(var); // The output file's missing value indicator
-      for(int t = 0; t < mNTime; t++) {
-         float offset = getOffset(var);
-         float scale = getScale(var);
-         FieldPtr field = getField(varType, t);
-         if(field != NULL) { // TODO: Can't be null if coming from reference
-            var->set_cur(t, 0, 0, 0, 0);
-            float* values = new float[mNTime*1*mNEns*mNLat*mNLon];
+void FileEc::writeField(Variable::Type iVariable, int iTime, FieldPtr iField) {
+   std::string variable = getVariableName(iVariable);
+   NcVar* var;
+   if(hasVariableCore(iVariable)) {
+      var = getVar(variable);
+   }
+   else {
+      // Create variable
+      NcDim* dTime    = getDim("time");
+      NcDim* dSurface = getDim("surface");
+      NcDim* dEns     = getDim("ensemble_member");
+      NcDim* dLon     = getLonDim();
+      NcDim* dLat     = getLatDim();
+      var = mFile.add_var(variable.c_str(), ncFloat, dTime, dSurface, dEns, dLat, dLon);
+   }
+   float MV = getMissingValue(var); // The output file's missing value indicator
+   float offset = getOffset(var);
+   float scale = getScale(var);
+   FieldPtr field = iField;
+   if(field != NULL) { // TODO: Can't be null if coming from reference
+      var->set_cur(iTime, 0, 0, 0, 0);
+      float* values = new float[mNEns*mNLat*mNLon];
 
-            int index = 0;
-            for(int e = 0; e < mNEns; e++) {
-               for(int lat = 0; lat < mNLat; lat++) {
-                  for(int lon = 0; lon < mNLon; lon++) {
-                     float value = (*field)(lat,lon,e);
-                     if(Util::isValid(MV) && !Util::isValid(value)) {
-                        // Field has missing value indicator and the value is missing
-                        // Save values using the file's missing indicator value
-                        value = MV;
-                     }
-                     else {
-                        value = ((*field)(lat,lon,e) - offset)/scale;
-                     }
-                     values[index] = value;
-                     index++;
-                  }
+      int index = 0;
+      for(int e = 0; e < mNEns; e++) {
+         for(int lat = 0; lat < mNLat; lat++) {
+            for(int lon = 0; lon < mNLon; lon++) {
+               float value = (*field)(lat,lon,e);
+               if(Util::isValid(MV) && !Util::isValid(value)) {
+                  // Field has missing value indicator and the value is missing
+                  // Save values using the file's missing indicator value
+                  value = MV;
                }
-            }
-            if(var->num_dims() == 5) {
-               var->put(values, 1, 1, mNEns, mNLat, mNLon);
-               setAttribute(var, "coordinates", "longitude latitude");
-               setAttribute(var, "units", Variable::getUnits(varType));
-               setAttribute(var, "standard_name", Variable::getStandardName(varType));
-            }
-            else {
-               Util::warning("Cannot write " + variable + " to '" + getFilename() +
-                             "' because it does not have 5 dimensions");
+               else {
+                  value = ((*field)(lat,lon,e) - offset)/scale;
+               }
+               values[index] = value;
+               index++;
             }
          }
       }
+      if(var->num_dims() == 5) {
+         var->put(values, 1, 1, mNEns, mNLat, mNLon);
+         setAttribute(var, "coordinates", "longitude latitude");
+         setAttribute(var, "units", Variable::getUnits(iVariable));
+         setAttribute(var, "standard_name", Variable::getStandardName(iVariable));
+      }
+      else {
+         Util::warning("Cannot write " + variable + " to '" + getFilename() +
+                       "' because it does not have 5 dimensions");
+      }
+      delete[] values;
    }
 }
 
@@ -18,13 +18,14 @@
 class FileEc : public FileNetcdf {
    public:
       FileEc(std::string iFilename, bool iReadOnly=false);
+      ~FileEc();
 
       std::string getVariableName(Variable::Type iVariable) const;
       static bool isValid(std::string iFilename);
       static std::string description();
       std::string name() const {return "ec";};
    protected:
-      void writeCore(std::vector<Variable::Type> iVariables);
+      void writeField(Variable::Type iVariable, int iTime, FieldPtr iField);
       FieldPtr getFieldCore(Variable::Type iVariable, int iTime) const;
 
       std::vector<int> mTimes;
@@ -40,6 +40,10 @@ FileFake::FileFake(int nLat, int nLon, int nEns, int nTime) :
    }
 }
 
+FileFake::~FileFake() {
+   stopPrefetch();
+}
+
 FieldPtr FileFake::getFieldCore(Variable::Type iVariable, int iTime) const {
 
    FieldPtr field = getEmptyField();
@@ -53,7 +57,7 @@ FieldPtr FileFake::getFieldCore(Variable::Type iVariable, int iTime) const {
    }
    return field;
 }
-void FileFake::writeCore(std::vector<Variable::Type> iVariables) {
+void FileFake::writeCore(std::vector<Variable::Type> iVariables, const std::vector<std::vector<FieldPtr> >& iFields) {
    Util::warning("Cannot write file using the 'Fake' format");
 }
 
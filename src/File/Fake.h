@@ -6,10 +6,11 @@
 class FileFake : public File {
    public:
       FileFake(int nLat=10, int nLon=10, int nEns=2, int nTime=10);
+      ~FileFake();
       static std::string description();
       std::string name() const {return "fake";};
    protected:
-      void writeCore(std::vector<Variable::Type> iVariables);
+      void writeCore(std::vector<Variable::Type> iVariables, const std::vector<std::vector<FieldPtr> >& iFields);
       FieldPtr getFieldCore(Variable::Type iVariable, int iTime) const;
       bool hasVariableCore(Variable::Type iVariable) const;
 };
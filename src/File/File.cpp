@@ -4,13 +4,39 @@
 #include <stdlib.h>
 #include <sstream>
 #include <cmath>
+#include <algorithm>
 #include "../Util.h"
 #include "../Options.h"
 
-File::File(std::string iFilename) :
+pthread_mutex_t File::mIoMutex;
+pthread_once_t File::mIoMutexOnce = PTHREAD_ONCE_INIT;
+
+File::File(std::string iFilename, bool iReadOnly) :
       mFilename(iFilename),
+      mTagValid(false),
+      mElevTagValid(false),
+      mReadOnly(iReadOnly),
+      mMaxCacheSize(Util::MV),
+      mNumCached(0),
+      mCacheHits(0),
+      mCacheMisses(0),
+      mCacheEvictions(0),
+      mReadAhead(0),
+      mKeepDerived(false),
+      mDerivations(Derivation::getDefaults()),
+      mPrefetch(0),
+      mPrefetchRunning(false),
+      mPrefetchStop(false),
       mReferenceTime(Util::MV) {
-   createNewTag();
+   pthread_mutexattr_t attr;
+   pthread_mutexattr_init(&attr);
+   pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+   pthread_mutex_init(&mCacheMutex, &attr);
+   pthread_mutexattr_destroy(&attr);
+   pthread_cond_init(&mCacheCond, NULL);
+   pthread_mutex_init(&mPrefetchMutex, NULL);
+   pthread_cond_init(&mPrefetchCond, NULL);
+   pthread_once(&mIoMutexOnce, &File::initIoMutex);
 }
 
 File* File::getScheme(std::string iFilename, const Options& iOptions, bool iReadOnly) {
@@ -54,159 +80,266 @@ File* File::getScheme(std::string iFilename, const Options& iOptions, bool iRead
    else {
       Util::error("Could not understand file type " + type);
    }
+
+   std::string cacheSize;
+   if(file != NULL && iOptions.getValue("cacheSize", cacheSize)) {
+      file->setMaxCacheSize(Util::parseBytes(cacheSize));
+   }
+   int readAhead;
+   if(file != NULL && iOptions.getValue("readAhead", readAhead)) {
+      file->setReadAhead(readAhead);
+   }
+   int prefetch;
+   if(file != NULL && iOptions.getValue("prefetch", prefetch)) {
+      file->setPrefetch(prefetch);
+   }
+   bool keepDerived;
+   if(file != NULL && iOptions.getValue("keepDerived", keepDerived)) {
+      file->setKeepDerived(keepDerived);
+   }
+   std::vector<std::string> derive;
+   if(file != NULL && iOptions.getValues("derive", derive)) {
+      for(int i = 0; i < derive.size(); i++) {
+         file->addDerivation(Derivation::getScheme(derive[i]));
+      }
+   }
    return file;
 }
 
 FieldPtr File::getField(Variable::Type iVariable, int iTime) const {
-   // Determine if values have been cached
-   std::map<Variable::Type, std::vector<FieldPtr> >::const_iterator it = mFields.find(iVariable);
-   bool needsReading = it == mFields.end();
-   if(!needsReading) {
-      if(mFields[iVariable].size() <= iTime) {
-         std::stringstream ss;
-         ss << "Attempted to access variable '" << Variable::getTypeName(iVariable) << "' for time " << iTime
-            << " in file '" << getFilename() << "'";
-         Util::error(ss.str());
-      }
+   return getField(iVariable, iTime, false);
+}
 
-      needsReading = mFields[iVariable][iTime] == NULL;
+FieldPtr File::getField(Variable::Type iVariable, int iTime, bool iIsInput) const {
+   if(iTime < 0 || iTime >= getNumTime()) {
+      std::stringstream ss;
+      ss << "Attempted to access variable '" << Variable::getTypeName(iVariable) << "' for time " << iTime
+         << " in file '" << getFilename() << "'";
+      Util::error(ss.str());
    }
-   else {
+
+   bool stored = isStored(iVariable);
+   FieldKey key(iVariable, iTime);
+   pthread_mutex_lock(&mCacheMutex);
+   if(mFields.find(iVariable) == mFields.end()) {
       mFields[iVariable].resize(getNumTime());
    }
+   if(!iIsInput)
+      mRequested.insert(iVariable);
+   // Another thread is reading or deriving the field
+   while(mLoading.find(key) != mLoading.end()) {
+      pthread_cond_wait(&mCacheCond, &mCacheMutex);
+   }
 
-   if(needsReading) {
+   // Determine if values have been cached
+   FieldPtr field = mFields[iVariable][iTime];
+   if(field == NULL) {
+      mCacheMisses++;
+      mLoading.insert(key);
       // Load non-derived variable from file
-      if(hasVariableCore(iVariable)) {
-         for(int t = 0; t < getNumTime(); t++) {
-            mFields[iVariable][t] = getFieldCore(iVariable, t);
-         }
-      }
-      // Try to derive the field
-      else if(iVariable == Variable::Precip) {
-         // Deaccumulate
-         FieldPtr field = getEmptyField();
-         addField(field, Variable::Precip, 0); // First offset is 0
-
-         for(int t = 1; t < getNumTime(); t++) {
-            FieldPtr field = getEmptyField();
-            const FieldPtr acc0  = getField(Variable::PrecipAcc, t-1);
-            const FieldPtr acc1  = getField(Variable::PrecipAcc, t);
-            for(int lat = 0; lat < getNumLat(); lat++) {
-               for(int lon = 0; lon < getNumLon(); lon++) {
-                  for(int e = 0; e < getNumEns(); e++) {
-                     float a1 = (*acc1)(lat,lon,e);
-                     float a0 = (*acc0)(lat,lon,e);
-                     float value = Util::MV;
-                     if(Util::isValid(a1) && Util::isValid(a0)) {
-                         value = a1 - a0;
-                         if(value < 0)
-                            value = 0;
-                     }
-                     (*field)(lat,lon,e) = value;
-                  }
-               }
-            }
-            addField(field, Variable::Precip, t);
-         }
-      }
-      else if(iVariable == Variable::PrecipAcc) {
-         // Accumulate
-         FieldPtr prevAccum = getEmptyField(0);
-         addField(prevAccum, Variable::PrecipAcc, 0); // First offset is 0
-
-         for(int t = 1; t < getNumTime(); t++) {
-            FieldPtr currAccum = getEmptyField();
-            const FieldPtr currPrecip  = getField(Variable::Precip, t);
-            for(int lat = 0; lat < getNumLat(); lat++) {
-               for(int lon = 0; lon < getNumLon(); lon++) {
-                  for(int e = 0; e < getNumEns(); e++) {
-                     float a = (*prevAccum)(lat,lon,e);
-                     float p = (*currPrecip)(lat,lon,e);
-                     float value = Util::MV;
-                     if(Util::isValid(a) && Util::isValid(p)) {
-                         value = a + p;
-                         if(value < 0)
-                            value = 0;
-                     }
-                     (*currAccum)(lat,lon,e) = value;
-                  }
-               }
+      if(stored) {
+         // Read the requested time and the following read-ahead times
+         int endTime = std::min(getNumTime(), iTime + 1 + mReadAhead);
+         std::vector<int> times(1, iTime);
+         for(int t = iTime + 1; t < endTime; t++) {
+            FieldKey aheadKey(iVariable, t);
+            if(mFields[iVariable][t] == NULL && mLoading.find(aheadKey) == mLoading.end()) {
+               times.push_back(t);
+               mLoading.insert(aheadKey);
             }
-            addField(currAccum, Variable::PrecipAcc, t);
-            prevAccum = currAccum;
          }
-      }
-      else if(iVariable == Variable::W) {
-         if(hasVariableCore(Variable::U) && hasVariableCore(Variable::V)) {
-            for(int t = 0; t < getNumTime(); t++) {
-               FieldPtr windSpeed = getEmptyField();
-               const FieldPtr u = getField(Variable::U, t);
-               const FieldPtr v = getField(Variable::V, t);
-               for(int lat = 0; lat < getNumLat(); lat++) {
-                  for(int lon = 0; lon < getNumLon(); lon++) {
-                     for(int e = 0; e < getNumEns(); e++) {
-                        float currU = (*u)(lat,lon,e);
-                        float currV = (*v)(lat,lon,e);
-                        (*windSpeed)(lat,lon,e) = sqrt(currU*currU + currV*currV);
-                     }
-                  }
-               }
-               addField(windSpeed, Variable::W, t);
+         pthread_mutex_unlock(&mCacheMutex);
+         for(int i = 0; i < times.size(); i++) {
+            FieldPtr curr = readField(iVariable, times[i]);
+            if(i == 0)
+               field = curr;
+            pthread_mutex_lock(&mCacheMutex);
+            cacheFieldFromFile(curr, iVariable, times[i]);
+            // The requested time is released below
+            if(i > 0) {
+               mLoading.erase(FieldKey(iVariable, times[i]));
+               pthread_cond_broadcast(&mCacheCond);
             }
+            pthread_mutex_unlock(&mCacheMutex);
          }
-         else {
-            Util::error("Cannot derive wind speed from variables in file");
+         for(int t = endTime; t < std::min(getNumTime(), endTime + mPrefetch); t++) {
+            prefetch(iVariable, t);
          }
       }
-      else if(iVariable == Variable::WD) {
-         if(hasVariableCore(Variable::U) && hasVariableCore(Variable::V)) {
-            for(int t = 0; t < getNumTime(); t++) {
-               FieldPtr windDir = getEmptyField();
-               const FieldPtr u = getField(Variable::U, t);
-               const FieldPtr v = getField(Variable::V, t);
-               for(int lat = 0; lat < getNumLat(); lat++) {
-                  for(int lon = 0; lon < getNumLon(); lon++) {
-                     for(int e = 0; e < getNumEns(); e++) {
-                        float currU = (*u)(lat,lon,e);
-                        float currV = (*v)(lat,lon,e);
-                        float dir = std::atan2(-currU,-currV) * 180 / Util::pi;
-                        if(dir < 0)
-                           dir += 360;
-                        (*windDir)(lat,lon,e) = dir;
-                     }
-                  }
-               }
-               addField(windDir, Variable::WD, t);
-            }
-         }
-         else {
-            Util::error("Cannot derive wind speed from variables in file");
-         }
+      // Try to derive the field
+      else {
+         pthread_mutex_unlock(&mCacheMutex);
+         field = deriveField(iVariable, iTime);
+         pthread_mutex_lock(&mCacheMutex);
+         cacheFieldFromFile(field, iVariable, iTime, true);
+         pthread_mutex_unlock(&mCacheMutex);
+      }
+      pthread_mutex_lock(&mCacheMutex);
+      mLoading.erase(key);
+      pthread_cond_broadcast(&mCacheCond);
+      if(mFields[iVariable][iTime] != NULL)
+         field = mFields[iVariable][iTime];
+   }
+   else {
+      mCacheHits++;
+   }
+
+   // Mark as most recently used
+   std::map<FieldKey, std::list<FieldKey>::iterator>::iterator itLru = mLruPosition.find(key);
+   if(itLru != mLruPosition.end()) {
+      mLru.splice(mLru.begin(), mLru, itLru->second);
+   }
+   // Inputs to a derivation are evicted by the outermost call, once the derived field is cached.
+   // Fields in use elsewhere (e.g. by other threads) are held by their FieldPtr, so they can
+   // safely be removed from the cache.
+   if(!iIsInput)
+      evict(key);
+   pthread_mutex_unlock(&mCacheMutex);
+   return field;
+}
+
+FieldPtr File::deriveField(Variable::Type iVariable, int iTime) const {
+   DerivationPtr derivation = getDerivation(iVariable);
+   if(derivation == NULL) {
+      std::string variableType = Variable::getTypeName(iVariable);
+      Util::error(variableType + " not available in '" + getFilename() + "'");
+   }
+
+   // Inputs before the first timestep are not available. The derivation then provides initial
+   // values instead.
+   const std::vector<Variable::Type>& inputs = derivation->getInputs();
+   const std::vector<int>& offsets = derivation->getOffsets();
+   bool hasInputs = true;
+   for(int k = 0; k < inputs.size(); k++) {
+      if(iTime + offsets[k] < 0)
+         hasInputs = false;
+   }
+   std::vector<FieldPtr> inputFields;
+   if(hasInputs) {
+      for(int k = 0; k < inputs.size(); k++) {
+         inputFields.push_back(getField(inputs[k], iTime + offsets[k], true));
+      }
+   }
+
+   // Other outputs of the derivation that have been used before (e.g. for an earlier timestep)
+   // will most likely also be needed for this timestep, so compute them in the same pass.
+   const std::vector<Variable::Type>& outputs = derivation->getOutputs();
+   std::vector<bool> isSameDerivation(outputs.size(), false);
+   for(int k = 0; k < outputs.size(); k++) {
+      isSameDerivation[k] = !isStored(outputs[k]) && getDerivation(outputs[k]) == derivation;
+   }
+   std::vector<bool> isInputStored(inputs.size(), false);
+   for(int k = 0; k < inputs.size(); k++) {
+      isInputStored[k] = isStored(inputs[k]);
+   }
+   std::vector<FieldPtr> outputFields(outputs.size());
+   std::vector<Field*> outputPointers(outputs.size(), (Field*) NULL);
+   FieldPtr field;
+   pthread_mutex_lock(&mCacheMutex);
+   for(int k = 0; k < outputs.size(); k++) {
+      if(outputs[k] == iVariable) {
+         field = getEmptyField();
+         outputFields[k] = field;
       }
       else {
-         std::string variableType = Variable::getTypeName(iVariable);
-         Util::error(variableType + " not available in '" + getFilename() + "'");
+         std::map<Variable::Type, std::vector<FieldPtr> >::const_iterator it = mFields.find(outputs[k]);
+         if(it != mFields.end() && it->second[iTime] == NULL && mLoading.find(FieldKey(outputs[k], iTime)) == mLoading.end()
+               && isSameDerivation[k]) {
+            outputFields[k] = getEmptyField();
+         }
       }
+      outputPointers[k] = outputFields[k].get();
    }
-   if(mFields[iVariable].size() <= iTime) {
-      std::stringstream ss;
-      ss << "Attempted to access variable '" << Variable::getTypeName(iVariable) << "' for time " << iTime
-         << " in file '" << getFilename() << "'";
-      Util::error(ss.str());
+   pthread_mutex_unlock(&mCacheMutex);
+
+   if(getNumLat() * getNumLon() * getNumEns() > 0)
+      derivation->compute(*this, inputFields, outputPointers);
+
+   pthread_mutex_lock(&mCacheMutex);
+   for(int k = 0; k < outputs.size(); k++) {
+      if(outputFields[k] != NULL && outputs[k] != iVariable)
+         cacheFieldFromFile(outputFields[k], outputs[k], iTime, true);
    }
-   FieldPtr field = mFields[iVariable][iTime];
+   // Free derived inputs that have not been requested by themselves, unless the derivation uses
+   // them again for the next timestep
+   for(int k = 0; k < inputFields.size(); k++) {
+      bool usedLater = false;
+      for(int m = 0; m < inputs.size(); m++) {
+         if(inputs[m] == inputs[k] && offsets[m] < offsets[k])
+            usedLater = true;
+      }
+      FieldKey key(inputs[k], iTime + offsets[k]);
+      if(!usedLater && mRequested.find(inputs[k]) == mRequested.end() && mLruPosition.find(key) != mLruPosition.end()
+            && mKept.find(key) == mKept.end() && !isInputStored[k]) {
+         cacheField(FieldPtr(), key.first, key.second, true);
+      }
+   }
+   pthread_mutex_unlock(&mCacheMutex);
    return field;
 }
 
 File::~File() {
+   stopPrefetch();
+   pthread_cond_destroy(&mPrefetchCond);
+   pthread_mutex_destroy(&mPrefetchMutex);
+   pthread_cond_destroy(&mCacheCond);
+   pthread_mutex_destroy(&mCacheMutex);
 }
 
 void File::write(std::vector<Variable::Type> iVariables) {
-   writeCore(iVariables);
+   // Retrieve the fields before locking the I/O, since getField may wait for another thread
+   // that is reading a field
+   std::vector<std::vector<FieldPtr> > fields(iVariables.size());
+   for(int v = 0; v < iVariables.size(); v++) {
+      fields[v].resize(getNumTime());
+      for(int t = 0; t < getNumTime(); t++) {
+         fields[v][t] = getField(iVariables[v], t);
+      }
+   }
+   lockIo();
+   writeCore(iVariables, fields);
+   unlockIo();
+   // Writing can add variables to the file
+   pthread_mutex_lock(&mCacheMutex);
+   clearStored();
+   pthread_mutex_unlock(&mCacheMutex);
    // mCache.clear();
 }
 
+void File::writeTimestep(std::vector<Variable::Type> iVariables, int iTime) {
+   if(!canWriteTimestep()) {
+      Util::error("Cannot write one timestep at a time to '" + getFilename() + "'");
+   }
+   std::vector<FieldPtr> fields(iVariables.size());
+   for(int v = 0; v < iVariables.size(); v++) {
+      fields[v] = getField(iVariables[v], iTime);
+   }
+   lockIo();
+   writeTimestepCore(iVariables, iTime, fields);
+   unlockIo();
+   pthread_mutex_lock(&mCacheMutex);
+   clearStored();
+   pthread_mutex_unlock(&mCacheMutex);
+}
+
+void File::clearStored() {
+   std::map<Variable::Type, bool>::iterator it = mStored.begin();
+   while(it != mStored.end()) {
+      if(mCreated.find(it->first) == mCreated.end())
+         mStored.erase(it++);
+      else
+         it++;
+   }
+}
+
+bool File::canWriteTimestep() const {
+   return false;
+}
+
+void File::writeTimestepCore(std::vector<Variable::Type> iVariables, int iTime, const std::vector<FieldPtr>& iFields) {
+   Util::error("Cannot write one timestep at a time to '" + getFilename() + "'");
+}
+
 
 FieldPtr File::getEmptyField(float iFillValue) const {
    return getEmptyField(getNumLat(), getNumLon(), getNumEns(), iFillValue);
@@ -217,12 +350,72 @@ FieldPtr File::getEmptyField(int nLat, int nLon, int nEns, float iFillValue) con
 }
 
 void File::addField(FieldPtr iField, Variable::Type iVariable, int iTime) const {
+   pthread_mutex_lock(&mCacheMutex);
+   cacheField(iField, iVariable, iTime, true);
+   pthread_mutex_unlock(&mCacheMutex);
+}
+
+void File::cacheField(FieldPtr iField, Variable::Type iVariable, int iTime, bool iPinned) const {
    std::map<Variable::Type, std::vector<FieldPtr> >::const_iterator it = mFields.find(iVariable);
    if(it == mFields.end()) {
       mFields[iVariable].resize(getNumTime());
    }
 
-   mFields[iVariable][iTime] = iField;
+   FieldPtr& slot = mFields[iVariable][iTime];
+   if(slot == NULL && iField != NULL)
+      mNumCached++;
+   else if(slot != NULL && iField == NULL)
+      mNumCached--;
+   slot = iField;
+
+   FieldKey key(iVariable, iTime);
+   mKept.erase(key);
+   std::map<FieldKey, std::list<FieldKey>::iterator>::iterator itLru = mLruPosition.find(key);
+   if(itLru != mLruPosition.end()) {
+      mLru.erase(itLru->second);
+      mLruPosition.erase(itLru);
+   }
+   if(!iPinned && iField != NULL) {
+      mLru.push_front(key);
+      mLruPosition[key] = mLru.begin();
+   }
+}
+
+void File::cacheFieldFromFile(FieldPtr iField, Variable::Type iVariable, int iTime, bool iDerived) const {
+   std::map<Variable::Type, std::vector<FieldPtr> >::const_iterator it = mFields.find(iVariable);
+   if(it != mFields.end() && it->second[iTime] != NULL)
+      return;
+   // Fields in writable files can be modified in place by the caller and must therefore be kept
+   cacheField(iField, iVariable, iTime, !isReadOnly());
+   if(isReadOnly() && iDerived && mKeepDerived)
+      mKept.insert(FieldKey(iVariable, iTime));
+}
+
+void File::evict(const FieldKey& iKeep) const {
+   if(!Util::isValid(mMaxCacheSize))
+      return;
+   long fieldSize = getNumLat()*getNumLon()*getNumEns()*sizeof(float);
+   // First evict the fields that can be read again. Kept derived fields are only evicted when
+   // they alone exceed the maximum size.
+   for(int pass = 0; pass < 2; pass++) {
+      std::list<FieldKey>::iterator it = mLru.end();
+      while(it != mLru.begin()) {
+         bool isFull = pass == 0 ? getCacheSize() > mMaxCacheSize : mKept.size() * fieldSize > mMaxCacheSize;
+         if(!isFull)
+            break;
+         it--;
+         FieldKey key = *it;
+         bool isKept = mKept.find(key) != mKept.end();
+         if(key == iKeep || (pass == 0 && isKept) || (pass == 1 && !isKept))
+            continue;
+         it = mLru.erase(it);
+         mLruPosition.erase(key);
+         mKept.erase(key);
+         mFields[key.first][key.second].reset();
+         mNumCached--;
+         mCacheEvictions++;
+      }
+   }
 }
 
 bool File::hasSameDimensions(const File& iOther) const {
@@ -245,81 +438,408 @@ std::string File::getFilename() const {
 }
 
 void File::initNewVariable(Variable::Type iVariable) {
-   if(!hasVariable(iVariable)) {
+   if(isStored(iVariable) || isDerivable(iVariable))
+      return;
+   pthread_mutex_lock(&mCacheMutex);
+   mCreated.insert(iVariable);
+   if(mFields.find(iVariable) == mFields.end()) {
       for(int t = 0; t < getNumTime(); t++) {
          addField(getEmptyField(), iVariable, t);
       }
    }
+   pthread_mutex_unlock(&mCacheMutex);
+}
+void File::initNewVariable(Variable::Type iVariable, int iTime) {
+   if(isStored(iVariable) || isDerivable(iVariable))
+      return;
+   pthread_mutex_lock(&mCacheMutex);
+   mCreated.insert(iVariable);
+   std::map<Variable::Type, std::vector<FieldPtr> >::const_iterator it = mFields.find(iVariable);
+   if(it == mFields.end() || it->second[iTime] == NULL) {
+      addField(getEmptyField(), iVariable, iTime);
+   }
+   pthread_mutex_unlock(&mCacheMutex);
 }
 bool File::hasVariable(Variable::Type iVariable) const {
-   bool status = hasVariableCore(iVariable);
-   if(status)
+   if(isStored(iVariable) || isDerivable(iVariable))
       return true;
-// Check if field is derivable
-   if(iVariable == Variable::Precip) {
-      return hasVariableCore(Variable::PrecipAcc);
-   }
-   else if(iVariable == Variable::PrecipAcc) {
-      return hasVariableCore(Variable::Precip);
-   }
-   else if(iVariable == Variable::W) {
-      return hasVariableCore(Variable::V) && hasVariableCore(Variable::U);
+
+   // Check if field has been initialized
+   pthread_mutex_lock(&mCacheMutex);
+   bool isInitialized = mFields.find(iVariable) != mFields.end();
+   pthread_mutex_unlock(&mCacheMutex);
+   return isInitialized;
+}
+std::vector<Variable::Type> File::getDerivedFrom(Variable::Type iVariable) const {
+   std::set<Variable::Type> variables;
+   addDerivedFrom(iVariable, variables);
+   return std::vector<Variable::Type>(variables.begin(), variables.end());
+}
+void File::addDerivedFrom(Variable::Type iVariable, std::set<Variable::Type>& iVariables) const {
+   if(isStored(iVariable))
+      return;
+   DerivationPtr derivation = getDerivation(iVariable);
+   if(derivation == NULL)
+      return;
+   const std::vector<Variable::Type>& inputs = derivation->getInputs();
+   for(int k = 0; k < inputs.size(); k++) {
+      // Only resolve each variable once, since variables can be derived from themselves
+      if(iVariables.insert(inputs[k]).second)
+         addDerivedFrom(inputs[k], iVariables);
    }
-   else if(iVariable == Variable::WD) {
-      return hasVariableCore(Variable::V) && hasVariableCore(Variable::U);
+}
+bool File::isDerivable(Variable::Type iVariable) const {
+   return getDerivation(iVariable) != NULL;
+}
+DerivationPtr File::getDerivation(Variable::Type iVariable) const {
+   std::set<Variable::Type> visited;
+   return getDerivation(iVariable, visited);
+}
+DerivationPtr File::getDerivation(Variable::Type iVariable, std::set<Variable::Type>& iVisited) const {
+   // Use the first derivation where all inputs are in the file or can be derived without
+   // depending on the variable itself
+   iVisited.insert(iVariable);
+   DerivationPtr found;
+   for(int i = 0; i < mDerivations.size() && found == NULL; i++) {
+      if(!mDerivations[i]->hasOutput(iVariable))
+         continue;
+      const std::vector<Variable::Type>& inputs = mDerivations[i]->getInputs();
+      bool isAvailable = true;
+      for(int k = 0; k < inputs.size() && isAvailable; k++) {
+         // A variable can be derived from itself at earlier timesteps
+         isAvailable = inputs[k] == iVariable || isStored(inputs[k])
+                       || (iVisited.find(inputs[k]) == iVisited.end() && getDerivation(inputs[k], iVisited) != NULL);
+      }
+      if(isAvailable)
+         found = mDerivations[i];
    }
-   
-   // Check if field has been initialized
-   std::map<Variable::Type, std::vector<FieldPtr> >::const_iterator it = mFields.find(iVariable);
-   return it != mFields.end();
+   iVisited.erase(iVariable);
+   return found;
+}
+void File::addDerivation(DerivationPtr iDerivation) {
+   mDerivations.insert(mDerivations.begin(), iDerivation);
 }
 void File::clear() {
+   pthread_mutex_lock(&mCacheMutex);
    mFields.clear();
+   mLru.clear();
+   mLruPosition.clear();
+   mKept.clear();
+   mNumCached = 0;
+   pthread_mutex_unlock(&mCacheMutex);
+   pthread_mutex_lock(&mPrefetchMutex);
+   mPrefetchQueue.clear();
+   pthread_mutex_unlock(&mPrefetchMutex);
 }
 
-long File::getCacheSize() const {
-   long size = 0;
+void File::clear(int iTime) {
+   pthread_mutex_lock(&mCacheMutex);
    std::map<Variable::Type, std::vector<FieldPtr> >::const_iterator it;
    for(it = mFields.begin(); it != mFields.end(); it++) {
-      size += it->second.size() * getNumLat()*getNumLon()*getNumEns()*sizeof(float);
+      cacheField(FieldPtr(), it->first, iTime, true);
    }
-   return size;
+   pthread_mutex_unlock(&mCacheMutex);
 }
 
-boost::uuids::uuid File::getUniqueTag() const {
-   return mTag;
+long File::getCacheSize() const {
+   pthread_mutex_lock(&mCacheMutex);
+   long numCached = mNumCached;
+   pthread_mutex_unlock(&mCacheMutex);
+   return numCached * getNumLat()*getNumLon()*getNumEns()*sizeof(float);
+}
+
+void File::setMaxCacheSize(long iBytes) {
+   pthread_mutex_lock(&mCacheMutex);
+   mMaxCacheSize = iBytes;
+   pthread_mutex_unlock(&mCacheMutex);
+}
+long File::getMaxCacheSize() const {
+   pthread_mutex_lock(&mCacheMutex);
+   long maxCacheSize = mMaxCacheSize;
+   pthread_mutex_unlock(&mCacheMutex);
+   return maxCacheSize;
+}
+long File::getCacheHits() const {
+   pthread_mutex_lock(&mCacheMutex);
+   long cacheHits = mCacheHits;
+   pthread_mutex_unlock(&mCacheMutex);
+   return cacheHits;
+}
+long File::getCacheMisses() const {
+   pthread_mutex_lock(&mCacheMutex);
+   long cacheMisses = mCacheMisses;
+   pthread_mutex_unlock(&mCacheMutex);
+   return cacheMisses;
+}
+long File::getCacheEvictions() const {
+   pthread_mutex_lock(&mCacheMutex);
+   long cacheEvictions = mCacheEvictions;
+   pthread_mutex_unlock(&mCacheMutex);
+   return cacheEvictions;
+}
+void File::setReadAhead(int iNumTimes) {
+   if(!Util::isValid(iNumTimes) || iNumTimes < 0) {
+      std::stringstream ss;
+      ss << "Invalid number of read-ahead times: " << iNumTimes;
+      Util::error(ss.str());
+   }
+   mReadAhead = iNumTimes;
+}
+int File::getReadAhead() const {
+   return mReadAhead;
+}
+void File::setPrefetch(int iNumTimes) {
+   if(!Util::isValid(iNumTimes) || iNumTimes < 0) {
+      std::stringstream ss;
+      ss << "Invalid number of prefetch times: " << iNumTimes;
+      Util::error(ss.str());
+   }
+   mPrefetch = iNumTimes;
+}
+int File::getPrefetch() const {
+   return mPrefetch;
+}
+void File::setKeepDerived(bool iKeepDerived) {
+   mKeepDerived = iKeepDerived;
+}
+bool File::getKeepDerived() const {
+   return mKeepDerived;
+}
+
+void File::prefetch(Variable::Type iVariable, int iTime) const {
+   if(iTime < 0 || iTime >= getNumTime())
+      return;
+   FieldKey key(iVariable, iTime);
+   pthread_mutex_lock(&mCacheMutex);
+   std::map<Variable::Type, std::vector<FieldPtr> >::const_iterator it = mFields.find(iVariable);
+   bool isCached = (it != mFields.end() && it->second[iTime] != NULL) || mLoading.find(key) != mLoading.end();
+   pthread_mutex_unlock(&mCacheMutex);
+   if(isCached)
+      return;
+
+   if(!isStored(iVariable)) {
+      // Queue the fields that the variable is derived from
+      DerivationPtr derivation = getDerivation(iVariable);
+      if(derivation == NULL)
+         return;
+      const std::vector<Variable::Type>& inputs = derivation->getInputs();
+      const std::vector<int>& offsets = derivation->getOffsets();
+      for(int k = 0; k < inputs.size(); k++) {
+         if(iTime + offsets[k] < 0)
+            return;
+      }
+      for(int k = 0; k < inputs.size(); k++) {
+         prefetch(inputs[k], iTime + offsets[k]);
+      }
+      return;
+   }
+
+   pthread_mutex_lock(&mPrefetchMutex);
+   bool isQueued = std::find(mPrefetchQueue.begin(), mPrefetchQueue.end(), key) != mPrefetchQueue.end();
+   if(!isQueued) {
+      if(!mPrefetchRunning) {
+         mPrefetchStop = false;
+         if(pthread_create(&mPrefetchThread, NULL, &File::prefetchThread, (void*) this) != 0) {
+            // Fields are read when requested instead
+            pthread_mutex_unlock(&mPrefetchMutex);
+            Util::warning("Could not start prefetch thread for '" + getFilename() + "'");
+            return;
+         }
+         mPrefetchRunning = true;
+      }
+      mPrefetchQueue.push_back(key);
+      pthread_cond_broadcast(&mPrefetchCond);
+   }
+   pthread_mutex_unlock(&mPrefetchMutex);
+}
+
+FieldPtr File::readField(Variable::Type iVariable, int iTime) const {
+   FieldKey key(iVariable, iTime);
+   // Not prefetched yet, so no need for the thread to read it
+   pthread_mutex_lock(&mPrefetchMutex);
+   std::deque<FieldKey>::iterator itQueue = std::find(mPrefetchQueue.begin(), mPrefetchQueue.end(), key);
+   if(itQueue != mPrefetchQueue.end())
+      mPrefetchQueue.erase(itQueue);
+   pthread_mutex_unlock(&mPrefetchMutex);
+
+   lockIo();
+   FieldPtr field = getFieldCore(iVariable, iTime);
+   unlockIo();
+   return field;
+}
+
+void* File::prefetchThread(void* iFile) {
+   const File* file = (const File*) iFile;
+   file->runPrefetch();
+   return NULL;
+}
+
+void File::runPrefetch() const {
+   pthread_mutex_lock(&mPrefetchMutex);
+   while(true) {
+      while(mPrefetchQueue.empty() && !mPrefetchStop) {
+         pthread_cond_wait(&mPrefetchCond, &mPrefetchMutex);
+      }
+      if(mPrefetchStop)
+         break;
+      FieldKey key = mPrefetchQueue.front();
+      mPrefetchQueue.pop_front();
+      pthread_mutex_unlock(&mPrefetchMutex);
+
+      // Mark the field as being loaded, such that getField waits for it instead of reading it
+      // again, unless getField has already started reading it
+      pthread_mutex_lock(&mCacheMutex);
+      std::map<Variable::Type, std::vector<FieldPtr> >::const_iterator it = mFields.find(key.first);
+      bool isCached = it != mFields.end() && it->second[key.second] != NULL;
+      bool isLoading = mLoading.find(key) != mLoading.end();
+      if(!isCached && !isLoading)
+         mLoading.insert(key);
+      pthread_mutex_unlock(&mCacheMutex);
+
+      if(!isCached && !isLoading) {
+         lockIo();
+         FieldPtr field = getFieldCore(key.first, key.second);
+         unlockIo();
+
+         // Prefetched fields count towards the cache size like any other field
+         pthread_mutex_lock(&mCacheMutex);
+         cacheFieldFromFile(field, key.first, key.second);
+         mLoading.erase(key);
+         pthread_cond_broadcast(&mCacheCond);
+         evict(key);
+         pthread_mutex_unlock(&mCacheMutex);
+      }
+
+      pthread_mutex_lock(&mPrefetchMutex);
+   }
+   pthread_mutex_unlock(&mPrefetchMutex);
+}
+
+void File::initIoMutex() {
+   pthread_mutexattr_t attr;
+   pthread_mutexattr_init(&attr);
+   pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+   pthread_mutex_init(&mIoMutex, &attr);
+   pthread_mutexattr_destroy(&attr);
+}
+void File::lockIo() {
+   pthread_once(&mIoMutexOnce, &File::initIoMutex);
+   pthread_mutex_lock(&mIoMutex);
+}
+void File::unlockIo() {
+   pthread_mutex_unlock(&mIoMutex);
+}
+bool File::isStored(Variable::Type iVariable) const {
+   pthread_mutex_lock(&mCacheMutex);
+   std::map<Variable::Type, bool>::const_iterator it = mStored.find(iVariable);
+   bool isChecked = it != mStored.end();
+   bool stored = isChecked && it->second;
+   pthread_mutex_unlock(&mCacheMutex);
+   if(!isChecked) {
+      lockIo();
+      stored = hasVariableCore(iVariable);
+      unlockIo();
+      pthread_mutex_lock(&mCacheMutex);
+      mStored[iVariable] = stored;
+      pthread_mutex_unlock(&mCacheMutex);
+   }
+   return stored;
+}
+
+void File::stopPrefetch() {
+   pthread_mutex_lock(&mPrefetchMutex);
+   bool isRunning = mPrefetchRunning;
+   mPrefetchStop = true;
+   mPrefetchRunning = false;
+   pthread_cond_broadcast(&mPrefetchCond);
+   pthread_mutex_unlock(&mPrefetchMutex);
+   if(isRunning)
+      pthread_join(mPrefetchThread, NULL);
+}
+bool File::isReadOnly() const {
+   return mReadOnly;
+}
+std::string File::description() {
+   std::stringstream ss;
+   ss << Util::formatDescription("cacheSize=undef", "Keep at most this much data in memory (e.g. 4GB or 500MB). When exceeded, the least recently used fields are read again from file when needed. Only has an effect on files that are opened read-only.") << std::endl;
+   ss << Util::formatDescription("readAhead=0", "When a timestep of a variable is read from file, also read this many of the following timesteps.") << std::endl;
+   ss << Util::formatDescription("prefetch=0", "When a timestep of a variable is read from file, read this many of the following timesteps in a background thread.") << std::endl;
+   ss << Util::formatDescription("keepDerived=0", "Remove derived fields (e.g. wind speed and direction computed from U and V) from the cache only when they alone exceed cacheSize, such that they are usually computed only once for all downscalers and calibrators that use them.") << std::endl;
+   ss << Util::formatDescription("derive=undef", "Also compute these variables when they are not in the file, as a comma-separated list of: windComponents (U and V from W and WD), qnh (QNH from P), rh (RH from T and TD).") << std::endl;
+   return ss.str();
+}
+
+boost::uint64_t File::getUniqueTag() const {
+   pthread_mutex_lock(&mCacheMutex);
+   if(!mTagValid) {
+      mTag = Util::hash(mLons, Util::hash(mLats));
+      mTagValid = true;
+   }
+   boost::uint64_t tag = mTag;
+   pthread_mutex_unlock(&mCacheMutex);
+   return tag;
+}
+boost::uint64_t File::getElevTag() const {
+   pthread_mutex_lock(&mCacheMutex);
+   if(!mElevTagValid) {
+      mElevTag = Util::hash(mElevs);
+      mElevTagValid = true;
+   }
+   boost::uint64_t tag = mElevTag;
+   pthread_mutex_unlock(&mCacheMutex);
+   return tag;
 }
 bool File::setLats(vec2 iLats) {
    if(iLats.size() != mNLat || iLats[0].size() != mNLon)
       return false;
+   pthread_mutex_lock(&mCacheMutex);
    if(mLats != iLats)
-      createNewTag();
+      mTagValid = false;
    mLats = iLats;
+   mGrid.reset();
+   pthread_mutex_unlock(&mCacheMutex);
    return true;
 }
 bool File::setLons(vec2 iLons) {
    if(iLons.size() != mNLat || iLons[0].size() != mNLon)
       return false;
+   pthread_mutex_lock(&mCacheMutex);
    if(mLons != iLons)
-      createNewTag();
+      mTagValid = false;
    mLons = iLons;
+   mGrid.reset();
+   pthread_mutex_unlock(&mCacheMutex);
    return true;
 }
 bool File::setElevs(vec2 iElevs) {
    if(iElevs.size() != mNLat || iElevs[0].size() != mNLon)
       return false;
+   pthread_mutex_lock(&mCacheMutex);
+   if(mElevs != iElevs)
+      mElevTagValid = false;
    mElevs = iElevs;
+   mGrid.reset();
+   pthread_mutex_unlock(&mCacheMutex);
    return true;
 }
-vec2 File::getLats() const {
+const vec2& File::getLats() const {
    return mLats;
 }
-vec2 File::getLons() const {
+const vec2& File::getLons() const {
    return mLons;
 }
-vec2 File::getElevs() const {
+const vec2& File::getElevs() const {
    return mElevs;
 }
+GridPtr File::getGrid() const {
+   pthread_mutex_lock(&mCacheMutex);
+   if(mGrid == NULL) {
+      mGrid = GridPtr(new Grid(mLats, mLons, mElevs));
+   }
+   GridPtr grid = mGrid;
+   pthread_mutex_unlock(&mCacheMutex);
+   return grid;
+}
 int File::getNumLat() const {
    return mNLat;
 }
@@ -332,9 +852,6 @@ int File::getNumEns() const {
 int File::getNumTime() const {
    return mNTime;
 }
-void File::createNewTag() const {
-   mTag = boost::uuids::random_generator()();
-}
 void File::setReferenceTime(double iTime) {
    mReferenceTime = iTime;
 }
@@ -2,12 +2,17 @@
 #define FILE_H
 #include <vector>
 #include <map>
+#include <list>
+#include <deque>
+#include <set>
+#include <pthread.h>
 #include <boost/shared_ptr.hpp>
-#include <boost/uuid/uuid.hpp>
-#include <boost/uuid/uuid_generators.hpp>
+#include <boost/cstdint.hpp>
 #include "../Variable.h"
 #include "../Util.h"
 #include "../Field.h"
+#include "../Grid.h"
+#include "Derivation.h"
 
 class Options;
 
@@ -17,12 +22,15 @@ typedef std::vector<std::vector<float> > vec2; // Lat, Lon
 //! Represents a data file containing spatial and temporal data initialized at one particular time
 class File {
    public:
-      File(std::string iFilename);
+      File(std::string iFilename, bool iReadOnly=false);
       virtual ~File();
 
       //! Insantiates a file. Returns null if file does not exist or cannot be parsed.
       static File* getScheme(std::string iFilename, const Options& iOptions, bool iReadOnly=false);
 
+      //! \brief Get the field for one timestep. Only this timestep (and any read-ahead timesteps)
+      //! is read from file. Derived variables are computed for this timestep only. Can be called
+      //! from several threads at once; each field is then read or derived only once.
       FieldPtr getField(Variable::Type iVariable, int iTime) const;
 
       //! Get a new field initialized with missing values
@@ -33,38 +41,100 @@ class File {
 
       // Write these variables to file
       void write(std::vector<Variable::Type> iVariables);
+      //! \brief Write one timestep of these variables to file. Other metadata (e.g. times) is written
+      //! on the first call. Only possible if canWriteTimestep() is true.
+      void writeTimestep(std::vector<Variable::Type> iVariables, int iTime);
+      //! Can this file type write one timestep at a time?
+      virtual bool canWriteTimestep() const;
 
       // Dimension sizes
       int getNumLat() const;
       int getNumLon() const;
       int getNumEns() const;
       int getNumTime() const;
-      vec2 getLats() const;
-      vec2 getLons() const;
-      vec2 getElevs() const;
+      //! Latitudes, longitudes, and elevations [lat][lon]. Returned by reference to avoid copies.
+      const vec2& getLats() const;
+      const vec2& getLons() const;
+      const vec2& getElevs() const;
+      //! \brief Geometry of the grid in contiguous arrays. Created when first needed and shared
+      //! until the lats, lons, or elevs are changed.
+      GridPtr getGrid() const;
       bool setLats(vec2 iLats);
       bool setLons(vec2 iLons);
       bool setElevs(vec2 iElevs);
 
       //! Does this file provide the variable (deriving it if necessary)?
       bool hasVariable(Variable::Type iVariable) const;
+      //! \brief Variables that the variable is derived from, including the variables that those are
+      //! derived from in turn. Changing any of them changes the derived values.
+      //! @return empty if the variable is stored in the file or cannot be derived
+      std::vector<Variable::Type> getDerivedFrom(Variable::Type iVariable) const;
+      //! \brief Derive variables using this rule when they are not in the file. Takes precedence
+      //! over the rules added before it and over the default rules (Derivation::getDefaults).
+      void addDerivation(DerivationPtr iDerivation);
 
       std::string getFilename() const;
 
       bool hasSameDimensions(const File& iOther) const;
       std::string getDimenionString() const;
       void initNewVariable(Variable::Type iVariable);
+      //! Add an empty field for one timestep, if the file does not provide the variable
+      void initNewVariable(Variable::Type iVariable, int iTime);
       virtual std::string name() const = 0;
       //! Clear the retrieved/computed fields stored in cache
       void clear();
+      //! Clear the fields of all variables for one timestep, including fields added with addField
+      void clear(int iTime);
       //! How many bytes of retrieved/computed  data are stored in cache?
       //! @return Number of bytes
       long getCacheSize() const;
+      //! \brief Limit the memory used by the cache. When exceeded, the least recently used fields
+      //! that can be read or derived again are removed from the cache. Fields added with
+      //! addField and fields in writable files may be modified by the caller and are never
+      //! removed. The limit can temporarily be exceeded while a variable is derived.
+      //! @param iBytes Maximum number of bytes. Util::MV means no limit (default).
+      void setMaxCacheSize(long iBytes);
+      long getMaxCacheSize() const;
+      //! Number of calls to getField where the field was in the cache
+      long getCacheHits() const;
+      //! Number of calls to getField where the field had to be read or derived
+      long getCacheMisses() const;
+      //! Number of fields removed from the cache to stay within the maximum cache size
+      long getCacheEvictions() const;
+      //! \brief Fields are read from file one timestep at a time. Set this to also read the
+      //! following timesteps of the variable at the same time.
+      //! @param iNumTimes Number of additional timesteps to read (default 0)
+      void setReadAhead(int iNumTimes);
+      int getReadAhead() const;
+      //! \brief Read fields in a background thread before they are needed, such that reading
+      //! overlaps with computations. When a timestep of a variable is read from file, the
+      //! following timesteps of the variable are queued for reading. Prefetched fields are put
+      //! in the cache and count towards the maximum cache size.
+      //! @param iNumTimes Number of timesteps to prefetch (default 0, no prefetching)
+      void setPrefetch(int iNumTimes);
+      int getPrefetch() const;
+      //! \brief Evict derived fields (e.g. wind direction computed from U and V) from the cache
+      //! only after all other evictable fields, and only while the derived fields alone exceed the
+      //! maximum cache size. They are then usually derived only once even when the cache size is
+      //! limited. Only has an effect on files opened read-only.
+      void setKeepDerived(bool iKeepDerived);
+      bool getKeepDerived() const;
+      //! \brief Queue a field for reading in the background thread. For derived variables, the
+      //! fields they are computed from are queued. Does nothing if the field is already cached
+      //! or the file does not provide the variable.
+      void prefetch(Variable::Type iVariable, int iTime) const;
+      static std::string description();
 
-      //! Returns a tag that uniquely identifies the latitude/longitude grid
-      //! If the grid changes, a new tag is issued. Two files with the same grid
-      //! will not have the same unique tag.
-      boost::uuids::uuid getUniqueTag() const;
+      //! Is the file opened read-only?
+      bool isReadOnly() const;
+
+      //! Returns a tag that uniquely identifies the latitude/longitude grid. The tag is a hash
+      //! of the latitudes and longitudes, computed when first needed. If the grid changes, a new
+      //! tag is issued. Two files with the same grid have the same tag.
+      boost::uint64_t getUniqueTag() const;
+      //! Returns a hash of the elevations, computed when first needed and recomputed after the
+      //! elevations are changed. Two files with the same elevations have the same tag.
+      boost::uint64_t getElevTag() const;
 
       //! Set the time that the file is issued
       //! @ param iTime The number of seconds since 1970-01-01 00:00:00 +00:00
@@ -76,9 +146,24 @@ class File {
       std::vector<double> getTimes() const;
    protected:
       virtual FieldPtr getFieldCore(Variable::Type iVariable, int iTime) const = 0;
-      virtual void writeCore(std::vector<Variable::Type> iVariables) = 0;
+      //! \brief Write the variables to file. Called with the I/O lock held, so the fields are
+      //! retrieved beforehand and must be used instead of calling getField.
+      //! @param iFields the fields to write [variable][time]
+      virtual void writeCore(std::vector<Variable::Type> iVariables, const std::vector<std::vector<FieldPtr> >& iFields) = 0;
+      //! \brief Write one timestep. Must be implemented if canWriteTimestep() is true.
+      //! @param iFields the fields to write [variable]
+      virtual void writeTimestepCore(std::vector<Variable::Type> iVariables, int iTime, const std::vector<FieldPtr>& iFields);
       //! Can the subclass provide this variable?
       virtual bool hasVariableCore(Variable::Type iVariable) const = 0;
+      //! \brief Stop the prefetch thread. Must be called in the destructor of every concrete
+      //! subclass, since the thread calls getFieldCore.
+      void stopPrefetch();
+      //! \brief The underlying file libraries (e.g. NetCDF) are not thread-safe. All calls into
+      //! them, in any file, must therefore be made between lockIo and unlockIo. Calls to
+      //! getFieldCore, writeCore, and writeTimestepCore are already locked. Never call getField
+      //! with the I/O lock held, since it can wait for another thread that needs the lock.
+      static void lockIo();
+      static void unlockIo();
 
       // Subclasses must fill these fields in the constructor:
       vec2 mLats;
@@ -91,9 +176,93 @@ class File {
    private:
       std::string mFilename;
       mutable std::map<Variable::Type, std::vector<FieldPtr> > mFields;  // Variable, offset
-      mutable boost::uuids::uuid mTag;
-      void createNewTag() const;
+      mutable boost::uint64_t mTag;
+      mutable bool mTagValid;
+      mutable boost::uint64_t mElevTag;
+      mutable bool mElevTagValid;
+      mutable GridPtr mGrid;
+      bool mReadOnly;
+
+      // Field cache bookkeeping
+      typedef std::pair<Variable::Type, int> FieldKey;
+      //! Put field in cache. Pinned fields are never evicted.
+      void cacheField(FieldPtr iField, Variable::Type iVariable, int iTime, bool iPinned) const;
+      //! Put a field read or derived from the file in the cache, unless it is already there
+      //! @param iDerived was the field derived from other variables?
+      void cacheFieldFromFile(FieldPtr iField, Variable::Type iVariable, int iTime, bool iDerived=false) const;
+      //! Remove least recently used fields until the cache is small enough. Never removes iKeep.
+      void evict(const FieldKey& iKeep) const;
+      //! Evictable fields, the most recently used first
+      mutable std::list<FieldKey> mLru;
+      //! Derived fields in mLru that are evicted last (see setKeepDerived)
+      mutable std::set<FieldKey> mKept;
+      mutable std::map<FieldKey, std::list<FieldKey>::iterator> mLruPosition;
+      long mMaxCacheSize;
+      mutable long mNumCached;
+      mutable long mCacheHits;
+      mutable long mCacheMisses;
+      mutable long mCacheEvictions;
+      //! Fields currently being read or derived. Other threads wait for these instead of loading
+      //! them again.
+      mutable std::set<FieldKey> mLoading;
+      //! Protects the field cache. Recursive, since derived variables call getField.
+      mutable pthread_mutex_t mCacheMutex;
+      //! Signals that a field in mLoading has been loaded
+      mutable pthread_cond_t mCacheCond;
+      int mReadAhead;
+      bool mKeepDerived;
+      //! \brief Is the variable stored in the file, as opposed to derived? Calls hasVariableCore
+      //! with the I/O lock the first time the variable is checked. Must not be called while
+      //! holding mCacheMutex, since writes lock the I/O before the cache.
+      bool isStored(Variable::Type iVariable) const;
+      //! Results of hasVariableCore. Cleared when the file is written to, except for the variables
+      //! in mCreated.
+      mutable std::map<Variable::Type, bool> mStored;
+      //! \brief Variables given empty fields by initNewVariable. They are still not treated as
+      //! stored once written, such that their fields are not read back from the file.
+      std::set<Variable::Type> mCreated;
+      //! Forget the results of hasVariableCore after a write. Call with mCacheMutex held.
+      void clearStored();
+      //! @param iIsInput is the field requested as input to a derivation? If so, the cache is not
+      //! evicted, since the call is nested within the getField call for the derived variable.
+      FieldPtr getField(Variable::Type iVariable, int iTime, bool iIsInput) const;
+      //! Variables requested by callers of getField, as opposed to only being used as inputs
+      //! to derivations
+      mutable std::set<Variable::Type> mRequested;
+      //! Derivation rules, the preferred ones first
+      std::vector<DerivationPtr> mDerivations;
+      //! Compute a variable that is not in the file from other variables, for one timestep
+      FieldPtr deriveField(Variable::Type iVariable, int iTime) const;
+      //! Can the variable be computed from other variables in the file?
+      bool isDerivable(Variable::Type iVariable) const;
+      //! Add the variables that iVariable is derived from to iVariables, recursively
+      void addDerivedFrom(Variable::Type iVariable, std::set<Variable::Type>& iVariables) const;
+      //! The rule used to derive the variable. NULL if it cannot be derived.
+      DerivationPtr getDerivation(Variable::Type iVariable) const;
+      //! @param iVisited variables that are being resolved, which therefore cannot be used as inputs
+      DerivationPtr getDerivation(Variable::Type iVariable, std::set<Variable::Type>& iVisited) const;
       FieldPtr getEmptyField(int nLat, int nLon, int nEns, float iFillValue=Util::MV) const;
+
+      // Prefetching
+      //! Read a field from file, removing it from the prefetch queue
+      FieldPtr readField(Variable::Type iVariable, int iTime) const;
+      static void* prefetchThread(void* iFile);
+      //! \brief Read queued fields until stopPrefetch is called. Fields are put in the cache,
+      //! and are marked as being loaded while read, like in getField.
+      void runPrefetch() const;
+      int mPrefetch;
+      mutable bool mPrefetchRunning;
+      mutable bool mPrefetchStop;
+      mutable pthread_t mPrefetchThread;
+      //! Protects the prefetch queue
+      mutable pthread_mutex_t mPrefetchMutex;
+      //! Signals that fields have been queued or the thread should stop
+      mutable pthread_cond_t mPrefetchCond;
+      mutable std::deque<FieldKey> mPrefetchQueue;
+      //! Recursive, such that the locked sections can call each other
+      static pthread_mutex_t mIoMutex;
+      static pthread_once_t mIoMutexOnce;
+      static void initIoMutex();
       double mReferenceTime;
       std::vector<double> mTimes;
 };
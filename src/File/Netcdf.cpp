@@ -5,8 +5,9 @@
 #include "../Util.h"
 
 FileNetcdf::FileNetcdf(std::string iFilename, bool iReadOnly) :
-      File(iFilename), 
-      mFile(NcFile(getFilename().c_str(), iReadOnly ? NcFile::ReadOnly : NcFile::Write)) {
+      File(iFilename, iReadOnly),
+      mFile(NcFile(getFilename().c_str(), iReadOnly ? NcFile::ReadOnly : NcFile::Write)),
+      mWroteMetadata(false) {
    if(!mFile.is_valid()) {
       Util::error("Netcdf file " + getFilename() + " not valid");
    }
@@ -16,38 +17,78 @@ FileNetcdf::~FileNetcdf() {
    mFile.close();
 }
 
+void FileNetcdf::writeCore(std::vector<Variable::Type> iVariables, const std::vector<std::vector<FieldPtr> >& iFields) {
+   writeMetadata();
+   for(int v = 0; v < iVariables.size(); v++) {
+      for(int t = 0; t < getNumTime(); t++) {
+         writeField(iVariables[v], t, iFields[v][t]);
+      }
+   }
+}
+
+void FileNetcdf::writeTimestepCore(std::vector<Variable::Type> iVariables, int iTime, const std::vector<FieldPtr>& iFields) {
+   if(!mWroteMetadata) {
+      writeMetadata();
+      mWroteMetadata = true;
+   }
+   for(int v = 0; v < iVariables.size(); v++) {
+      writeField(iVariables[v], iTime, iFields[v]);
+   }
+}
+
+bool FileNetcdf::canWriteTimestep() const {
+   return true;
+}
+
+void FileNetcdf::writeMetadata() {
+   writeTimes();
+   writeReferenceTime();
+   writeGlobalAttributes();
+}
+
 bool FileNetcdf::hasVariableCore(Variable::Type iVariable) const {
    std::string variable = getVariableName(iVariable);
    return hasVariableCore(variable);
 }
 bool FileNetcdf::hasVariableCore(std::string iVariable) const {
-   NcError q(NcError::silent_nonfatal); 
-   NcVar* var = mFile.get_var(iVariable.c_str());
-   return var != NULL;
+   return hasVar(iVariable);
 }
 
 float FileNetcdf::getScale(NcVar* iVar) const {
-   NcError q(NcError::silent_nonfatal); 
-   NcAtt* scaleAtt = iVar->get_att("scale_factor");
+   lockIo();
    float scale  = 1;
-   if(scaleAtt != NULL) {
-      scale = scaleAtt->as_float(0);
+   {
+      NcError q(NcError::silent_nonfatal);
+      NcAtt* scaleAtt = iVar->get_att("scale_factor");
+      if(scaleAtt != NULL) {
+         scale = scaleAtt->as_float(0);
+      }
    }
+   unlockIo();
    return scale;
 }
 float FileNetcdf::getOffset(NcVar* iVar) const {
-   NcError q(NcError::silent_nonfatal); 
-   NcAtt* offsetAtt = iVar->get_att("add_offset");
+   lockIo();
    float offset = 0;
-   if(offsetAtt != NULL) {
-      offset = offsetAtt->as_float(0);
+   {
+      NcError q(NcError::silent_nonfatal);
+      NcAtt* offsetAtt = iVar->get_att("add_offset");
+      if(offsetAtt != NULL) {
+         offset = offsetAtt->as_float(0);
+      }
    }
+   unlockIo();
    return offset;
 }
 
 NcDim* FileNetcdf::getDim(std::string iDim) const {
-   NcError q(NcError::silent_nonfatal); 
-   NcDim* dim = mFile.get_dim(iDim.c_str());
+   lockIo();
+   NcDim* dim;
+   {
+      NcError q(NcError::silent_nonfatal);
+      dim = mFile.get_dim(iDim.c_str());
+   }
+   unlockIo();
    if(dim == NULL) {
       std::stringstream ss;
       ss << "File '" << getFilename() << "' does not have dimension '" << iDim << "'";
@@ -56,8 +97,13 @@ NcDim* FileNetcdf::getDim(std::string iDim) const {
    return dim;
 }
 NcVar* FileNetcdf::getVar(std::string iVar) const {
-   NcError q(NcError::silent_nonfatal); 
-   NcVar* var = mFile.get_var(iVar.c_str());
+   lockIo();
+   NcVar* var;
+   {
+      NcError q(NcError::silent_nonfatal);
+      var = mFile.get_var(iVar.c_str());
+   }
+   unlockIo();
    if(var == NULL) {
       std::stringstream ss;
       ss << "File '" << getFilename() << "' does not have variable '" << iVar << "'";
@@ -74,23 +120,37 @@ bool FileNetcdf::hasVar(std::string iVar) const {
 }
 
 bool FileNetcdf::hasDim(const NcFile& iFile, std::string iDim) {
-   NcError q(NcError::silent_nonfatal); 
-   NcDim* dim = iFile.get_dim(iDim.c_str());
-   return dim != NULL;
+   lockIo();
+   bool hasDim;
+   {
+      NcError q(NcError::silent_nonfatal);
+      hasDim = iFile.get_dim(iDim.c_str()) != NULL;
+   }
+   unlockIo();
+   return hasDim;
 }
 bool FileNetcdf::hasVar(const NcFile& iFile, std::string iVar) {
-   NcError q(NcError::silent_nonfatal); 
-   NcVar* var = iFile.get_var(iVar.c_str());
-   return var != NULL;
+   lockIo();
+   bool hasVar;
+   {
+      NcError q(NcError::silent_nonfatal);
+      hasVar = iFile.get_var(iVar.c_str()) != NULL;
+   }
+   unlockIo();
+   return hasVar;
 }
 
 float FileNetcdf::getMissingValue(const NcVar* iVar) {
-   NcError q(NcError::silent_nonfatal); 
-   NcAtt* fillValueAtt = iVar->get_att("_FillValue");
-   if(fillValueAtt != NULL)
-      return fillValueAtt->as_float(0);
-   else
-      return ncBad_float;
+   lockIo();
+   float missingValue = ncBad_float;
+   {
+      NcError q(NcError::silent_nonfatal);
+      NcAtt* fillValueAtt = iVar->get_att("_FillValue");
+      if(fillValueAtt != NULL)
+         missingValue = fillValueAtt->as_float(0);
+   }
+   unlockIo();
+   return missingValue;
 }
 void FileNetcdf::setMissingValue(NcVar* iVar, float iValue) {
    // TODO: Mysterious errors can occur if the existing file was written
@@ -98,65 +158,87 @@ void FileNetcdf::setMissingValue(NcVar* iVar, float iValue) {
    // attributes already. For more information, see "Corruption Problem
    // In HDF5 1.8.0 through HDF5 1.8.4" on
    // http://www.hdfgroup.org/HDF5/release/known_problems/index.html
-   if(iValue != ncBad_float)
+   if(iValue != ncBad_float) {
+      lockIo();
       iVar->add_att("_FillValue", iValue);
+      unlockIo();
+   }
 }
 
 void FileNetcdf::setAttribute(NcVar* iVar, std::string iName, std::string iValue) {
-   NcError q(NcError::silent_nonfatal); 
-   NcAtt* att = iVar->get_att(iName.c_str());
-   if(att != NULL) {
-      att->remove();
+   lockIo();
+   {
+      NcError q(NcError::silent_nonfatal);
+      NcAtt* att = iVar->get_att(iName.c_str());
+      if(att != NULL) {
+         att->remove();
+      }
+      iVar->add_att(iName.c_str(), iValue.c_str());
    }
-   iVar->add_att(iName.c_str(), iValue.c_str());
+   unlockIo();
 }
 
 void FileNetcdf::setGlobalAttribute(std::string iName, std::string iValue) {
-   NcError q(NcError::silent_nonfatal); 
-   NcAtt* att = mFile.get_att(iName.c_str());
-   if(att != NULL) {
-      att->remove();
+   lockIo();
+   {
+      NcError q(NcError::silent_nonfatal);
+      NcAtt* att = mFile.get_att(iName.c_str());
+      if(att != NULL) {
+         att->remove();
+      }
+      mFile.add_att(iName.c_str(), iValue.c_str());
    }
-   mFile.add_att(iName.c_str(), iValue.c_str());
+   unlockIo();
 }
 
 void FileNetcdf::appendGlobalAttribute(std::string iName, std::string iValue) {
-   NcError q(NcError::silent_nonfatal);
-   NcAtt* att = mFile.get_att(iName.c_str());
-   if(att == NULL) {
-      setGlobalAttribute(iName, iValue);
-   }
-   else {
-      NcValues* values = att->values();
-      std::stringstream ss;
-      ss << values->as_string(0) << "\n" << iValue;
-      setGlobalAttribute(iName, ss.str());
+   lockIo();
+   {
+      NcError q(NcError::silent_nonfatal);
+      NcAtt* att = mFile.get_att(iName.c_str());
+      if(att == NULL) {
+         setGlobalAttribute(iName, iValue);
+      }
+      else {
+         NcValues* values = att->values();
+         std::stringstream ss;
+         ss << values->as_string(0) << "\n" << iValue;
+         setGlobalAttribute(iName, ss.str());
+      }
    }
+   unlockIo();
 }
 
 void FileNetcdf::prependGlobalAttribute(std::string iName, std::string iValue) {
-   NcError q(NcError::silent_nonfatal);
-   NcAtt* att = mFile.get_att(iName.c_str());
-   if(att == NULL) {
-      setGlobalAttribute(iName, iValue);
-   }
-   else {
-      NcValues* values = att->values();
-      std::stringstream ss;
-      ss << iValue << "\n" << values->as_string(0);
-      setGlobalAttribute(iName, ss.str());
+   lockIo();
+   {
+      NcError q(NcError::silent_nonfatal);
+      NcAtt* att = mFile.get_att(iName.c_str());
+      if(att == NULL) {
+         setGlobalAttribute(iName, iValue);
+      }
+      else {
+         NcValues* values = att->values();
+         std::stringstream ss;
+         ss << iValue << "\n" << values->as_string(0);
+         setGlobalAttribute(iName, ss.str());
+      }
    }
+   unlockIo();
 }
 
 std::string FileNetcdf::getGlobalAttribute(std::string iName) {
-   NcError q(NcError::silent_nonfatal); 
-   NcAtt* att = mFile.get_att(iName.c_str());
-   if(att == NULL) {
-      return "";
-   }
-   else {
-      return att->values()->as_string(0);
+   lockIo();
+   std::string value = "";
+   {
+      NcError q(NcError::silent_nonfatal);
+      NcAtt* att = mFile.get_att(iName.c_str());
+      if(att != NULL) {
+         value = att->values()->as_string(0);
+      }
    }
+   unlockIo();
+   return value;
 }
 
 void FileNetcdf::writeTimes() {
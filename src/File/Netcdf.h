@@ -24,10 +24,19 @@ class FileNetcdf : public File {
       void prependGlobalAttribute(std::string iName, std::string iValue);
       //! Get global string attribute. Returns "" if non-existant.
       std::string getGlobalAttribute(std::string iName);
+      bool canWriteTimestep() const;
    protected:
+      void writeCore(std::vector<Variable::Type> iVariables, const std::vector<std::vector<FieldPtr> >& iFields);
+      //! Writes the metadata on the first call
+      void writeTimestepCore(std::vector<Variable::Type> iVariables, int iTime, const std::vector<FieldPtr>& iFields);
+      //! Write one timestep of a variable, adding the variable to the file if necessary
+      virtual void writeField(Variable::Type iVariable, int iTime, FieldPtr iField) = 0;
+      //! Write times, reference time, and global attributes
+      void writeMetadata();
       float getScale(NcVar* iVar) const;
       float getOffset(NcVar* iVar) const;
       NcFile mFile;
+      bool mWroteMetadata;
 
       // Does this file contain the variable?
       bool hasVariableCore(Variable::Type iVariable) const;
@@ -63,6 +63,7 @@ FileNorcomQnh::FileNorcomQnh(std::string iFilename, const Options& iOptions) :
 }
 
 FileNorcomQnh::~FileNorcomQnh() {
+   stopPrefetch();
 }
 
 FieldPtr FileNorcomQnh::getFieldCore(Variable::Type iVariable, int iTime) const {
@@ -70,7 +71,7 @@ FieldPtr FileNorcomQnh::getFieldCore(Variable::Type iVariable, int iTime) const
    return field;
 }
 
-void FileNorcomQnh::writeCore(std::vector<Variable::Type> iVariables) {
+void FileNorcomQnh::writeCore(std::vector<Variable::Type> iVariables, const std::vector<std::vector<FieldPtr> >& iFields) {
    std::ofstream ofs(getFilename().c_str());
    if(iVariables.size() == 0) {
       Util::warning("No variables to write");
@@ -110,7 +111,7 @@ void FileNorcomQnh::writeCore(std::vector<Variable::Type> iVariables) {
       // Find minimum
       int valuePa = Util::MV;
       for(int t = mStartTime; t <= mEndTime; t++) {
-         FieldPtr field = getField(variable, t);
+         FieldPtr field = iFields[0][t];
          int currValue = (int) (*field)(0,j,0);
          if(!Util::isValid(valuePa)|| (Util::isValid(currValue) && currValue < valuePa))
             valuePa = currValue;
@@ -20,7 +20,7 @@ class FileNorcomQnh : public File {
       std::string name() const {return "point";};
    protected:
       FieldPtr getFieldCore(Variable::Type iVariable, int iTime) const;
-      void writeCore(std::vector<Variable::Type> iVariables);
+      void writeCore(std::vector<Variable::Type> iVariables, const std::vector<std::vector<FieldPtr> >& iFields);
       bool hasVariableCore(Variable::Type iVariable) const {return true;};
       int mStartTime;
       int mEndTime;
@@ -59,6 +59,7 @@ FilePoint::FilePoint(std::string iFilename, const Options& iOptions) :
 }
 
 FilePoint::~FilePoint() {
+   stopPrefetch();
 }
 
 FieldPtr FilePoint::getFieldCore(Variable::Type iVariable, int iTime) const {
@@ -74,7 +75,7 @@ FieldPtr FilePoint::getFieldCore(Variable::Type iVariable, int iTime) const {
    return field;
 }
 
-void FilePoint::writeCore(std::vector<Variable::Type> iVariables) {
+void FilePoint::writeCore(std::vector<Variable::Type> iVariables, const std::vector<std::vector<FieldPtr> >& iFields) {
    std::ofstream ofs(getFilename().c_str());
    // ofs << mLats[0][0] << " " << mLons[0][0] << " " << mElevs[0][0];
    if(iVariables.size() == 0) {
@@ -83,7 +84,7 @@ void FilePoint::writeCore(std::vector<Variable::Type> iVariables) {
    }
    for(int i = 0; i < getNumTime(); i++) {
       ofs.precision(0);
-      FieldPtr field = getField(iVariables[0], i);
+      FieldPtr field = iFields[0][i];
       if(field != NULL) {
          ofs << (long) getTimes()[i];
          ofs.precision(2);
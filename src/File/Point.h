@@ -16,7 +16,7 @@ class FilePoint : public File {
       std::string name() const {return "point";};
    protected:
       FieldPtr getFieldCore(Variable::Type iVariable, int iTime) const;
-      void writeCore(std::vector<Variable::Type> iVariables);
+      void writeCore(std::vector<Variable::Type> iVariables, const std::vector<std::vector<FieldPtr> >& iFields);
       bool hasVariableCore(Variable::Type iVariable) const {return true;};
 };
 #endif
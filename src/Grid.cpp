@@ -0,0 +1,65 @@
+#include "Grid.h"
+#include <math.h>
+
+Grid::Grid(const vec2& iLats, const vec2& iLons, const vec2& iElevs) :
+      mNLat(iLats.size()),
+      mNLon(0) {
+   if(mNLat > 0)
+      mNLon = iLats[0].size();
+   if(iLons.size() != mNLat || (mNLat > 0 && iLons[0].size() != mNLon)) {
+      Util::error("Cannot create grid with latitudes and longitudes of different sizes");
+   }
+   bool hasElevs = iElevs.size() == mNLat && (mNLat == 0 || iElevs[0].size() == mNLon);
+
+   int N = mNLat * mNLon;
+   mLats.resize(N);
+   mLons.resize(N);
+   mElevs.resize(N, Util::MV);
+   mUnitVectors.resize(3*N, Util::MV);
+   for(int i = 0; i < mNLat; i++) {
+      for(int j = 0; j < mNLon; j++) {
+         int index = getIndex(i,j);
+         mLats[index] = iLats[i][j];
+         mLons[index] = iLons[i][j];
+         if(hasElevs)
+            mElevs[index] = iElevs[i][j];
+         if(isValid(i,j)) {
+            getUnitVector(mLats[index], mLons[index], mUnitVectors[3*index],
+                  mUnitVectors[3*index+1], mUnitVectors[3*index+2]);
+         }
+      }
+   }
+}
+
+int Grid::getNumLat() const {
+   return mNLat;
+}
+int Grid::getNumLon() const {
+   return mNLon;
+}
+int Grid::size() const {
+   return mNLat * mNLon;
+}
+const std::vector<float>& Grid::getLats() const {
+   return mLats;
+}
+const std::vector<float>& Grid::getLons() const {
+   return mLons;
+}
+const std::vector<float>& Grid::getElevs() const {
+   return mElevs;
+}
+const std::vector<double>& Grid::getUnitVectors() const {
+   return mUnitVectors;
+}
+bool Grid::isValid(int i, int j) const {
+   int index = getIndex(i,j);
+   return Util::isValid(mLats[index]) && Util::isValid(mLons[index]);
+}
+void Grid::getUnitVector(float iLat, float iLon, double& iX, double& iY, double& iZ) {
+   double lat = Util::deg2rad(iLat);
+   double lon = Util::deg2rad(iLon);
+   iX = cos(lat) * cos(lon);
+   iY = cos(lat) * sin(lon);
+   iZ = sin(lat);
+}
@@ -0,0 +1,51 @@
+#ifndef GRID_H
+#define GRID_H
+#include <boost/shared_ptr.hpp>
+#include <vector>
+#include "Util.h"
+
+//! Geometry of a 2D grid: latitude, longitude, and elevation of each gridpoint. The values are
+//! stored in contiguous arrays, with the longitude index changing fastest. The position of each
+//! gridpoint on the unit sphere is precomputed, for use in spatial searches.
+class Grid {
+   public:
+      //! @param iLats latitudes in degrees [lat][lon]
+      //! @param iLons longitudes in degrees [lat][lon]
+      //! @param iElevs elevations in meters [lat][lon]. If empty, all elevations are missing.
+      Grid(const vec2& iLats, const vec2& iLons, const vec2& iElevs=vec2());
+
+      int getNumLat() const;
+      int getNumLon() const;
+      //! Total number of gridpoints
+      int size() const;
+
+      //! Index into the flat arrays for gridpoint (i,j)
+      int getIndex(int i, int j) const {return i*mNLon + j;};
+      float getLat(int i, int j) const {return mLats[getIndex(i,j)];};
+      float getLon(int i, int j) const {return mLons[getIndex(i,j)];};
+      float getElev(int i, int j) const {return mElevs[getIndex(i,j)];};
+
+      //! Flat arrays of all gridpoints
+      const std::vector<float>& getLats() const;
+      const std::vector<float>& getLons() const;
+      const std::vector<float>& getElevs() const;
+
+      //! \brief Positions on the unit sphere, stored as x0,y0,z0,x1,y1,z1,...
+      //! Gridpoints with missing latitude or longitude have missing coordinates.
+      const std::vector<double>& getUnitVectors() const;
+
+      //! Does the gridpoint have a valid latitude and longitude?
+      bool isValid(int i, int j) const;
+
+      //! Convert latitude/longitude (in degrees) to a point on the unit sphere
+      static void getUnitVector(float iLat, float iLon, double& iX, double& iY, double& iZ);
+   private:
+      int mNLat;
+      int mNLon;
+      std::vector<float> mLats;
+      std::vector<float> mLons;
+      std::vector<float> mElevs;
+      std::vector<double> mUnitVectors;
+};
+typedef boost::shared_ptr<const Grid> GridPtr;
+#endif
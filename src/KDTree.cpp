@@ -0,0 +1,183 @@
+#include "KDTree.h"
+#include "Grid.h"
+#include <algorithm>
+#include <limits>
+#include <math.h>
+#include <assert.h>
+
+namespace {
+   //! Orders points by one of their coordinates
+   struct CompareCoord {
+      CompareCoord(const std::vector<double>& iCoords, int iDim) : mCoords(iCoords), mDim(iDim) {};
+      bool operator()(int iLeft, int iRight) const {
+         return mCoords[3*iLeft + mDim] < mCoords[3*iRight + mDim];
+      }
+      const std::vector<double>& mCoords;
+      int mDim;
+   };
+}
+
+KDTree::KDTree(const vec2& iLats, const vec2& iLons) :
+      mNLon(0) {
+   init(Grid(iLats, iLons));
+}
+
+KDTree::KDTree(const Grid& iGrid) :
+      mNLon(0) {
+   init(iGrid);
+}
+
+void KDTree::init(const Grid& iGrid) {
+   int nLat = iGrid.getNumLat();
+   mNLon = iGrid.getNumLon();
+   const std::vector<double>& unitVectors = iGrid.getUnitVectors();
+   mCoords.reserve(3*nLat*mNLon);
+   mGridIndex.reserve(nLat*mNLon);
+   for(int i = 0; i < nLat; i++) {
+      for(int j = 0; j < mNLon; j++) {
+         if(iGrid.isValid(i, j)) {
+            int index = iGrid.getIndex(i, j);
+            mCoords.push_back(unitVectors[3*index]);
+            mCoords.push_back(unitVectors[3*index+1]);
+            mCoords.push_back(unitVectors[3*index+2]);
+            mGridIndex.push_back(index);
+         }
+      }
+   }
+   int N = mGridIndex.size();
+   mIndices.resize(N);
+   for(int n = 0; n < N; n++)
+      mIndices[n] = n;
+   mSplitDim.resize(N, 0);
+   build(0, N);
+}
+
+void KDTree::build(int iStart, int iEnd) {
+   if(iEnd - iStart <= 1)
+      return;
+
+   // Split along the dimension with the largest extent
+   double min[3] = {2, 2, 2};
+   double max[3] = {-2, -2, -2};
+   for(int n = iStart; n < iEnd; n++) {
+      const double* coord = &mCoords[3*mIndices[n]];
+      for(int d = 0; d < 3; d++) {
+         min[d] = std::min(min[d], coord[d]);
+         max[d] = std::max(max[d], coord[d]);
+      }
+   }
+   int dim = 0;
+   for(int d = 1; d < 3; d++) {
+      if(max[d] - min[d] > max[dim] - min[dim])
+         dim = d;
+   }
+
+   int mid = (iStart + iEnd) / 2;
+   std::nth_element(mIndices.begin() + iStart, mIndices.begin() + mid, mIndices.begin() + iEnd, CompareCoord(mCoords, dim));
+   mSplitDim[mid] = dim;
+   build(iStart, mid);
+   build(mid+1, iEnd);
+}
+
+bool KDTree::getNearestNeighbour(float iLat, float iLon, int& iI, int& iJ) const {
+   iI = Util::MV;
+   iJ = Util::MV;
+   if(!Util::isValid(iLat) || !Util::isValid(iLon) || size() == 0)
+      return false;
+
+   double point[3];
+   Grid::getUnitVector(iLat, iLon, point[0], point[1], point[2]);
+   Candidate best(std::numeric_limits<double>::max(), std::numeric_limits<int>::max());
+   findNearest(0, size(), point, best);
+
+   int index = mGridIndex[best.second];
+   iI = index / mNLon;
+   iJ = index % mNLon;
+   return true;
+}
+
+void KDTree::getNearestNeighbours(float iLat, float iLon, int iNum, std::vector<int>& iI, std::vector<int>& iJ) const {
+   iI.clear();
+   iJ.clear();
+   if(!Util::isValid(iLat) || !Util::isValid(iLon) || iNum <= 0 || size() == 0)
+      return;
+
+   double point[3];
+   Grid::getUnitVector(iLat, iLon, point[0], point[1], point[2]);
+   std::vector<Candidate> heap;
+   heap.reserve(iNum+1);
+   findNearest(0, size(), point, iNum, heap);
+
+   std::sort_heap(heap.begin(), heap.end());
+   iI.resize(heap.size());
+   iJ.resize(heap.size());
+   for(int n = 0; n < heap.size(); n++) {
+      int index = mGridIndex[heap[n].second];
+      iI[n] = index / mNLon;
+      iJ[n] = index % mNLon;
+   }
+}
+
+void KDTree::findNearest(int iStart, int iEnd, const double iPoint[3], Candidate& iBest) const {
+   if(iEnd <= iStart)
+      return;
+   int mid = (iStart + iEnd) / 2;
+   int index = mIndices[mid];
+   // Ties are resolved by using the point that comes first in the grid
+   Candidate curr(getDist2(index, iPoint), index);
+   if(curr < iBest)
+      iBest = curr;
+
+   int dim = mSplitDim[mid];
+   double diff = iPoint[dim] - mCoords[3*index + dim];
+   if(diff < 0) {
+      findNearest(iStart, mid, iPoint, iBest);
+      if(diff*diff <= iBest.first)
+         findNearest(mid+1, iEnd, iPoint, iBest);
+   }
+   else {
+      findNearest(mid+1, iEnd, iPoint, iBest);
+      if(diff*diff <= iBest.first)
+         findNearest(iStart, mid, iPoint, iBest);
+   }
+}
+
+void KDTree::findNearest(int iStart, int iEnd, const double iPoint[3], int iNum, std::vector<Candidate>& iHeap) const {
+   if(iEnd <= iStart)
+      return;
+   int mid = (iStart + iEnd) / 2;
+   int index = mIndices[mid];
+   // iHeap is a max-heap, so that the farthest of the current candidates is at the front
+   Candidate curr(getDist2(index, iPoint), index);
+   if(iHeap.size() < iNum) {
+      iHeap.push_back(curr);
+      std::push_heap(iHeap.begin(), iHeap.end());
+   }
+   else if(curr < iHeap.front()) {
+      std::pop_heap(iHeap.begin(), iHeap.end());
+      iHeap.back() = curr;
+      std::push_heap(iHeap.begin(), iHeap.end());
+   }
+
+   int dim = mSplitDim[mid];
+   double diff = iPoint[dim] - mCoords[3*index + dim];
+   int nearStart = diff < 0 ? iStart : mid+1;
+   int nearEnd   = diff < 0 ? mid    : iEnd;
+   int farStart  = diff < 0 ? mid+1  : iStart;
+   int farEnd    = diff < 0 ? iEnd   : mid;
+   findNearest(nearStart, nearEnd, iPoint, iNum, iHeap);
+   if(iHeap.size() < iNum || diff*diff <= iHeap.front().first)
+      findNearest(farStart, farEnd, iPoint, iNum, iHeap);
+}
+
+double KDTree::getDist2(int iIndex, const double iPoint[3]) const {
+   const double* coord = &mCoords[3*iIndex];
+   double dx = coord[0] - iPoint[0];
+   double dy = coord[1] - iPoint[1];
+   double dz = coord[2] - iPoint[2];
+   return dx*dx + dy*dy + dz*dz;
+}
+
+int KDTree::size() const {
+   return mGridIndex.size();
+}
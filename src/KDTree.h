@@ -0,0 +1,58 @@
+#ifndef KDTREE_H
+#define KDTREE_H
+#include <vector>
+#include "Util.h"
+class Grid;
+
+//! Spatial index for fast nearest neighbour lookups on a sphere. Each gridpoint is stored as a
+//! 3D unit vector, such that the euclidean (chord) distance between two points increases
+//! monotonically with the great-circle distance. Lookups are therefore exact and take O(log N).
+//! Gridpoints with missing latitude or longitude are not added to the tree.
+class KDTree {
+   public:
+      //! Build the tree for a grid
+      //! @param iLats latitudes in degrees [lat][lon]
+      //! @param iLons longitudes in degrees [lat][lon]
+      KDTree(const vec2& iLats, const vec2& iLons);
+      //! Build the tree for a grid, using its precomputed unit vectors
+      KDTree(const Grid& iGrid);
+
+      //! \brief Find the nearest gridpoint to a location
+      //! @param iLat latitude in degrees of lookup point
+      //! @param iLon longitude in degrees of lookup point
+      //! @param iI latitude index of nearest gridpoint. Util::MV if none found.
+      //! @param iJ longitude index of nearest gridpoint. Util::MV if none found.
+      //! @return false if the lookup point is missing or the tree is empty
+      bool getNearestNeighbour(float iLat, float iLon, int& iI, int& iJ) const;
+
+      //! \brief Find the iNum nearest gridpoints to a location
+      //! @param iNum Find this many gridpoints. Fewer are returned if the tree is smaller.
+      //! @param iI latitude indices, sorted from nearest to farthest
+      //! @param iJ longitude indices, sorted from nearest to farthest
+      void getNearestNeighbours(float iLat, float iLon, int iNum, std::vector<int>& iI, std::vector<int>& iJ) const;
+
+      //! Number of (valid) gridpoints in the tree
+      int size() const;
+
+   private:
+      //! Squared chord distance and index of a point in the tree
+      typedef std::pair<double, int> Candidate;
+
+      void init(const Grid& iGrid);
+      //! Recursively order mIndices[iStart, iEnd) such that the median is the splitting point
+      void build(int iStart, int iEnd);
+      void findNearest(int iStart, int iEnd, const double iPoint[3], Candidate& iBest) const;
+      void findNearest(int iStart, int iEnd, const double iPoint[3], int iNum, std::vector<Candidate>& iHeap) const;
+      double getDist2(int iIndex, const double iPoint[3]) const;
+
+      int mNLon;
+      //! Coordinates of each valid gridpoint, stored as x0,y0,z0,x1,y1,z1,...
+      std::vector<double> mCoords;
+      //! Flat grid index (i*nLon + j) of each valid gridpoint
+      std::vector<int> mGridIndex;
+      //! Tree ordering of points. The node covering [start,end) is at the middle.
+      std::vector<int> mIndices;
+      //! Splitting dimension (0, 1, 2) of each node in the tree
+      std::vector<unsigned char> mSplitDim;
+};
+#endif
@@ -2,6 +2,124 @@
 #include "File/File.h"
 #include "Calibrator/Calibrator.h"
 #include "Downscaler/Downscaler.h"
+#include "Util.h"
+#include <set>
+#include <sstream>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+   //! Variables read from the output file when post-processing the variable. Variables that the
+   //! output file derives are read through the variables they are derived from.
+   std::set<Variable::Type> getReads(const VariableConfiguration& iConfiguration, const File& iFile) {
+      std::set<Variable::Type> variables;
+      for(int c = 0; c < iConfiguration.calibrators.size(); c++) {
+         std::vector<Variable::Type> inputs = iConfiguration.calibrators[c]->getInputVariables();
+         variables.insert(inputs.begin(), inputs.end());
+      }
+      variables.insert(iConfiguration.variable);
+      std::set<Variable::Type> derivedFrom;
+      std::set<Variable::Type>::const_iterator it;
+      for(it = variables.begin(); it != variables.end(); it++) {
+         std::vector<Variable::Type> inputs = iFile.getDerivedFrom(*it);
+         derivedFrom.insert(inputs.begin(), inputs.end());
+      }
+      variables.insert(derivedFrom.begin(), derivedFrom.end());
+      return variables;
+   }
+   //! Variables written to the output file when post-processing the variable
+   std::set<Variable::Type> getWrites(const VariableConfiguration& iConfiguration) {
+      std::set<Variable::Type> variables;
+      variables.insert(iConfiguration.variable);
+      for(int c = 0; c < iConfiguration.calibrators.size(); c++) {
+         std::vector<Variable::Type> outputs = iConfiguration.calibrators[c]->getOutputVariables();
+         variables.insert(outputs.begin(), outputs.end());
+      }
+      return variables;
+   }
+   bool overlaps(const std::set<Variable::Type>& iFirst, const std::set<Variable::Type>& iSecond) {
+      std::set<Variable::Type>::const_iterator it;
+      for(it = iFirst.begin(); it != iFirst.end(); it++) {
+         if(iSecond.find(*it) != iSecond.end())
+            return true;
+      }
+      return false;
+   }
+   //! \brief Downscale and calibrate one variable
+   //! @param iTime Process this timestep only. Util::MV processes all timesteps.
+   //! @param iLog Progress is written here
+   void processVariable(const Setup& iSetup, int iIndex, int iTime, std::ostream& iLog) {
+      const VariableConfiguration& varconf = iSetup.variableConfigurations[iIndex];
+      if(Util::isValid(iTime)) {
+         iSetup.outputFile->initNewVariable(varconf.variable, iTime);
+         varconf.downscaler->downscale(*iSetup.inputFile, *iSetup.outputFile, iTime);
+         Calibrator::calibrate(varconf.calibrators, *iSetup.outputFile, iTime);
+         return;
+      }
+
+      double s = Util::clock();
+      Variable::Type variable = varconf.variable;
+      iSetup.outputFile->initNewVariable(variable);
+
+      iLog << "Processing " << Variable::getTypeName(variable) << std::endl;
+
+      // Downscale
+      iLog << "   Downscaler " << varconf.downscaler->name() << std::endl;
+      varconf.downscaler->downscale(*iSetup.inputFile, *iSetup.outputFile);
+      // Calibrate. Consecutive pointwise calibrators are run together in one pass.
+      std::vector<std::vector<Calibrator*> > groups = Calibrator::getGroups(varconf.calibrators, *iSetup.outputFile);
+      for(int g = 0; g < groups.size(); g++) {
+         iLog << "   Calibrator ";
+         for(int c = 0; c < groups[g].size(); c++) {
+            iLog << (c > 0 ? " + " : "") << groups[g][c]->name();
+         }
+         iLog << std::endl;
+         Calibrator::calibrate(groups[g], *iSetup.outputFile);
+      }
+      double e = Util::clock();
+      iLog << "   " << e-s << " seconds" << std::endl;
+      iLog << "Current mem usage input: " << iSetup.inputFile->getCacheSize() / 1e6<< std::endl;
+      iLog << "Current mem usage output: " << iSetup.outputFile->getCacheSize() / 1e6<< std::endl;
+   }
+
+   //! Variables being processed concurrently
+   struct Schedule {
+      const Setup* setup;
+      int time;
+      //! Number of threads used by the parallel loops within each variable
+      int numInnerThreads;
+      std::ostream* log;
+      //! Number of dependencies of each variable that have not been processed yet
+      std::vector<int> numRemaining;
+      //! Variables that depend on each variable
+      std::vector<std::vector<int> > dependents;
+   };
+
+   //! Process a variable in a task, and then start the variables that were only waiting for it
+   void startVariable(Schedule* iSchedule, int iIndex) {
+      #pragma omp task firstprivate(iSchedule, iIndex)
+      {
+#ifdef _OPENMP
+         omp_set_num_threads(iSchedule->numInnerThreads);
+#endif
+         std::stringstream log;
+         processVariable(*iSchedule->setup, iIndex, iSchedule->time, log);
+         #pragma omp critical(SetupLog)
+         *iSchedule->log << log.str() << std::flush;
+
+         const std::vector<int>& dependents = iSchedule->dependents[iIndex];
+         for(int k = 0; k < dependents.size(); k++) {
+            bool isReady;
+            #pragma omp critical(SetupSchedule)
+            isReady = --iSchedule->numRemaining[dependents[k]] == 0;
+            if(isReady)
+               startVariable(iSchedule, dependents[k]);
+         }
+      }
+   }
+}
 
 Setup::Setup(const std::vector<std::string>& argv) :
       mIdenticalIOFiles(false) {
@@ -311,3 +429,80 @@ Setup::~Setup() {
 std::string Setup::defaultDownscaler() {
    return "nearestNeighbour";
 }
+std::vector<std::vector<int> > Setup::getDependencies() const {
+   int N = variableConfigurations.size();
+   std::vector<std::set<Variable::Type> > reads(N);
+   std::vector<std::set<Variable::Type> > writes(N);
+   for(int v = 0; v < N; v++) {
+      reads[v] = getReads(variableConfigurations[v], *outputFile);
+      writes[v] = getWrites(variableConfigurations[v]);
+   }
+   std::vector<std::vector<int> > dependencies(N);
+   for(int v = 0; v < N; v++) {
+      for(int u = 0; u < v; u++) {
+         if(overlaps(writes[u], reads[v]) || overlaps(writes[u], writes[v]) || overlaps(reads[u], writes[v]))
+            dependencies[v].push_back(u);
+      }
+   }
+   return dependencies;
+}
+void Setup::process(int iTime, bool iConcurrent, std::ostream& iLog) const {
+   int N = variableConfigurations.size();
+   int numThreads = 1;
+#ifdef _OPENMP
+   numThreads = omp_get_max_threads();
+#endif
+   std::vector<std::vector<int> > dependencies;
+   int numConcurrent = 1;
+   if(iConcurrent && numThreads > 1) {
+      dependencies = getDependencies();
+      // Find the largest number of variables that can run at the same time, by grouping the
+      // variables by the longest chain of dependencies leading to them
+      std::vector<int> level(N, 0);
+      std::vector<int> numAtLevel(N, 0);
+      int maxWidth = 0;
+      for(int v = 0; v < N; v++) {
+         for(int k = 0; k < dependencies[v].size(); k++) {
+            level[v] = std::max(level[v], level[dependencies[v][k]] + 1);
+         }
+         numAtLevel[level[v]]++;
+         maxWidth = std::max(maxWidth, numAtLevel[level[v]]);
+      }
+      numConcurrent = std::min(maxWidth, numThreads);
+   }
+   if(numConcurrent <= 1) {
+      for(int v = 0; v < N; v++) {
+         processVariable(*this, v, iTime, iLog);
+      }
+      return;
+   }
+
+   Schedule schedule;
+   schedule.setup = this;
+   schedule.time = iTime;
+   schedule.numInnerThreads = std::max(1, numThreads / numConcurrent);
+   schedule.log = &iLog;
+   schedule.numRemaining.resize(N);
+   schedule.dependents.resize(N);
+   for(int v = 0; v < N; v++) {
+      schedule.numRemaining[v] = dependencies[v].size();
+      for(int k = 0; k < dependencies[v].size(); k++) {
+         schedule.dependents[dependencies[v][k]].push_back(v);
+      }
+   }
+#ifdef _OPENMP
+   int maxActiveLevels = omp_get_max_active_levels();
+   omp_set_max_active_levels(std::max(maxActiveLevels, 2));
+#endif
+   #pragma omp parallel num_threads(numConcurrent)
+   #pragma omp single
+   {
+      for(int v = 0; v < N; v++) {
+         if(schedule.numRemaining[v] == 0)
+            startVariable(&schedule, v);
+      }
+   }
+#ifdef _OPENMP
+   omp_set_max_active_levels(maxActiveLevels);
+#endif
+}
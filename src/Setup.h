@@ -2,6 +2,7 @@
 #define METCAL_SETUP_H
 #include <string>
 #include <vector>
+#include <ostream>
 #include "Variable.h"
 #include "Options.h"
 class File;
@@ -33,6 +34,18 @@ class Setup {
       Setup(const std::vector<std::string>& argv);
       ~Setup();
       static std::string defaultDownscaler();
+      //! \brief For each variable configuration, the earlier configurations that must be processed
+      //! before it: those that write a variable that it reads or writes, and those that read a
+      //! variable that it writes. Configurations that do not depend on each other can be processed
+      //! concurrently, with the same result as processing all of them in order.
+      std::vector<std::vector<int> > getDependencies() const;
+      //! \brief Downscale and calibrate all variables into the output file
+      //! @param iTime Process this timestep only. Util::MV processes all timesteps.
+      //! @param iConcurrent Process variables that do not depend on each other (see
+      //! getDependencies) concurrently, sharing the threads between the variables and the parallel
+      //! loops within each variable. Otherwise the variables are processed in order.
+      //! @param iLog Progress is written here
+      void process(int iTime, bool iConcurrent, std::ostream& iLog) const;
    private:
       bool mIdenticalIOFiles;
 };
@@ -1,6 +1,7 @@
 #include "../Calibrator/Calibrator.h"
 #include "../Util.h"
 #include "../Options.h"
+#include "../File/File.h"
 #include <gtest/gtest.h>
 #include <vector>
 
@@ -106,6 +107,147 @@ namespace {
       EXPECT_EQ(3, vec2[2]);
       EXPECT_TRUE(vec2[3]==1 || vec2[3]==2);
    }
+   TEST_F(TestCalibrator, shuffleWorkSpace) {
+      // Reuse the same work space for ensembles of different sizes, including sizes that are
+      // sorted with and without sorting networks
+      std::vector<std::pair<float,int> > pairs;
+      std::vector<float> values;
+      int sizes[] = {3, 51, 7, 16, 17, 1};
+      for(int s = 0; s < sizeof(sizes)/sizeof(int); s++) {
+         int N = sizes[s];
+         std::vector<float> before(N);
+         std::vector<float> after(N);
+         for(int e = 0; e < N; e++) {
+            before[e] = (e * 37) % N;
+            after[e] = 100 - 2*e;
+         }
+         Calibrator::shuffle(&before[0], &after[0], N, pairs, values);
+         EXPECT_GE(pairs.size(), N);
+         EXPECT_GE(values.size(), N);
+         // Member e has rank before[e], and should get the before[e]'th smallest value
+         for(int e = 0; e < N; e++) {
+            EXPECT_FLOAT_EQ(100 - 2*(N-1) + 2*before[e], after[e]);
+         }
+      }
+   }
+   TEST_F(TestCalibrator, shuffleNetworkSizes) {
+      // Check every ensemble size that has its own sorting network, and the first size without
+      std::vector<std::pair<float,int> > pairs;
+      std::vector<float> values;
+      for(int N = 1; N <= 17; N++) {
+         // Two different permutations of the ranks 0..N-1
+         std::vector<float> before(N);
+         std::vector<float> after(N);
+         for(int e = 0; e < N; e++) {
+            before[e] = e;
+            after[e] = e;
+         }
+         for(int e = 0; e < N; e++) {
+            std::swap(before[e], before[(e * 7 + 3) % N]);
+            std::swap(after[e], after[(e * 5 + 1) % N]);
+         }
+         Calibrator::shuffle(&before[0], &after[0], N, pairs, values);
+         // Each member keeps its rank
+         for(int e = 0; e < N; e++) {
+            EXPECT_FLOAT_EQ(before[e], after[e]);
+         }
+      }
+   }
+   TEST_F(TestCalibrator, shuffleWorkSpaceMissing) {
+      std::vector<std::pair<float,int> > pairs;
+      std::vector<float> values;
+      float before[] = {3, 1, Util::MV};
+      float after[] = {1, 2, 3};
+      Calibrator::shuffle(before, after, 3, pairs, values);
+      EXPECT_FLOAT_EQ(1, after[0]);
+      EXPECT_FLOAT_EQ(2, after[1]);
+      EXPECT_FLOAT_EQ(3, after[2]);
+   }
+   TEST_F(TestCalibrator, getGroups) {
+      std::vector<Calibrator*> calibrators;
+      calibrators.push_back(Calibrator::getScheme("regression", Options("variable=T parameters=testing/files/regression1order.txt")));
+      calibrators.push_back(Calibrator::getScheme("qc", Options("variable=T max=370")));
+      calibrators.push_back(Calibrator::getScheme("neighbourhood", Options("variable=T radius=1")));
+      calibrators.push_back(Calibrator::getScheme("qc", Options("variable=T min=365")));
+      EXPECT_TRUE(calibrators[0]->isPointwise());
+      EXPECT_TRUE(calibrators[1]->isPointwise());
+      EXPECT_FALSE(calibrators[2]->isPointwise());
+
+      FileFake file(3, 3, 1, 1);
+      std::vector<std::vector<Calibrator*> > groups = Calibrator::getGroups(calibrators, file);
+      ASSERT_EQ(3, groups.size());
+      ASSERT_EQ(2, groups[0].size());
+      EXPECT_EQ(calibrators[0], groups[0][0]);
+      EXPECT_EQ(calibrators[1], groups[0][1]);
+      ASSERT_EQ(1, groups[1].size());
+      EXPECT_EQ(calibrators[2], groups[1][0]);
+      ASSERT_EQ(1, groups[2].size());
+      EXPECT_EQ(calibrators[3], groups[2][0]);
+
+      EXPECT_EQ(0, Calibrator::getGroups(std::vector<Calibrator*>(), file).size());
+      for(int c = 0; c < calibrators.size(); c++)
+         delete calibrators[c];
+   }
+   TEST_F(TestCalibrator, getGroupsDerived) {
+      // PrecipAcc is derived from Precip in the fake file, so it must not be read in the same
+      // pass as Precip is calibrated
+      std::vector<Calibrator*> calibrators;
+      calibrators.push_back(Calibrator::getScheme("qc", Options("variable=T max=370")));
+      calibrators.push_back(Calibrator::getScheme("regression", Options("variable=Precip parameters=testing/files/regression1order.txt")));
+      calibrators.push_back(Calibrator::getScheme("qc", Options("variable=PrecipAcc max=20")));
+      calibrators.push_back(Calibrator::getScheme("qc", Options("variable=Precip max=3")));
+
+      FileFake file(3, 3, 2, 3);
+      std::vector<std::vector<Calibrator*> > groups = Calibrator::getGroups(calibrators, file);
+      ASSERT_EQ(2, groups.size());
+      ASSERT_EQ(2, groups[0].size());
+      ASSERT_EQ(2, groups[1].size());
+      EXPECT_EQ(calibrators[2], groups[1][0]);
+
+      // Same result as running the calibrators one after another
+      FileFake fused(3, 3, 2, 3);
+      FileFake separate(3, 3, 2, 3);
+      EXPECT_TRUE(Calibrator::calibrate(calibrators, fused));
+      for(int c = 0; c < calibrators.size(); c++)
+         calibrators[c]->calibrate(separate);
+      for(int t = 0; t < fused.getNumTime(); t++) {
+         EXPECT_EQ(*separate.getField(Variable::Precip, t), *fused.getField(Variable::Precip, t));
+         EXPECT_EQ(*separate.getField(Variable::PrecipAcc, t), *fused.getField(Variable::PrecipAcc, t));
+      }
+      for(int c = 0; c < calibrators.size(); c++)
+         delete calibrators[c];
+   }
+   TEST_F(TestCalibrator, chain) {
+      // Running the chain with fused calibrators should give the same result as running each
+      // calibrator on its own
+      std::vector<Calibrator*> calibrators;
+      calibrators.push_back(Calibrator::getScheme("regression", Options("variable=T parameters=testing/files/regression1order.txt")));
+      calibrators.push_back(Calibrator::getScheme("qc", Options("variable=T max=370")));
+      calibrators.push_back(Calibrator::getScheme("neighbourhood", Options("variable=T radius=1")));
+      calibrators.push_back(Calibrator::getScheme("regression", Options("variable=T parameters=testing/files/regression1order.txt")));
+      calibrators.push_back(Calibrator::getScheme("qc", Options("variable=T min=440")));
+
+      FileArome fused("testing/files/10x10.nc");
+      FileArome separate("testing/files/10x10.nc");
+      FileArome singleTime("testing/files/10x10.nc");
+      EXPECT_TRUE(Calibrator::calibrate(calibrators, fused));
+      for(int c = 0; c < calibrators.size(); c++)
+         calibrators[c]->calibrate(separate);
+      for(int t = 0; t < singleTime.getNumTime(); t++)
+         EXPECT_TRUE(Calibrator::calibrate(calibrators, singleTime, t));
+
+      for(int t = 0; t < fused.getNumTime(); t++) {
+         const Field& expected = *separate.getField(Variable::T, t);
+         EXPECT_EQ(expected, *fused.getField(Variable::T, t));
+         EXPECT_EQ(expected, *singleTime.getField(Variable::T, t));
+      }
+      // Check that the calibrators were applied. Values are at most 0.3 + 1.2 * 370 = 444.3.
+      EXPECT_LT(440, (*fused.getField(Variable::T, 0))(0,9,0));
+      EXPECT_GT(444.3, (*fused.getField(Variable::T, 0))(0,9,0));
+      EXPECT_FLOAT_EQ(440, (*fused.getField(Variable::T, 0))(5,2,0));
+      for(int c = 0; c < calibrators.size(); c++)
+         delete calibrators[c];
+   }
    TEST_F(TestCalibrator, factoryZaga) {
       Calibrator* c;
       c = Calibrator::getScheme("zaga", Options("variable=T parameters=testing/files/parameters.txt fracThreshold=0.9"));
@@ -151,6 +293,26 @@ namespace {
       EXPECT_EQ("qnh", c->name());
       delete c;
    }
+   TEST_F(TestCalibrator, variables) {
+      Calibrator* c = Calibrator::getScheme("phase", Options("parameters=testing/files/parametersPhase.txt"));
+      std::vector<Variable::Type> inputs = c->getInputVariables();
+      ASSERT_EQ(3, inputs.size());
+      EXPECT_EQ(Variable::T, inputs[0]);
+      EXPECT_EQ(Variable::Precip, inputs[1]);
+      EXPECT_EQ(Variable::RH, inputs[2]);
+      ASSERT_EQ(1, c->getOutputVariables().size());
+      EXPECT_EQ(Variable::Phase, c->getOutputVariables()[0]);
+      ((CalibratorPhase*) c)->setUseWetbulb(false);
+      EXPECT_EQ(2, c->getInputVariables().size());
+      delete c;
+
+      c = Calibrator::getScheme("qc", Options("variable=W"));
+      ASSERT_EQ(1, c->getInputVariables().size());
+      EXPECT_EQ(Variable::W, c->getInputVariables()[0]);
+      ASSERT_EQ(1, c->getOutputVariables().size());
+      EXPECT_EQ(Variable::W, c->getOutputVariables()[0]);
+      delete c;
+   }
    TEST_F(TestCalibrator, factoryValid) {
       Calibrator::getScheme("zaga", Options("variable=T parameters=testing/files/parameters.txt"));
       Calibrator::getScheme("zaga", Options("variable=Precip variable=T parameters=testing/files/parameters.txt"));
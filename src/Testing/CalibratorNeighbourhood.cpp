@@ -144,6 +144,61 @@ namespace {
       EXPECT_FLOAT_EQ(310,   (*after)(5,9,0));
       EXPECT_FLOAT_EQ(316.1, (*after)(0,9,0));
    }
+   TEST_F(TestCalibratorNeighbourhood, matchBruteForce) {
+      // The operators are computed for the whole field at once. Check against compute().
+      int nLat = 20, nLon = 17, nEns = 2, radius = 4;
+      FileFake file(nLat, nLon, nEns, 1);
+      Field& field = *file.getField(Variable::T, 0);
+      unsigned int seed = 1;
+      for(int i = 0; i < nLat; i++) {
+         for(int j = 0; j < nLon; j++) {
+            for(int e = 0; e < nEns; e++) {
+               seed = seed * 1103515245 + 12345;
+               float value = 280 + (seed / 65536) % 1000 / 100.0;
+               // Some missing values, and a block of missing values larger than the neighbourhood
+               if(seed % 11 == 0 || (i < 10 && j < 10 && e == 1))
+                  value = Util::MV;
+               field(i,j,e) = value;
+            }
+         }
+      }
+      Field raw = field;
+      const char* operators[] = {"mean", "std", "min", "max", "median", "quantile quantile=0.3"};
+      CalibratorNeighbourhood::OperatorType types[] = {CalibratorNeighbourhood::OperatorMean, CalibratorNeighbourhood::OperatorStd,
+         CalibratorNeighbourhood::OperatorQuantile, CalibratorNeighbourhood::OperatorQuantile,
+         CalibratorNeighbourhood::OperatorQuantile, CalibratorNeighbourhood::OperatorQuantile};
+      float quantiles[] = {Util::MV, Util::MV, 0, 1, 0.5, 0.3};
+      for(int o = 0; o < 6; o++) {
+         FileFake curr(nLat, nLon, nEns, 1);
+         *curr.getField(Variable::T, 0) = raw;
+         std::stringstream ss;
+         ss << "radius=" << radius << " operator=" << operators[o];
+         CalibratorNeighbourhood cal(Variable::T, Options(ss.str()));
+         cal.calibrate(curr);
+         const Field& after = *curr.getField(Variable::T, 0);
+         for(int i = 0; i < nLat; i++) {
+            for(int j = 0; j < nLon; j++) {
+               for(int e = 0; e < nEns; e++) {
+                  std::vector<float> hood;
+                  for(int ii = std::max(0, i-radius); ii <= std::min(nLat-1, i+radius); ii++) {
+                     for(int jj = std::max(0, j-radius); jj <= std::min(nLon-1, j+radius); jj++) {
+                        hood.push_back(raw(ii,jj,e));
+                     }
+                  }
+                  float expected = CalibratorNeighbourhood::compute(hood, types[o], quantiles[o]);
+                  if(!Util::isValid(expected) || types[o] == CalibratorNeighbourhood::OperatorQuantile)
+                     EXPECT_FLOAT_EQ(expected, after(i,j,e));
+                  else
+                     EXPECT_NEAR(expected, after(i,j,e), 1e-3);
+               }
+            }
+         }
+      }
+      // The missing block is larger than the neighbourhood
+      CalibratorNeighbourhood cal(Variable::T, Options("radius=1 operator=mean"));
+      cal.calibrate(file);
+      EXPECT_FLOAT_EQ(Util::MV, (*file.getField(Variable::T, 0))(3,3,1));
+   }
    TEST_F(TestCalibratorNeighbourhood, compute) {
       FileArome from("testing/files/10x10.nc");
 
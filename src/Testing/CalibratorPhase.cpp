@@ -2,6 +2,7 @@
 #include "../Util.h"
 #include "../ParameterFile.h"
 #include "../Calibrator/Zaga.h"
+#include "../Downscaler/Pressure.h"
 #include <gtest/gtest.h>
 
 namespace {
@@ -137,6 +138,70 @@ namespace {
       EXPECT_FLOAT_EQ(Util::MV, CalibratorPhase::getWetbulb(270, 30000, Util::MV));
       EXPECT_FLOAT_EQ(Util::MV, CalibratorPhase::getWetbulb(270, 100000, 0)); // No humidity
    }
+   TEST_F(TestCalibratorPhase, getWetbulbArray) {
+      float temp[] = {270, 300, 270, 240, Util::MV, 270, 270};
+      float pressure[] = {100000, 101000, 100000, 50000, 30000, Util::MV, 100000};
+      float rh[] = {0.8, 0.7, 1, 0.9, 1, 1, 0};
+      float wetbulb[7];
+      CalibratorPhase::getWetbulb(temp, pressure, rh, 7, wetbulb);
+      for(int i = 0; i < 7; i++) {
+         EXPECT_FLOAT_EQ(CalibratorPhase::getWetbulb(temp[i], pressure[i], rh[i]), wetbulb[i]);
+      }
+   }
+   TEST_F(TestCalibratorPhase, getPhase) {
+      EXPECT_FLOAT_EQ(Variable::PhaseSnow, CalibratorPhase::getPhase(273, 273.7, 274.7));
+      EXPECT_FLOAT_EQ(Variable::PhaseSnow, CalibratorPhase::getPhase(273.7, 273.7, 274.7));
+      EXPECT_FLOAT_EQ(Variable::PhaseSleet, CalibratorPhase::getPhase(274, 273.7, 274.7));
+      EXPECT_FLOAT_EQ(Variable::PhaseRain, CalibratorPhase::getPhase(275, 273.7, 274.7));
+      EXPECT_FLOAT_EQ(Util::MV, CalibratorPhase::getPhase(Util::MV, 273.7, 274.7));
+   }
+   TEST_F(TestCalibratorPhase, ensemble) {
+      // Mix of dry, wet and missing members over several gridpoints
+      FileFake file(2,3,4,1);
+      ParameterFile parFile = getParameterFile(273.7,274.7);
+      CalibratorPhase cal = getCalibrator(&parFile);
+      FieldPtr precip = file.getField(Variable::Precip, 0);
+      FieldPtr temp   = file.getField(Variable::T, 0);
+      FieldPtr rh     = file.getField(Variable::RH, 0);
+      const vec2& elevs = file.getElevs();
+      for(int i = 0; i < 2; i++) {
+         for(int j = 0; j < 3; j++) {
+            for(int e = 0; e < 4; e++) {
+               int k = (i*3 + j)*4 + e;
+               (*precip)(i,j,e) = (k % 3 == 0) ? 0.1 : 2;
+               (*temp)(i,j,e) = 272 + 0.25 * (k % 13);
+               (*rh)(i,j,e) = 0.3 + 0.05 * (k % 14);
+            }
+         }
+      }
+      (*precip)(0,1,2) = Util::MV;
+      (*temp)(1,0,1) = Util::MV;
+      (*temp)(1,2,0) = Util::MV;
+      (*rh)(1,1,1) = Util::MV;
+
+      cal.calibrate(file);
+      FieldPtr phase = file.getField(Variable::Phase, 0);
+      for(int i = 0; i < 2; i++) {
+         for(int j = 0; j < 3; j++) {
+            float currPressure = DownscalerPressure::calcPressure(0, 101325, elevs[i][j]);
+            for(int e = 0; e < 4; e++) {
+               float currPrecip = (*precip)(i,j,e);
+               float currTemp = (*temp)(i,j,e);
+               float expected;
+               if(currPrecip <= 0.2)
+                  expected = Util::isValid(currTemp) ? Variable::PhaseNone : Util::MV;
+               else if(Util::isValid((*rh)(i,j,e)))
+                  expected = CalibratorPhase::getPhase(CalibratorPhase::getWetbulb(currTemp, currPressure, (*rh)(i,j,e)), 273.7, 274.7);
+               else
+                  expected = CalibratorPhase::getPhase(currTemp, 273.7, 274.7);
+               EXPECT_FLOAT_EQ(expected, (*phase)(i,j,e));
+            }
+         }
+      }
+      // Dry member and wet member with missing temperature
+      EXPECT_FLOAT_EQ(Variable::PhaseNone, (*phase)(0,0,0));
+      EXPECT_FLOAT_EQ(Util::MV, (*phase)(1,0,1));
+   }
    TEST_F(TestCalibratorPhase, description) {
       CalibratorPhase::description();
    }
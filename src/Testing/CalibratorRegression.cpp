@@ -77,6 +77,32 @@ namespace {
       EXPECT_FLOAT_EQ(Util::MV, (*after)(5,9,0));
       EXPECT_FLOAT_EQ(Util::MV, (*after)(0,9,0));
    }
+   TEST_F(TestCalibratorRegression, highOrderMissing) {
+      // Third order polynomial on an ensemble with missing and non-finite members
+      FileFake file(1, 2, 5, 1);
+      std::vector<float> coeffs;
+      coeffs.push_back(1);
+      coeffs.push_back(-2);
+      coeffs.push_back(0.5);
+      coeffs.push_back(0.25);
+      ParameterFile par("testing/files/regression1order.txt");
+      par.setParameters(Parameters(coeffs), 0);
+      CalibratorRegression cal = CalibratorRegression(&par, Variable::Precip);
+
+      FieldPtr field = file.getField(Variable::Precip, 0);
+      float values[] = {0, 2, -3, Util::MV, 1.0/0.0, 1.5, 0.0/0.0, 4, -1, 10};
+      for(int k = 0; k < 10; k++)
+         (*field)(0, k / 5, k % 5) = values[k];
+      cal.calibrate(file);
+      for(int k = 0; k < 10; k++) {
+         float x = values[k];
+         float value = (*field)(0, k / 5, k % 5);
+         if(Util::isValid(x))
+            EXPECT_FLOAT_EQ(1 - 2*x + 0.5*x*x + 0.25*x*x*x, value);
+         else
+            EXPECT_FLOAT_EQ(Util::MV, value);
+      }
+   }
    // Incorrect number of data columns
    TEST_F(TestCalibratorRegression, invalid) {
       ::testing::FLAGS_gtest_death_test_style = "threadsafe";
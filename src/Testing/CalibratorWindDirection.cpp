@@ -96,6 +96,45 @@ namespace {
       // Invalid values
       // EXPECT_DEATH(cal.getFactor(-1, par), ".*");
    }
+   TEST_F(TestCalibratorWindDirection, getFactorHarmonics) {
+      // Compare against evaluating each harmonic directly
+      ParameterFile parFile = getParameterFile(1.2,0.1,-0.2,0.3,0.05,-0.1,0.15,0.02,-0.07);
+      Parameters par = parFile.getParameters(0);
+      for(float dir = 0; dir <= 360; dir += 7.5) {
+         float rad = Util::deg2rad(dir);
+         float expected = par[0];
+         for(int n = 1; n <= 4; n++) {
+            expected += par[2*n-1] * sin(n*rad) + par[2*n] * cos(n*rad);
+         }
+         EXPECT_NEAR(std::max(expected, 0.0f), CalibratorWindDirection::getFactor(dir, par), 1e-5);
+      }
+   }
+   TEST_F(TestCalibratorWindDirection, calibrate) {
+      FileFake file(1, 2, 3, 1);
+      ParameterFile parFile = getParameterFile(1,0,1,0,0,0,0,0,0);
+      CalibratorWindDirection cal = getCalibrator(&parFile);
+      FieldPtr wind = file.getField(Variable::T, 0);
+      FieldPtr direction = file.getField(Variable::WD, 0);
+      float winds[] = {2, 3, 4, Util::MV, 5, 6};
+      float directions[] = {0, 90, 180, 0, Util::MV, 45};
+      for(int k = 0; k < 6; k++) {
+         (*wind)(0, k / 3, k % 3) = winds[k];
+         (*direction)(0, k / 3, k % 3) = directions[k];
+      }
+      cal.calibrate(file);
+      EXPECT_FLOAT_EQ(4, (*wind)(0,0,0));
+      EXPECT_FLOAT_EQ(3, (*wind)(0,0,1));
+      EXPECT_NEAR(0, (*wind)(0,0,2), 1e-5);
+      EXPECT_FLOAT_EQ(Util::MV, (*wind)(0,1,0));
+      EXPECT_FLOAT_EQ(Util::MV, (*wind)(0,1,1));
+      EXPECT_FLOAT_EQ(6*1.7071067, (*wind)(0,1,2));
+
+      // Missing parameters give missing values
+      parFile = getParameterFile(1,0,1,0,0,0,0,Util::MV,0);
+      cal.calibrate(file);
+      EXPECT_FLOAT_EQ(Util::MV, (*wind)(0,0,0));
+      EXPECT_FLOAT_EQ(Util::MV, (*wind)(0,1,2));
+   }
    TEST_F(TestCalibratorWindDirection, description) {
       CalibratorWindDirection::description();
    }
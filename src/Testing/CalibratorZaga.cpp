@@ -177,6 +177,60 @@ namespace {
       EXPECT_FLOAT_EQ(Util::MV, CalibratorZaga::getInvCdf(0, 15, 0.3, par));
       EXPECT_FLOAT_EQ(Util::MV, CalibratorZaga::getInvCdf(0.5, 15, 0.3, par));
    }
+   TEST_F(TestCalibratorZaga, getGammaQuantile) {
+      // The iterative solution should agree with boost within the requested accuracy
+      float shapes[] = {0.2, 0.5, 1, 2.5, 10, 100, 1000};
+      float accuracies[] = {1e-2, 1e-4, 1e-6};
+      for(int s = 0; s < sizeof(shapes)/sizeof(float); s++) {
+         for(int a = 0; a < sizeof(accuracies)/sizeof(float); a++) {
+            for(int q = 1; q < 1000; q += 7) {
+               float quantile = (float) q / 1000;
+               float expected = CalibratorZaga::getGammaQuantile(quantile, shapes[s], 2.3);
+               float value = CalibratorZaga::getGammaQuantile(quantile, shapes[s], 2.3, accuracies[a]);
+               EXPECT_NEAR(expected, value, accuracies[a] * expected);
+            }
+         }
+      }
+      // Extreme quantiles
+      EXPECT_NEAR(CalibratorZaga::getGammaQuantile(1e-6, 3, 1), CalibratorZaga::getGammaQuantile(1e-6, 3, 1, 1e-4), 1e-4*CalibratorZaga::getGammaQuantile(1e-6, 3, 1));
+      EXPECT_NEAR(CalibratorZaga::getGammaQuantile(0.99999, 3, 1), CalibratorZaga::getGammaQuantile(0.99999, 3, 1, 1e-4), 1e-4*CalibratorZaga::getGammaQuantile(0.99999, 3, 1));
+      EXPECT_FLOAT_EQ(0, CalibratorZaga::getGammaQuantile(0, 3, 1, 1e-4));
+   }
+   TEST_F(TestCalibratorZaga, accuracy) {
+      FileFake file(1, 1, 3, 1);
+      ParameterFile parFile = getParameterFile(-1.1,1.4,0.05,-0.05, 2.03, -0.05, 0.82, -2.71);
+      CalibratorZaga cal = getCalibrator(&parFile);
+      cal.setAccuracy(1e-4);
+      FieldPtr field  = file.getField(Variable::Precip, 0);
+      (*field)(0,0,0) = 12;
+      (*field)(0,0,1) = 1;
+      (*field)(0,0,2) = 4;
+      cal.calibrate(file);
+      EXPECT_NEAR(6.6280001, (*field)(0,0,0), 6.6280001e-4);
+      EXPECT_NEAR(1.0158194, (*field)(0,0,1), 1.0158194e-4);
+      EXPECT_NEAR(3.0753615, (*field)(0,0,2), 3.0753615e-4);
+
+      Parameters par = getParameters(-1.1,1.4,0.05,-0.05, 2.03, -0.05, 0.82, -2.71);
+      for(int i = 1; i < 10; i++) {
+         float quantile = (float) i / 10;
+         float expected = CalibratorZaga::getInvCdf(quantile, 5, 0.1, par);
+         EXPECT_NEAR(expected, CalibratorZaga::getInvCdf(quantile, 5, 0.1, par, 1e-4), 1e-4*expected);
+      }
+   }
+   TEST_F(TestCalibratorZaga, setGetAccuracy) {
+      ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+      Util::setShowError(false);
+      ParameterFile parFile = getParameterFile(-1.1,1.4,0.05,-0.05, 2.03, -0.05, 0.82, -2.71);
+      CalibratorZaga cal = getCalibrator(&parFile);
+      // Full precision by default
+      EXPECT_FLOAT_EQ(0, cal.getAccuracy());
+      cal.setAccuracy(0.001);
+      EXPECT_FLOAT_EQ(0.001, cal.getAccuracy());
+
+      EXPECT_DEATH(cal.setAccuracy(-0.01), ".*");
+      EXPECT_DEATH(cal.setAccuracy(1), ".*");
+      EXPECT_DEATH(cal.setAccuracy(Util::MV), ".*");
+   }
    /* This would be nice, but not yet implemented
    TEST_F(TestCalibratorZaga, getInvCdfExtreme) {
       // Extremes should produce valid values
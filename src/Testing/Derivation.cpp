@@ -0,0 +1,139 @@
+#include "../File/Fake.h"
+#include "../Util.h"
+#include <math.h>
+#include <gtest/gtest.h>
+
+namespace {
+   class DerivationTest : public ::testing::Test {
+      protected:
+         //! Get the default derivation for this variable
+         DerivationPtr getDerivation(Variable::Type iVariable) {
+            std::vector<DerivationPtr> derivations = Derivation::getDefaults();
+            for(int i = 0; i < derivations.size(); i++) {
+               if(derivations[i]->hasOutput(iVariable))
+                  return derivations[i];
+            }
+            return DerivationPtr();
+         };
+   };
+   //! Uses its output as input for the same timestep
+   class DerivationCyclic : public Derivation {
+      public:
+         DerivationCyclic() : Derivation(std::vector<Variable::Type>(1, Variable::Fake)) {
+            addInput(Variable::Fake, 0);
+         };
+         void compute(const File& iFile, const std::vector<FieldPtr>& iInputs, const std::vector<Field*>& iOutputs) const {};
+   };
+
+   TEST_F(DerivationTest, defaults) {
+      std::vector<DerivationPtr> derivations = Derivation::getDefaults();
+      ASSERT_EQ(3, derivations.size());
+      for(int i = 0; i < derivations.size(); i++) {
+         EXPECT_GE(derivations[i]->getOutputs().size(), 1);
+         EXPECT_EQ(derivations[i]->getInputs().size(), derivations[i]->getOffsets().size());
+      }
+      DerivationPtr wind = getDerivation(Variable::W);
+      ASSERT_TRUE(wind != NULL);
+      EXPECT_TRUE(wind->hasOutput(Variable::WD));
+      EXPECT_FALSE(wind->hasOutput(Variable::U));
+      DerivationPtr acc = getDerivation(Variable::PrecipAcc);
+      ASSERT_TRUE(acc != NULL);
+      ASSERT_EQ(2, acc->getInputs().size());
+      EXPECT_EQ(Variable::PrecipAcc, acc->getInputs()[0]);
+      EXPECT_EQ(-1, acc->getOffsets()[0]);
+      // The other rules must be added explicitly
+      EXPECT_TRUE(getDerivation(Variable::U) == NULL);
+      EXPECT_TRUE(getDerivation(Variable::QNH) == NULL);
+      EXPECT_TRUE(getDerivation(Variable::RH) == NULL);
+   }
+   TEST_F(DerivationTest, getScheme) {
+      EXPECT_TRUE(Derivation::getScheme("windComponents")->hasOutput(Variable::V));
+      EXPECT_TRUE(Derivation::getScheme("qnh")->hasOutput(Variable::QNH));
+      DerivationPtr rh = Derivation::getScheme("rh");
+      EXPECT_TRUE(rh->hasOutput(Variable::RH));
+      ASSERT_EQ(2, rh->getInputs().size());
+      EXPECT_EQ(Variable::TD, rh->getInputs()[1]);
+   }
+   TEST_F(DerivationTest, initialValues) {
+      FileFake file(2, 3, 2, 2);
+      FieldPtr precip = file.getEmptyField();
+      std::vector<Field*> outputs(1, precip.get());
+      getDerivation(Variable::Precip)->compute(file, std::vector<FieldPtr>(), outputs);
+      EXPECT_FLOAT_EQ(Util::MV, (*precip)(1,2,1));
+
+      FieldPtr acc = file.getEmptyField();
+      outputs[0] = acc.get();
+      getDerivation(Variable::PrecipAcc)->compute(file, std::vector<FieldPtr>(), outputs);
+      EXPECT_FLOAT_EQ(0, (*acc)(1,2,1));
+   }
+   TEST_F(DerivationTest, windComponents) {
+      FileFake file(1, 4, 1, 1);
+      std::vector<FieldPtr> inputs;
+      inputs.push_back(file.getEmptyField());
+      inputs.push_back(file.getEmptyField());
+      float u[4] = {3, -2, 0, Util::MV};
+      float v[4] = {4, 1, -5, 1};
+      for(int j = 0; j < 4; j++) {
+         (*inputs[0])(0,j,0) = u[j];
+         (*inputs[1])(0,j,0) = v[j];
+      }
+      FieldPtr speed = file.getEmptyField();
+      FieldPtr direction = file.getEmptyField();
+      std::vector<Field*> outputs;
+      outputs.push_back(speed.get());
+      outputs.push_back(direction.get());
+      getDerivation(Variable::W)->compute(file, inputs, outputs);
+      EXPECT_FLOAT_EQ(5, (*speed)(0,0,0));
+      EXPECT_FLOAT_EQ(0, (*direction)(0,2,0));
+
+      // Back to the components. Only compute U.
+      std::vector<FieldPtr> inputs2;
+      inputs2.push_back(speed);
+      inputs2.push_back(direction);
+      (*speed)(0,3,0) = Util::MV;
+      FieldPtr u2 = file.getEmptyField();
+      std::vector<Field*> outputs2;
+      outputs2.push_back(u2.get());
+      outputs2.push_back(NULL);
+      Derivation::getScheme("windComponents")->compute(file, inputs2, outputs2);
+      for(int j = 0; j < 3; j++) {
+         EXPECT_NEAR(u[j], (*u2)(0,j,0), 1e-5);
+      }
+      EXPECT_FLOAT_EQ(Util::MV, (*u2)(0,3,0));
+   }
+   TEST_F(DerivationTest, qnh) {
+      FileFake file(2, 2, 2, 1);
+      std::vector<FieldPtr> inputs(1, file.getEmptyField(90000));
+      (*inputs[0])(1,1,1) = Util::MV;
+      FieldPtr qnh = file.getEmptyField();
+      Derivation::getScheme("qnh")->compute(file, inputs, std::vector<Field*>(1, qnh.get()));
+      EXPECT_FLOAT_EQ(Util::calcQnh(file.getElevs()[0][1], 90000), (*qnh)(0,1,0));
+      EXPECT_FLOAT_EQ(Util::MV, (*qnh)(1,1,1));
+   }
+   TEST_F(DerivationTest, rh) {
+      FileFake file(1, 4, 1, 1);
+      std::vector<FieldPtr> inputs;
+      inputs.push_back(file.getEmptyField(283.15));
+      inputs.push_back(file.getEmptyField());
+      float td[4] = {283.15, 273.15, 274, Util::MV};
+      for(int j = 0; j < 4; j++) {
+         (*inputs[1])(0,j,0) = td[j];
+      }
+      FieldPtr rh = file.getEmptyField();
+      Derivation::getScheme("rh")->compute(file, inputs, std::vector<Field*>(1, rh.get()));
+      EXPECT_FLOAT_EQ(1, (*rh)(0,0,0));
+      EXPECT_NEAR(0.5, (*rh)(0,1,0), 0.01);
+      EXPECT_LT((*rh)(0,1,0), (*rh)(0,2,0));
+      EXPECT_FLOAT_EQ(Util::MV, (*rh)(0,3,0));
+   }
+   TEST_F(DerivationTest, invalidInput) {
+      ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+      Util::setShowError(false);
+      EXPECT_DEATH(DerivationCyclic(), ".*");
+      EXPECT_DEATH(Derivation::getScheme("nonexistent"), ".*");
+   }
+}
+int main(int argc, char **argv) {
+     ::testing::InitGoogleTest(&argc, argv);
+       return RUN_ALL_TESTS();
+}
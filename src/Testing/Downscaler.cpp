@@ -3,7 +3,10 @@
 #include "../Downscaler/Downscaler.h"
 #include <gtest/gtest.h>
 #include <boost/assign/list_of.hpp>
-#include <boost/uuid/uuid.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/weak_ptr.hpp>
+#include <fstream>
+#include <cstdio>
 
 namespace {
    class TestDownscaler : public ::testing::Test {
@@ -40,6 +43,47 @@ namespace {
          };
       protected:
    };
+   //! Read-only file that records how many of the fields it has read are still in use
+   class FileTracked : public File {
+      public:
+         FileTracked(int nTime) : File("", true), mMaxInUse(0) {
+            mNLat = 3;
+            mNLon = 2;
+            mNEns = 1;
+            mNTime = nTime;
+            mLats.resize(mNLat, std::vector<float>(mNLon));
+            mLons.resize(mNLat, std::vector<float>(mNLon));
+            mElevs.resize(mNLat, std::vector<float>(mNLon, 0));
+            for(int i = 0; i < mNLat; i++) {
+               for(int j = 0; j < mNLon; j++) {
+                  mLats[i][j] = 50 + i;
+                  mLons[i][j] = j;
+               }
+            }
+         };
+         ~FileTracked() {
+            stopPrefetch();
+         };
+         std::string name() const {return "tracked";};
+         //! Largest number of fields in use when a field was read, including the one being read
+         int getMaxInUse() const {return mMaxInUse;};
+      protected:
+         FieldPtr getFieldCore(Variable::Type iVariable, int iTime) const {
+            int numInUse = 1;
+            for(int k = 0; k < mRead.size(); k++) {
+               numInUse += !mRead[k].expired();
+            }
+            mMaxInUse = std::max(mMaxInUse, numInUse);
+            FieldPtr field = getEmptyField(iTime);
+            mRead.push_back(boost::weak_ptr<Field>(field));
+            return field;
+         };
+         void writeCore(std::vector<Variable::Type> iVariables, const std::vector<std::vector<FieldPtr> >& iFields) {};
+         bool hasVariableCore(Variable::Type iVariable) const {return true;};
+      private:
+         mutable std::vector<boost::weak_ptr<Field> > mRead;
+         mutable int mMaxInUse;
+   };
 
    TEST_F(TestDownscaler, validDownscalers) {
       Downscaler* d0 = Downscaler::getScheme("nearestNeighbour", Variable::T, Options());
@@ -221,9 +265,9 @@ namespace {
       EXPECT_EQ(1, J[0][0]);
 
       // Don't change the grid
-      boost::uuids::uuid idBefore = from.getUniqueTag();
+      boost::uint64_t idBefore = from.getUniqueTag();
       setLatLon(from, (float[]) {60,50,55}, (float[]){5,4});
-      boost::uuids::uuid idAfter = from.getUniqueTag();
+      boost::uint64_t idAfter = from.getUniqueTag();
       EXPECT_EQ(idBefore, idAfter);
       Downscaler::getNearestNeighbour(from, to, I, J);
       ASSERT_EQ(2, I.size());
@@ -257,6 +301,183 @@ namespace {
          }
       }
    }
+   TEST_F(TestDownscaler, sameGridSameTag) {
+      FileFake file1(3,2,1,1);
+      FileFake file2(3,2,1,1);
+      setLatLon(file1, (float[]) {60,50,55}, (float[]){5,4});
+      setLatLon(file2, (float[]) {60,50,55}, (float[]){5,4});
+      EXPECT_EQ(file1.getUniqueTag(), file2.getUniqueTag());
+      setLatLon(file2, (float[]) {60,50,55}, (float[]){5,3});
+      EXPECT_NE(file1.getUniqueTag(), file2.getUniqueTag());
+      setLatLon(file2, (float[]) {60,50,55}, (float[]){5,4});
+      EXPECT_EQ(file1.getUniqueTag(), file2.getUniqueTag());
+   }
+   TEST_F(TestDownscaler, elevTag) {
+      FileFake file1(3,2,1,1);
+      FileFake file2(3,2,1,1);
+      EXPECT_EQ(file1.getElevTag(), file2.getElevTag());
+      vec2 elevs = file2.getElevs();
+      elevs[1][1] += 10;
+      file2.setElevs(elevs);
+      EXPECT_NE(file1.getElevTag(), file2.getElevTag());
+      // The lat/lon tag does not depend on the elevations
+      EXPECT_EQ(file1.getUniqueTag(), file2.getUniqueTag());
+      file1.setElevs(elevs);
+      EXPECT_EQ(file1.getElevTag(), file2.getElevTag());
+   }
+   TEST_F(TestDownscaler, diskCache) {
+      Downscaler::setCacheDirectory("testing/files");
+      // Earlier tests may have put the same grids in the memory cache
+      Downscaler::clearCache();
+      FileFake from(3,2,1,1);
+      FileFake to(2,2,1,1);
+      setLatLon(from, (float[]) {60,50,55}, (float[]){5,4});
+      setLatLon(to,   (float[]) {56,49},    (float[]){3,4.6});
+      std::string filename = Downscaler::getCacheFilename("nearest", from, to);
+      EXPECT_NE("", filename);
+      remove(filename.c_str());
+
+      vec2Int I, J;
+      Downscaler::getNearestNeighbour(from, to, I, J);
+      EXPECT_TRUE(Util::exists(filename));
+
+      // New files with the same grids use the disk cache, when the memory cache is empty
+      Downscaler::clearCache();
+      FileFake from2(3,2,1,1);
+      FileFake to2(2,2,1,1);
+      setLatLon(from2, (float[]) {60,50,55}, (float[]){5,4});
+      setLatLon(to2,   (float[]) {56,49},    (float[]){3,4.6});
+      EXPECT_EQ(filename, Downscaler::getCacheFilename("nearest", from2, to2));
+      vec2Int I2, J2;
+      Downscaler::getNearestNeighbour(from2, to2, I2, J2);
+      EXPECT_EQ(I, I2);
+      EXPECT_EQ(J, J2);
+
+      // Invalid cache files are ignored
+      std::ofstream ofs(filename.c_str());
+      ofs << "invalid";
+      ofs.close();
+      Downscaler::clearCache();
+      FileFake from3(3,2,1,1);
+      FileFake to3(2,2,1,1);
+      setLatLon(from3, (float[]) {60,50,55}, (float[]){5,4});
+      setLatLon(to3,   (float[]) {56,49},    (float[]){3,4.6});
+      vec2Int I3, J3;
+      Util::setShowWarning(false);
+      Downscaler::getNearestNeighbour(from3, to3, I3, J3);
+      EXPECT_EQ(I, I3);
+      EXPECT_EQ(J, J3);
+
+      // Cache files with indices outside the input grid are ignored. The header has 6 values and
+      // the tables follow; point the first I index past the last latitude of the input grid.
+      std::fstream fs(filename.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+      boost::int32_t tampered = 3;
+      fs.seekp(6*sizeof(boost::int32_t));
+      fs.write(reinterpret_cast<const char*>(&tampered), sizeof(tampered));
+      fs.close();
+      Downscaler::clearCache();
+      FileFake from4(3,2,1,1);
+      FileFake to4(2,2,1,1);
+      setLatLon(from4, (float[]) {60,50,55}, (float[]){5,4});
+      setLatLon(to4,   (float[]) {56,49},    (float[]){3,4.6});
+      vec2Int I4, J4;
+      Downscaler::getNearestNeighbour(from4, to4, I4, J4);
+      EXPECT_EQ(I, I4);
+      EXPECT_EQ(J, J4);
+      // The recomputed tables are written back
+      boost::int32_t first = Util::MV;
+      std::ifstream ifs(filename.c_str(), std::ios::binary);
+      ifs.seekg(6*sizeof(boost::int32_t));
+      ifs.read(reinterpret_cast<char*>(&first), sizeof(first));
+      ifs.close();
+      EXPECT_EQ(I[0][0], first);
+
+      // Different grid gives a different file
+      setLatLon(to3, (float[]) {56,48}, (float[]){3,4.6});
+      EXPECT_NE(filename, Downscaler::getCacheFilename("nearest", from3, to3));
+
+      remove(filename.c_str());
+      Downscaler::setCacheDirectory("");
+      EXPECT_EQ("", Downscaler::getCacheFilename("nearest", from, to));
+   }
+   TEST_F(TestDownscaler, getOperator) {
+      FileFake from(3,2,1,1);
+      FileFake to(2,2,1,1);
+      setLatLon(from, (float[]) {60,50,55}, (float[]){5,4});
+      setLatLon(to,   (float[]) {56,49},    (float[]){3,4.6});
+
+      Downscaler* nn = Downscaler::getScheme("nearestNeighbour", Variable::T, Options());
+      Downscaler* nn2 = Downscaler::getScheme("nearestNeighbour", Variable::Precip, Options());
+      Downscaler* gradient = Downscaler::getScheme("gradient", Variable::T, Options());
+      Downscaler* constant = Downscaler::getScheme("gradient", Variable::T, Options("constantGradient=0.01"));
+      DownscalingOperatorPtr op = nn->getOperator(from, to);
+      ASSERT_TRUE(op);
+      EXPECT_EQ(6, op->getNumInput());
+      EXPECT_EQ(4, op->getNumOutput());
+      // Shared between variables
+      EXPECT_EQ(op, nn2->getOperator(from, to));
+      // Gradient depends on the values, unless the gradient is constant
+      EXPECT_FALSE(gradient->getOperator(from, to));
+      EXPECT_TRUE(constant->getOperator(from, to));
+      EXPECT_NE(op, constant->getOperator(from, to));
+
+      // The operator gives the same results as the nearest neighbour tables
+      vec2Int I, J;
+      Downscaler::getNearestNeighbour(from, to, I, J);
+      const Field& input = *from.getField(Variable::T, 0);
+      Field output(2, 2, 1);
+      op->apply(input, output);
+      for(int i = 0; i < 2; i++) {
+         for(int j = 0; j < 2; j++) {
+            EXPECT_FLOAT_EQ(input(I[i][j], J[i][j], 0), output(i,j,0));
+         }
+      }
+
+      // New grid gives a new operator
+      setLatLon(to, (float[]) {56,48}, (float[]){3,4.6});
+      EXPECT_NE(op, nn->getOperator(from, to));
+
+      // Disk cache
+      Downscaler::setCacheDirectory("testing/files");
+      Downscaler::clearCache();
+      std::string filename = Downscaler::getCacheFilename("operator_nearestNeighbour", from, to);
+      remove(filename.c_str());
+      op = nn->getOperator(from, to);
+      EXPECT_TRUE(Util::exists(filename));
+      Downscaler::clearCache();
+      DownscalingOperatorPtr op2 = nn->getOperator(from, to);
+      EXPECT_NE(op, op2);
+      EXPECT_TRUE(*op == *op2);
+      remove(filename.c_str());
+      remove(Downscaler::getCacheFilename("nearest", from, to).c_str());
+      Downscaler::setCacheDirectory("");
+
+      delete nn;
+      delete nn2;
+      delete gradient;
+      delete constant;
+   }
+   TEST_F(TestDownscaler, operatorCacheSize) {
+      FileTracked from(5);
+      FileFake to(2, 2, 1, 5);
+      long fieldSize = from.getNumLat() * from.getNumLon() * from.getNumEns() * sizeof(float);
+      from.setMaxCacheSize(2*fieldSize);
+      Downscaler* nn = Downscaler::getScheme("nearestNeighbour", Variable::T, Options());
+      ASSERT_TRUE(nn->getOperator(from, to));
+      nn->downscale(from, to);
+      // Timesteps are downscaled in batches that fit in the cache, such that the earlier
+      // batches can be freed
+      EXPECT_LE(from.getMaxInUse(), 3);
+      for(int t = 0; t < 5; t++) {
+         EXPECT_FLOAT_EQ(t, (*to.getField(Variable::T, t))(1,1,0));
+      }
+
+      // Without a limit, all timesteps are downscaled at once
+      FileTracked from2(5);
+      nn->downscale(from2, to);
+      EXPECT_EQ(5, from2.getMaxInUse());
+      delete nn;
+   }
 }
 int main(int argc, char **argv) {
      ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,191 @@
+#include "../Util.h"
+#include "../File/File.h"
+#include "../Downscaler/Downscaler.h"
+#include <gtest/gtest.h>
+#include <math.h>
+
+namespace {
+   class TestDownscalerBilinear : public ::testing::Test {
+      public:
+         // Grid rotated by iAngle degrees and stretched in latitude
+         void setRotatedGrid(FileFake& iFile, float iAngle) {
+            int nLat = iFile.getNumLat();
+            int nLon = iFile.getNumLon();
+            vec2 lats(nLat, std::vector<float>(nLon));
+            vec2 lons(nLat, std::vector<float>(nLon));
+            float angle = Util::deg2rad(iAngle);
+            for(int i = 0; i < nLat; i++) {
+               for(int j = 0; j < nLon; j++) {
+                  float x = j + 0.05 * i * i;
+                  float y = i;
+                  lats[i][j] = 60 + 0.1 * (x*sin(angle) + y*cos(angle));
+                  lons[i][j] = 10 + 0.2 * (x*cos(angle) - y*sin(angle));
+               }
+            }
+            iFile.setLats(lats);
+            iFile.setLons(lons);
+         }
+         // A field that is linear in latitude and longitude
+         void setLinearField(FileFake& iFile) {
+            const vec2& lats = iFile.getLats();
+            const vec2& lons = iFile.getLons();
+            for(int t = 0; t < iFile.getNumTime(); t++) {
+               Field& field = *iFile.getField(Variable::T, t);
+               for(int i = 0; i < iFile.getNumLat(); i++) {
+                  for(int j = 0; j < iFile.getNumLon(); j++) {
+                     for(int e = 0; e < iFile.getNumEns(); e++) {
+                        field(i,j,e) = getLinear(lats[i][j], lons[i][j]) + e + t;
+                     }
+                  }
+               }
+            }
+         }
+         float getLinear(float iLat, float iLon) {
+            return 3 * (iLat - 60) - 2 * (iLon - 10);
+         }
+         void setLatLon(FileFake& iFile, float iLat[], float iLon[]) {
+            int nLat = iFile.getNumLat();
+            int nLon = iFile.getNumLon();
+            vec2 lat(nLat, std::vector<float>(nLon));
+            vec2 lon(nLat, std::vector<float>(nLon));
+            for(int i = 0; i < nLat; i++) {
+               for(int j = 0; j < nLon; j++) {
+                  lat[i][j] = iLat[i];
+                  lon[i][j] = iLon[j];
+               }
+            }
+            iFile.setLats(lat);
+            iFile.setLons(lon);
+         };
+   };
+
+   TEST_F(TestDownscalerBilinear, description) {
+      DownscalerBilinear::description();
+   }
+   TEST_F(TestDownscalerBilinear, getScheme) {
+      Downscaler* d = Downscaler::getScheme("bilinear", Variable::T, Options());
+      EXPECT_EQ("bilinear", d->name());
+      delete d;
+   }
+   TEST_F(TestDownscalerBilinear, calcParameters) {
+      float s, t;
+      // Unit square
+      float x0[4] = {0, 1, 0, 1};
+      float y0[4] = {0, 0, 1, 1};
+      EXPECT_TRUE(DownscalerBilinear::calcParameters(0.25, 0.75, x0, y0, s, t));
+      EXPECT_FLOAT_EQ(0.25, s);
+      EXPECT_FLOAT_EQ(0.75, t);
+      EXPECT_TRUE(DownscalerBilinear::calcParameters(1, 0, x0, y0, s, t));
+      EXPECT_FLOAT_EQ(1, s);
+      EXPECT_FLOAT_EQ(0, t);
+      EXPECT_FALSE(DownscalerBilinear::calcParameters(1.1, 0.5, x0, y0, s, t));
+      EXPECT_FALSE(DownscalerBilinear::calcParameters(0.5, -0.1, x0, y0, s, t));
+
+      // General quadrilateral: check that the parameters reproduce the point
+      float x1[4] = {0, 2, 0.5, 3};
+      float y1[4] = {0, 0.5, 1.5, 2.5};
+      for(float S = 0; S <= 1; S += 0.25) {
+         for(float T = 0; T <= 1; T += 0.25) {
+            float x = (1-S)*(1-T)*x1[0] + S*(1-T)*x1[1] + (1-S)*T*x1[2] + S*T*x1[3];
+            float y = (1-S)*(1-T)*y1[0] + S*(1-T)*y1[1] + (1-S)*T*y1[2] + S*T*y1[3];
+            EXPECT_TRUE(DownscalerBilinear::calcParameters(x, y, x1, y1, s, t));
+            EXPECT_NEAR(S, s, 1e-5);
+            EXPECT_NEAR(T, t, 1e-5);
+         }
+      }
+
+      // Degenerate cell
+      float x2[4] = {0, 0, 0, 0};
+      EXPECT_FALSE(DownscalerBilinear::calcParameters(0, 0, x2, y0, s, t));
+   }
+   TEST_F(TestDownscalerBilinear, regularGrid) {
+      DownscalerBilinear d(Variable::T);
+      FileFake from(3,3,1,1);
+      FileFake to(2,3,1,1);
+      setLatLon(from, (float[]) {50,51,52}, (float[]){5,6,7});
+      setLatLon(to,   (float[]) {50.5,51.25}, (float[]){5.5,6,6.9});
+      d.downscale(from, to);
+      // Fake values are i + j
+      const Field& toT = *to.getField(Variable::T, 0);
+      EXPECT_FLOAT_EQ(1, toT(0,0,0));
+      EXPECT_FLOAT_EQ(1.5, toT(0,1,0));
+      EXPECT_FLOAT_EQ(2.4, toT(0,2,0));
+      EXPECT_FLOAT_EQ(1.75, toT(1,0,0));
+      EXPECT_FLOAT_EQ(2.25, toT(1,1,0));
+      EXPECT_FLOAT_EQ(3.15, toT(1,2,0));
+   }
+   TEST_F(TestDownscalerBilinear, outsideGrid) {
+      // Use the nearest neighbour outside the grid
+      DownscalerBilinear d(Variable::T);
+      FileFake from(2,2,1,1);
+      FileFake to(1,3,1,1);
+      setLatLon(from, (float[]) {50,51}, (float[]){5,6});
+      setLatLon(to,   (float[]) {52}, (float[]){4,5.4,6});
+      d.downscale(from, to);
+      const Field& toT = *to.getField(Variable::T, 0);
+      EXPECT_FLOAT_EQ(1, toT(0,0,0));
+      EXPECT_FLOAT_EQ(1, toT(0,1,0));
+      EXPECT_FLOAT_EQ(2, toT(0,2,0));
+   }
+   TEST_F(TestDownscalerBilinear, missingValues) {
+      DownscalerBilinear d(Variable::T);
+      FileFake from(2,2,2,1);
+      FileFake to(1,1,2,1);
+      setLatLon(from, (float[]) {50,51}, (float[]){5,6});
+      setLatLon(to,   (float[]) {50.5}, (float[]){5.5});
+      Field& fromT = *from.getField(Variable::T, 0);
+      fromT(1,1,0) = Util::MV;
+      for(int i = 0; i < 2; i++)
+         for(int j = 0; j < 2; j++)
+            fromT(i,j,1) = Util::MV;
+      d.downscale(from, to);
+      const Field& toT = *to.getField(Variable::T, 0);
+      // Weights of the remaining points are rescaled
+      EXPECT_FLOAT_EQ(2.0/3, toT(0,0,0));
+      EXPECT_FLOAT_EQ(Util::MV, toT(0,0,1));
+   }
+   // Bilinear interpolation reproduces fields that are linear in latitude and longitude, also on
+   // curvilinear grids
+   TEST_F(TestDownscalerBilinear, curvilinearGrid) {
+      DownscalerBilinear d(Variable::T);
+      FileFake from(10,12,2,2);
+      setRotatedGrid(from, 30);
+      setLinearField(from);
+
+      int nLat = 7;
+      int nLon = 9;
+      FileFake to(nLat,nLon,2,2);
+      const vec2& ilats = from.getLats();
+      const vec2& ilons = from.getLons();
+      vec2 lats(nLat, std::vector<float>(nLon));
+      vec2 lons(nLat, std::vector<float>(nLon));
+      for(int i = 0; i < nLat; i++) {
+         for(int j = 0; j < nLon; j++) {
+            // Points inside the input grid
+            float a = 0.13 + 0.11 * i;
+            float b = 0.17 + 0.09 * j;
+            int I = 2 + i;
+            int J = 1 + j;
+            lats[i][j] = (1-a)*(1-b)*ilats[I][J] + a*(1-b)*ilats[I+1][J] + (1-a)*b*ilats[I][J+1] + a*b*ilats[I+1][J+1];
+            lons[i][j] = (1-a)*(1-b)*ilons[I][J] + a*(1-b)*ilons[I+1][J] + (1-a)*b*ilons[I][J+1] + a*b*ilons[I+1][J+1];
+         }
+      }
+      to.setLats(lats);
+      to.setLons(lons);
+      d.downscale(from, to);
+      for(int t = 0; t < 2; t++) {
+         const Field& toT = *to.getField(Variable::T, t);
+         for(int i = 0; i < nLat; i++) {
+            for(int j = 0; j < nLon; j++) {
+               for(int e = 0; e < 2; e++) {
+                  EXPECT_NEAR(getLinear(lats[i][j], lons[i][j]) + e + t, toT(i,j,e), 1e-3);
+               }
+            }
+         }
+      }
+   }
+}
+int main(int argc, char **argv) {
+     ::testing::InitGoogleTest(&argc, argv);
+       return RUN_ALL_TESTS();
+}
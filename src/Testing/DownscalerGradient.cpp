@@ -2,6 +2,7 @@
 #include "../File/File.h"
 #include "../Downscaler/Downscaler.h"
 #include <gtest/gtest.h>
+#include <math.h>
 #include <boost/assign/list_of.hpp>
 
 namespace {
@@ -235,6 +236,87 @@ namespace {
          EXPECT_FLOAT_EQ(278.6948,  toT(0,2,0)); // 304 - 0.1 * (600-346.9477)
       }
    }
+   // Precomputing the gradients on the input grid should give the same results as a regression
+   // in double precision over each neighbourhood
+   TEST_F(TestDownscalerGradient, precompute) {
+      // Output grid denser than the input grid
+      const vec2& ilats = mFrom->getLats();
+      const vec2& ilons = mFrom->getLons();
+      const vec2& ielevs = mFrom->getElevs();
+      int nLat = 19;
+      int nLon = 19;
+      FileFake to(nLat, nLon, 1, mFrom->getNumTime());
+      vec2 lats(nLat, std::vector<float>(nLon));
+      vec2 lons(nLat, std::vector<float>(nLon));
+      vec2 elevs(nLat, std::vector<float>(nLon));
+      for(int i = 0; i < nLat; i++) {
+         for(int j = 0; j < nLon; j++) {
+            lats[i][j] = ilats[i/2][j/2] + (ilats[9][9] - ilats[0][0]) * (i % 2) / 20;
+            lons[i][j] = ilons[i/2][j/2] + (ilons[9][9] - ilons[0][0]) * (j % 2) / 20;
+            elevs[i][j] = 50 * ((i*7 + j*3) % 11);
+         }
+      }
+      elevs[3][4] = Util::MV;
+      to.setLats(lats);
+      to.setLons(lons);
+      to.setElevs(elevs);
+      vec2Int nearestI, nearestJ;
+      Downscaler::getNearestNeighbour(*mFrom, to, nearestI, nearestJ);
+      const Field& ifield = *mFrom->getField(Variable::T, 0);
+
+      int radii[]         = {1, 2, 3, 1, 0, 1, 12};
+      bool logTransform[] = {0, 0, 1, 0, 0, 0, 0};
+      float minElevDiff[] = {30, 0, 30, 1500, 30, 30, 30};
+      float defaultGradient[] = {0, 0, 0, -0.0065, 0.01, 0, 0};
+      float minGradient[] = {Util::MV, Util::MV, Util::MV, Util::MV, Util::MV, -0.01, Util::MV};
+      float maxGradient[] = {Util::MV, Util::MV, Util::MV, Util::MV, Util::MV, -0.008, Util::MV};
+      for(int k = 0; k < sizeof(radii)/sizeof(radii[0]); k++) {
+         std::stringstream ss;
+         ss << "precompute=1 searchRadius=" << radii[k] << " logTransform=" << logTransform[k]
+            << " minElevDiff=" << minElevDiff[k] << " defaultGradient=" << defaultGradient[k];
+         if(Util::isValid(minGradient[k]))
+            ss << " minGradient=" << minGradient[k] << " maxGradient=" << maxGradient[k];
+         DownscalerGradient d(Variable::T, Options(ss.str()));
+         EXPECT_TRUE(d.getPrecompute());
+         d.downscale(*mFrom, to);
+         const Field& actual = *to.getField(Variable::T, 0);
+         for(int i = 0; i < nLat; i++) {
+            for(int j = 0; j < nLon; j++) {
+               int I = nearestI[i][j];
+               int J = nearestJ[i][j];
+               float expected = ifield(I,J,0);
+               if(Util::isValid(elevs[i][j])) {
+                  double sumX = 0, sumY = 0, sumXY = 0, sumXX = 0;
+                  float min = 1e9, max = -1e9;
+                  int counter = 0;
+                  for(int ii = std::max(0, I-radii[k]); ii <= std::min(9, I+radii[k]); ii++) {
+                     for(int jj = std::max(0, J-radii[k]); jj <= std::min(9, J+radii[k]); jj++) {
+                        double x = ielevs[ii][jj];
+                        double y = logTransform[k] ? log(ifield(ii,jj,0)) : ifield(ii,jj,0);
+                        sumX += x;
+                        sumY += y;
+                        sumXY += x*y;
+                        sumXX += x*x;
+                        min = std::min(min, ielevs[ii][jj]);
+                        max = std::max(max, ielevs[ii][jj]);
+                        counter++;
+                     }
+                  }
+                  float gradient = defaultGradient[k];
+                  if(max - min >= minElevDiff[k] && max > min) {
+                     double meanX = sumX / counter;
+                     gradient = (sumXY / counter - meanX * sumY / counter) / (sumXX / counter - meanX * meanX);
+                  }
+                  if(Util::isValid(minGradient[k]))
+                     gradient = std::max(minGradient[k], std::min(maxGradient[k], gradient));
+                  float dElev = elevs[i][j] - ielevs[I][J];
+                  expected = logTransform[k] ? expected * exp(gradient * dElev) : expected + gradient * dElev;
+               }
+               EXPECT_NEAR(expected, actual(i,j,0), 1e-3) << ss.str() << " " << i << " " << j;
+            }
+         }
+      }
+   }
    TEST_F(TestDownscalerGradient, options) {
       DownscalerGradient d(Variable::T, Options("searchRadius=3 defaultGradient=0.1 constantGradient=0.3 minGradient=0 maxGradient=0.2 logTransform=1 minElevDiff=1500"));
       EXPECT_FLOAT_EQ(3, d.getSearchRadius());
@@ -244,6 +326,7 @@ namespace {
       EXPECT_FLOAT_EQ(0.2, d.getMaxGradient());
       EXPECT_FLOAT_EQ(1, d.getLogTransform());
       EXPECT_FLOAT_EQ(1500, d.getMinElevDiff());
+      EXPECT_FALSE(d.getPrecompute());
    }
    TEST_F(TestDownscalerGradient, missingValues) {
 
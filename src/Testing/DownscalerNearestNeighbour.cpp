@@ -56,6 +56,35 @@ namespace {
       EXPECT_FLOAT_EQ(fromT(1,1,0), toT(1,0,0));
       EXPECT_FLOAT_EQ(fromT(1,0,0), toT(1,1,0));
    }
+   TEST_F(TestDownscalerNearestNeighbour, downscaleOneTimestep) {
+      DownscalerNearestNeighbour d(Variable::T);
+      FileFake from(3,2,1,2);
+      FileFake to(2,2,1,2);
+      setLatLon(from, (float[]) {60,50,55}, (float[]){5,4});
+      setLatLon(to,   (float[]) {56,49},    (float[]){3,4.6});
+      (*to.getField(Variable::T, 0))(0,0,0) = -1;
+      (*to.getField(Variable::T, 1))(0,0,0) = -1;
+      d.downscale(from, to, 1);
+      EXPECT_FLOAT_EQ(-1, (*to.getField(Variable::T, 0))(0,0,0));
+      EXPECT_FLOAT_EQ((*from.getField(Variable::T, 1))(2,1,0), (*to.getField(Variable::T, 1))(0,0,0));
+   }
+   TEST_F(TestDownscalerNearestNeighbour, downscalePoints) {
+      // Output with one latitude are downscaled in parallel over time
+      DownscalerNearestNeighbour d(Variable::T);
+      FileFake from(3,2,1,20);
+      FileFake to(1,2,1,20);
+      setLatLon(from, (float[]) {60,50,55}, (float[]){5,4});
+      setLatLon(to,   (float[]) {56},       (float[]){3,4.6});
+      for(int t = 0; t < from.getNumTime(); t++) {
+         (*from.getField(Variable::T, t))(2,1,0) = t;
+         (*from.getField(Variable::T, t))(2,0,0) = -t;
+      }
+      d.downscale(from, to);
+      for(int t = 0; t < to.getNumTime(); t++) {
+         EXPECT_FLOAT_EQ(t, (*to.getField(Variable::T, t))(0,0,0));
+         EXPECT_FLOAT_EQ(-t, (*to.getField(Variable::T, t))(0,1,0));
+      }
+   }
    TEST_F(TestDownscalerNearestNeighbour, 10x10) {
       DownscalerNearestNeighbour d(Variable::T);
       FileArome from("testing/files/10x10.nc");
@@ -61,6 +61,19 @@ namespace {
       EXPECT_FLOAT_EQ(294.83279, toT(0,2,0)); // 304 347m->600m
       EXPECT_FLOAT_EQ(320.89322, toT(0,3,0)); // 304 347m->-100m
    }
+   TEST_F(TestDownscalerPressure, changeElevs) {
+      // The operator is rebuilt when the elevations change
+      DownscalerPressure d(Variable::T);
+      FileArome from("testing/files/10x10.nc");
+      FileFake to(1,4,1,from.getNumTime());
+      setLatLonElev(to, (float[]) {5}, (float[]){2,2,12,20}, (float[]){120, 1500, 600, -100});
+      EXPECT_TRUE(d.downscale(from, to, 0));
+      EXPECT_FLOAT_EQ(302.44693, (*to.getField(Variable::T, 0))(0,0,0));
+      setLatLonElev(to, (float[]) {5}, (float[]){2,2,12,20}, (float[]){160, 160, 347, 347});
+      EXPECT_TRUE(d.downscale(from, to, 0));
+      EXPECT_NEAR(301, (*to.getField(Variable::T, 0))(0,0,0), 0.1);
+      EXPECT_NEAR(304, (*to.getField(Variable::T, 0))(0,2,0), 0.1);
+   }
    TEST_F(TestDownscalerPressure, calcPressure) {
       EXPECT_FLOAT_EQ(101325, DownscalerPressure::calcPressure(0, 101325, 0));
       EXPECT_FLOAT_EQ(89777.391, DownscalerPressure::calcPressure(0, 101325, 1000));
@@ -241,6 +241,73 @@ namespace {
       EXPECT_FLOAT_EQ(49, d.getNumSearchPoints());
       EXPECT_FLOAT_EQ(49, DownscalerSmart::getNumSearchPoints(3));
    }
+   // Smart neighbours are shared between downscalers with the same settings
+   TEST_F(TestDownscalerSmart, cache) {
+      FileFake from(5,3,1,1);
+      setLatLonElev(from, (float[]) {4,5,6,7,8}, (float[]){5,10,15}, (float[]){70,50,20,80,60,70,50,40,30,20,10,40,50,30,60});
+      FileFake to(1,4,1,1);
+      setLatLonElev(to, (float[]) {5.5}, (float[]){2,4, 10,20}, (float[]){120, 80, 600, 45});
+
+      vec3Int I1, J1, I2, J2, I3, J3;
+      DownscalerSmart d1(Variable::T);
+      DownscalerSmart d2(Variable::RH);
+      d1.setSearchRadius(2);
+      d2.setSearchRadius(2);
+      d1.getSmartNeighbours(from, to, I1, J1);
+      d2.getSmartNeighbours(from, to, I2, J2);
+      EXPECT_EQ(I1, I2);
+      EXPECT_EQ(J1, J2);
+
+      // Different settings
+      d2.setNumSmart(2);
+      d2.getSmartNeighbours(from, to, I2, J2);
+      ASSERT_EQ(4, I2[0].size());
+      EXPECT_EQ(2, I2[0][0].size());
+      EXPECT_EQ(5, I1[0][0].size());
+
+      // Changing the elevations gives new neighbours
+      setLatLonElev(to, (float[]) {5.5}, (float[]){2,4, 10,20}, (float[]){120, 80, 600, 10});
+      d1.getSmartNeighbours(from, to, I3, J3);
+      EXPECT_NE(I1[0][3], I3[0][3]);
+      EXPECT_EQ(I1[0][0], I3[0][0]);
+   }
+   TEST_F(TestDownscalerSmart, diskCache) {
+      Downscaler::setCacheDirectory("testing/files");
+      FileFake from(5,3,1,1);
+      setLatLonElev(from, (float[]) {4,5,6,7,8}, (float[]){5,10,15}, (float[]){70,50,20,80,60,70,50,40,30,20,10,40,50,30,60});
+      FileFake to(1,4,1,1);
+      setLatLonElev(to, (float[]) {5.5}, (float[]){2,4, 10,20}, (float[]){120, Util::MV, 600, 45});
+
+      DownscalerSmart d(Variable::T);
+      d.setSearchRadius(1);
+      d.setNumSmart(7);
+      std::string filename = d.getSmartCacheFilename(from, to);
+      EXPECT_NE("", filename);
+      remove(filename.c_str());
+
+      vec3Int I, J;
+      Downscaler::clearCache();
+      d.getSmartNeighbours(from, to, I, J);
+      EXPECT_TRUE(Util::exists(filename));
+      // Fewer neighbours than numSmart for some points
+      EXPECT_EQ(1, I[0][1].size());
+      EXPECT_EQ(6, I[0][0].size());
+
+      // Read from disk when the memory cache is empty
+      Downscaler::clearCache();
+      vec3Int I2, J2;
+      d.getSmartNeighbours(from, to, I2, J2);
+      EXPECT_EQ(I, I2);
+      EXPECT_EQ(J, J2);
+
+      // Other settings use a different file
+      d.setNumSmart(3);
+      EXPECT_NE(filename, d.getSmartCacheFilename(from, to));
+
+      remove(filename.c_str());
+      Downscaler::setCacheDirectory("");
+      EXPECT_EQ("", d.getSmartCacheFilename(from, to));
+   }
    TEST_F(TestDownscalerSmart, description) {
       DownscalerSmart::description();
    }
@@ -0,0 +1,152 @@
+#include "../Downscaler/Operator.h"
+#include "../Util.h"
+#include <gtest/gtest.h>
+#include <fstream>
+
+namespace {
+   class DownscalingOperatorTest : public ::testing::Test {
+      protected:
+         // 2x2 input grid to 1x3 output grid
+         void makeOperator(DownscalingOperator& iOperator) {
+            std::vector<int> indices;
+            std::vector<float> weights;
+            indices.push_back(0);
+            indices.push_back(3);
+            weights.push_back(0.25);
+            weights.push_back(0.75);
+            iOperator.addRow(indices, weights);
+            iOperator.addRow(2, 2, 1);
+            iOperator.addRow(Util::MV);
+         }
+   };
+
+   TEST_F(DownscalingOperatorTest, empty) {
+      DownscalingOperator op(4);
+      EXPECT_EQ(4, op.getNumInput());
+      EXPECT_EQ(0, op.getNumOutput());
+      EXPECT_EQ(0, op.size());
+      Field input(2, 2, 1, 3);
+      Field output(0, 0, 1);
+      op.apply(input, output);
+   }
+   TEST_F(DownscalingOperatorTest, apply) {
+      DownscalingOperator op(4);
+      makeOperator(op);
+      EXPECT_EQ(3, op.getNumOutput());
+      EXPECT_EQ(3, op.size());
+
+      Field input(2, 2, 2);
+      for(int i = 0; i < 2; i++) {
+         for(int j = 0; j < 2; j++) {
+            input(i,j,0) = i*2 + j;
+            input(i,j,1) = 10 * (i*2 + j);
+         }
+      }
+      Field output(1, 3, 2, 0);
+      op.apply(input, output);
+      EXPECT_FLOAT_EQ(2.25, output(0,0,0));
+      EXPECT_FLOAT_EQ(22.5, output(0,0,1));
+      EXPECT_FLOAT_EQ(5,    output(0,1,0));
+      EXPECT_FLOAT_EQ(41,   output(0,1,1));
+      EXPECT_FLOAT_EQ(Util::MV, output(0,2,0));
+      EXPECT_FLOAT_EQ(Util::MV, output(0,2,1));
+   }
+   TEST_F(DownscalingOperatorTest, missingValues) {
+      DownscalingOperator op(4);
+      makeOperator(op);
+      Field input(2, 2, 2, 1);
+      input(1,1,0) = Util::MV;
+      input(0,0,1) = Util::MV;
+      input(1,1,1) = Util::MV;
+      input(1,0,1) = Util::MV;
+      Field output(1, 3, 2, 0);
+      op.apply(input, output);
+      // The remaining weights are rescaled
+      EXPECT_FLOAT_EQ(1, output(0,0,0));
+      EXPECT_FLOAT_EQ(Util::MV, output(0,0,1));
+      EXPECT_FLOAT_EQ(3, output(0,1,0));
+      EXPECT_FLOAT_EQ(Util::MV, output(0,1,1));
+   }
+   TEST_F(DownscalingOperatorTest, bounds) {
+      DownscalingOperator op(2);
+      op.addRow(0, 1, -5);
+      op.addRow(1, 3);
+      op.setBounds(0, 10);
+      Field input(1, 2, 2);
+      input(0,0,0) = 7;
+      input(0,0,1) = 3;
+      input(0,1,0) = 3;
+      input(0,1,1) = 4;
+      Field output(2, 1, 2);
+      op.apply(input, output);
+      EXPECT_FLOAT_EQ(2, output(0,0,0));
+      // Outside the bounds, so use the uncorrected value
+      EXPECT_FLOAT_EQ(3, output(0,0,1));
+      EXPECT_FLOAT_EQ(9, output(1,0,0));
+      EXPECT_FLOAT_EQ(4, output(1,0,1));
+   }
+   TEST_F(DownscalingOperatorTest, severalFields) {
+      DownscalingOperator op(4);
+      makeOperator(op);
+      std::vector<Field> inputs;
+      for(int t = 0; t < 3; t++)
+         inputs.push_back(Field(2, 2, 2, t));
+      inputs[1](1,1,1) = Util::MV;
+      std::vector<Field> outputs(3, Field(1, 3, 2));
+      std::vector<const Field*> inputPointers;
+      std::vector<Field*> outputPointers;
+      for(int t = 0; t < 3; t++) {
+         inputPointers.push_back(&inputs[t]);
+         outputPointers.push_back(&outputs[t]);
+      }
+      op.apply(inputPointers, outputPointers);
+      for(int t = 0; t < 3; t++) {
+         Field expected(1, 3, 2);
+         op.apply(inputs[t], expected);
+         EXPECT_EQ(expected, outputs[t]);
+      }
+   }
+   TEST_F(DownscalingOperatorTest, invalid) {
+      ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+      Util::setShowError(false);
+      DownscalingOperator op(4);
+      EXPECT_DEATH(op.addRow(4), ".*");
+      EXPECT_DEATH(op.addRow(std::vector<int>(1, 0), std::vector<float>(2, 1)), ".*");
+      makeOperator(op);
+      // Wrong sizes
+      Field input(2, 3, 1);
+      Field output(1, 3, 1);
+      EXPECT_DEATH(op.apply(input, output), ".*");
+      Field input2(2, 2, 1);
+      Field output2(1, 4, 1);
+      EXPECT_DEATH(op.apply(input2, output2), ".*");
+   }
+   TEST_F(DownscalingOperatorTest, readWrite) {
+      std::string filename = "testing/files/operator.bin";
+      DownscalingOperator op(4);
+      makeOperator(op);
+      op.setBounds(0, Util::MV);
+      EXPECT_TRUE(op.write(filename));
+
+      DownscalingOperator op2(0);
+      EXPECT_TRUE(op2.read(filename));
+      EXPECT_TRUE(op == op2);
+      EXPECT_EQ(4, op2.getNumInput());
+      EXPECT_EQ(3, op2.getNumOutput());
+
+      // Invalid files are ignored
+      std::ofstream ofs(filename.c_str());
+      ofs << "invalid";
+      ofs.close();
+      Util::setShowWarning(false);
+      DownscalingOperator op3(0);
+      EXPECT_FALSE(op3.read(filename));
+      EXPECT_EQ(0, op3.getNumOutput());
+      remove(filename.c_str());
+      EXPECT_FALSE(op3.read(filename));
+   }
+}
+int main(int argc, char **argv) {
+     ::testing::InitGoogleTest(&argc, argv);
+       return RUN_ALL_TESTS();
+}
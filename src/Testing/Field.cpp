@@ -30,6 +30,42 @@ namespace {
       EXPECT_FLOAT_EQ(def, vec2[1]);
       EXPECT_FLOAT_EQ(def, vec2[2]);
    }
+   TEST_F(FieldTest, pointerAccess) {
+      Field field(3, 2, 4, 0);
+      for(int i = 0; i < 3; i++) {
+         for(int j = 0; j < 2; j++) {
+            for(int e = 0; e < 4; e++) {
+               field(i,j,e) = 100*i + 10*j + e;
+            }
+         }
+      }
+      const float* ens = field.getEnsemble(2,1);
+      for(int e = 0; e < 4; e++)
+         EXPECT_FLOAT_EQ(210 + e, ens[e]);
+      const float* row = field.getRow(1);
+      EXPECT_FLOAT_EQ(100, row[0]);
+      EXPECT_FLOAT_EQ(113, row[7]);
+      const float* data = field.getData();
+      EXPECT_FLOAT_EQ(0, data[0]);
+      EXPECT_FLOAT_EQ(213, data[23]);
+
+      // Writing through the pointers
+      field.getEnsemble(0,1)[2] = -1;
+      EXPECT_FLOAT_EQ(-1, field(0,1,2));
+      field.getData()[0] = -2;
+      EXPECT_FLOAT_EQ(-2, field(0,0,0));
+   }
+   TEST_F(FieldTest, invalidPointerAccess) {
+      // Only checked in debug builds
+      Field field(3, 2, 4, 0);
+      ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+      Util::setShowError(false);
+#ifdef DEBUG
+      EXPECT_DEATH(field.getEnsemble(3,0), ".*");
+      EXPECT_DEATH(field.getEnsemble(0,2), ".*");
+      EXPECT_DEATH(field.getRow(3), ".*");
+#endif
+   }
    TEST_F(FieldTest, equality) {
       Field field1(3, 2, 3, 3.5);
       Field field2(3, 2, 3, 3.5);
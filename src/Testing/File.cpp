@@ -1,11 +1,52 @@
 #include "../File/Arome.h"
 #include "../Util.h"
 #include "../Downscaler/Downscaler.h"
+#include <math.h>
+#include <unistd.h>
 #include <gtest/gtest.h>
 
 namespace {
    class FileTest : public ::testing::Test {
    };
+   //! Adds 1 to the input variable
+   class DerivationPlusOne : public Derivation {
+      public:
+         DerivationPlusOne(Variable::Type iOutput, Variable::Type iInput) : Derivation(std::vector<Variable::Type>(1, iOutput)) {
+            addInput(iInput);
+         };
+         void compute(const File& iFile, const std::vector<FieldPtr>& iInputs, const std::vector<Field*>& iOutputs) const {
+            int N = iFile.getNumLat() * iFile.getNumLon() * iFile.getNumEns();
+            for(int n = 0; n < N; n++) {
+               iOutputs[0]->getData()[n] = iInputs[0]->getData()[n] + 1;
+            }
+         };
+   };
+
+   //! Read-only file where the field of each timestep is filled with the timestep. Reading takes
+   //! some time, such that reads in different threads overlap.
+   class FileSlow : public File {
+      public:
+         FileSlow(int nLat, int nLon, int nEns, int nTime) : File("", true) {
+            mNLat = nLat;
+            mNLon = nLon;
+            mNEns = nEns;
+            mNTime = nTime;
+            mLats.resize(nLat, std::vector<float>(nLon, 0));
+            mLons.resize(nLat, std::vector<float>(nLon, 0));
+            mElevs.resize(nLat, std::vector<float>(nLon, 0));
+         };
+         ~FileSlow() {
+            stopPrefetch();
+         };
+         std::string name() const {return "slow";};
+      protected:
+         FieldPtr getFieldCore(Variable::Type iVariable, int iTime) const {
+            usleep(1000);
+            return getEmptyField(iTime);
+         };
+         void writeCore(std::vector<Variable::Type> iVariables, const std::vector<std::vector<FieldPtr> >& iFields) {};
+         bool hasVariableCore(Variable::Type iVariable) const {return iVariable == Variable::T;};
+   };
 
    TEST_F(FileTest, 10x10) {
       File* file = File::getScheme("testing/files/10x10.nc", Options());
@@ -93,6 +134,38 @@ namespace {
       EXPECT_FLOAT_EQ(4.6,      (*acc1)(0,0,0));
       EXPECT_FLOAT_EQ(10.7,     (*acc2)(0,0,0));
    }
+   TEST_F(FileTest, deriveWind) {
+      FileArome file("testing/files/10x10.nc", true);
+      ASSERT_GE(file.getNumTime(), 2);
+      FieldPtr u = file.getField(Variable::U, 1);
+      FieldPtr v = file.getField(Variable::V, 1);
+      // Use both speed and direction, such that they are derived together for later timesteps
+      file.getField(Variable::WD, 0);
+      file.getField(Variable::W, 0);
+      FieldPtr speed = file.getField(Variable::W, 1);
+      long misses = file.getCacheMisses();
+      FieldPtr direction = file.getField(Variable::WD, 1);
+      EXPECT_EQ(misses, file.getCacheMisses());
+
+      for(int i = 0; i < file.getNumLat(); i++) {
+         for(int j = 0; j < file.getNumLon(); j++) {
+            float currU = (*u)(i,j,0);
+            float currV = (*v)(i,j,0);
+            EXPECT_FLOAT_EQ(sqrt(currU*currU + currV*currV), (*speed)(i,j,0));
+            float dir = atan2(-currU, -currV) * 180 / Util::pi;
+            if(dir < 0)
+               dir += 360;
+            EXPECT_FLOAT_EQ(dir, (*direction)(i,j,0));
+         }
+      }
+
+      // Only the requested variable is derived when the other has not been used
+      FileArome other("testing/files/10x10.nc", true);
+      other.getField(Variable::W, 1);
+      misses = other.getCacheMisses();
+      EXPECT_EQ(*direction, *other.getField(Variable::WD, 1));
+      EXPECT_EQ(misses + 1, other.getCacheMisses());
+   }
    TEST_F(FileTest, getFieldInvalidTime) {
       ::testing::FLAGS_gtest_death_test_style = "threadsafe";
       Util::setShowError(false);
@@ -132,6 +205,392 @@ namespace {
       double referenceTime = f0.getReferenceTime();
       EXPECT_DOUBLE_EQ(4.1123, referenceTime);
    }
+   TEST_F(FileTest, cacheSizeOption) {
+      File* file = File::getScheme("testing/files/10x10.nc", Options("cacheSize=2MB"), true);
+      EXPECT_EQ(2*1024*1024, file->getMaxCacheSize());
+      EXPECT_TRUE(file->isReadOnly());
+      delete file;
+      file = File::getScheme("testing/files/10x10.nc", Options());
+      EXPECT_FALSE(Util::isValid(file->getMaxCacheSize()));
+      delete file;
+   }
+   TEST_F(FileTest, cacheEviction) {
+      FileArome file("testing/files/10x10.nc", true);
+      ASSERT_GE(file.getNumTime(), 2);
+      long fieldSize = file.getNumLat() * file.getNumLon() * file.getNumEns() * sizeof(float);
+      file.setMaxCacheSize(fieldSize);
+
+      float value0 = (*file.getField(Variable::T, 0))(5,5,0);
+      EXPECT_EQ(1, file.getCacheMisses());
+      EXPECT_EQ(0, file.getCacheEvictions());
+      EXPECT_EQ(fieldSize, file.getCacheSize());
+
+      // Time 0 is the least recently used
+      float value1 = (*file.getField(Variable::T, 1))(5,5,0);
+      file.getField(Variable::T, 1);
+      EXPECT_EQ(1, file.getCacheHits());
+      EXPECT_EQ(2, file.getCacheMisses());
+      EXPECT_EQ(1, file.getCacheEvictions());
+      EXPECT_EQ(fieldSize, file.getCacheSize());
+
+      // Evicted fields are read again
+      EXPECT_FLOAT_EQ(value0, (*file.getField(Variable::T, 0))(5,5,0));
+      EXPECT_FLOAT_EQ(value1, (*file.getField(Variable::T, 1))(5,5,0));
+      EXPECT_EQ(1, file.getCacheHits());
+      EXPECT_EQ(4, file.getCacheMisses());
+      EXPECT_EQ(3, file.getCacheEvictions());
+      EXPECT_EQ(fieldSize, file.getCacheSize());
+
+      // No limit
+      file.setMaxCacheSize(Util::MV);
+      file.getField(Variable::T, 0);
+      file.getField(Variable::T, 1);
+      EXPECT_EQ(2*fieldSize, file.getCacheSize());
+   }
+   TEST_F(FileTest, cacheEvictionDerived) {
+      FileArome file("testing/files/10x10.nc", true);
+      long fieldSize = file.getNumLat() * file.getNumLon() * file.getNumEns() * sizeof(float);
+      FileArome reference("testing/files/10x10.nc", true);
+      file.setMaxCacheSize(fieldSize);
+      for(int t = 0; t < file.getNumTime(); t++) {
+         FieldPtr precip = file.getField(Variable::Precip, t);
+         EXPECT_EQ(*reference.getField(Variable::Precip, t), *precip);
+         EXPECT_EQ(fieldSize, file.getCacheSize());
+      }
+   }
+   TEST_F(FileTest, keepDerived) {
+      FileArome file("testing/files/10x10.nc", true);
+      ASSERT_GE(file.getNumTime(), 2);
+      long fieldSize = file.getNumLat() * file.getNumLon() * file.getNumEns() * sizeof(float);
+      file.setMaxCacheSize(fieldSize);
+      EXPECT_FALSE(file.getKeepDerived());
+      file.setKeepDerived(true);
+      EXPECT_TRUE(file.getKeepDerived());
+
+      // Wind direction is derived from U and V
+      FieldPtr direction = file.getField(Variable::WD, 1);
+      long misses = file.getCacheMisses();
+      file.getField(Variable::T, 0);
+      file.getField(Variable::T, 1);
+      EXPECT_EQ(misses + 2, file.getCacheMisses());
+
+      // The derived field is still in the cache
+      long hits = file.getCacheHits();
+      EXPECT_EQ(direction, file.getField(Variable::WD, 1));
+      EXPECT_EQ(hits + 1, file.getCacheHits());
+      EXPECT_EQ(misses + 2, file.getCacheMisses());
+   }
+   TEST_F(FileTest, keepDerivedBounded) {
+      // Derived fields are evicted when they alone exceed the cache size
+      FileArome file("testing/files/10x10.nc", true);
+      long fieldSize = file.getNumLat() * file.getNumLon() * file.getNumEns() * sizeof(float);
+      file.setMaxCacheSize(fieldSize);
+      file.setKeepDerived(true);
+      file.getField(Variable::WD, 0);
+      FieldPtr direction = file.getField(Variable::WD, 1);
+      EXPECT_EQ(fieldSize, file.getCacheSize());
+      long hits = file.getCacheHits();
+      EXPECT_EQ(direction, file.getField(Variable::WD, 1));
+      EXPECT_EQ(hits + 1, file.getCacheHits());
+   }
+   TEST_F(FileTest, keepDerivedOption) {
+      File* file = File::getScheme("testing/files/10x10.nc", Options("keepDerived=1"), true);
+      EXPECT_TRUE(file->getKeepDerived());
+      delete file;
+   }
+   TEST_F(FileTest, cachePinned) {
+      // Added fields are never evicted
+      FileArome file("testing/files/10x10.nc", true);
+      long fieldSize = file.getNumLat() * file.getNumLon() * file.getNumEns() * sizeof(float);
+      file.setMaxCacheSize(fieldSize);
+      file.initNewVariable(Variable::Fake);
+      (*file.getField(Variable::Fake, 0))(1,1,0) = 3;
+      file.getField(Variable::T, 0);
+      file.getField(Variable::T, 1);
+      EXPECT_FLOAT_EQ(3, (*file.getField(Variable::Fake, 0))(1,1,0));
+
+      // Fields in writable files are never evicted
+      FileFake fake(3, 3, 1, 3);
+      fake.setMaxCacheSize(1);
+      (*fake.getField(Variable::T, 0))(1,1,0) = 3;
+      fake.getField(Variable::T, 1);
+      fake.getField(Variable::T, 2);
+      EXPECT_FLOAT_EQ(3, (*fake.getField(Variable::T, 0))(1,1,0));
+      EXPECT_EQ(0, fake.getCacheEvictions());
+   }
+   TEST_F(FileTest, readOneTimestep) {
+      FileArome file("testing/files/10x10.nc", true);
+      long fieldSize = file.getNumLat() * file.getNumLon() * file.getNumEns() * sizeof(float);
+      file.getField(Variable::T, 1);
+      EXPECT_EQ(fieldSize, file.getCacheSize());
+      EXPECT_EQ(1, file.getCacheMisses());
+      file.getField(Variable::T, 0);
+      EXPECT_EQ(2*fieldSize, file.getCacheSize());
+      EXPECT_EQ(2, file.getCacheMisses());
+   }
+   TEST_F(FileTest, readAhead) {
+      File* file = File::getScheme("testing/files/10x10.nc", Options("readAhead=1"), true);
+      EXPECT_EQ(1, file->getReadAhead());
+      long fieldSize = file->getNumLat() * file->getNumLon() * file->getNumEns() * sizeof(float);
+      file->getField(Variable::T, 0);
+      EXPECT_EQ(2*fieldSize, file->getCacheSize());
+      file->getField(Variable::T, 1);
+      EXPECT_EQ(1, file->getCacheMisses());
+      EXPECT_EQ(1, file->getCacheHits());
+      delete file;
+
+      // Read-ahead does not go past the last time
+      FileArome file2("testing/files/10x10.nc", true);
+      file2.setReadAhead(10);
+      file2.getField(Variable::T, 1);
+      EXPECT_EQ(fieldSize, file2.getCacheSize());
+   }
+   TEST_F(FileTest, deriveOneTimestep) {
+      FileFake file(3, 3, 1, 5);
+      long fieldSize = 3 * 3 * 1 * sizeof(float);
+      // Needs PrecipAcc for times 0-2, and Precip for times 1-2, but no later times
+      FieldPtr acc = file.getField(Variable::PrecipAcc, 2);
+      EXPECT_EQ(5*fieldSize, file.getCacheSize());
+      FieldPtr p1 = file.getField(Variable::Precip, 1);
+      FieldPtr p2 = file.getField(Variable::Precip, 2);
+      EXPECT_FLOAT_EQ((*p1)(1,1,0) + (*p2)(1,1,0), (*acc)(1,1,0));
+      EXPECT_EQ(5*fieldSize, file.getCacheSize());
+   }
+   TEST_F(FileTest, initNewVariableTimestep) {
+      FileArome file("testing/files/10x10.nc", true);
+      long fieldSize = file.getNumLat() * file.getNumLon() * file.getNumEns() * sizeof(float);
+      file.initNewVariable(Variable::Fake, 1);
+      EXPECT_EQ(fieldSize, file.getCacheSize());
+      FieldPtr field = file.getField(Variable::Fake, 1);
+      EXPECT_FLOAT_EQ(Util::MV, (*field)(1,1,0));
+      // Variables provided by the file are not initialized
+      file.initNewVariable(Variable::T, 0);
+      EXPECT_EQ(fieldSize, file.getCacheSize());
+   }
+   TEST_F(FileTest, clearTimestep) {
+      FileArome file("testing/files/10x10.nc", true);
+      long fieldSize = file.getNumLat() * file.getNumLon() * file.getNumEns() * sizeof(float);
+      file.getField(Variable::T, 0);
+      file.getField(Variable::T, 1);
+      file.initNewVariable(Variable::Fake, 0);
+      EXPECT_EQ(3*fieldSize, file.getCacheSize());
+      file.clear(0);
+      EXPECT_EQ(fieldSize, file.getCacheSize());
+      // Cleared fields are read again when needed
+      file.getField(Variable::T, 0);
+      EXPECT_EQ(3, file.getCacheMisses());
+   }
+   TEST_F(FileTest, canWriteTimestep) {
+      FileFake fake(3, 3, 1, 2);
+      FileArome arome("testing/files/10x10.nc", true);
+      EXPECT_FALSE(fake.canWriteTimestep());
+      EXPECT_TRUE(arome.canWriteTimestep());
+      std::vector<Variable::Type> variables(1, Variable::T);
+      ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+      Util::setShowError(false);
+      EXPECT_DEATH(fake.writeTimestep(variables, 0), ".*");
+   }
+   TEST_F(FileTest, writeTimestep) {
+      std::vector<Variable::Type> variables(1, Variable::T);
+      {
+         FileArome from("testing/files/10x10.nc", true);
+         FileArome to("testing/files/10x10_copy.nc");
+         DownscalerNearestNeighbour d(Variable::T);
+         for(int t = 0; t < from.getNumTime(); t++) {
+            d.downscale(from, to, t);
+            to.writeTimestep(variables, t);
+            to.clear(t);
+         }
+      }
+      FileArome f1("testing/files/10x10.nc", true);
+      FileArome f2("testing/files/10x10_copy.nc", true);
+      for(int t = 0; t < f1.getNumTime(); t++) {
+         EXPECT_EQ(*f1.getField(Variable::T, t), *f2.getField(Variable::T, t));
+      }
+   }
+   TEST_F(FileTest, writeTimestepNewVariable) {
+      std::vector<Variable::Type> variables(1, Variable::QNH);
+      {
+         FileArome to("testing/files/10x10_copy.nc");
+         ASSERT_FALSE(to.hasVariable(Variable::QNH));
+         for(int t = 0; t < to.getNumTime(); t++) {
+            to.initNewVariable(Variable::QNH, t);
+            // The variable is in the file after the first timestep, but the unwritten timesteps
+            // must not be read back from it
+            long misses = to.getCacheMisses();
+            FieldPtr field = to.getField(Variable::QNH, t);
+            EXPECT_EQ(misses, to.getCacheMisses());
+            EXPECT_FLOAT_EQ(Util::MV, (*field)(2,3,0));
+            (*field)(2,3,0) = 100000 + t;
+            to.writeTimestep(variables, t);
+            to.clear(t);
+         }
+      }
+      FileArome f("testing/files/10x10_copy.nc", true);
+      ASSERT_TRUE(f.hasVariable(Variable::QNH));
+      for(int t = 0; t < f.getNumTime(); t++) {
+         EXPECT_FLOAT_EQ(100000 + t, (*f.getField(Variable::QNH, t))(2,3,0));
+      }
+   }
+   TEST_F(FileTest, prefetchOption) {
+      File* file = File::getScheme("testing/files/10x10.nc", Options("prefetch=1"), true);
+      EXPECT_EQ(1, file->getPrefetch());
+      delete file;
+   }
+   TEST_F(FileTest, prefetch) {
+      FileArome reference("testing/files/10x10.nc", true);
+      FileArome file("testing/files/10x10.nc", true);
+      long fieldSize = file.getNumLat() * file.getNumLon() * file.getNumEns() * sizeof(float);
+      file.prefetch(Variable::T, 1);
+      file.prefetch(Variable::T, 1);
+      // Times outside the file and variables not in the file are ignored
+      file.prefetch(Variable::T, 2);
+      file.prefetch(Variable::Fake, 0);
+      EXPECT_EQ(*reference.getField(Variable::T, 1), *file.getField(Variable::T, 1));
+      EXPECT_EQ(fieldSize, file.getCacheSize());
+      EXPECT_EQ(*reference.getField(Variable::T, 0), *file.getField(Variable::T, 0));
+   }
+   TEST_F(FileTest, prefetchDerived) {
+      FileArome reference("testing/files/10x10.nc", true);
+      FileArome file("testing/files/10x10.nc", true);
+      file.prefetch(Variable::Precip, 1);
+      EXPECT_EQ(*reference.getField(Variable::Precip, 1), *file.getField(Variable::Precip, 1));
+   }
+   TEST_F(FileTest, prefetchNextTimes) {
+      FileArome reference("testing/files/10x10.nc", true);
+      FileArome file("testing/files/10x10.nc", true);
+      file.setPrefetch(1);
+      long fieldSize = file.getNumLat() * file.getNumLon() * file.getNumEns() * sizeof(float);
+      EXPECT_EQ(*reference.getField(Variable::T, 0), *file.getField(Variable::T, 0));
+      EXPECT_EQ(*reference.getField(Variable::T, 1), *file.getField(Variable::T, 1));
+      EXPECT_EQ(2*fieldSize, file.getCacheSize());
+      EXPECT_EQ(2, file.getCacheMisses() + file.getCacheHits());
+   }
+   TEST_F(FileTest, prefetchCacheSize) {
+      // Prefetched fields count towards the maximum cache size
+      FileArome reference("testing/files/10x10.nc", true);
+      FileArome file("testing/files/10x10.nc", true);
+      long fieldSize = file.getNumLat() * file.getNumLon() * file.getNumEns() * sizeof(float);
+      file.setMaxCacheSize(fieldSize);
+      file.prefetch(Variable::T, 0);
+      file.prefetch(Variable::T, 1);
+      file.prefetch(Variable::Precip, 1);
+      EXPECT_EQ(*reference.getField(Variable::T, 1), *file.getField(Variable::T, 1));
+      EXPECT_EQ(*reference.getField(Variable::PrecipAcc, 1), *file.getField(Variable::PrecipAcc, 1));
+      EXPECT_LE(file.getCacheSize(), fieldSize);
+   }
+   TEST_F(FileTest, getFieldParallel) {
+      FileArome reference("testing/files/10x10.nc", true);
+      FileArome file("testing/files/10x10.nc", true);
+      int nTime = file.getNumTime();
+      std::vector<Variable::Type> variables;
+      variables.push_back(Variable::T);
+      variables.push_back(Variable::Precip);
+      variables.push_back(Variable::PrecipAcc);
+      int N = 20 * nTime * variables.size();
+      int numDifferent = 0;
+      #pragma omp parallel for reduction(+:numDifferent)
+      for(int i = 0; i < N; i++) {
+         Variable::Type variable = variables[i % variables.size()];
+         int t = (i / variables.size()) % nTime;
+         if(!(*file.getField(variable, t) == *reference.getField(variable, t)))
+            numDifferent++;
+      }
+      EXPECT_EQ(0, numDifferent);
+      // Each field is only read or derived once
+      EXPECT_EQ(nTime * variables.size(), file.getCacheMisses());
+   }
+   TEST_F(FileTest, cacheEvictionParallel) {
+      // The cache size is also bounded when fields are read by several threads at once
+      FileSlow file(10, 10, 2, 20);
+      long fieldSize = file.getNumLat() * file.getNumLon() * file.getNumEns() * sizeof(float);
+      file.setMaxCacheSize(2*fieldSize);
+      int numDifferent = 0;
+      long maxSize = 0;
+      #pragma omp parallel for num_threads(2) schedule(static, 1) reduction(+:numDifferent) reduction(max:maxSize)
+      for(int i = 0; i < 2 * 5 * file.getNumTime(); i++) {
+         int t = (i * 7) % file.getNumTime();
+         if((*file.getField(Variable::T, t))(0,0,0) != t)
+            numDifferent++;
+         // The other thread may have cached a field that it has not yet evicted
+         maxSize = std::max(maxSize, file.getCacheSize() - fieldSize);
+      }
+      EXPECT_EQ(0, numDifferent);
+      EXPECT_LE(maxSize, 2*fieldSize);
+      EXPECT_LE(file.getCacheSize(), 2*fieldSize);
+      EXPECT_GT(file.getCacheEvictions(), 0);
+   }
+   TEST_F(FileTest, addDerivation) {
+      FileArome file("testing/files/10x10.nc", true);
+      EXPECT_FALSE(file.hasVariable(Variable::Fake));
+      file.addDerivation(DerivationPtr(new DerivationPlusOne(Variable::Fake, Variable::T)));
+      EXPECT_TRUE(file.hasVariable(Variable::Fake));
+      EXPECT_FLOAT_EQ((*file.getField(Variable::T, 1))(2,3,0) + 1, (*file.getField(Variable::Fake, 1))(2,3,0));
+
+      // Takes precedence over the default derivation
+      file.addDerivation(DerivationPtr(new DerivationPlusOne(Variable::W, Variable::T)));
+      EXPECT_FLOAT_EQ((*file.getField(Variable::T, 0))(2,3,0) + 1, (*file.getField(Variable::W, 0))(2,3,0));
+
+      // Inputs that cannot be derived
+      file.addDerivation(DerivationPtr(new DerivationPlusOne(Variable::TD, Variable::Phase)));
+      EXPECT_FALSE(file.hasVariable(Variable::TD));
+   }
+   TEST_F(FileTest, deriveChain) {
+      FileArome file("testing/files/10x10.nc", true);
+      EXPECT_FALSE(file.hasVariable(Variable::QNH));
+      file.addDerivation(Derivation::getScheme("qnh"));
+      EXPECT_TRUE(file.hasVariable(Variable::QNH));
+      EXPECT_FALSE(file.hasVariable(Variable::TD));
+      file.addDerivation(DerivationPtr(new DerivationPlusOne(Variable::Fake, Variable::QNH)));
+      file.addDerivation(DerivationPtr(new DerivationPlusOne(Variable::MSLP, Variable::Fake)));
+      EXPECT_TRUE(file.hasVariable(Variable::MSLP));
+      FieldPtr pressure = file.getField(Variable::P, 0);
+      FieldPtr mslp = file.getField(Variable::MSLP, 0);
+      float qnh = Util::calcQnh(file.getElevs()[2][3], (*pressure)(2,3,0));
+      EXPECT_FLOAT_EQ(qnh + 2, (*mslp)(2,3,0));
+
+      // The intermediate variables have been freed, since they were not requested
+      long misses = file.getCacheMisses();
+      file.getField(Variable::QNH, 0);
+      EXPECT_EQ(misses + 1, file.getCacheMisses());
+
+      // QNH has now been requested, so it is kept when deriving Fake
+      file.getField(Variable::MSLP, 1);
+      misses = file.getCacheMisses();
+      file.getField(Variable::QNH, 1);
+      file.getField(Variable::Fake, 1);
+      EXPECT_EQ(misses + 1, file.getCacheMisses());
+   }
+   TEST_F(FileTest, deriveOption) {
+      // Only the default rules are used unless others are requested
+      File* file = File::getScheme("testing/files/10x10.nc", Options(), true);
+      EXPECT_TRUE(file->hasVariable(Variable::W));
+      EXPECT_FALSE(file->hasVariable(Variable::QNH));
+      delete file;
+
+      file = File::getScheme("testing/files/10x10.nc", Options("derive=qnh,rh"), true);
+      EXPECT_TRUE(file->hasVariable(Variable::QNH));
+      FieldPtr pressure = file->getField(Variable::P, 0);
+      FieldPtr qnh = file->getField(Variable::QNH, 0);
+      EXPECT_FLOAT_EQ(Util::calcQnh(file->getElevs()[2][3], (*pressure)(2,3,0)), (*qnh)(2,3,0));
+      delete file;
+   }
+   TEST_F(FileTest, getGrid) {
+      FileFake file(3, 2, 1, 1);
+      GridPtr grid = file.getGrid();
+      ASSERT_EQ(3, grid->getNumLat());
+      ASSERT_EQ(2, grid->getNumLon());
+      EXPECT_FLOAT_EQ(file.getLats()[2][1], grid->getLat(2,1));
+      EXPECT_FLOAT_EQ(file.getElevs()[2][1], grid->getElev(2,1));
+      // The grid is shared until the file's grid changes
+      EXPECT_EQ(grid, file.getGrid());
+      vec2 elevs = file.getElevs();
+      elevs[2][1] = 100;
+      file.setElevs(elevs);
+      GridPtr newGrid = file.getGrid();
+      EXPECT_NE(grid, newGrid);
+      EXPECT_FLOAT_EQ(100, newGrid->getElev(2,1));
+   }
    TEST_F(FileTest, factoryMissing) {
       File* f = File::getScheme("missingfilename", Options());
       EXPECT_EQ(NULL, f);
@@ -0,0 +1,80 @@
+#include "../Grid.h"
+#include "../Util.h"
+#include <gtest/gtest.h>
+
+namespace {
+   class GridTest : public ::testing::Test {
+      protected:
+         void makeGrid(int nLat, int nLon, vec2& iLats, vec2& iLons, vec2& iElevs) {
+            iLats.resize(nLat);
+            iLons.resize(nLat);
+            iElevs.resize(nLat);
+            for(int i = 0; i < nLat; i++) {
+               iLats[i].resize(nLon);
+               iLons[i].resize(nLon);
+               iElevs[i].resize(nLon);
+               for(int j = 0; j < nLon; j++) {
+                  iLats[i][j] = 55 + 0.1 * i;
+                  iLons[i][j] = 5 + 0.2 * j;
+                  iElevs[i][j] = 10 * i + j;
+               }
+            }
+         }
+   };
+
+   TEST_F(GridTest, empty) {
+      Grid grid((vec2()), (vec2()));
+      EXPECT_EQ(0, grid.getNumLat());
+      EXPECT_EQ(0, grid.getNumLon());
+      EXPECT_EQ(0, grid.size());
+   }
+   TEST_F(GridTest, flatArrays) {
+      vec2 lats, lons, elevs;
+      makeGrid(3, 4, lats, lons, elevs);
+      Grid grid(lats, lons, elevs);
+      EXPECT_EQ(3, grid.getNumLat());
+      EXPECT_EQ(4, grid.getNumLon());
+      ASSERT_EQ(12, grid.size());
+      ASSERT_EQ(12, grid.getLats().size());
+      ASSERT_EQ(36, grid.getUnitVectors().size());
+      for(int i = 0; i < 3; i++) {
+         for(int j = 0; j < 4; j++) {
+            int index = grid.getIndex(i, j);
+            EXPECT_EQ(i*4 + j, index);
+            EXPECT_FLOAT_EQ(lats[i][j], grid.getLat(i, j));
+            EXPECT_FLOAT_EQ(lons[i][j], grid.getLon(i, j));
+            EXPECT_FLOAT_EQ(elevs[i][j], grid.getElev(i, j));
+            EXPECT_FLOAT_EQ(lats[i][j], grid.getLats()[index]);
+
+            double x, y, z;
+            Grid::getUnitVector(lats[i][j], lons[i][j], x, y, z);
+            EXPECT_DOUBLE_EQ(x, grid.getUnitVectors()[3*index]);
+            EXPECT_DOUBLE_EQ(y, grid.getUnitVectors()[3*index+1]);
+            EXPECT_DOUBLE_EQ(z, grid.getUnitVectors()[3*index+2]);
+         }
+      }
+   }
+   TEST_F(GridTest, missing) {
+      vec2 lats, lons, elevs;
+      makeGrid(2, 2, lats, lons, elevs);
+      lats[0][1] = Util::MV;
+      Grid grid(lats, lons);
+      EXPECT_TRUE(grid.isValid(0, 0));
+      EXPECT_FALSE(grid.isValid(0, 1));
+      EXPECT_FLOAT_EQ(Util::MV, grid.getUnitVectors()[3]);
+      // No elevations given
+      EXPECT_FLOAT_EQ(Util::MV, grid.getElev(1, 1));
+   }
+   TEST_F(GridTest, invalidSizes) {
+      vec2 lats, lons, elevs;
+      makeGrid(2, 2, lats, lons, elevs);
+      lons.resize(1);
+      ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+      Util::setShowError(false);
+      EXPECT_DEATH(Grid(lats, lons), ".*");
+   }
+}
+int main(int argc, char **argv) {
+     ::testing::InitGoogleTest(&argc, argv);
+       return RUN_ALL_TESTS();
+}
@@ -0,0 +1,145 @@
+#include "../KDTree.h"
+#include "../Util.h"
+#include <gtest/gtest.h>
+
+namespace {
+   class KDTreeTest : public ::testing::Test {
+      protected:
+         // Create a slightly curved grid, similar to a projected grid
+         void makeGrid(int nLat, int nLon, vec2& iLats, vec2& iLons) {
+            iLats.resize(nLat);
+            iLons.resize(nLat);
+            for(int i = 0; i < nLat; i++) {
+               iLats[i].resize(nLon);
+               iLons[i].resize(nLon);
+               for(int j = 0; j < nLon; j++) {
+                  iLats[i][j] = 55 + 0.1 * i + 0.01 * j;
+                  iLons[i][j] = 5 + 0.13 * j - 0.02 * i;
+               }
+            }
+         }
+         // Brute force search
+         void getNearest(const vec2& iLats, const vec2& iLons, float iLat, float iLon, int& iI, int& iJ) {
+            float minDist = Util::MV;
+            iI = Util::MV;
+            iJ = Util::MV;
+            for(int i = 0; i < iLats.size(); i++) {
+               for(int j = 0; j < iLats[i].size(); j++) {
+                  float dist = Util::getDistance(iLat, iLon, iLats[i][j], iLons[i][j]);
+                  if(Util::isValid(dist) && (!Util::isValid(minDist) || dist < minDist)) {
+                     minDist = dist;
+                     iI = i;
+                     iJ = j;
+                  }
+               }
+            }
+         }
+   };
+
+   TEST_F(KDTreeTest, empty) {
+      vec2 lats, lons;
+      KDTree tree(lats, lons);
+      EXPECT_EQ(0, tree.size());
+      int I, J;
+      EXPECT_FALSE(tree.getNearestNeighbour(50, 10, I, J));
+      EXPECT_EQ(Util::MV, I);
+      EXPECT_EQ(Util::MV, J);
+   }
+   TEST_F(KDTreeTest, bruteForce) {
+      vec2 lats, lons;
+      makeGrid(23, 17, lats, lons);
+      KDTree tree(lats, lons);
+      EXPECT_EQ(23*17, tree.size());
+      for(float lat = 53; lat < 60; lat += 0.173) {
+         for(float lon = 3; lon < 9; lon += 0.231) {
+            int I, J, Iexp, Jexp;
+            EXPECT_TRUE(tree.getNearestNeighbour(lat, lon, I, J));
+            getNearest(lats, lons, lat, lon, Iexp, Jexp);
+            EXPECT_EQ(Iexp, I);
+            EXPECT_EQ(Jexp, J);
+         }
+      }
+   }
+   TEST_F(KDTreeTest, exactMatch) {
+      vec2 lats, lons;
+      makeGrid(5, 7, lats, lons);
+      KDTree tree(lats, lons);
+      for(int i = 0; i < 5; i++) {
+         for(int j = 0; j < 7; j++) {
+            int I, J;
+            tree.getNearestNeighbour(lats[i][j], lons[i][j], I, J);
+            EXPECT_EQ(i, I);
+            EXPECT_EQ(j, J);
+         }
+      }
+   }
+   TEST_F(KDTreeTest, dateline) {
+      vec2 lats(1, std::vector<float>(3, 0));
+      vec2 lons(1, std::vector<float>(3, 0));
+      lons[0][0] = -179;
+      lons[0][1] = 0;
+      lons[0][2] = 170;
+      KDTree tree(lats, lons);
+      int I, J;
+      tree.getNearestNeighbour(0, 179.5, I, J);
+      EXPECT_EQ(0, I);
+      EXPECT_EQ(0, J);
+   }
+   TEST_F(KDTreeTest, missing) {
+      vec2 lats, lons;
+      makeGrid(3, 3, lats, lons);
+      lats[1][1] = Util::MV;
+      lons[2][2] = Util::MV;
+      KDTree tree(lats, lons);
+      EXPECT_EQ(7, tree.size());
+      int I, J;
+      tree.getNearestNeighbour(Util::MV, lons[1][1], I, J);
+      EXPECT_EQ(Util::MV, I);
+      EXPECT_EQ(Util::MV, J);
+      // Point 1,1 is not in the tree
+      tree.getNearestNeighbour(55.11, lons[1][1], I, J);
+      EXPECT_TRUE(I != 1 || J != 1);
+      EXPECT_FALSE(tree.getNearestNeighbour(55, Util::MV, I, J));
+   }
+   TEST_F(KDTreeTest, nearestNeighbours) {
+      vec2 lats, lons;
+      makeGrid(11, 13, lats, lons);
+      KDTree tree(lats, lons);
+      float lat = 55.52;
+      float lon = 5.77;
+      std::vector<int> I, J;
+      tree.getNearestNeighbours(lat, lon, 9, I, J);
+      ASSERT_EQ(9, I.size());
+      ASSERT_EQ(9, J.size());
+      // First neighbour is the nearest
+      int Iexp, Jexp;
+      getNearest(lats, lons, lat, lon, Iexp, Jexp);
+      EXPECT_EQ(Iexp, I[0]);
+      EXPECT_EQ(Jexp, J[0]);
+      // Sorted by distance, and no other point is closer than the farthest
+      float maxDist = 0;
+      for(int n = 0; n < I.size(); n++) {
+         float dist = Util::getDistance(lat, lon, lats[I[n]][J[n]], lons[I[n]][J[n]]);
+         EXPECT_GE(dist, maxDist);
+         maxDist = dist;
+      }
+      int numCloser = 0;
+      for(int i = 0; i < 11; i++) {
+         for(int j = 0; j < 13; j++) {
+            if(Util::getDistance(lat, lon, lats[i][j], lons[i][j]) < maxDist)
+               numCloser++;
+         }
+      }
+      EXPECT_EQ(8, numCloser);
+
+      // Asking for more points than available
+      tree.getNearestNeighbours(lat, lon, 1000, I, J);
+      EXPECT_EQ(11*13, I.size());
+      tree.getNearestNeighbours(lat, lon, 0, I, J);
+      EXPECT_EQ(0, I.size());
+   }
+}
+int main(int argc, char **argv) {
+     ::testing::InitGoogleTest(&argc, argv);
+       return RUN_ALL_TESTS();
+}
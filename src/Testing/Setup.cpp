@@ -1,7 +1,12 @@
 #include <gtest/gtest.h>
 #include "../Setup.h"
+#include "../File/File.h"
 #include "../Downscaler/Smart.h"
 #include "../Calibrator/Calibrator.h"
+#include <sstream>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 typedef Setup MetSetup;
 
 namespace {
@@ -162,6 +167,64 @@ namespace {
          MetSetup setup(Util::split("testing/files/10x10.nc testing/files/10x10.nc -v T -d smart numSmart=2 -v Precip -d smart"));
       }
    }
+   TEST(SetupTest, dependencies) {
+      MetSetup setup(Util::split("testing/files/10x10.nc testing/files/10x10.nc -v T -v Precip -c phase parameters=testing/files/parametersPhase.txt -v W -c qc -v RH -v Cloud -c cloud -v P -c qnh"));
+      std::vector<std::vector<int> > dependencies = setup.getDependencies();
+      ASSERT_EQ(6, dependencies.size());
+      // Nothing before T
+      EXPECT_EQ(0, dependencies[0].size());
+      // The phase calibrator reads T
+      ASSERT_EQ(1, dependencies[1].size());
+      EXPECT_EQ(0, dependencies[1][0]);
+      // W is independent
+      EXPECT_EQ(0, dependencies[2].size());
+      // RH must not be written before the phase calibrator has read it
+      ASSERT_EQ(1, dependencies[3].size());
+      EXPECT_EQ(1, dependencies[3][0]);
+      // The cloud calibrator reads Precip
+      ASSERT_EQ(1, dependencies[4].size());
+      EXPECT_EQ(1, dependencies[4][0]);
+      EXPECT_EQ(0, dependencies[5].size());
+   }
+   TEST(SetupTest, dependenciesDerived) {
+      // W and WD are derived from U and V in the output file
+      MetSetup setup(Util::split("testing/files/10x10.nc testing/files/10x10.nc -v U -c qc -v W -c qc -v T -v V"));
+      ASSERT_GT(setup.outputFile->getDerivedFrom(Variable::W).size(), 0);
+      std::vector<std::vector<int> > dependencies = setup.getDependencies();
+      ASSERT_EQ(4, dependencies.size());
+      // W must be derived after U has been processed
+      ASSERT_EQ(1, dependencies[1].size());
+      EXPECT_EQ(0, dependencies[1][0]);
+      EXPECT_EQ(0, dependencies[2].size());
+      // V must not be written while W is derived from it
+      ASSERT_EQ(1, dependencies[3].size());
+      EXPECT_EQ(1, dependencies[3][0]);
+   }
+   TEST(SetupTest, processConcurrent) {
+      std::string args = "testing/files/10x10.nc testing/files/10x10_copy.nc -v T -c qc -v U -c qc -v W -c qc -v V -v Precip -v P";
+      MetSetup sequential(Util::split(args));
+      MetSetup concurrent(Util::split(args));
+      std::stringstream log;
+      sequential.process(Util::MV, false, log);
+#ifdef _OPENMP
+      // Use several threads also on machines with a single core
+      int numThreads = omp_get_max_threads();
+      omp_set_num_threads(4);
+#endif
+      concurrent.process(Util::MV, true, log);
+#ifdef _OPENMP
+      omp_set_num_threads(numThreads);
+#endif
+
+      Variable::Type variables[] = {Variable::T, Variable::U, Variable::W, Variable::V, Variable::Precip, Variable::P};
+      for(int v = 0; v < 6; v++) {
+         for(int t = 0; t < sequential.outputFile->getNumTime(); t++) {
+            FieldPtr expected = sequential.outputFile->getField(variables[v], t);
+            FieldPtr actual = concurrent.outputFile->getField(variables[v], t);
+            EXPECT_TRUE(*expected == *actual) << Variable::getTypeName(variables[v]) << " differs at time " << t;
+         }
+      }
+   }
    TEST(SetupTest, inputoutputOptions) {
       MetSetup setup0(Util::split("testing/files/10x10.nc option1=1 testing/files/10x10.nc option2=2 -v T write=1 -d smart numSmart=2"));
       int i;
@@ -241,6 +241,73 @@ namespace {
       Util::formatDescription("test", "ad qwi qwio wqio dwqion qdwion", 10, 5, 2); // Too narrow message
       Util::formatDescription("test", "ad qwi qwio wqio dwqion qdwion", 10, 11, 2); // Very narrow message
    }
+   TEST_F(UtilTest, hash) {
+      vec2 values(2, std::vector<float>(3, 1.5));
+      vec2 same = values;
+      EXPECT_EQ(Util::hash(values), Util::hash(same));
+      // Different values
+      same[1][2] = 1.6;
+      EXPECT_NE(Util::hash(values), Util::hash(same));
+      // Same values, different shape
+      vec2 reshaped(3, std::vector<float>(2, 1.5));
+      EXPECT_NE(Util::hash(values), Util::hash(reshaped));
+      // Seed
+      EXPECT_NE(Util::hash(values), Util::hash(values, 1));
+      EXPECT_EQ(Util::hash(values, 1), Util::hash(values, 1));
+      // Empty
+      EXPECT_NE(Util::hash(vec2()), Util::hash(vec2(1)));
+   }
+   TEST_F(UtilTest, hashValue) {
+      boost::uint64_t value = 1234567890123ULL;
+      EXPECT_EQ(Util::hash(value), Util::hash(value));
+      EXPECT_NE(Util::hash(value), Util::hash(value + 1));
+      EXPECT_NE(Util::hash(value), Util::hash(value, 1));
+      // Order matters when combining
+      EXPECT_NE(Util::hash(Util::hash(value), 5), Util::hash(Util::hash(5), value));
+   }
+   TEST_F(UtilTest, parseBytes) {
+      EXPECT_EQ(1024, Util::parseBytes("1024"));
+      EXPECT_EQ(1024, Util::parseBytes("1kB"));
+      EXPECT_EQ(3*1024*1024, Util::parseBytes("3MB"));
+      EXPECT_EQ(4L*1024*1024*1024, Util::parseBytes("4GB"));
+      EXPECT_EQ(512L*1024*1024, Util::parseBytes("0.5G"));
+   }
+   TEST_F(UtilTest, parseBytesInvalid) {
+      ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+      Util::setShowError(false);
+      EXPECT_DEATH(Util::parseBytes("GB"), ".*");
+      EXPECT_DEATH(Util::parseBytes("4XB"), ".*");
+      EXPECT_DEATH(Util::parseBytes("-4GB"), ".*");
+   }
+   TEST_F(UtilTest, slidingExtreme) {
+      float values[] = {3, Util::MV, 1, 4, 1, 5, Util::MV, Util::MV, Util::MV, 2};
+      float expMin[] = {3, 1, 1, 1, 1, 1, 5, Util::MV, 2, 2};
+      float expMax[] = {3, 3, 4, 4, 5, 5, 5, Util::MV, 2, 2};
+      std::vector<int> queue(10);
+      float output[10];
+      Util::slidingExtreme(values, 10, 1, 1, false, output, 1, queue);
+      for(int i = 0; i < 10; i++)
+         EXPECT_FLOAT_EQ(expMin[i], output[i]);
+      Util::slidingExtreme(values, 10, 1, 1, true, output, 1, queue);
+      for(int i = 0; i < 10; i++)
+         EXPECT_FLOAT_EQ(expMax[i], output[i]);
+
+      // Strided input and output, radius larger than the array
+      float strided[] = {2, 0, 7, 0, 5, 0};
+      float output2[6] = {0, 0, 0, 0, 0, 0};
+      Util::slidingExtreme(strided, 3, 2, 5, true, output2, 2, queue);
+      for(int i = 0; i < 3; i++) {
+         EXPECT_FLOAT_EQ(7, output2[2*i]);
+         EXPECT_FLOAT_EQ(0, output2[2*i+1]);
+      }
+   }
+   TEST_F(UtilTest, calcQnh) {
+      EXPECT_FLOAT_EQ(100000, Util::calcQnh(0,100000));
+      EXPECT_FLOAT_EQ(100184.6424, Util::calcQnh(100,99000));
+      EXPECT_FLOAT_EQ(0, Util::calcQnh(100,0));
+      EXPECT_FLOAT_EQ(Util::MV, Util::calcQnh(Util::MV,99000));
+      EXPECT_FLOAT_EQ(Util::MV, Util::calcQnh(100,Util::MV));
+   }
    TEST_F(UtilTest, gridppVersion) {
       std::string version = Util::gridppVersion();
       EXPECT_NE("", version);
@@ -15,6 +15,12 @@
 #include <fstream>
 #include <istream>
 #include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <ctype.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #ifdef DEBUG
 extern "C" void __gcov_flush();
 #endif
@@ -102,6 +108,31 @@ float Util::deg2rad(float deg) {
 float Util::rad2deg(float rad) {
    return (rad * 180 / Util::pi);
 }
+float Util::calcQnh(float iElev, float iPressure) {
+   if(iPressure == 0)
+         return 0;
+   else if(Util::isValid(iElev) && Util::isValid(iPressure)) {
+      float g  = 9.80665;   // m/s2
+      float T0 = 288.15;    // K
+      float L  = 0.0065;    // K/m
+      // Method 1:
+      // float dElev = 0 - iElev;
+      // float M  = 0.0289644; // kg/mol
+      // float R  = 8.31447;   // J/(mol•K)
+      // float cp = 1007;      // J/(kg•K)
+      // float constant = -g*M/R/T0;
+      // float qnh = iPressure * pow(1 - L*dElev/T0, g*M/R/L);
+
+      // Method 2: http://www.hochwarth.com/misc/AviationCalculator.html
+      float CRGas = 287.053; // [m^2/(s^2*K)] = [J/(kg*K)]
+      float p0    = 101325;  // pa
+      float qnh   = p0*pow(pow((iPressure/p0), (CRGas*L)/g) + (iElev*L)/T0, g/(CRGas*L));
+      return qnh;
+   }
+   else {
+      return Util::MV;
+   }
+}
 std::string Util::gridppVersion() {
    return GRIDPP_VERSION;
 }
@@ -261,3 +292,91 @@ std::string Util::formatDescription(std::string iTitle, std::string iMessage, in
    ss << curr.str();
    return ss.str();
 }
+
+boost::uint64_t Util::hash(const vec2& iValues, boost::uint64_t iSeed) {
+   const boost::uint64_t prime = 1099511628211ULL;
+   boost::uint64_t hash = iSeed;
+   // Include the dimensions, so that grids with the same values but different shapes differ
+   std::vector<int> sizes(1, iValues.size());
+   for(int i = 0; i < iValues.size(); i++)
+      sizes.push_back(iValues[i].size());
+   const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&sizes[0]);
+   for(int b = 0; b < sizes.size() * sizeof(int); b++) {
+      hash = (hash ^ bytes[b]) * prime;
+   }
+   for(int i = 0; i < iValues.size(); i++) {
+      if(iValues[i].size() == 0)
+         continue;
+      bytes = reinterpret_cast<const unsigned char*>(&iValues[i][0]);
+      for(int b = 0; b < iValues[i].size() * sizeof(float); b++) {
+         hash = (hash ^ bytes[b]) * prime;
+      }
+   }
+   return hash;
+}
+boost::uint64_t Util::hash(boost::uint64_t iValue, boost::uint64_t iSeed) {
+   const boost::uint64_t prime = 1099511628211ULL;
+   boost::uint64_t hash = iSeed;
+   const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&iValue);
+   for(int b = 0; b < sizeof(iValue); b++) {
+      hash = (hash ^ bytes[b]) * prime;
+   }
+   return hash;
+}
+
+long Util::parseBytes(std::string iString) {
+   std::stringstream ss(iString);
+   double value;
+   ss >> value;
+   std::string unit = "";
+   if(ss.fail() || value < 0) {
+      Util::error("Could not parse memory size '" + iString + "'");
+   }
+   ss >> unit;
+   std::transform(unit.begin(), unit.end(), unit.begin(), ::toupper);
+   double scale = 1;
+   if(unit == "" || unit == "B")
+      scale = 1;
+   else if(unit == "K" || unit == "KB")
+      scale = 1024;
+   else if(unit == "M" || unit == "MB")
+      scale = 1024.0*1024;
+   else if(unit == "G" || unit == "GB")
+      scale = 1024.0*1024*1024;
+   else if(unit == "T" || unit == "TB")
+      scale = 1024.0*1024*1024*1024;
+   else {
+      Util::error("Could not parse memory size '" + iString + "'");
+   }
+   return value * scale;
+}
+
+bool Util::parallelizeOverTime(int iNumTime, int iNumLat) {
+#ifdef _OPENMP
+   return iNumTime > 1 && iNumLat < omp_get_max_threads();
+#else
+   return false;
+#endif
+}
+
+void Util::slidingExtreme(const float* iValues, int iN, int iStride, int iRadius, bool iMax, float* oValues, int oStride, std::vector<int>& iQueue) {
+   // Indices in the window, such that their values are increasing (decreasing for max)
+   int head = 0;
+   int tail = 0;
+   for(int k = 0; k < iN + iRadius; k++) {
+      if(k < iN) {
+         float value = iValues[k*iStride];
+         if(Util::isValid(value)) {
+            while(tail > head && (iMax ? iValues[iQueue[tail-1]*iStride] <= value : iValues[iQueue[tail-1]*iStride] >= value))
+               tail--;
+            iQueue[tail++] = k;
+         }
+      }
+      int j = k - iRadius;
+      if(j >= 0) {
+         while(tail > head && iQueue[head] < j - iRadius)
+            head++;
+         oValues[j*oStride] = tail > head ? iValues[iQueue[head]*iStride] : Util::MV;
+      }
+   }
+}
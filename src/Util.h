@@ -2,6 +2,7 @@
 #define UTIL_H
 #include <string>
 #include <vector>
+#include <boost/cstdint.hpp>
 
 typedef std::vector<std::vector<float> > vec2; // Lat, Lon
 
@@ -33,6 +34,9 @@ class Util {
       //! \brief Checks if a value is valid
       //! @return false if iValue equals Util::MV or is +-inf or nan. Returns true otherwise.
       static bool isValid(float iValue);
+      //! \brief Same as isValid, but inlined and without function calls, so that loops using it
+      //! can be vectorized. Read Util::MV into a local variable before the loop and pass it as iMV.
+      static bool isValidInline(float iValue, float iMV) {return iValue != iMV && iValue - iValue == 0;};
 
       //! Checks if the file exists
       static bool exists(const std::string& iFilename);
@@ -54,6 +58,12 @@ class Util {
       //! Convert radians to degrees
       static float rad2deg(float rad);
 
+      //! \brief Adjusts the surface pressure down to sea-level based on a standard atmosphere (ICAO)
+      //! @param iElev Elevation in meters
+      //! @param iPressure Surface pressure in pa
+      //! @return QNH in pa
+      static float calcQnh(float iElev, float iPressure);
+
       static float pi;
 
       static std::string gridppVersion();
@@ -119,6 +129,30 @@ class Util {
 
       //! Copy the file with filename iFrom to filename iTo
       static bool copy(std::string iFrom, std::string iTo);
+
+      //! \brief Computes a 64-bit hash (FNV-1a) of the values and dimensions of a 2D array.
+      //! Identical arrays always give the same hash, also across runs and machines with the same
+      //! endianness.
+      //! @param iSeed Combine with this hash, such that several arrays can be hashed together
+      static boost::uint64_t hash(const vec2& iValues, boost::uint64_t iSeed=14695981039346656037ULL);
+      //! Computes a 64-bit hash (FNV-1a) of a single value, e.g. to combine hashes
+      static boost::uint64_t hash(boost::uint64_t iValue, boost::uint64_t iSeed=14695981039346656037ULL);
+
+      //! \brief Parses a memory size such as "4GB", "500MB", "64kB" or "1024" (bytes). Units are
+      //! powers of 1024 and are case insensitive. Issues an error if the size cannot be parsed.
+      //! @return Number of bytes
+      static long parseBytes(std::string iString);
+
+      //! \brief Should a loop over time be parallelized, instead of the loops over latitude within
+      //! each timestep? This is the case when there are too few latitudes (e.g. point files) to
+      //! keep all threads busy.
+      static bool parallelizeOverTime(int iNumTime, int iNumLat);
+
+      //! \brief Minimum (or maximum) in a window of +- iRadius around each of iN values spaced
+      //! iStride apart, using a monotone queue. Missing values are ignored. Windows with only missing
+      //! values give Util::MV. The results are written to oValues, spaced oStride apart.
+      //! @param iQueue work space with at least iN elements
+      static void slidingExtreme(const float* iValues, int iN, int iStride, int iRadius, bool iMax, float* oValues, int oStride, std::vector<int>& iQueue);
      
       //! \brief Comparator class for sorting pairs using the second entry.
       //! Sorts from smallest to largest
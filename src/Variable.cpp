@@ -21,6 +21,8 @@ std::string Variable::getTypeName(Type iType) {
       return "WD";
    else if(iType == RH)
       return "RH";
+   else if(iType == TD)
+      return "TD";
    else if(iType == Phase)
       return "Phase";
    else if(iType == P)
@@ -54,6 +56,8 @@ Variable::Type Variable::getType(std::string iName) {
       return WD;
    else if(iName == "RH")
       return RH;
+   else if(iName == "TD")
+      return TD;
    else if(iName == "Phase")
       return Phase;
    else if(iName == "P")
@@ -79,6 +83,7 @@ std::string Variable::description() {
    ss << Util::formatDescription("-v V", "V-wind") << std::endl;
    ss << Util::formatDescription("-v Cloud", "Cloud cover") << std::endl;
    ss << Util::formatDescription("-v RH", "Relative humidity") << std::endl;
+   ss << Util::formatDescription("-v TD", "Dewpoint temperature") << std::endl;
    ss << Util::formatDescription("-v Phase", "Precipitation phase (0 none, 1 rain, 2 sleet, 3 snow)") << std::endl;
    ss << Util::formatDescription("-v P", "Pressure") << std::endl;
    ss << Util::formatDescription("-v MSLP", "Mean sea-level pressure") << std::endl;
@@ -97,6 +102,7 @@ std::vector<Variable::Type> Variable::getAllVariables() {
    variables.push_back(Variable::V);
    variables.push_back(Variable::Cloud);
    variables.push_back(Variable::RH);
+   variables.push_back(Variable::TD);
    variables.push_back(Variable::Phase);
    variables.push_back(Variable::P);
    variables.push_back(Variable::MSLP);
@@ -124,6 +130,8 @@ float Variable::getMin(Type iType) {
          return 0;
       case RH:
          return 0;
+      case TD:
+         return 0;
       case Phase:
          return 0;
       case P:
@@ -157,6 +165,8 @@ float Variable::getMax(Type iType) {
          return 1;
       case RH:
          return 1.1;
+      case TD:
+         return Util::MV;
       case Phase:
          return 3;
       case P:
@@ -189,6 +199,8 @@ std::string Variable::getUnits(Type iType) {
          return "1";
       case RH:
          return "%";
+      case TD:
+         return "K";
       case Phase:
          return "";
       case P:
@@ -223,6 +235,8 @@ std::string Variable::getStandardName(Type iType) {
          return "cloud_area_fraction";
       case RH:
          return "relative_humidity";
+      case TD:
+         return "dew_point_temperature";
       case Phase:
          return "";
       case P:
@@ -17,6 +17,7 @@ class Variable {
          W         = 50,   // 10m windspeed (m/s)
          WD        = 55,   // Wind direction (degrees, from north 0)
          RH        = 60,   // Reliative humidity (%)
+         TD        = 65,   // 2m dewpoint temperature (K)
          Phase     = 70,   // Precip phase
          P         = 80,   // Surface pressure (pa)
          MSLP      = 85,   // Mean sea-level pressure (pa)